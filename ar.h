@@ -19,4 +19,8 @@ int ar_archivemember_close(struct archive *, void *);
 int ar_archivemember_open(struct archive *, void *);
 ssize_t ar_archivemember_read(struct archive *, void *, const void **);
 
+/* read the control file from the current member (a control.tar),
+ * RET_NOTHING if there is none (in debfile.c) */
+retvalue ar_readcontrolmember(/*@out@*/char **, const char * /*debfile*/, struct ar_archive *);
+
 #endif
@@ -18,7 +18,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <assert.h>
 
 #include "error.h"
@@ -33,11 +32,10 @@
 #include "archallflood.h"
 
 struct aa_source_name {
-	/*@null@*/struct aa_source_name *parent;
-	/*@null@*/struct aa_source_name *left_child;
-	/*@null@*/struct aa_source_name *right_child;
+	/* next in the same hash bucket */
+	/*@null@*/struct aa_source_name *hashnext;
 
-	char *name;
+	/*@dependent@*/char *name;
 
 	/*@null@*/struct aa_source_version *versions;
 };
@@ -45,7 +43,7 @@ struct aa_source_name {
 struct aa_source_version {
 	/*@null@*/struct aa_source_version *next;
 	struct aa_source_name *name;
-	char *version;
+	/*@dependent@*/char *version;
 
 	/* if true, it was already verified that there is no
 	 * binary package of the same source version already there,
@@ -59,8 +57,10 @@ struct aa_source_version {
 
 struct aa_package_data {
 	struct aa_package_data *next;
+	/* next in the same hash bucket */
+	/*@null@*/struct aa_package_data *hashnext;
 	/* the name of the architecture all package: */
-	char *name;
+	/*@dependent@*/char *name;
 
 	/* NULL if does not exists/not yet known */
 	/*@null@*/char *old_version;
@@ -74,109 +74,243 @@ struct aa_package_data {
 	char *new_control;
 };
 
+/* all nodes and the names in them are allocated from blocks
+ * only freed together with the floodlist */
+struct aa_pool {
+	/*@null@*/struct aa_pool *next;
+	size_t used, size;
+};
+#define AA_POOLSIZE 65536
+#define AA_ALIGN(x) (((x) + sizeof(long long) - 1) & ~(sizeof(long long) - 1))
+
+/* a hash table growing with the number of entries */
+struct aa_hash {
+	void **buckets;
+	size_t size, count;
+};
+
 struct floodlist {
 	/*@dependent@*/struct target *target;
-	struct aa_source_name *sources;
+	/* all source names, by name */
+	struct aa_hash sources;
+	/* all packages, by name */
+	struct aa_hash packages;
+	/* all packages, only sorted by floodlist_sort */
 	struct aa_package_data *list;
-	/* package the next package will most probably be after.
-	 * (NULL=before start of list) */
-	/*@null@*//*@dependent@*/struct aa_package_data *last;
+	/*@null@*/struct aa_pool *pool;
 };
 
-static void aa_package_data_free(/*@only@*/struct aa_package_data *data){
-	if (data == NULL)
-		return;
-	free(data->name);
+static void aa_package_data_done(struct aa_package_data *data){
 	free(data->old_version);
 	free(data->new_version);
 	free(data->new_control);
 	strlist_done(&data->new_filekeys);
 	checksumsarray_done(&data->new_origfiles);
-	free(data);
 }
 
 static void floodlist_free(struct floodlist *list) {
-	struct aa_source_name *s;
 	struct aa_package_data *l;
 
 	if (list == NULL)
 		return;
 
-	l = list->list;
-	while (l != NULL) {
-		struct aa_package_data *n = l->next;
-		aa_package_data_free(l);
-		l = n;
-	}
-	s = list->sources;
-	while (s != NULL) {
-		struct aa_source_name *n;
-
-		while (s->left_child != NULL || s->right_child != NULL) {
-			if (s->left_child != NULL) {
-				n = s->left_child;
-				s->left_child = NULL;
-				s = n;
-			} else {
-				n = s->right_child;
-				s->right_child = NULL;
-				s = n;
-			}
-		}
+	for (l = list->list ; l != NULL ; l = l->next)
+		aa_package_data_done(l);
+	while (list->pool != NULL) {
+		struct aa_pool *n = list->pool->next;
 
-		while (s->versions != NULL) {
-			struct aa_source_version *nv;
-			nv = s->versions->next;
-			free(s->versions->version);
-			free(s->versions);
-			s->versions = nv;
-		}
-	        n = s->parent;
-		free(s->name);
-		free(s);
-		s = n;
+		free(list->pool);
+		list->pool = n;
 	}
+	free(list->sources.buckets);
+	free(list->packages.buckets);
 	free(list);
 	return;
 }
 
-static retvalue find_or_add_sourcename(struct floodlist *list, struct package *pkg, /*@out@*/struct aa_source_name **src_p) {
-	struct aa_source_name *parent, **p, *n;
-	int c;
+/* returns zeroed memory */
+static /*@null@*/void *aa_alloc(struct floodlist *list, size_t size) {
+	struct aa_pool *p = list->pool;
+	char *result;
+
+	size = AA_ALIGN(size);
+	if (p == NULL || p->size - p->used < size) {
+		size_t poolsize = AA_ALIGN(sizeof(struct aa_pool))
+			+ ((size > AA_POOLSIZE)?size:AA_POOLSIZE);
+
+		p = malloc(poolsize);
+		if (FAILEDTOALLOC(p))
+			return NULL;
+		p->next = list->pool;
+		p->used = AA_ALIGN(sizeof(struct aa_pool));
+		p->size = poolsize;
+		list->pool = p;
+	}
+	result = (char*)p + p->used;
+	p->used += size;
+	memset(result, 0, size);
+	return result;
+}
 
-	parent = NULL;
-	p = &list->sources;
+static /*@null@*/char *aa_strdup(struct floodlist *list, const char *s) {
+	size_t len = strlen(s) + 1;
+	char *n = aa_alloc(list, len);
 
-	/* if this gets too slow, make it a balanced tree,
-	 * but it seems fast enough even as simple tree */
+	if (n != NULL)
+		memcpy(n, s, len);
+	return n;
+}
 
-	while (*p != NULL) {
-		c = strcmp(pkg->source, (*p)->name);
-		if (c == 0)
-			break;
-		parent = *p;
-		if (c > 0)
-			p = &parent->right_child;
-		else
-			p = &parent->left_child;
-	}
-	if (*p == NULL) {
-		/* there is not even something with this name */
-		n = zNEW(struct aa_source_name);
-		if (FAILEDTOALLOC(n)) {
-			return RET_ERROR_OOM;
-		}
-		n->name = strdup(pkg->source);
-		if (FAILEDTOALLOC(n->name)) {
-			free(n);
-			return RET_ERROR_OOM;
+static size_t aa_hashvalue(const char *s) {
+	size_t h = 0;
+
+	while (*s != '\0')
+		h = h * 31 + (unsigned char)*(s++);
+	return h;
+}
+
+/* make room for one more entry, returns the new bucket array if the
+ * entries need to be moved into it */
+static retvalue aa_hash_grow(struct aa_hash *hash, /*@out@*/void ***old_p, /*@out@*/size_t *oldsize_p) {
+	void **n;
+	size_t newsize;
+
+	*old_p = NULL;
+	*oldsize_p = 0;
+	if (hash->count < hash->size)
+		return RET_OK;
+	newsize = (hash->size == 0)?1024:2 * hash->size;
+	n = nzNEW(newsize, void *);
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	*old_p = hash->buckets;
+	*oldsize_p = hash->size;
+	hash->buckets = n;
+	hash->size = newsize;
+	return RET_OK;
+}
+
+static /*@null@*/struct aa_package_data *find_package(struct floodlist *list, const char *name) {
+	struct aa_package_data *p;
+
+	if (list->packages.size == 0)
+		return NULL;
+	p = list->packages.buckets[aa_hashvalue(name)
+		& (list->packages.size - 1)];
+	while (p != NULL && strcmp(p->name, name) != 0)
+		p = p->hashnext;
+	return p;
+}
+
+static retvalue add_package(struct floodlist *list, struct aa_package_data *package) {
+	void **old;
+	size_t i, oldsize, h;
+	retvalue r;
+
+	r = aa_hash_grow(&list->packages, &old, &oldsize);
+	if (RET_WAS_ERROR(r))
+		return r;
+	for (i = 0 ; i < oldsize ; i++) {
+		struct aa_package_data *p = old[i];
+
+		while (p != NULL) {
+			struct aa_package_data *following = p->hashnext;
+
+			h = aa_hashvalue(p->name) & (list->packages.size - 1);
+			p->hashnext = list->packages.buckets[h];
+			list->packages.buckets[h] = p;
+			p = following;
 		}
-		n->parent = parent;
-		*p = n;
+	}
+	free(old);
+	h = aa_hashvalue(package->name) & (list->packages.size - 1);
+	package->hashnext = list->packages.buckets[h];
+	list->packages.buckets[h] = package;
+	list->packages.count++;
+	package->next = list->list;
+	list->list = package;
+	return RET_OK;
+}
+
+static int package_data_cmp(const void *a, const void *b) {
+	return strcmp((*(struct aa_package_data* const *)a)->name,
+			(*(struct aa_package_data* const *)b)->name);
+}
+
+/* sort list->list by name, so packages are added in that order */
+static retvalue floodlist_sort(struct floodlist *list) {
+	struct aa_package_data **all, *p;
+	size_t i, count = list->packages.count;
+
+	if (count <= 1)
+		return RET_OK;
+	all = nNEW(count, struct aa_package_data *);
+	if (FAILEDTOALLOC(all))
+		return RET_ERROR_OOM;
+	i = 0;
+	for (p = list->list ; p != NULL ; p = p->next)
+		all[i++] = p;
+	assert (i == count);
+	qsort(all, count, sizeof(struct aa_package_data *), package_data_cmp);
+	for (i = 0 ; i + 1 < count ; i++)
+		all[i]->next = all[i + 1];
+	all[count - 1]->next = NULL;
+	list->list = all[0];
+	free(all);
+	return RET_OK;
+}
+
+static /*@null@*/struct aa_source_name *find_sourcename(struct floodlist *list, const char *source) {
+	struct aa_source_name *s;
+
+	if (list->sources.size == 0)
+		return NULL;
+	s = list->sources.buckets[aa_hashvalue(source)
+		& (list->sources.size - 1)];
+	while (s != NULL && strcmp(s->name, source) != 0)
+		s = s->hashnext;
+	return s;
+}
+
+static retvalue find_or_add_sourcename(struct floodlist *list, struct package *pkg, /*@out@*/struct aa_source_name **src_p) {
+	struct aa_source_name *n;
+	void **old;
+	size_t i, oldsize, h;
+	retvalue r;
+
+	n = find_sourcename(list, pkg->source);
+	if (n != NULL) {
 		*src_p = n;
 		return RET_OK;
 	}
-	*src_p = *p;
+	/* there is not even something with this name */
+	r = aa_hash_grow(&list->sources, &old, &oldsize);
+	if (RET_WAS_ERROR(r))
+		return r;
+	for (i = 0 ; i < oldsize ; i++) {
+		struct aa_source_name *o = old[i];
+
+		while (o != NULL) {
+			struct aa_source_name *following = o->hashnext;
+
+			h = aa_hashvalue(o->name) & (list->sources.size - 1);
+			o->hashnext = list->sources.buckets[h];
+			list->sources.buckets[h] = o;
+			o = following;
+		}
+	}
+	free(old);
+	n = aa_alloc(list, sizeof(struct aa_source_name));
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	n->name = aa_strdup(list, pkg->source);
+	if (FAILEDTOALLOC(n->name))
+		return RET_ERROR_OOM;
+	h = aa_hashvalue(n->name) & (list->sources.size - 1);
+	n->hashnext = list->sources.buckets[h];
+	list->sources.buckets[h] = n;
+	list->sources.count++;
+	*src_p = n;
 	return RET_OK;
 }
 
@@ -190,7 +324,8 @@ static retvalue find_or_add_source(struct floodlist *list, struct package *pkg,
 	if (RET_WAS_ERROR(r))
 		return r;
 
-	/* source name found (or created), now look for version: */
+	/* source name found (or created), now look for version
+	 * (there are seldom more than a few for each name): */
 
 	p = &sn->versions;
 	c = -1;
@@ -203,14 +338,13 @@ static retvalue find_or_add_source(struct floodlist *list, struct package *pkg,
 		*src_p = *p;
 		return RET_OK;
 	}
-	n = zNEW(struct aa_source_version);
+	n = aa_alloc(list, sizeof(struct aa_source_version));
 	if (FAILEDTOALLOC(n)) {
 		return RET_ERROR_OOM;
 	}
 	n->name = sn;
-	n->version = strdup(pkg->sourceversion);
+	n->version = aa_strdup(list, pkg->sourceversion);
 	if (FAILEDTOALLOC(n->version)) {
-		free(n);
 		return RET_ERROR_OOM;
 	}
 	n->next = *p;
@@ -224,31 +358,20 @@ static struct aa_source_version *find_source(struct floodlist *list, const char
 	struct aa_source_version *v;
 	int c = -1;
 
-	p = list->sources;
-
-	while (p != NULL) {
-		c = strcmp(source, p->name);
-		if (c == 0)
-			break;
-		if (c > 0)
-			p = p->right_child;
-		else
-			p = p->left_child;
-	}
+	p = find_sourcename(list, source);
 	if (p == NULL)
 		return NULL;
 	v = p->versions;
 	while (v != NULL && (c = strcmp(sourceversion, v->version)) > 0)
 		v = v->next;
-	if (c < 0)
+	if (c != 0)
 		return NULL;
 	else
 		return v;
 }
 
 /* Before anything else is done the current state of one target is read into
- * the list: list->list points to the first in the sorted list,
- * list->last to the last one inserted */
+ * the list */
 static retvalue save_package_version(struct floodlist *list, struct package *pkg) {
 	struct aa_source_version *src;
 	retvalue r;
@@ -275,43 +398,21 @@ static retvalue save_package_version(struct floodlist *list, struct package *pkg
 	if (RET_WAS_ERROR(r))
 		return r;
 
-	package = zNEW(struct aa_package_data);
+	package = aa_alloc(list, sizeof(struct aa_package_data));
 	if (FAILEDTOALLOC(package)) {
 		return RET_ERROR_OOM;
 	}
 
-	package->name = strdup(pkg->name);
+	package->name = aa_strdup(list, pkg->name);
 	if (FAILEDTOALLOC(package->name)) {
-		free(package);
 		return RET_ERROR_OOM;
 	}
 	package->old_version = package_dupversion(pkg);
 	if (FAILEDTOALLOC(package->old_version)) {
-		free(package->name);
-		free(package);
 		return RET_ERROR_OOM;
 	}
 	package->old_source = src;
-
-	if (list->list == NULL) {
-		/* first chunk to add: */
-		list->list = package;
-		list->last = package;
-	} else {
-		if (strcmp(pkg->name, list->last->name) > 0) {
-			list->last->next = package;
-			list->last = package;
-		} else {
-			/* this should only happen if the underlying
-			 * database-method get changed, so just throwing
-			 * out here */
-			fprintf(stderr,
-"INTERNAL ERROR: Package database is not sorted!!!\n");
-			assert(false);
-			exit(EXIT_FAILURE);
-		}
-	}
-	return RET_OK;
+	return add_package(list, package);
 }
 
 static retvalue floodlist_initialize(struct floodlist **fl, struct target *t) {
@@ -345,14 +446,13 @@ static retvalue floodlist_initialize(struct floodlist **fl, struct target *t) {
 		floodlist_free(list);
 		return r;
 	}
-	list->last = NULL;
 	*fl = list;
 	return RET_OK;
 }
 
 static retvalue floodlist_trypackage(struct floodlist *list, struct package *package) {
 	retvalue r;
-	struct aa_package_data *current, *insertafter;
+	struct aa_package_data *current;
 
 	r = package_getversion(package);
 	if (!RET_IS_OK(r))
@@ -361,85 +461,20 @@ static retvalue floodlist_trypackage(struct floodlist *list, struct package *pac
 	if (!RET_IS_OK(r))
 		return r;
 
-	/* insertafter = NULL will mean insert before list */
-	insertafter = list->last;
-	/* the next one to test, current = NULL will mean not found */
-	if (insertafter != NULL)
-		current = insertafter->next;
-	else
-		current = list->list;
-
-	/* the algorithm assumes almost all packages are feed in
-	 * alphabetically. */
-
-	while (true) {
-		int cmp;
-
-		assert (insertafter == NULL || insertafter->next == current);
-		assert (insertafter != NULL || current == list->list);
-
-		if (current == NULL)
-			cmp = -1; /* every package is before the end of list */
-		else
-			cmp = strcmp(package->name, current->name);
-
-		if (cmp == 0)
-			break;
-
-		if (cmp < 0) {
-			int precmp;
-
-			if (insertafter == NULL) {
-				/* if we are before the first
-				 * package, add us there...*/
-				current = NULL;
-				break;
-			}
-			precmp = strcmp(package->name, insertafter->name);
-			if (precmp == 0) {
-				current = insertafter;
-				break;
-			} else if (precmp < 0) {
-				/* restart at the beginning: */
-				current = list->list;
-				insertafter = NULL;
-				continue;
-			} else { // precmp > 0
-				/* insert after insertafter: */
-				current = NULL;
-				break;
-			}
-			assert ("This is not reached" == NULL);
-		}
-		/* cmp > 0 : may come later... */
-		assert (current != NULL);
-		insertafter = current;
-		current = current->next;
-		if (current == NULL) {
-			/* add behind insertafter at end of list */
-			break;
-		}
-		/* otherwise repeat until place found */
-	}
+	current = find_package(list, package->name);
 	if (current == NULL) {
 		/* adding a package not yet known */
 		struct aa_package_data *new;
 		struct aa_source_version *src;
 
 		src = find_source(list, package->source, package->sourceversion);
-		new = zNEW(struct aa_package_data);
+		new = aa_alloc(list, sizeof(struct aa_package_data));
 		if (FAILEDTOALLOC(new)) {
 			return RET_ERROR_OOM;
 		}
 		new->new_source = src;
-		new->new_version = package_dupversion(package);
-		if (FAILEDTOALLOC(new->new_version)) {
-			aa_package_data_free(new);
-			return RET_ERROR_OOM;
-		}
-		new->name = strdup(package->name);
+		new->name = aa_strdup(list, package->name);
 		if (FAILEDTOALLOC(new->name)) {
-			aa_package_data_free(new);
 			return RET_ERROR_OOM;
 		}
 		r = list->target->getinstalldata(list->target,
@@ -447,17 +482,18 @@ static retvalue floodlist_trypackage(struct floodlist *list, struct package *pac
 				&new->new_control, &new->new_filekeys,
 				&new->new_origfiles);
 		if (RET_WAS_ERROR(r)) {
-			aa_package_data_free(new);
 			return r;
 		}
-		if (insertafter != NULL) {
-			new->next = insertafter->next;
-			insertafter->next = new;
-		} else {
-			new->next = list->list;
-			list->list = new;
+		new->new_version = package_dupversion(package);
+		if (FAILEDTOALLOC(new->new_version)) {
+			aa_package_data_done(new);
+			return RET_ERROR_OOM;
+		}
+		r = add_package(list, new);
+		if (RET_WAS_ERROR(r)) {
+			aa_package_data_done(new);
+			return r;
 		}
-		list->last = new;
 	} else {
 		/* The package already exists: */
 		char *control;
@@ -466,8 +502,6 @@ static retvalue floodlist_trypackage(struct floodlist *list, struct package *pac
 		struct aa_source_version *src;
 		int versioncmp;
 
-		list->last = current;
-
 		if (current->new_has_sibling) {
 			/* it has a new and that has a binary sibling,
 			 * which means this becomes the new version
@@ -548,7 +582,6 @@ static retvalue floodlist_pull(struct floodlist *list, struct target *source) {
 	retvalue result, r;
 	struct package_cursor iterator;
 
-	list->last = NULL;
 	r = package_openiterator(source, READONLY, true, &iterator);
 	if (RET_WAS_ERROR(r))
 		return r;
@@ -585,6 +618,9 @@ static retvalue floodlist_install(struct floodlist *list, struct logger *logger,
 	if (list->list == NULL)
 		return RET_NOTHING;
 
+	result = floodlist_sort(list);
+	if (RET_WAS_ERROR(result))
+		return result;
 	result = target_initpackagesdb(list->target, READWRITE);
 	if (RET_WAS_ERROR(result))
 		return result;
@@ -493,11 +493,18 @@ void binaries_debdone(struct deb_headers *pkg) {
 
 retvalue binaries_readdeb(struct deb_headers *deb, const char *filename) {
 	retvalue r;
-	char *architecture;
 
 	r = extractcontrol(&deb->control, filename);
 	if (RET_WAS_ERROR(r))
 		return r;
+	return binaries_parsedeb(deb, filename);
+}
+
+retvalue binaries_parsedeb(struct deb_headers *deb, const char *filename) {
+	retvalue r;
+	char *architecture;
+
+	assert (deb->control != NULL);
 	/* first look for fields that should be there */
 
 	r = chunk_getname(deb->control, "Package", &deb->name, false);
@@ -45,6 +45,8 @@ struct deb_headers {
  * - no checks for sanity of values, left to the caller */
 
 retvalue binaries_readdeb(struct deb_headers *, const char *filename);
+/* like binaries_readdeb, but with the control chunk already extracted */
+retvalue binaries_parsedeb(struct deb_headers *, const char *filename);
 void binaries_debdone(struct deb_headers *);
 
 retvalue binaries_calcfilekeys(component_t, const struct deb_headers *, packagetype_t, /*@out@*/struct strlist *);
@@ -39,6 +39,10 @@
 #include "tracking.h"
 #include "override.h"
 #include "hooks.h"
+#include "debfile.h"
+#include "filelist.h"
+#include "contents.h"
+#include "workers.h"
 
 /* This file includes the code to include binaries, i.e.
    to create the chunk for the Packages.gz-file and
@@ -61,6 +65,9 @@ struct debpackage {
 	/* with deb_calclocations: */
 	const char *filekey;
 	struct strlist filekeys;
+	/* read together with the control data if needed for Contents: */
+	/*@null@*/char *filelist;
+	size_t filelistsize;
 };
 
 void deb_free(/*@only@*/struct debpackage *pkg) {
@@ -68,20 +75,16 @@ void deb_free(/*@only@*/struct debpackage *pkg) {
 		binaries_debdone(&pkg->deb);
 		if (pkg->filekey != NULL)
 			strlist_done(&pkg->filekeys);
+		free(pkg->filelist);
 	}
 	free(pkg);
 }
 
-/* read the data from a .deb, make some checks and extract some data */
-static retvalue deb_read(/*@out@*/struct debpackage **pkg, const char *filename) {
+/* parse and check the already extracted control chunk */
+static retvalue deb_parse(struct debpackage *deb, const char *filename) {
 	retvalue r;
-	struct debpackage *deb;
-
-	deb = zNEW(struct debpackage);
-	if (FAILEDTOALLOC(deb))
-		return RET_ERROR_OOM;
 
-	r = binaries_readdeb(&deb->deb, filename);
+	r = binaries_parsedeb(&deb->deb, filename);
 	if (RET_IS_OK(r))
 		r = properpackagename(deb->deb.name);
 	if (RET_IS_OK(r))
@@ -90,6 +93,24 @@ static retvalue deb_read(/*@out@*/struct debpackage **pkg, const char *filename)
 		r = properversion(deb->deb.sourceversion);
 	if (RET_IS_OK(r))
 		r = properversion(deb->deb.version);
+	return r;
+}
+
+/* read the data from a .deb, make some checks and extract some data
+ * (with the file list in the same pass if it will be needed) */
+static retvalue deb_read(/*@out@*/struct debpackage **pkg, const char *filename, bool withfilelist) {
+	retvalue r;
+	struct debpackage *deb;
+
+	deb = zNEW(struct debpackage);
+	if (FAILEDTOALLOC(deb))
+		return RET_ERROR_OOM;
+
+	r = extractcontrolandfilelist(&deb->deb.control,
+			withfilelist?&deb->filelist:NULL,
+			&deb->filelistsize, filename);
+	if (RET_IS_OK(r))
+		r = deb_parse(deb, filename);
 	if (RET_WAS_ERROR(r)) {
 		deb_free(deb);
 		return r;
@@ -261,7 +282,8 @@ retvalue deb_prepare(/*@out@*/struct debpackage **deb, component_t forcecomponen
 
 	/* First taking a closer look in the file: */
 
-	r = deb_read(&pkg, debfilename);
+	r = deb_read(&pkg, debfilename,
+			contents_needfilelist(distribution, packagetype));
 	if (RET_WAS_ERROR(r)) {
 		return r;
 	}
@@ -351,6 +373,16 @@ retvalue deb_prepare(/*@out@*/struct debpackage **deb, component_t forcecomponen
 		deb_free(pkg);
 		return RET_ERROR;
 	}
+	/* the file is already in the pool, so it will not be needed to
+	 * read it again for the Contents files */
+	if (pkg->filelist != NULL) {
+		r = filelist_store(pkg->filekey, pkg->filelist,
+				pkg->filelistsize);
+		if (RET_WAS_ERROR(r)) {
+			deb_free(pkg);
+			return r;
+		}
+	}
 	/* Prepare everything that can be prepared beforehand */
 	r = binaries_complete(&pkg->deb, pkg->filekey, checksums, oinfo,
 			pkg->deb.section, pkg->deb.priority, &control);
@@ -370,24 +402,14 @@ retvalue deb_addprepared(const struct debpackage *pkg, const struct atomlist *fo
 			pkg->deb.control);
 }
 
-/* insert the given .deb into the mirror in <component> in the <distribution>
- * putting things with architecture of "all" into <d->architectures> (and also
- * causing error, if it is not one of them otherwise)
- * if component is NULL, guessing it from the section. */
-retvalue deb_add(component_t forcecomponent, const struct atomlist *forcearchitectures, const char *forcesection, const char *forcepriority, packagetype_t packagetype, struct distribution *distribution, const char *debfilename, int delete, /*@null@*/trackingdb tracks) {
-	struct debpackage *pkg;
+/* add an already read .deb (freeing it) */
+static retvalue deb_addread(/*@only@*/struct debpackage *pkg, component_t forcecomponent, const struct atomlist *forcearchitectures, const char *forcesection, const char *forcepriority, packagetype_t packagetype, struct distribution *distribution, const char *debfilename, int delete, /*@null@*/trackingdb tracks) {
 	retvalue r;
 	struct trackingdata trackingdata;
 	const struct overridedata *oinfo;
 	char *control;
 	struct checksums *checksums;
 
-	causingfile = debfilename;
-
-	r = deb_read(&pkg, debfilename);
-	if (RET_WAS_ERROR(r)) {
-		return r;
-	}
 	r = deb_preparelocation(pkg, forcecomponent, forcearchitectures,
 			forcesection, forcepriority, packagetype, distribution,
 			&oinfo, debfilename);
@@ -400,6 +422,15 @@ retvalue deb_add(component_t forcecomponent, const struct atomlist *forcearchite
 		deb_free(pkg);
 		return r;
 	}
+	if (pkg->filelist != NULL) {
+		r = filelist_store(pkg->filekey, pkg->filelist,
+				pkg->filelistsize);
+		if (RET_WAS_ERROR(r)) {
+			checksums_free(checksums);
+			deb_free(pkg);
+			return r;
+		}
+	}
 	/* Prepare everything that can be prepared beforehand */
 	r = binaries_complete(&pkg->deb, pkg->filekey, checksums, oinfo,
 			pkg->deb.section, pkg->deb.priority, &control);
@@ -442,3 +473,183 @@ retvalue deb_add(component_t forcecomponent, const struct atomlist *forcearchite
 
 	return r;
 }
+
+/* insert the given .deb into the mirror in <component> in the <distribution>
+ * putting things with architecture of "all" into <d->architectures> (and also
+ * causing error, if it is not one of them otherwise)
+ * if component is NULL, guessing it from the section. */
+retvalue deb_add(component_t forcecomponent, const struct atomlist *forcearchitectures, const char *forcesection, const char *forcepriority, packagetype_t packagetype, struct distribution *distribution, const char *debfilename, int delete, /*@null@*/trackingdb tracks) {
+	struct debpackage *pkg;
+	retvalue r;
+
+	causingfile = debfilename;
+
+	r = deb_read(&pkg, debfilename,
+			contents_needfilelist(distribution, packagetype));
+	if (RET_WAS_ERROR(r)) {
+		return r;
+	}
+	return deb_addread(pkg, forcecomponent, forcearchitectures,
+			forcesection, forcepriority, packagetype,
+			distribution, debfilename, delete, tracks);
+}
+
+struct addmany {
+	component_t forcecomponent;
+	const struct atomlist *forcearchitectures;
+	const char *forcesection, *forcepriority;
+	packagetype_t packagetype;
+	struct distribution *distribution;
+	int delete;
+	trackingdb tracks;
+	bool withfilelist;
+	/* for each file its name and the result of adding it */
+	struct addmanyfile {
+		const struct addmany *common;
+		const char *filename;
+		retvalue result;
+	} *files;
+};
+
+/* called in a worker process: extract the control chunk (and the file list
+ * if needed) and send them back, separated by a null byte */
+static retvalue addmany_read(void *privdata, char **data_p, size_t *len_p) {
+	const struct addmanyfile *f = privdata;
+	char *control, *filelist = NULL, *data;
+	size_t controllen, filelistsize = 0;
+	retvalue r;
+
+	r = extractcontrolandfilelist(&control,
+			f->common->withfilelist?&filelist:NULL,
+			&filelistsize, f->filename);
+	if (!RET_IS_OK(r))
+		return r;
+	controllen = strlen(control);
+	if (filelist == NULL)
+		filelistsize = 0;
+	data = malloc(controllen + 1 + filelistsize);
+	if (FAILEDTOALLOC(data)) {
+		free(control);
+		free(filelist);
+		return RET_ERROR_OOM;
+	}
+	memcpy(data, control, controllen);
+	*len_p = controllen;
+	if (filelist != NULL) {
+		data[controllen] = '\0';
+		memcpy(data + controllen + 1, filelist, filelistsize);
+		*len_p += 1 + filelistsize;
+	}
+	free(control);
+	free(filelist);
+	*data_p = data;
+	return RET_OK;
+}
+
+/* called in the parent in the order of the files: add the package */
+static retvalue addmany_add(void *privdata, retvalue r, const char *data, size_t len) {
+	struct addmanyfile *f = privdata;
+	const struct addmany *a = f->common;
+	struct debpackage *pkg;
+	const char *controlend;
+
+	causingfile = f->filename;
+	if (RET_WAS_ERROR(r)) {
+		f->result = r;
+		return RET_NOTHING;
+	}
+	if (data == NULL) {
+		f->result = RET_ERROR;
+		return RET_NOTHING;
+	}
+	pkg = zNEW(struct debpackage);
+	if (FAILEDTOALLOC(pkg)) {
+		f->result = RET_ERROR_OOM;
+		return RET_ERROR_OOM;
+	}
+	controlend = memchr(data, '\0', len);
+	if (controlend == NULL)
+		controlend = data + len;
+	pkg->deb.control = strndup(data, controlend - data);
+	if (FAILEDTOALLOC(pkg->deb.control)) {
+		deb_free(pkg);
+		f->result = RET_ERROR_OOM;
+		return RET_ERROR_OOM;
+	}
+	if (controlend + 1 < data + len) {
+		controlend++;
+		pkg->filelistsize = (data + len) - controlend;
+		pkg->filelist = malloc(pkg->filelistsize);
+		if (FAILEDTOALLOC(pkg->filelist)) {
+			deb_free(pkg);
+			f->result = RET_ERROR_OOM;
+			return RET_ERROR_OOM;
+		}
+		memcpy(pkg->filelist, controlend, pkg->filelistsize);
+	}
+	r = deb_parse(pkg, f->filename);
+	if (RET_WAS_ERROR(r)) {
+		deb_free(pkg);
+		f->result = r;
+		return RET_NOTHING;
+	}
+	f->result = deb_addread(pkg, a->forcecomponent, a->forcearchitectures,
+			a->forcesection, a->forcepriority, a->packagetype,
+			a->distribution, f->filename, a->delete, a->tracks);
+	return RET_NOTHING;
+}
+
+/* like deb_add for each of the given files, but the .deb files are read
+ * in parallel worker processes (if allowed by --jobs) while the packages
+ * read so far are added one after the other in the given order */
+retvalue deb_addmany(component_t forcecomponent, const struct atomlist *forcearchitectures, const char *forcesection, const char *forcepriority, packagetype_t packagetype, struct distribution *distribution, int count, const char * const *debfilenames, int delete, /*@null@*/trackingdb tracks) {
+	struct addmany a;
+	struct workers *workers;
+	retvalue result, r;
+	int i;
+
+	if (count == 1 || global.jobs <= 1) {
+		result = RET_NOTHING;
+		for (i = 0 ; i < count ; i++) {
+			r = deb_add(forcecomponent, forcearchitectures,
+					forcesection, forcepriority,
+					packagetype, distribution,
+					debfilenames[i], delete, tracks);
+			RET_UPDATE(result, r);
+		}
+		return result;
+	}
+
+	a.forcecomponent = forcecomponent;
+	a.forcearchitectures = forcearchitectures;
+	a.forcesection = forcesection;
+	a.forcepriority = forcepriority;
+	a.packagetype = packagetype;
+	a.distribution = distribution;
+	a.delete = delete;
+	a.tracks = tracks;
+	a.withfilelist = contents_needfilelist(distribution, packagetype);
+	a.files = nzNEW(count, struct addmanyfile);
+	if (FAILEDTOALLOC(a.files))
+		return RET_ERROR_OOM;
+	r = workers_init(&workers, global.jobs);
+	if (RET_WAS_ERROR(r)) {
+		free(a.files);
+		return r;
+	}
+	for (i = 0 ; i < count ; i++) {
+		a.files[i].common = &a;
+		a.files[i].filename = debfilenames[i];
+		a.files[i].result = RET_NOTHING;
+		r = workers_start(workers, addmany_read, addmany_add,
+				&a.files[i]);
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+	result = workers_finish(workers);
+	RET_UPDATE(result, r);
+	for (i = 0 ; i < count ; i++)
+		RET_UPDATE(result, a.files[i].result);
+	free(a.files);
+	return result;
+}
@@ -20,6 +20,9 @@
  * information there), */
 retvalue deb_add(component_t, const struct atomlist * /*forcearchitectures*/, /*@null@*/const char * /*forcesection*/, /*@null@*/const char * /*forcepriority*/, packagetype_t, struct distribution *, const char * /*debfilename*/, int /*delete*/, /*@null@*/trackingdb);
 
+/* the same for many files, reading them in parallel if --jobs allows */
+retvalue deb_addmany(component_t, const struct atomlist * /*forcearchitectures*/, /*@null@*/const char * /*forcesection*/, /*@null@*/const char * /*forcepriority*/, packagetype_t, struct distribution *, int /*count*/, const char * const * /*debfilenames*/, int /*delete*/, /*@null@*/trackingdb);
+
 /* in two steps */
 struct debpackage;
 retvalue deb_addprepared(const struct debpackage *, const struct atomlist * /*forcearchitectures*/, packagetype_t, struct distribution *, struct trackingdata *);
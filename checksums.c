@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #define CHECKSUMS_CONTEXT visible
 #include "error.h"
@@ -1212,32 +1213,114 @@ retvalue checksums_complete(struct checksums **checksums_p, const char *fullfile
 	return checksums_test(fullfilename, *checksums_p, checksums_p);
 }
 
-retvalue checksums_read(const char *fullfilename, /*@out@*/struct checksums **checksums_p) {
+static /*@null@*/ checksumscache_get *cache_get = NULL;
+static /*@null@*/ checksumscache_put *cache_put = NULL;
+
+void checksums_setcache(checksumscache_get *get, checksumscache_put *put) {
+	cache_get = get;
+	cache_put = put;
+}
+
+/* Files are found in the cache by device and inode, and they must have
+ * the same size and times of last modification and status change.
+ * Files changed within the last second are not cached, as on file systems
+ * with coarse timestamps they might still change without that showing. */
+static retvalue cachekey(int fd, /*@out@*/char **key_p) {
+	struct stat s;
+
+	if (fstat(fd, &s) != 0 || !S_ISREG(s.st_mode))
+		return RET_NOTHING;
+	if (s.st_mtime >= time(NULL) || s.st_ctime >= time(NULL))
+		return RET_NOTHING;
+	*key_p = mprintf("%llx:%llx:%llx:%lld.%09ld:%lld.%09ld",
+			(unsigned long long)s.st_dev,
+			(unsigned long long)s.st_ino,
+			(unsigned long long)s.st_size,
+			(long long)s.st_mtim.tv_sec, (long)s.st_mtim.tv_nsec,
+			(long long)s.st_ctim.tv_sec, (long)s.st_ctim.tv_nsec);
+	if (FAILEDTOALLOC(*key_p))
+		return RET_ERROR_OOM;
+	return RET_OK;
+}
+
+static retvalue cachelookup(const char *key, /*@out@*/struct checksums **checksums_p) {
+	const char *data;
+	size_t len;
+	retvalue r;
+
+	r = cache_get(key, &data, &len);
+	if (!RET_IS_OK(r))
+		return r;
+	if (len == 0 || data[len - 1] != '\0')
+		return RET_NOTHING;
+	return checksums_parse(checksums_p, data);
+}
+
+static retvalue cachestore(int fd, const char *key, const struct checksums *checksums) {
+	const char *combinedchecksum;
+	char *newkey;
+	size_t len;
+	retvalue r;
+
+	/* only if the file did not change while being read */
+	r = cachekey(fd, &newkey);
+	if (!RET_IS_OK(r))
+		return r;
+	if (strcmp(key, newkey) != 0) {
+		free(newkey);
+		return RET_NOTHING;
+	}
+	free(newkey);
+	r = checksums_getcombined(checksums, &combinedchecksum, &len);
+	if (!RET_IS_OK(r))
+		return r;
+	return cache_put(key, combinedchecksum, len + 1);
+}
+
+static retvalue readfile(const char *fullfilename, bool usecache, /*@out@*/struct checksums **checksums_p) {
 	struct checksumscontext context;
 	static const size_t bufsize = 16384;
-	unsigned char *buffer = malloc(bufsize);
+	unsigned char *buffer;
+	char *key = NULL;
 	ssize_t sizeread;
 	int e, i;
 	int infd;
-
-	if (FAILEDTOALLOC(buffer))
-		return RET_ERROR_OOM;
-
-	checksumscontext_init(&context);
+	retvalue r;
 
 	infd = open(fullfilename, O_RDONLY);
 	if (infd < 0) {
 		e = errno;
 		if ((e == EACCES || e == ENOENT) &&
 				!isregularfile(fullfilename)) {
-			free(buffer);
 			return RET_NOTHING;
 		}
 		fprintf(stderr, "Error %d opening '%s': %s\n",
 				e, fullfilename, strerror(e));
-		free(buffer);
 		return RET_ERRNO(e);
 	}
+	if (usecache && cache_get != NULL) {
+		r = cachekey(infd, &key);
+		if (RET_IS_OK(r)) {
+			r = cachelookup(key, checksums_p);
+			if (r != RET_NOTHING) {
+				free(key);
+				(void)close(infd);
+				return r;
+			}
+		}
+		if (RET_WAS_ERROR(r)) {
+			(void)close(infd);
+			return r;
+		}
+	}
+
+	buffer = malloc(bufsize);
+	if (FAILEDTOALLOC(buffer)) {
+		free(key);
+		(void)close(infd);
+		return RET_ERROR_OOM;
+	}
+	checksumscontext_init(&context);
 	do {
 		sizeread = read(infd, buffer, bufsize);
 		if (sizeread < 0) {
@@ -1245,20 +1328,42 @@ retvalue checksums_read(const char *fullfilename, /*@out@*/struct checksums **ch
 			fprintf(stderr, "Error %d while reading %s: %s\n",
 					e, fullfilename, strerror(e));
 			free(buffer);
+			free(key);
 			(void)close(infd);
 			return RET_ERRNO(e);;
 		}
 		checksumscontext_update(&context, buffer, (size_t)sizeread);
 	} while (sizeread > 0);
 	free(buffer);
+	r = checksums_from_context(checksums_p, &context);
+	if (key != NULL) {
+		if (RET_IS_OK(r)) {
+			r = cachestore(infd, key, *checksums_p);
+			if (RET_WAS_ERROR(r))
+				checksums_free(*checksums_p);
+			else
+				r = RET_OK;
+		}
+		free(key);
+	}
 	i = close(infd);
 	if (i != 0) {
 		e = errno;
 		fprintf(stderr, "Error %d reading %s: %s\n",
 				e, fullfilename, strerror(e));
+		if (RET_IS_OK(r))
+			checksums_free(*checksums_p);
 		return RET_ERRNO(e);;
 	}
-	return checksums_from_context(checksums_p, &context);
+	return r;
+}
+
+retvalue checksums_read(const char *fullfilename, /*@out@*/struct checksums **checksums_p) {
+	return readfile(fullfilename, true, checksums_p);
+}
+
+retvalue checksums_reread(const char *fullfilename, /*@out@*/struct checksums **checksums_p) {
+	return readfile(fullfilename, false, checksums_p);
 }
 
 retvalue checksums_copyfile(const char *destination, const char *source, bool deletetarget, struct checksums **checksums_p) {
@@ -68,8 +68,16 @@ retvalue checksums_hardlink(const char * /*directory*/, const char * /*filekey*/
 
 retvalue checksums_linkorcopyfile(const char * /*destination*/, const char * /*origin*/, /*@out@*/struct checksums **);
 
-/* calculare checksums of a file: */
+/* calculare checksums of a file (or get them from the cache, if set): */
 retvalue checksums_read(const char * /*fullfilename*/, /*@out@*/struct checksums **);
+/* the same, but always read the file (to check it is still intact) */
+retvalue checksums_reread(const char * /*fullfilename*/, /*@out@*/struct checksums **);
+
+/* persistent cache of checksums of files, keyed by what stat returns,
+ * the data given to put is always 0-terminated (with len including it) */
+typedef retvalue checksumscache_get(const char * /*key*/, /*@out@*/const char ** /*data_p*/, /*@out@*/size_t * /*len_p*/);
+typedef retvalue checksumscache_put(const char * /*key*/, const char * /*data*/, size_t /*len*/);
+void checksums_setcache(/*@null@*/checksumscache_get *, /*@null@*/checksumscache_put *);
 
 /* replace the contents of a file with data and calculate the new checksums */
 retvalue checksums_replace(const char * /*filename*/, const char *, size_t, /*@out@*//*@null@*/struct checksums **);
@@ -120,6 +120,49 @@ retvalue chunk_getvalue(const char *chunk, const char *name, char **value) {
 	return RET_OK;
 }
 
+void chunk_getslices(const char *chunk, int count, const char * const *names, struct chunkslice *values) {
+	int i, missing = count;
+	const char *colon, *b, *e;
+
+	for (i = 0 ; i < count ; i++) {
+		values[i].value = NULL;
+		values[i].len = 0;
+	}
+	if (chunk == NULL)
+		return;
+	while (*chunk != '\0' && missing > 0) {
+		colon = chunk;
+		while (*colon != ':' && *colon != '\n' && *colon != '\0')
+			colon++;
+		if (*colon == ':') for (i = 0 ; i < count ; i++) {
+			size_t l = colon - chunk;
+
+			if (values[i].value != NULL ||
+					strncasecmp(names[i], chunk, l) != 0 ||
+					names[i][l] != '\0')
+				continue;
+			/* same as in chunk_getvalue */
+			b = colon + 1;
+			while (*b == ' ' || *b == '\t')
+				b++;
+			e = b;
+			while (*e != '\n' && *e != '\0')
+				e++;
+			while (e > b && xisspace(e[-1]))
+				e--;
+			values[i].value = b;
+			values[i].len = e - b;
+			missing--;
+		}
+		chunk = colon;
+		while (*chunk != '\n' && *chunk != '\0')
+			chunk++;
+		if (*chunk == '\0')
+			return;
+		chunk++;
+	}
+}
+
 retvalue chunk_getextralinelist(const char *chunk, const char *name, struct strlist *strlist) {
 	retvalue r;
 	const char *f, *b, *e;
@@ -166,16 +209,11 @@ retvalue chunk_getextralinelist(const char *chunk, const char *name, struct strl
 	return RET_OK;
 }
 
-retvalue chunk_getwholedata(const char *chunk, const char *name, char **value) {
-	const char *f, *p, *e;
+/* the end of the data of a field starting at f (without the last newline) */
+static const char *wholedata_end(const char *f) {
+	const char *p, *e;
 	bool afternewline = false;
-	char *v;
 
-	f = chunk_getfield(name, chunk);
-	if (f == NULL)
-		return RET_NOTHING;
-	while (*f == ' ')
-		f++;
 	for (e = p = f ; *p != '\0' ; p++) {
 		if (afternewline) {
 			if (*p == ' ' || *p == '\t')
@@ -191,13 +229,59 @@ retvalue chunk_getwholedata(const char *chunk, const char *name, char **value) {
 	}
 	if (!afternewline && *p == '\0')
 		e = p;
-	v = strndup(f, e - f);
+	return e;
+}
+
+retvalue chunk_getwholedata(const char *chunk, const char *name, char **value) {
+	const char *f;
+	char *v;
+
+	f = chunk_getfield(name, chunk);
+	if (f == NULL)
+		return RET_NOTHING;
+	while (*f == ' ')
+		f++;
+	v = strndup(f, wholedata_end(f) - f);
 	if (FAILEDTOALLOC(v))
 		return RET_ERROR_OOM;
 	*value = v;
 	return RET_OK;
 }
 
+void chunk_getwholeslices(const char *chunk, int count, const char * const *names, struct chunkslice *values) {
+	int i, missing = count;
+	const char *f;
+
+	for (i = 0 ; i < count ; i++) {
+		values[i].value = NULL;
+		values[i].len = 0;
+	}
+	if (chunk == NULL)
+		return;
+	while (*chunk != '\0' && missing > 0) {
+		for (i = 0 ; i < count ; i++) {
+			size_t l = strlen(names[i]);
+
+			/* same as in chunk_getfield */
+			if (values[i].value != NULL ||
+					strncasecmp(names[i], chunk, l) != 0 ||
+					chunk[l] != ':')
+				continue;
+			f = chunk + l + 1;
+			while (*f == ' ')
+				f++;
+			values[i].value = f;
+			values[i].len = wholedata_end(f) - f;
+			missing--;
+		}
+		while (*chunk != '\n' && *chunk != '\0')
+			chunk++;
+		if (*chunk == '\0')
+			return;
+		chunk++;
+	}
+}
+
 retvalue chunk_getwordlist(const char *chunk, const char *name, struct strlist *strlist) {
 	retvalue r;
 	const char *f, *b;
@@ -11,10 +11,21 @@
 
 /* look for name in chunk. returns RET_NOTHING if not found */
 retvalue chunk_getvalue(const char *, const char *, /*@out@*/char **);
+
+/* the value of a field (like chunk_getvalue) pointing into the chunk */
+struct chunkslice {
+	/* NULL if the field is missing */
+	/*@null@*//*@dependent@*/const char *value;
+	size_t len;
+};
+/* look for count fields at once */
+void chunk_getslices(const char *, int /*count*/, const char * const * /*names*/, /*@out@*/struct chunkslice *);
 retvalue chunk_getextralinelist(const char *, const char *, /*@out@*/struct strlist *);
 retvalue chunk_getwordlist(const char *, const char *, /*@out@*/struct strlist *);
 retvalue chunk_getuniqwordlist(const char *, const char *, /*@out@*/struct strlist *);
 retvalue chunk_getwholedata(const char *, const char *, /*@out@*/char **value);
+/* like chunk_getwholedata for count fields at once, without copying */
+void chunk_getwholeslices(const char *, int /*count*/, const char * const * /*names*/, /*@out@*/struct chunkslice *);
 
 /* Parse a package/source-field: ' *value( ?\(version\))? *' */
 retvalue chunk_getname(const char *, const char *, /*@out@*/char **, bool /*allowversion*/);
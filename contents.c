@@ -40,10 +40,10 @@
 retvalue contentsoptions_parse(struct distribution *distribution, struct configiterator *iter) {
 	enum contentsflags {
 		cf_disable, cf_dummy, cf_udebs, cf_nodebs,
-		cf_uncompressed, cf_gz, cf_bz2, cf_xz,
+		cf_uncompressed, cf_gz, cf_bz2, cf_xz, cf_zst,
 		cf_percomponent, cf_allcomponents,
 		cf_compatsymlink, cf_nocompatsymlink,
-		cf_ddebs,
+		cf_ddebs, cf_rsyncable,
 		cf_COUNT
 	};
 	bool flags[cf_COUNT];
@@ -57,11 +57,13 @@ retvalue contentsoptions_parse(struct distribution *distribution, struct configi
 		{"allcomponents", cf_allcomponents},
 		{"compatsymlink", cf_compatsymlink},
 		{"nocompatsymlink", cf_nocompatsymlink},
+		{".zst", cf_zst},
 		{".xz", cf_xz},
 		{".bz2", cf_bz2},
 		{".gz", cf_gz},
 		{".", cf_uncompressed},
 		{"ddebs", cf_ddebs},
+		{"rsyncable", cf_rsyncable},
 		{NULL, -1}
 	};
 	retvalue r;
@@ -117,6 +119,16 @@ retvalue contentsoptions_parse(struct distribution *distribution, struct configi
 			config_filename(iter), config_line(iter));
 		flags[cf_xz] = false;
 	}
+#endif
+#ifndef HAVE_LIBZSTD
+	if (flags[cf_zst]) {
+		fprintf(stderr,
+"Warning: Ignoring request to generate .zst'ed Contents files.\n"
+"(zstd support disabled at build time.)\n"
+"Request was in %s in the Contents header ending in line %u\n",
+			config_filename(iter), config_line(iter));
+		flags[cf_zst] = false;
+	}
 #endif
 	distribution->contents.compressions = 0;
 	if (flags[cf_uncompressed])
@@ -130,10 +142,15 @@ retvalue contentsoptions_parse(struct distribution *distribution, struct configi
 #ifdef HAVE_LIBLZMA
 	if (flags[cf_xz])
 		distribution->contents.compressions |= IC_FLAG(ic_xz);
+#endif
+#ifdef HAVE_LIBZSTD
+	if (flags[cf_zst])
+		distribution->contents.compressions |= IC_FLAG(ic_zstd);
 #endif
 	distribution->contents.flags.udebs = flags[cf_udebs];
 	distribution->contents.flags.ddebs = flags[cf_ddebs];
 	distribution->contents.flags.nodebs = flags[cf_nodebs];
+	distribution->contents.flags.rsyncable = flags[cf_rsyncable];
 	if (flags[cf_allcomponents])
 		distribution->contents.flags.allcomponents = true;
 	else
@@ -214,11 +231,13 @@ static retvalue gentargetcontents(struct target *target, struct release *release
 		r = release_startlinkedfile(release, contentsfilename,
 				symlinkas,
 				target->distribution->contents.compressions,
+				target->distribution->contents.flags.rsyncable,
 				onlyneeded, &file);
 		free(symlinkas);
 	} else
 		r = release_startfile(release, contentsfilename,
 				target->distribution->contents.compressions,
+				target->distribution->contents.flags.rsyncable,
 				onlyneeded, &file);
 	if (!RET_IS_OK(r)) {
 		free(contentsfilename);
@@ -336,6 +355,7 @@ static retvalue genarchcontents(struct distribution *distribution, architecture_
 		return RET_ERROR_OOM;
 	r = release_startfile(release, contentsfilename,
 			distribution->contents.compressions,
+			distribution->contents.flags.rsyncable,
 			combinedonlyifneeded, &file);
 	if (!RET_IS_OK(r)) {
 		free(contentsfilename);
@@ -365,6 +385,18 @@ static retvalue genarchcontents(struct distribution *distribution, architecture_
 	return result;
 }
 
+bool contents_needfilelist(const struct distribution *distribution, packagetype_t packagetype) {
+	if (!distribution->contents.flags.enabled)
+		return false;
+	if (packagetype == pt_deb)
+		return !distribution->contents.flags.nodebs;
+	if (packagetype == pt_udeb)
+		return distribution->contents.flags.udebs;
+	if (packagetype == pt_ddeb)
+		return distribution->contents.flags.ddebs;
+	return false;
+}
+
 retvalue contents_generate(struct distribution *distribution, struct release *release, bool onlyneeded) {
 	retvalue result, r;
 	int i;
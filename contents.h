@@ -20,6 +20,7 @@ struct contentsoptions {
 		bool allcomponents;
 		bool compatsymlink;
 		bool ddebs;
+		bool rsyncable;
 	} flags;
 	compressionset compressions;
 };
@@ -29,5 +30,7 @@ struct configiterator;
 
 retvalue contentsoptions_parse(struct distribution *, struct configiterator *);
 retvalue contents_generate(struct distribution *, struct release *, bool /*onlyneeded*/);
+/* are the file lists of packages of that type needed for Contents files? */
+bool contents_needfilelist(const struct distribution *, packagetype_t);
 
 #endif
@@ -547,7 +547,10 @@ static retvalue by_source(struct package_list *list, struct target *desttarget,
 
 	assert (d->argc > 0);
 
-	r = package_openiterator(fromtarget, READONLY, true, &iterator);
+	r = package_opensourceiterator(fromtarget, READONLY, d->argv[0],
+			&iterator);
+	if (r == RET_NOTHING)
+		r = package_openiterator(fromtarget, READONLY, true, &iterator);
 	assert (r != RET_NOTHING);
 	if (!RET_IS_OK(r))
 		return r;
@@ -713,8 +716,14 @@ static retvalue by_glob(struct package_list *list, struct target *desttarget, st
 	const char *glob = data;
 	struct package_cursor iterator;
 	retvalue result, r;
+	char *prefix;
 
-	r = package_openiterator(fromtarget, READONLY, true, &iterator);
+	prefix = glob_literalprefix(glob);
+	if (FAILEDTOALLOC(prefix))
+		return RET_ERROR_OOM;
+	r = package_openprefixiterator(fromtarget, READONLY, true, prefix,
+			&iterator);
+	free(prefix);
 	assert (r != RET_NOTHING);
 	if (!RET_IS_OK(r))
 		return r;
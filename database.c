@@ -18,6 +18,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <ctype.h>
 #include <assert.h>
 #include <limits.h>
 #include <string.h>
@@ -44,6 +45,8 @@
 #include "distribution.h"
 #include "database_p.h"
 #include "chunks.h"
+#include "signature.h"
+#include "checksums.h"
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
@@ -60,11 +63,21 @@ static /*@null@*/ char *rdb_version, *rdb_lastsupportedversion,
 static DB_ENV *rdb_env = NULL;
 
 struct table *rdb_checksums, *rdb_contents;
-struct table *rdb_references;
+struct table *rdb_references, *rdb_sizes;
+static struct table *rdb_signaturecache = NULL;
+static struct table *rdb_checksumscache = NULL;
+static pid_t rdb_checksumscache_owner;
 static struct {
 	bool createnewtables;
+	/* packagesources.db was kept up to date by every version
+	 * changing the database */
+	bool sourceindex;
 } rdb_capabilities;
 
+/* the first version maintaining packagesources.db, older versions
+ * must no longer change the database once it is used */
+#define SOURCEINDEX_VERSION "5.4.0"
+
 struct opened_tables {
 	struct opened_tables *next;
 	const char *name;
@@ -226,6 +239,11 @@ retvalue database_close(void) {
 		RET_UPDATE(result, r);
 		rdb_references = NULL;
 	}
+	if (rdb_sizes != NULL) {
+		r = table_close(rdb_sizes);
+		RET_UPDATE(result, r);
+		rdb_sizes = NULL;
+	}
 	if (rdb_checksums != NULL) {
 		r = table_close(rdb_checksums);
 		RET_UPDATE(result, r);
@@ -236,6 +254,18 @@ retvalue database_close(void) {
 		RET_UPDATE(result, r);
 		rdb_contents = NULL;
 	}
+	if (rdb_signaturecache != NULL) {
+		signature_setcache(NULL, NULL);
+		r = table_close(rdb_signaturecache);
+		RET_UPDATE(result, r);
+		rdb_signaturecache = NULL;
+	}
+	if (rdb_checksumscache != NULL) {
+		checksums_setcache(NULL, NULL);
+		r = table_close(rdb_checksumscache);
+		RET_UPDATE(result, r);
+		rdb_checksumscache = NULL;
+	}
 	r = writeversionfile();
 	RET_UPDATE(result, r);
 	if (rdb_locked)
@@ -244,6 +274,44 @@ retvalue database_close(void) {
 	return result;
 }
 
+/* write all changes to disk, so that forked processes
+ * can read the database (see database_forked) while this
+ * process waits for them */
+retvalue database_sync(void) {
+	int dbret;
+
+	if (rdb_env == NULL)
+		return RET_NOTHING;
+	dbret = rdb_env->memp_sync(rdb_env, NULL);
+	if (dbret != 0) {
+		rdb_env->err(rdb_env, dbret, "memp_sync");
+		return RET_DBERR(dbret);
+	}
+	return RET_OK;
+}
+
+/* Called in a worker process forked while the database is open:
+ * Berkeley DB handles cannot be used across fork(), not even to close
+ * them, so forget all inherited ones and open an own environment.
+ * Tables are only to be opened read-only there, and only while the
+ * parent does not change anything. */
+retvalue database_forked(void) {
+	if (rdb_env == NULL)
+		return RET_NOTHING;
+	rdb_env = NULL;
+	rdb_references = NULL;
+	rdb_sizes = NULL;
+	rdb_checksums = NULL;
+	rdb_contents = NULL;
+	rdb_signaturecache = NULL;
+	rdb_checksumscache = NULL;
+	opened_tables = NULL;
+	/* the lock belongs to the parent */
+	rdb_locked = false;
+	rdb_readonly = true;
+	return database_openenv();
+}
+
 static retvalue database_hasdatabasefile(const char *filename, /*@out@*/bool *exists_p) {
 	char *fullfilename;
 
@@ -664,6 +732,7 @@ static retvalue readversionfile(bool nopackagesyet) {
 			if (FAILEDTOALLOC(rdb_version))
 				return RET_ERROR_OOM;
 			rdb_capabilities.createnewtables = true;
+			rdb_capabilities.sourceindex = true;
 		} else
 			rdb_version = NULL;
 		rdb_lastsupportedversion = NULL;
@@ -710,6 +779,11 @@ static retvalue readversionfile(bool nopackagesyet) {
 		return r;
 	if (c >= 0)
 		rdb_capabilities.createnewtables = true;
+	r = dpkgversions_cmp(rdb_lastsupportedversion, SOURCEINDEX_VERSION, &c);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (c >= 0)
+		rdb_capabilities.sourceindex = true;
 
 	/* ensure we can understand it */
 
@@ -757,6 +831,7 @@ static retvalue readversionfile(bool nopackagesyet) {
 
 static retvalue writeversionfile(void) {
 	char *versionfilename, *finalversionfilename;
+	const char *minimum;
 	FILE *f;
 	int i, e;
 
@@ -777,17 +852,21 @@ static retvalue writeversionfile(void) {
 		(void)fputs(rdb_version, f);
 		(void)fputc('\n', f);
 	}
+	/* with packagesources.db older versions must not touch it */
+	minimum = rdb_capabilities.sourceindex?SOURCEINDEX_VERSION:"3.3.0";
 	if (rdb_lastsupportedversion == NULL) {
-		(void)fputs("3.3.0\n", f);
+		(void)fputs(minimum, f);
+		(void)fputc('\n', f);
 	} else {
 		int c;
 		retvalue r;
 
 		r = dpkgversions_cmp(rdb_lastsupportedversion,
-				"3.3.0", &c);
-		if (!RET_IS_OK(r) || c < 0)
-			(void)fputs("3.3.0\n", f);
-		else {
+				minimum, &c);
+		if (!RET_IS_OK(r) || c < 0) {
+			(void)fputs(minimum, f);
+			(void)fputc('\n', f);
+		} else {
 			(void)fputs(rdb_lastsupportedversion, f);
 			(void)fputc('\n', f);
 		}
@@ -928,6 +1007,17 @@ retvalue database_create(struct distribution *alldistributions, bool fast, bool
 		return RET_OK;
 	}
 
+	if (!readonly && packagesfileexists && !rdb_capabilities.sourceindex) {
+		/* an older version might have changed packages.db without
+		 * updating the index, so build it anew */
+		r = database_dropsubtable("packagesources.db", NULL);
+		if (RET_WAS_ERROR(r)) {
+			database_close();
+			return r;
+		}
+		rdb_capabilities.sourceindex = true;
+	}
+
 	if (nopackagesyet) {
 		// TODO: handle readonly, but only once packages files may no
 		// longer be generated when it is active...
@@ -1000,12 +1090,26 @@ struct cursor {
 	DBC *cursor;
 	uint32_t flags;
 	retvalue r;
+	/* only return keys starting with this (if non-NULL) */
+	/*@null@*/char *prefix;
+	size_t prefixlen;
+	/* already positioned at the first record to return */
+	bool positioned;
+	/* nothing more to return */
+	bool exhausted;
+	/* iterating a source index: return the package names
+	 * from the primary keys (copied into keybuffer) */
+	bool primarykeys;
+	char *keybuffer;
+	size_t keybuffersize;
 };
 
 struct table {
 	char *name, *subname;
 	DB *berkeleydb;
 	DB *sec_berkeleydb;
+	/* only for packages: index by source name, NULL if not available */
+	DB *src_berkeleydb;
 	bool readonly, verbose;
 	uint32_t flags;
 };
@@ -1069,6 +1173,15 @@ retvalue table_close(struct table *table) {
 		        table == NULL ? NULL : table->name, table == NULL ? NULL : table->subname);
 	if (table == NULL)
 		return RET_NOTHING;
+	if (table->src_berkeleydb != NULL) {
+		dbret = table->src_berkeleydb->close(table->src_berkeleydb, 0);
+		if (dbret != 0) {
+			fprintf(stderr, "db_src_close(%s, %s): %s\n",
+					table->name, table->subname,
+					db_strerror(dbret));
+			result = RET_DBERR(dbret);
+		}
+	}
 	if (table->sec_berkeleydb != NULL) {
 		dbret = table->sec_berkeleydb->close(table->sec_berkeleydb, 0);
 		if (dbret != 0) {
@@ -1533,6 +1646,85 @@ static inline retvalue parse_pair(struct table *table, DBT Key, DBT Data, /*@nul
 	return RET_OK;
 }
 
+/* like table_newglobalcursor, but only for keys starting with prefix
+ * (making use of the keys being sorted) */
+retvalue table_newprefixcursor(struct table *table, bool duplicate, const char *prefix, struct cursor **cursor_p) {
+	struct cursor *cursor;
+	int dbret;
+	DBT Key, Data;
+	retvalue r;
+
+	if (prefix[0] == '\0')
+		return table_newglobalcursor(table, duplicate, cursor_p);
+	r = newcursor(table, duplicate ? DB_NEXT : DB_NEXT_NODUP, &cursor);
+	if (r == RET_NOTHING) {
+		/* like table_newglobalcursor */
+		return RET_OK;
+	}
+	if (!RET_IS_OK(r))
+		return r;
+	cursor->prefix = strdup(prefix);
+	if (FAILEDTOALLOC(cursor->prefix)) {
+		(void)cursor_close(table, cursor);
+		return RET_ERROR_OOM;
+	}
+	cursor->prefixlen = strlen(prefix);
+	/* without the trailing \0, so it is before all keys starting
+	 * with it: */
+	SETDBTl(Key, prefix, cursor->prefixlen);
+	CLEARDBT(Data);
+	dbret = cursor->cursor->c_get(cursor->cursor, &Key, &Data,
+			DB_SET_RANGE);
+	if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY) {
+		cursor->exhausted = true;
+	} else if (dbret != 0) {
+		table_printerror(table, dbret, "c_get(DB_SET_RANGE)");
+		(void)cursor_close(table, cursor);
+		return RET_DBERR(dbret);
+	} else
+		cursor->positioned = true;
+	*cursor_p = cursor;
+	return RET_OK;
+}
+
+/* iterate over all packages of a source with cursor_nexttempdata,
+ * RET_NOTHING if there is no index by source for this table */
+retvalue table_newsourcecursor(struct table *table, const char *source, struct cursor **cursor_p) {
+	struct cursor *cursor;
+	int dbret;
+	DBT Key, Data;
+
+	if (table->src_berkeleydb == NULL)
+		return RET_NOTHING;
+
+	cursor = zNEW(struct cursor);
+	if (FAILEDTOALLOC(cursor))
+		return RET_ERROR_OOM;
+	cursor->flags = DB_NEXT_DUP;
+	cursor->r = RET_OK;
+	cursor->primarykeys = true;
+	dbret = table->src_berkeleydb->cursor(table->src_berkeleydb, NULL,
+			&cursor->cursor, 0);
+	if (dbret != 0) {
+		table_printerror(table, dbret, "cursor");
+		free(cursor);
+		return RET_DBERR(dbret);
+	}
+	SETDBT(Key, source);
+	CLEARDBT(Data);
+	dbret = cursor->cursor->c_get(cursor->cursor, &Key, &Data, DB_SET);
+	if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY) {
+		cursor->exhausted = true;
+	} else if (dbret != 0) {
+		table_printerror(table, dbret, "c_get(DB_SET)");
+		(void)cursor_close(table, cursor);
+		return RET_DBERR(dbret);
+	} else
+		cursor->positioned = true;
+	*cursor_p = cursor;
+	return RET_OK;
+}
+
 retvalue table_newduplicatecursor(struct table *table, const char *key, long long skip, struct cursor **cursor_p, const char **key_p, const char **data_p, size_t *datalen_p) {
 	struct cursor *cursor;
 	int dbret;
@@ -1683,6 +1875,8 @@ retvalue cursor_close(struct table *table, struct cursor *cursor) {
 	r = cursor->r;
 	dbret = cursor->cursor->c_close(cursor->cursor);
 	cursor->cursor = NULL;
+	free(cursor->prefix);
+	free(cursor->keybuffer);
 	free(cursor);
 	if (dbret != 0) {
 		table_printerror(table, dbret, "c_close");
@@ -1694,14 +1888,52 @@ retvalue cursor_close(struct table *table, struct cursor *cursor) {
 static bool cursor_next(struct table *table, struct cursor *cursor, DBT *Key, DBT *Data) {
 	int dbret;
 
-	if (cursor == NULL)
+	if (cursor == NULL || cursor->exhausted)
 		return false;
 
 	CLEARDBT(*Key);
 	CLEARDBT(*Data);
 
-	dbret = cursor->cursor->c_get(cursor->cursor, Key, Data,
-			cursor->flags);
+	if (cursor->primarykeys) {
+		DBT PKey;
+
+		CLEARDBT(PKey);
+		dbret = cursor->cursor->c_pget(cursor->cursor, Key, &PKey, Data,
+				cursor->positioned?DB_CURRENT:cursor->flags);
+		cursor->positioned = false;
+		if (dbret == 0) {
+			const char *separator;
+			size_t len;
+
+			separator = memchr(PKey.data, '|', PKey.size);
+			if (separator == NULL) {
+				table_printerror(table, DB_MALFORMED_KEY,
+						"c_pget");
+				cursor->r = RET_ERROR;
+				return false;
+			}
+			len = separator - (const char *)PKey.data;
+			if (len >= cursor->keybuffersize) {
+				char *n = realloc(cursor->keybuffer, len + 64);
+				if (FAILEDTOALLOC(n)) {
+					cursor->r = RET_ERROR_OOM;
+					return false;
+				}
+				cursor->keybuffer = n;
+				cursor->keybuffersize = len + 64;
+			}
+			memcpy(cursor->keybuffer, PKey.data, len);
+			cursor->keybuffer[len] = '\0';
+			Key->data = cursor->keybuffer;
+			Key->size = len + 1;
+		}
+	} else if (cursor->positioned) {
+		cursor->positioned = false;
+		dbret = cursor->cursor->c_get(cursor->cursor, Key, Data,
+				DB_CURRENT);
+	} else
+		dbret = cursor->cursor->c_get(cursor->cursor, Key, Data,
+				cursor->flags);
 	if (dbret == DB_NOTFOUND)
 		return false;
 
@@ -1715,6 +1947,13 @@ static bool cursor_next(struct table *table, struct cursor *cursor, DBT *Key, DB
 		cursor->r = RET_DBERR(dbret);
 		return false;
 	}
+	if (cursor->prefix != NULL && (Key->size < cursor->prefixlen ||
+			memcmp(Key->data, cursor->prefix,
+				cursor->prefixlen) != 0)) {
+		/* sorted, so all following keys are too large */
+		cursor->exhausted = true;
+		return false;
+	}
 	return true;
 }
 
@@ -1971,6 +2210,18 @@ retvalue database_openreferences(void) {
 		return r;
 	} else
 		rdb_references->verbose = false;
+	/* size accounting (see sizes.c) */
+	assert (rdb_sizes == NULL);
+	r = database_table("references.db", "sizes",
+			dbt_BTREE, DB_CREATE, &rdb_sizes);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r)) {
+		rdb_sizes = NULL;
+		(void)table_close(rdb_references);
+		rdb_references = NULL;
+		return r;
+	} else
+		rdb_sizes->verbose = false;
 	return RET_OK;
 }
 
@@ -2048,6 +2299,30 @@ retvalue database_opentracking(const char *codename, bool readonly, struct table
 	return RET_OK;
 }
 
+/* the architecture all control chunks shared by the architectures
+ * of one component (see target.c) */
+retvalue database_opensharedpackages(const char *identifier, bool readonly, struct table **table_p) {
+	struct table *table;
+	retvalue r;
+
+	if (rdb_nopackages) {
+		(void)fputs(
+"Internal Error: Accessing packages database while that was not prepared!\n",
+				stderr);
+		return RET_ERROR;
+	}
+
+	r = database_table("sharedpackages.db", identifier,
+			dbt_BTREE, readonly?DB_RDONLY:DB_CREATE, &table);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r))
+		return r;
+	/* only reference counted copies, like the references */
+	table->verbose = false;
+	*table_p = table;
+	return RET_OK;
+}
+
 static int get_package_name(DB *secondary, const DBT *pkey, const DBT *pdata, DBT *skey) {
 	const char *separator;
 	size_t length;
@@ -2067,6 +2342,45 @@ static int get_package_name(DB *secondary, const DBT *pkey, const DBT *pdata, DB
 	return 0;
 }
 
+/* the source name of a package, i.e. the first word of the Source field
+ * or the package name itself if there is none */
+static int get_package_source(DB *secondary, const DBT *pkey, const DBT *pdata, DBT *skey) {
+	const char *chunk = pdata->data, *end, *p, *e;
+	size_t length;
+
+	end = chunk + pdata->size;
+	p = chunk;
+	while (p < end) {
+		if (end - p > 7 && strncasecmp(p, "Source:", 7) == 0) {
+			p += 7;
+			while (p < end && (*p == ' ' || *p == '\t'))
+				p++;
+			e = p;
+			while (e < end && *e != '\0' && !xisspace(*e)
+					&& *e != '(')
+				e++;
+			if (e > p)
+				break;
+		}
+		p = memchr(p, '\n', end - p);
+		if (p == NULL)
+			break;
+		p++;
+	}
+	if (p == NULL || p >= end)
+		/* no Source field, so it is the package name */
+		return get_package_name(secondary, pkey, pdata, skey);
+	length = e - p;
+	skey->flags = DB_DBT_APPMALLOC;
+	skey->data = strndup(p, length);
+	if (FAILEDTOALLOC(skey->data)) {
+		/* called by libdb, so it needs an errno value */
+		return ENOMEM;
+	}
+	skey->size = length + 1;
+	return 0;
+}
+
 static retvalue database_translate_legacy_packages(void) {
 	struct cursor *databases_cursor, *cursor;
 	struct table *legacy_databases, *legacy_table, *packages;
@@ -2229,6 +2543,43 @@ retvalue database_openpackages(const char *identifier, bool readonly, struct tab
 		}
 	}
 
+	/* the index by source name, created from the packages if it
+	 * did not yet exist (only missing or ignored if the database
+	 * itself is read-only, callers then have to look at everything) */
+	if (table->berkeleydb != NULL && rdb_capabilities.sourceindex) {
+		bool create = !readonly;
+		int dbret;
+
+		r = database_opentable("packagesources.db", identifier,
+				dbt_BTREEDUP, readonly?DB_RDONLY:DB_CREATE,
+				&table->src_berkeleydb);
+		if (r == RET_NOTHING && !rdb_readonly) {
+			/* not yet indexed (i.e. last written by an older
+			 * version), so build the index once now */
+			create = true;
+			r = database_opentable("packagesources.db", identifier,
+					dbt_BTREEDUP, DB_CREATE,
+					&table->src_berkeleydb);
+		}
+		if (RET_WAS_ERROR(r)) {
+			(void)table_close(table);
+			return r;
+		}
+		if (r == RET_NOTHING)
+			table->src_berkeleydb = NULL;
+		else {
+			dbret = table->berkeleydb->associate(table->berkeleydb,
+					NULL, table->src_berkeleydb,
+					get_package_source,
+					create?DB_CREATE:0);
+			if (dbret != 0) {
+				table_printerror(table, dbret, "associate");
+				(void)table_close(table);
+				return RET_DBERR(dbret);
+			}
+		}
+	}
+
 	*table_p = table;
 	return RET_OK;
 }
@@ -2245,6 +2596,13 @@ retvalue database_droppackages(const char *identifier) {
 	r = database_dropsubtable("packages.db", identifier);
 	if (RET_IS_OK(r))
 		r = database_dropsubtable("packagenames.db", identifier);
+	if (RET_IS_OK(r)) {
+		retvalue r2;
+
+		r2 = database_dropsubtable("packagesources.db", identifier);
+		if (RET_WAS_ERROR(r2))
+			r = r2;
+	}
 	return r;
 }
 
@@ -2305,10 +2663,18 @@ retvalue database_openfiles(void) {
 	return r;
 }
 
-retvalue database_openreleasecache(const char *codename, struct table **cachedb_p) {
+retvalue database_openreleasecache(const char *codename, bool readonly, struct table **cachedb_p) {
 	retvalue r;
 	char *oldcachefilename;
 
+	if (readonly) {
+		r = database_table("release.caches.db", codename,
+				 dbt_HASH, DB_RDONLY, cachedb_p);
+		if (RET_IS_OK(r))
+			(*cachedb_p)->verbose = false;
+		return r;
+	}
+
 	/* Since 3.1.0 it's release.caches.db, before release.cache.db.
 	 * The new file also contains the sha1 checksums and is extensible
 	 * for more in the future. Thus if there is only the old variant,
@@ -2360,6 +2726,72 @@ retvalue database_openreleasecache(const char *codename, struct table **cachedb_
 	return r;
 }
 
+static retvalue signaturecache_getrecord(const char *key, const char **data_p, size_t *len_p) {
+	return table_gettemprecord(rdb_signaturecache, key, data_p, len_p);
+}
+
+static retvalue signaturecache_putrecord(const char *key, const char *data, size_t len) {
+	return table_adduniqsizedrecord(rdb_signaturecache, key, data, len,
+			true, false);
+}
+
+/* remember results of signature checks (keyed by a hash of the signed
+ * data and the state of the keyring), see --signaturecache */
+retvalue database_opensignaturecache(void) {
+	retvalue r;
+
+	assert (rdb_signaturecache == NULL);
+	r = database_table("signatures.cache.db", NULL,
+			dbt_HASH, DB_CREATE, &rdb_signaturecache);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r)) {
+		rdb_signaturecache = NULL;
+		return r;
+	}
+	rdb_signaturecache->verbose = false;
+	signature_setcache(signaturecache_getrecord, signaturecache_putrecord);
+	return RET_OK;
+}
+
+/* Worker processes neither read nor write the cache: the handle
+ * is the parent's (or gone after database_forked). */
+static inline bool checksumscache_usable(void) {
+	return rdb_checksumscache != NULL &&
+		getpid() == rdb_checksumscache_owner;
+}
+
+static retvalue checksumscache_getrecord(const char *key, const char **data_p, size_t *len_p) {
+	if (!checksumscache_usable())
+		return RET_NOTHING;
+	return table_gettemprecord(rdb_checksumscache, key, data_p, len_p);
+}
+
+static retvalue checksumscache_putrecord(const char *key, const char *data, size_t len) {
+	if (!checksumscache_usable())
+		return RET_NOTHING;
+	return table_adduniqsizedrecord(rdb_checksumscache, key, data, len,
+			true, false);
+}
+
+/* remember checksums of files read (keyed by device, inode, size and
+ * times of modification and status change), see --checksumcache */
+retvalue database_openchecksumscache(void) {
+	retvalue r;
+
+	assert (rdb_checksumscache == NULL);
+	r = database_table("checksums.cache.db", NULL,
+			dbt_HASH, DB_CREATE, &rdb_checksumscache);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r)) {
+		rdb_checksumscache = NULL;
+		return r;
+	}
+	rdb_checksumscache->verbose = false;
+	rdb_checksumscache_owner = getpid();
+	checksums_setcache(checksumscache_getrecord, checksumscache_putrecord);
+	return RET_OK;
+}
+
 static retvalue table_copy(struct table *oldtable, struct table *newtable) {
 	retvalue r;
 	struct cursor *cursor;
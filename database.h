@@ -17,13 +17,18 @@ struct cursor;
 
 retvalue database_create(struct distribution *, bool fast, bool /*nopackages*/, bool /*allowunused*/, bool /*readonly*/, size_t /*waitforlock*/, bool /*verbosedb*/);
 retvalue database_close(void);
+retvalue database_sync(void);
+retvalue database_forked(void);
 
 retvalue database_openfiles(void);
 retvalue database_openreferences(void);
 retvalue database_listpackages(/*@out@*/struct strlist *);
 retvalue database_droppackages(const char *);
 retvalue database_openpackages(const char *, bool /*readonly*/, /*@out@*/struct table **);
-retvalue database_openreleasecache(const char *, /*@out@*/struct table **);
+retvalue database_opensharedpackages(const char *, bool /*readonly*/, /*@out@*/struct table **);
+retvalue database_openreleasecache(const char *, bool /*readonly*/, /*@out@*/struct table **);
+retvalue database_opensignaturecache(void);
+retvalue database_openchecksumscache(void);
 retvalue database_opentracking(const char *, bool /*readonly*/, /*@out@*/struct table **);
 retvalue database_translate_filelists(void);
 retvalue database_translate_legacy_checksums(bool /*verbosedb*/);
@@ -48,6 +53,8 @@ retvalue table_checkrecord(struct table *, const char *key, const char *data);
 retvalue table_removerecord(struct table *, const char *key, const char *data);
 
 retvalue table_newglobalcursor(struct table *, bool /*duplicate*/, /*@out@*/struct cursor **);
+retvalue table_newprefixcursor(struct table *, bool /*duplicate*/, const char * /*prefix*/, /*@out@*/struct cursor **);
+retvalue table_newsourcecursor(struct table *, const char * /*source*/, /*@out@*/struct cursor **);
 retvalue table_newduplicatecursor(struct table *, const char *, long long, /*@out@*/struct cursor **, /*@out@*/const char **, /*@out@*/const char **, /*@out@*/size_t *);
 retvalue table_newduplicatepairedcursor(struct table *, const char *, /*@out@*/struct cursor **, /*@out@*/const char **, /*@out@*/const char **, /*@out@*/size_t *);
 retvalue table_newpairedcursor(struct table *, const char *, const char *, /*@out@*/struct cursor **, /*@out@*//*@null@*/const char **, /*@out@*//*@null@*/size_t *);
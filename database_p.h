@@ -6,7 +6,7 @@
 #endif
 
 extern /*@null@*/ struct table *rdb_checksums, *rdb_contents;
-extern /*@null@*/ struct table *rdb_references;
+extern /*@null@*/ struct table *rdb_references, *rdb_sizes;
 
 retvalue database_listsubtables(const char *, /*@out@*/struct strlist *);
 retvalue database_dropsubtable(const char *, const char *);
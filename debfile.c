@@ -171,6 +171,36 @@ static retvalue read_control_tar(char **control, const char *debfile, struct ar_
 	return RET_ERROR_MISSING;
 }
 
+retvalue ar_readcontrolmember(char **control, const char *debfile, struct ar_archive *ar) {
+	struct archive *tar;
+	retvalue r;
+	bool got;
+	int a;
+
+	tar = archive_read_new();
+	r = read_control_tar(control, debfile, ar, tar);
+	got = RET_IS_OK(r);
+	a = archive_read_close(tar);
+	if (a != ARCHIVE_OK && !RET_WAS_ERROR(r)) {
+		int e = archive_errno(tar);
+		if (e == -EINVAL)
+			fprintf(stderr,
+"reading control.tar within '%s' failed: %s\n",
+				debfile, archive_error_string(tar));
+		else
+			fprintf(stderr,
+"reading control.tar within '%s' failed: %d:%d:%s\n", debfile, a, e,
+				archive_error_string(tar));
+		r = RET_ERROR;
+	}
+	a = archive_read_free(tar);
+	if (a != ARCHIVE_OK && !RET_WAS_ERROR(r))
+		r = RET_ERROR;
+	if (RET_WAS_ERROR(r) && got)
+		free(*control);
+	return r;
+}
+
 retvalue extractcontrol(char **control, const char *debfile) {
 	struct ar_archive *ar;
 	retvalue r;
@@ -202,12 +232,7 @@ retvalue extractcontrol(char **control, const char *debfile) {
 			}
 			ar_archivemember_setcompression(ar, c);
 			if (uncompression_supported(c)) {
-				struct archive *tar;
-
-				tar = archive_read_new();
-				r = read_control_tar(control, debfile, ar, tar);
-				// TODO run archive_read_close to get error messages?
-				archive_read_free(tar);
+				r = ar_readcontrolmember(control, debfile, ar);
 				if (r != RET_NOTHING) {
 					ar_close(ar);
 					free(filename);
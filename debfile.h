@@ -12,4 +12,9 @@ retvalue extractcontrol(/*@out@*/char **, const char *);
 /* Read a list of files from a .deb file */
 retvalue getfilelist(/*@out@*/char **, /*@out@*/ size_t *, const char *);
 
+/* Read both in one pass over the .deb file. The list of files is only
+ * read if its pointer is not NULL and set to NULL if this is not
+ * supported (i.e. without libarchive) or data.tar cannot be read */
+retvalue extractcontrolandfilelist(/*@out@*/char **, /*@null@*//*@out@*/char **, /*@out@*/size_t *, const char *);
+
 #endif
@@ -134,6 +134,49 @@ static retvalue read_data_tar(/*@out@*/char **list, /*@out@*/size_t *size, const
 }
 
 
+/* the compression of a member called prefix + suffix,
+ * c_COUNT if the suffix is unknown */
+static enum compression membercompression(const char *filename, size_t prefixlen) {
+	enum compression c;
+
+	for (c = 0 ; c < c_COUNT ; c++) {
+		if (strcmp(filename + prefixlen, uncompression_suffix[c]) == 0)
+			break;
+	}
+	return c;
+}
+
+static retvalue read_data_member(/*@out@*/char **filelist, /*@out@*/size_t *size, const char *debfile, struct ar_archive *ar) {
+	struct archive *tar;
+	retvalue r;
+	bool got;
+	int a;
+
+	tar = archive_read_new();
+	r = read_data_tar(filelist, size, debfile, ar, tar);
+	got = RET_IS_OK(r);
+	a = archive_read_close(tar);
+	if (a != ARCHIVE_OK && !RET_WAS_ERROR(r)) {
+		int e = archive_errno(tar);
+		if (e == -EINVAL)
+			fprintf(stderr,
+"reading data.tar within '%s' failed: %s\n",
+				debfile, archive_error_string(tar));
+		else
+			fprintf(stderr,
+"reading data.tar within '%s' failed: %d:%d:%s\n", debfile, a, e,
+				archive_error_string(tar));
+		r = RET_ERROR;
+	}
+	a = archive_read_free(tar);
+	if (a != ARCHIVE_OK && !RET_WAS_ERROR(r)) {
+		r = RET_ERROR;
+	}
+	if (RET_WAS_ERROR(r) && got)
+		free(*filelist);
+	return r;
+}
+
 retvalue getfilelist(/*@out@*/char **filelist, size_t *size, const char *debfile) {
 	struct ar_archive *ar;
 	retvalue r;
@@ -154,43 +197,15 @@ retvalue getfilelist(/*@out@*/char **filelist, size_t *size, const char *debfile
 				continue;
 			}
 			hadcandidate = true;
-			for (c = 0 ; c < c_COUNT ; c++) {
-				if (strcmp(filename + 8,
-						uncompression_suffix[c]) == 0)
-					break;
-			}
+			c = membercompression(filename, 8);
 			if (c >= c_COUNT) {
 				free(filename);
 				continue;
 			}
 			ar_archivemember_setcompression(ar, c);
 			if (uncompression_supported(c)) {
-				struct archive *tar;
-				int a;
-
-				tar = archive_read_new();
-				r = read_data_tar(filelist, size,
-						debfile, ar, tar);
-				a = archive_read_close(tar);
-				if (a != ARCHIVE_OK && !RET_WAS_ERROR(r)) {
-					int e = archive_errno(tar);
-					if (e == -EINVAL)
-						fprintf(stderr,
-"reading data.tar within '%s' failed: %s\n",
-							debfile,
-							archive_error_string(
-								tar));
-					else
-						fprintf(stderr,
-"reading data.tar within '%s' failed: %d:%d:%s\n", debfile, a, e,
-							archive_error_string(
-								tar));
-					r = RET_ERROR;
-				}
-				a = archive_read_free(tar);
-				if (a != ARCHIVE_OK && !RET_WAS_ERROR(r)) {
-					r = RET_ERROR;
-				}
+				r = read_data_member(filelist, size,
+						debfile, ar);
 				if (r != RET_NOTHING) {
 					ar_close(ar);
 					free(filename);
@@ -210,3 +225,92 @@ retvalue getfilelist(/*@out@*/char **filelist, size_t *size, const char *debfile
 "Could not find a data.tar file within '%s'!\n", debfile);
 	return RET_ERROR_MISSING;
 }
+
+/* like extractcontrol and getfilelist, but reading the file only once
+ * (control.tar is always before data.tar within a .deb).
+ * Problems with data.tar only cause a warning and *filelist to be NULL,
+ * as the file list is not needed to include the package. */
+retvalue extractcontrolandfilelist(char **control, char **filelist, size_t *size, const char *debfile) {
+	struct ar_archive *ar;
+	retvalue r;
+	char *c_control = NULL, *c_filelist = NULL;
+	size_t c_size = 0;
+	bool hadcontrol = false, haddata = false, dataerror = false;
+
+	if (filelist == NULL)
+		return extractcontrol(control, debfile);
+
+	r = ar_open(&ar, debfile);
+	if (RET_WAS_ERROR(r))
+		return r;
+	assert (r != RET_NOTHING);
+	do {
+		char *filename;
+		enum compression c;
+
+		r = ar_nextmember(ar, &filename);
+		if (!RET_IS_OK(r))
+			break;
+		if (c_control == NULL &&
+				strncmp(filename, "control.tar", 11) == 0) {
+			hadcontrol = true;
+			c = membercompression(filename, 11);
+			if (c < c_COUNT && uncompression_supported(c)) {
+				ar_archivemember_setcompression(ar, c);
+				r = ar_readcontrolmember(&c_control,
+						debfile, ar);
+			}
+		} else if (c_filelist == NULL && !dataerror &&
+				strncmp(filename, "data.tar", 8) == 0) {
+			haddata = true;
+			c = membercompression(filename, 8);
+			if (c < c_COUNT && uncompression_supported(c)) {
+				ar_archivemember_setcompression(ar, c);
+				r = read_data_member(&c_filelist, &c_size,
+						debfile, ar);
+				if (RET_WAS_ERROR(r) &&
+						r != RET_ERROR_OOM &&
+						r != RET_ERROR_INTERRUPTED) {
+					dataerror = true;
+					r = RET_NOTHING;
+				}
+			}
+		}
+		free(filename);
+		if (RET_WAS_ERROR(r))
+			break;
+		/* RET_NOTHING here means end of file */
+		r = RET_OK;
+	} while (c_control == NULL || (c_filelist == NULL && !dataerror));
+	ar_close(ar);
+	if (!RET_WAS_ERROR(r) && c_control == NULL) {
+		if (hadcontrol)
+			fprintf(stderr,
+"Could not find a suitable control.tar file within '%s'!\n", debfile);
+		else
+			fprintf(stderr,
+"Could not find a control.tar file within '%s'!\n", debfile);
+		r = RET_ERROR_MISSING;
+	}
+	if (RET_WAS_ERROR(r)) {
+		free(c_control);
+		free(c_filelist);
+		return r;
+	}
+	if (c_filelist == NULL) {
+		if (dataerror)
+			fprintf(stderr,
+"Warning: could not read the file list of '%s'!\n", debfile);
+		else if (haddata)
+			fprintf(stderr,
+"Warning: could not find a suitable data.tar file within '%s'!\n",
+				debfile);
+		else
+			fprintf(stderr,
+"Warning: could not find a data.tar file within '%s'!\n", debfile);
+	}
+	*control = c_control;
+	*filelist = c_filelist;
+	*size = c_size;
+	return RET_OK;
+}
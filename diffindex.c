@@ -160,9 +160,10 @@ static inline retvalue add_history(const char *diffindexfile, struct diffindex *
 
 retvalue diffindex_read(const char *diffindexfile, struct diffindex **out_p) {
 	retvalue r;
-	char *chunk, *current;
+	char *chunk, *current, *precedence;
 	struct strlist history, patches;
 	struct diffindex *n;
+	bool merged;
 
 	r = readtextfile(diffindexfile, diffindexfile, &chunk, NULL);
 	ASSERT_NOT_NOTHING(r);
@@ -189,6 +190,16 @@ retvalue diffindex_read(const char *diffindexfile, struct diffindex **out_p) {
 		strlist_done(&history);
 		return r;
 	}
+	r = chunk_getvalue(chunk, "X-Patch-Precedence", &precedence);
+	if (RET_WAS_ERROR(r)) {
+		free(chunk);
+		strlist_done(&history);
+		strlist_done(&patches);
+		return r;
+	}
+	merged = RET_IS_OK(r) && strcmp(precedence, "merged") == 0;
+	if (RET_IS_OK(r))
+		free(precedence);
 	r = chunk_getvalue(chunk, "SHA1-Current", &current);
 	free(chunk);
 	if (r == RET_NOTHING) {
@@ -210,6 +221,7 @@ retvalue diffindex_read(const char *diffindexfile, struct diffindex **out_p) {
 		return r;
 	}
 	n->patchcount = patches.count;
+	n->merged = merged;
 	r = add_current(diffindexfile, n, current);
 	if (RET_IS_OK(r))
 		r = add_patches(diffindexfile, n, &patches);
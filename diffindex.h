@@ -3,6 +3,9 @@
 
 struct diffindex {
 	struct checksums *destination;
+	/* X-Patch-Precedence: merged, i.e. every patch results in the
+	 * destination instead of the state of the next one */
+	bool merged;
 	int patchcount;
 	struct diffindex_patch {
 		struct checksums *frompackages;
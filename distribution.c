@@ -40,6 +40,7 @@
 #include "configparser.h"
 #include "byhandhook.h"
 #include "package.h"
+#include "workers.h"
 #include "distribution.h"
 
 static retvalue distribution_free(struct distribution *distribution) {
@@ -440,6 +441,7 @@ CFallSETPROC(distribution, origin)
 CFallSETPROC(distribution, notautomatic)
 CFallSETPROC(distribution, butautomaticupgrades)
 CFtruthSETPROC2(distribution, readonly, readonly)
+CFtruthSETPROC2(distribution, sharearchall, sharearchall)
 CFallSETPROC(distribution, label)
 CFallSETPROC(distribution, description)
 CFallSETPROC(distribution, signed_by)
@@ -515,6 +517,7 @@ CFUSETPROC(distribution, byhandhooks) {
 static const struct constant exportnames[deo_COUNT+1] = {
 	{"noexport", deo_noexport},
 	{"keepunknown", deo_keepunknown},
+	{"binaryall", deo_binaryall},
 	{NULL, 0}
 };
 
@@ -522,7 +525,7 @@ CFUSETPROC(distribution, exportoptions) {
 	CFSETPROCVAR(distribution, d);
 	return config_getflags(iter, name, exportnames, d->exportoptions,
 			IGNORABLE(unknownfield),
-			"(allowed values: noexport, keepunknown)");
+			"(allowed values: noexport, keepunknown, binaryall)");
 }
 
 static const struct configfield distributionconfigfields[] = {
@@ -554,6 +557,7 @@ static const struct configfield distributionconfigfields[] = {
 	CF("Pull",		distribution,	pulls),
 	CF("ReadOnly",		distribution,	readonly),
 	CF("ExportOptions",	distribution,	exportoptions),
+	CF("ShareArchitectureAll", distribution, sharearchall),
 	CF("SignWith",		distribution,	signwith),
 	CF("Suite",		distribution,	suite),
 	CF("Tracking",		distribution,	Tracking),
@@ -613,6 +617,11 @@ retvalue distribution_readall(struct distribution **distributions) {
 
 /* call <action> for each package */
 retvalue package_foreach(struct distribution *distribution, const struct atomlist *components, const struct atomlist *architectures, const struct atomlist *packagetypes, action_each_package action, action_each_target target_action, void *data) {
+	return package_foreach_prefix(distribution, components, architectures,
+			packagetypes, NULL, action, target_action, data);
+}
+
+retvalue package_foreach_prefix(struct distribution *distribution, const struct atomlist *components, const struct atomlist *architectures, const struct atomlist *packagetypes, const char *prefix, action_each_package action, action_each_target target_action, void *data) {
 	retvalue result, r;
 	struct target *t;
 	struct package_cursor iterator;
@@ -628,7 +637,8 @@ retvalue package_foreach(struct distribution *distribution, const struct atomlis
 			if (r == RET_NOTHING)
 				continue;
 		}
-		r = package_openiterator(t, READONLY, true, &iterator);
+		r = package_openprefixiterator(t, READONLY, true, prefix,
+				&iterator);
 		RET_UPDATE(result, r);
 		if (RET_WAS_ERROR(r))
 			return result;
@@ -826,6 +836,66 @@ retvalue distribution_get(struct distribution *alldistributions, const char *nam
 	return RET_OK;
 }
 
+/* the architecture all packages of binary targets are exported into a
+ * common binary-all index once per component (when reaching the first
+ * target of that component) if so requested */
+static retvalue export_binaryall(struct distribution *distribution, struct target *first, bool onlyneeded, bool snapshot, struct release *release) {
+	struct target *target, **targets;
+	const char *slash;
+	char *relativedirectory;
+	bool modified = false;
+	int count = 0;
+	retvalue r;
+
+	if (!target_hasarchallindex(first))
+		return RET_NOTHING;
+	for (target = distribution->targets ; target != first ;
+	                                      target = target->next) {
+		if (target->component == first->component &&
+				target_hasarchallindex(target))
+			return RET_NOTHING;
+	}
+	for (target = first ; target != NULL ; target = target->next) {
+		if (target->component == first->component &&
+				target_hasarchallindex(target))
+			count++;
+	}
+	targets = nNEW(count, struct target *);
+	if (FAILEDTOALLOC(targets))
+		return RET_ERROR_OOM;
+	count = 0;
+	for (target = first ; target != NULL ; target = target->next) {
+		if (target->component == first->component &&
+				target_hasarchallindex(target)) {
+			targets[count++] = target;
+			modified = modified || target->wasmodified;
+		}
+	}
+	/* <component>/binary-<arch> -> <component>/binary-all */
+	slash = strrchr(first->relativedirectory, '/');
+	assert (slash != NULL);
+	relativedirectory = mprintf("%.*s/binary-all",
+			(int)(slash - first->relativedirectory),
+			first->relativedirectory);
+	if (FAILEDTOALLOC(relativedirectory)) {
+		free(targets);
+		return RET_ERROR_OOM;
+	}
+	r = release_mkdir(release, relativedirectory);
+	if (!RET_WAS_ERROR(r))
+		r = export_archall(relativedirectory, count, targets,
+				first->exportmode, release,
+				onlyneeded && !modified, snapshot);
+	if (!RET_WAS_ERROR(r) && first->exportmode->release != NULL)
+		r = release_directorydescription(release, distribution,
+				relativedirectory, first->component,
+				architecture_all, first->exportmode->release,
+				onlyneeded);
+	free(relativedirectory);
+	free(targets);
+	return r;
+}
+
 retvalue distribution_snapshot(struct distribution *distribution, const char *name) {
 	struct target *target;
 	retvalue result, r;
@@ -841,6 +911,11 @@ retvalue distribution_snapshot(struct distribution *distribution, const char *na
 	result = RET_NOTHING;
 	for (target=distribution->targets; target != NULL ;
 	                                   target = target->next) {
+		r = export_binaryall(distribution, target, false, true,
+				release);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
 		r = release_mkdir(release, target->relativedirectory);
 		RET_ENDUPDATE(result, r);
 		if (RET_WAS_ERROR(r))
@@ -851,8 +926,9 @@ retvalue distribution_snapshot(struct distribution *distribution, const char *na
 			break;
 		if (target->exportmode->release != NULL) {
 			r = release_directorydescription(release, distribution,
-					target, target->exportmode->release,
-					false);
+					target->relativedirectory,
+					target->component, target->architecture,
+					target->exportmode->release, false);
 			RET_UPDATE(result, r);
 			if (RET_WAS_ERROR(r))
 				break;
@@ -880,16 +956,7 @@ retvalue distribution_snapshot(struct distribution *distribution, const char *na
 	return result;
 }
 
-static retvalue export(struct distribution *distribution, bool onlyneeded) {
-	struct target *target;
-	retvalue result, r;
-	struct release *release;
-
-	if (verbose >= 15)
-		fprintf(stderr, "trace: export(distribution={codename: %s}, onlyneeded=%s)\n",
-		        distribution->codename, onlyneeded ? "true" : "false");
-	assert (distribution != NULL);
-
+static retvalue export_check(struct distribution *distribution) {
 	if (distribution->exportoptions[deo_noexport])
 		return RET_NOTHING;
 
@@ -899,15 +966,24 @@ static retvalue export(struct distribution *distribution, bool onlyneeded) {
 				distribution->codename);
 		return RET_ERROR;
 	}
+	return RET_OK;
+}
 
-	r = release_init(&release, distribution->codename, distribution->suite,
-			distribution->fakecomponentprefix);
-	if (RET_WAS_ERROR(r))
-		return r;
+/* generate the index files of all targets, *done_p is set to the number
+ * of targets successfully exported */
+static retvalue export_targets(struct distribution *distribution, bool onlyneeded, struct release *release, /*@out@*/int *done_p) {
+	struct target *target;
+	retvalue result, r;
+	int done = 0;
 
 	result = RET_NOTHING;
 	for (target=distribution->targets; target != NULL ;
 	                                   target = target->next) {
+		r = export_binaryall(distribution, target, onlyneeded,
+				false, release);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
 		r = release_mkdir(release, target->relativedirectory);
 		RET_ENDUPDATE(result, r);
 		if (RET_WAS_ERROR(r))
@@ -916,15 +992,30 @@ static retvalue export(struct distribution *distribution, bool onlyneeded) {
 		RET_UPDATE(result, r);
 		if (RET_WAS_ERROR(r))
 			break;
+		done++;
 		if (target->exportmode->release != NULL) {
 			r = release_directorydescription(release, distribution,
-					target, target->exportmode->release,
-					onlyneeded);
+					target->relativedirectory,
+					target->component, target->architecture,
+					target->exportmode->release, onlyneeded);
 			RET_UPDATE(result, r);
 			if (RET_WAS_ERROR(r))
 				break;
 		}
 	}
+	*done_p = done;
+	return result;
+}
+
+/* generate Contents files and Release file and move everything in place */
+static retvalue export_finish(struct distribution *distribution, bool onlyneeded, /*@only@*/struct release *release, retvalue result) {
+	struct target *target;
+	retvalue r;
+
+	/* the export hooks add files to the release and their children
+	 * must not be reaped by something waiting for other children */
+	r = export_waithooks();
+	RET_UPDATE(result, r);
 	if (!RET_WAS_ERROR(result) && distribution->contents.flags.enabled) {
 		r = contents_generate(distribution, release, onlyneeded);
 	}
@@ -963,10 +1054,203 @@ static retvalue export(struct distribution *distribution, bool onlyneeded) {
 	return result;
 }
 
+static retvalue export(struct distribution *distribution, bool onlyneeded) {
+	retvalue result, r;
+	struct release *release;
+	int done;
+
+	if (verbose >= 15)
+		fprintf(stderr, "trace: export(distribution={codename: %s}, onlyneeded=%s)\n",
+		        distribution->codename, onlyneeded ? "true" : "false");
+	assert (distribution != NULL);
+
+	r = export_check(distribution);
+	if (!RET_IS_OK(r))
+		return r;
+
+	r = release_init(&release, distribution->codename, distribution->suite,
+			distribution->fakecomponentprefix);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	result = export_targets(distribution, onlyneeded, release, &done);
+	return export_finish(distribution, onlyneeded, release, result);
+}
+
+/* Exporting multiple distributions in worker processes:
+ * The index files are generated in the workers (which only read the
+ * database, using their own environment), everything else (Contents
+ * files, which may need to update the contents cache, signing the
+ * Release files, updating the release cache and moving the files in
+ * place) is done here afterwards, one distribution after the other. */
+
+struct exportjob {
+	struct distribution *distribution;
+	/*@null@*/struct release *release;
+	bool onlyneeded;
+	/* number of targets the worker exported */
+	int targetsdone;
+	retvalue result;
+};
+
+static retvalue exportjob_run(void *privdata, char **data_p, size_t *len_p) {
+	struct exportjob *job = privdata;
+	struct target *target;
+	retvalue result, r;
+	char *data;
+	size_t len;
+	int done = 0;
+
+	/* nothing opened by the parent may be used in this process */
+	r = database_forked();
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = release_forked(job->release, job->distribution->codename);
+	if (RET_WAS_ERROR(r))
+		return r;
+	for (target = job->distribution->targets ; target != NULL ;
+			target = target->next) {
+		target->packages = NULL;
+		target->sharedpackages = NULL;
+	}
+
+	result = export_targets(job->distribution, job->onlyneeded,
+			job->release, &done);
+	r = export_waithooks();
+	RET_UPDATE(result, r);
+	/* the files generated so far are needed in the parent in every case,
+	 * if only to delete them again */
+	r = release_serialize(job->release, &data, &len);
+	if (RET_WAS_ERROR(r))
+		return r;
+	*data_p = realloc(data, len + sizeof(int));
+	if (FAILEDTOALLOC(*data_p)) {
+		free(data);
+		return RET_ERROR_OOM;
+	}
+	data = *data_p;
+	memmove(data + sizeof(int), data, len);
+	memcpy(data, &done, sizeof(int));
+	*len_p = len + sizeof(int);
+	return result;
+}
+
+static retvalue exportjob_done(void *privdata, retvalue r, const char *data, size_t len) {
+	struct exportjob *job = privdata;
+
+	job->result = r;
+	if (data == NULL || len <= sizeof(int)) {
+		if (!RET_WAS_ERROR(r))
+			job->result = RET_ERROR;
+		return RET_NOTHING;
+	}
+	memcpy(&job->targetsdone, data, sizeof(int));
+	r = release_deserialize(job->release, data + sizeof(int),
+			len - sizeof(int));
+	RET_UPDATE(job->result, r);
+	return RET_OK;
+}
+
+static retvalue export_parallel(struct distribution **distributions, int count, bool onlyneeded) {
+	struct exportjob *jobs;
+	struct workers *workers;
+	struct target *target;
+	retvalue result, r;
+	int i, j;
+
+	jobs = nzNEW(count, struct exportjob);
+	if (FAILEDTOALLOC(jobs))
+		return RET_ERROR_OOM;
+	/* everything possibly changing the database (like creating the
+	 * release caches) is done before starting the workers */
+	for (i = 0 ; i < count ; i++) {
+		struct distribution *d = distributions[i];
+
+		jobs[i].distribution = d;
+		jobs[i].onlyneeded = onlyneeded;
+		r = export_check(d);
+		if (RET_IS_OK(r))
+			r = release_init(&jobs[i].release, d->codename,
+					d->suite, d->fakecomponentprefix);
+		if (!RET_IS_OK(r))
+			jobs[i].release = NULL;
+		jobs[i].result = r;
+	}
+	r = database_sync();
+	if (!RET_WAS_ERROR(r))
+		r = workers_init(&workers, global.jobs);
+	if (RET_WAS_ERROR(r)) {
+		for (i = 0 ; i < count ; i++) {
+			if (jobs[i].release != NULL)
+				release_free(jobs[i].release);
+		}
+		free(jobs);
+		return r;
+	}
+	for (i = 0 ; i < count ; i++) {
+		if (jobs[i].release == NULL)
+			continue;
+		if (verbose >= 15)
+			fprintf(stderr,
+"trace: export(distribution={codename: %s}, onlyneeded=%s) in worker\n",
+				distributions[i]->codename,
+				onlyneeded ? "true" : "false");
+		r = workers_start(workers, exportjob_run, exportjob_done,
+				&jobs[i]);
+		if (RET_WAS_ERROR(r)) {
+			for (j = i ; j < count ; j++)
+				jobs[j].result = r;
+			break;
+		}
+	}
+	r = workers_finish(workers);
+	if (RET_WAS_ERROR(r)) {
+		for (i = 0 ; i < count ; i++)
+			RET_UPDATE(jobs[i].result, r);
+	}
+
+	result = RET_NOTHING;
+	for (i = 0 ; i < count ; i++) {
+		struct exportjob *job = &jobs[i];
+
+		if (job->release == NULL) {
+			RET_UPDATE(result, job->result);
+			continue;
+		}
+		/* what target_export did in the worker: */
+		for (j = 0, target = job->distribution->targets ;
+				j < job->targetsdone && target != NULL ;
+				j++, target = target->next) {
+			target->saved_wasmodified =
+				target->saved_wasmodified || target->wasmodified;
+			target->wasmodified = false;
+		}
+		r = export_finish(job->distribution, onlyneeded,
+				job->release, job->result);
+		RET_UPDATE(result, r);
+	}
+	free(jobs);
+	return result;
+}
+
 retvalue distribution_fullexport(struct distribution *distribution) {
 	return export(distribution, false);
 }
 
+retvalue distribution_fullexportmany(struct distribution **distributions, int count) {
+	retvalue result, r;
+	int i;
+
+	if (count > 1 && global.jobs > 1)
+		return export_parallel(distributions, count, false);
+	result = RET_NOTHING;
+	for (i = 0 ; i < count ; i++) {
+		r = export(distributions[i], false);
+		RET_UPDATE(result, r);
+	}
+	return result;
+}
+
 retvalue distribution_freelist(struct distribution *distributions) {
 	retvalue result, r;
 
@@ -984,6 +1268,8 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 	retvalue result, r;
 	bool todo = false;
 	struct distribution *d;
+	struct distribution **queue = NULL;
+	int count, queued;
 
 	if (verbose >= 15)
 		fprintf(stderr, "trace: distribution_exportlist() called.\n");
@@ -1016,6 +1302,17 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 	if (verbose >= 0 && todo)
 		printf("Exporting indices...\n");
 
+	/* with --jobs, collect them to export them in parallel */
+	if (global.jobs > 1 && todo) {
+		count = 0;
+		for (d = distributions ; d != NULL ; d = d->next)
+			count++;
+		queue = nNEW(count, struct distribution *);
+		if (FAILEDTOALLOC(queue))
+			return RET_ERROR_OOM;
+	}
+	queued = 0;
+
 	result = RET_NOTHING;
 	for (d=distributions; d != NULL; d = d->next) {
 		if (verbose >= 20)
@@ -1057,6 +1354,10 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 "Please report this and how you got this message as bugreport. Thanks.\n"
 "Doing a export despite --export=changed....\n",
 						d->codename);
+					if (queue != NULL) {
+						queue[queued++] = d;
+						break;
+					}
 					r = export(d, true);
 					RET_UPDATE(result, r);
 					break;
@@ -1067,10 +1368,22 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 					(d->status == RET_NOTHING &&
 					  when != EXPORT_CHANGED) ||
 					when == EXPORT_FORCE);
+			if (queue != NULL) {
+				queue[queued++] = d;
+				continue;
+			}
 			r = export(d, true);
 			RET_UPDATE(result, r);
 		}
 	}
+	if (queued == 1) {
+		r = export(queue[0], true);
+		RET_UPDATE(result, r);
+	} else if (queued > 0) {
+		r = export_parallel(queue, queued, true);
+		RET_UPDATE(result, r);
+	}
+	free(queue);
 	return result;
 }
 
@@ -1193,9 +1506,37 @@ retvalue distribution_prepareforwriting(struct distribution *distribution) {
 
 /* delete every package decider returns RET_OK for */
 retvalue package_remove_each(struct distribution *distribution, const struct atomlist *components, const struct atomlist *architectures, const struct atomlist *packagetypes, action_each_package decider, struct trackingdata *trackingdata, void *data) {
+	return package_remove_each_prefix(distribution, components,
+			architectures, packagetypes, NULL,
+			decider, trackingdata, data);
+}
+
+static retvalue remove_iterated(struct distribution *distribution, struct package_cursor *iterator, action_each_package decider, struct trackingdata *trackingdata, void *data) {
+	retvalue result, r;
+
+	result = RET_NOTHING;
+	while (package_next(iterator)) {
+		r = decider(&iterator->current, data);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
+		if (RET_IS_OK(r)) {
+			r = package_remove_by_cursor(iterator,
+				distribution->logger, trackingdata);
+			RET_UPDATE(result, r);
+			RET_UPDATE(distribution->status, r);
+		}
+	}
+	r = package_closeiterator(iterator);
+	RET_ENDUPDATE(result, r);
+	return result;
+}
+
+static retvalue remove_each(struct distribution *distribution, const struct atomlist *components, const struct atomlist *architectures, const struct atomlist *packagetypes, const char *prefix, const struct strlist *sources, action_each_package decider, struct trackingdata *trackingdata, void *data) {
 	retvalue result, r;
 	struct target *t;
 	struct package_cursor iterator;
+	int i;
 
 	if (distribution->readonly) {
 		fprintf(stderr,
@@ -1208,26 +1549,52 @@ retvalue package_remove_each(struct distribution *distribution, const struct ato
 	for (t = distribution->targets ; t != NULL ; t = t->next) {
 		if (!target_matches(t, components, architectures, packagetypes))
 			continue;
-		r = package_openiterator(t, READWRITE, true, &iterator);
-		RET_UPDATE(result, r);
-		if (RET_WAS_ERROR(r))
-			return result;
-		while (package_next(&iterator)) {
-			r = decider(&iterator.current, data);
-			RET_UPDATE(result, r);
-			if (RET_WAS_ERROR(r))
-				break;
-			if (RET_IS_OK(r)) {
-				r = package_remove_by_cursor(&iterator,
-					distribution->logger, trackingdata);
+		i = 0;
+		if (sources != NULL) {
+			for (; i < sources->count ; i++) {
+				r = package_opensourceiterator(t, READWRITE,
+						sources->values[i], &iterator);
+				if (r == RET_NOTHING)
+					break;
 				RET_UPDATE(result, r);
-				RET_UPDATE(distribution->status, r);
+				if (RET_WAS_ERROR(r))
+					return result;
+				r = remove_iterated(distribution, &iterator,
+						decider, trackingdata, data);
+				RET_UPDATE(result, r);
+				if (RET_WAS_ERROR(result))
+					return result;
 			}
+			if (i >= sources->count)
+				continue;
+			/* no index, so look at everything, but only once
+			 * and not once for every source */
 		}
-		r = package_closeiterator(&iterator);
-		RET_ENDUPDATE(result, r);
+		r = package_openprefixiterator(t, READWRITE, true,
+				prefix, &iterator);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			return result;
+		r = remove_iterated(distribution, &iterator,
+				decider, trackingdata, data);
+		RET_UPDATE(result, r);
 		if (RET_WAS_ERROR(result))
 			return result;
 	}
 	return result;
 }
+
+retvalue package_remove_each_prefix(struct distribution *distribution, const struct atomlist *components, const struct atomlist *architectures, const struct atomlist *packagetypes, const char *prefix, action_each_package decider, struct trackingdata *trackingdata, void *data) {
+	return remove_each(distribution, components, architectures,
+			packagetypes, prefix, NULL,
+			decider, trackingdata, data);
+}
+
+/* only look at the packages of the given sources (if there is an index
+ * by source, otherwise at every package once), decider still has to
+ * check the source of every package */
+retvalue package_remove_each_source(struct distribution *distribution, const struct atomlist *components, const struct atomlist *architectures, const struct atomlist *packagetypes, const struct strlist *sources, action_each_package decider, struct trackingdata *trackingdata, void *data) {
+	return remove_each(distribution, components, architectures,
+			packagetypes, NULL, sources,
+			decider, trackingdata, data);
+}
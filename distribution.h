@@ -28,6 +28,7 @@ struct uploaders;
 enum exportoptions {
 	deo_noexport = 0,
 	deo_keepunknown,
+	deo_binaryall,
 	deo_COUNT,
 };
 
@@ -120,6 +121,8 @@ struct distribution {
 	bool selected;
 	/* forbid all writing operations and exports if true */
 	bool readonly;
+	/* store architecture all packages only once per component */
+	bool sharearchall;
 	/* tracking information might be obsolete */
 	bool needretrack;
 	/* omitted because of --onlysmalldeletes */
@@ -137,6 +140,8 @@ retvalue distribution_prepareforwriting(struct distribution *);
 /*@null@*//*@dependent@*/struct target *distribution_gettarget(const struct distribution *distribution, component_t, architecture_t, packagetype_t);
 
 retvalue distribution_fullexport(struct distribution *);
+/* the same for multiple distributions, with --jobs in parallel */
+retvalue distribution_fullexportmany(struct distribution **, int /*count*/);
 
 
 retvalue distribution_snapshot(struct distribution *, const char */*name*/);
@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
@@ -38,6 +40,7 @@
 #include "filecntl.h"
 #include "hooks.h"
 #include "package.h"
+#include "dpkgversions.h"
 
 static const char *exportdescription(const struct exportmode *mode, char *buffer, size_t buffersize) {
 	char *result = buffer;
@@ -50,6 +53,9 @@ static const char *exportdescription(const struct exportmode *mode, char *buffer
 #endif
 #ifdef HAVE_LIBLZMA
 		,"xzed"
+#endif
+#ifdef HAVE_LIBZSTD
+		,"zstded"
 #endif
 	};
 	bool needcomma = false,
@@ -126,8 +132,10 @@ static const char *exportdescription(const struct exportmode *mode, char *buffer
 
 retvalue exportmode_init(/*@out@*/struct exportmode *mode, bool uncompressed, /*@null@*/const char *release, const char *indexfile) {
 	strlist_init(&mode->hooks);
+	mode->batchedhooks = NULL;
 	mode->compressions = IC_FLAG(ic_gzip) | (uncompressed
 			? IC_FLAG(ic_uncompressed) : 0);
+	mode->rsyncable = false;
 	mode->filename = strdup(indexfile);
 	if (FAILEDTOALLOC(mode->filename))
 		return RET_ERROR_OOM;
@@ -145,6 +153,7 @@ retvalue exportmode_init(/*@out@*/struct exportmode *mode, bool uncompressed, /*
 retvalue exportmode_set(struct exportmode *mode, struct configiterator *iter) {
 	retvalue r;
 	char *word;
+	bool batched;
 
 	r = config_getword(iter, &word);
 	if (RET_WAS_ERROR(r))
@@ -217,6 +226,11 @@ retvalue exportmode_set(struct exportmode *mode, struct configiterator *iter) {
 #ifdef HAVE_LIBLZMA
 		else if (word[1] == 'x' && word[2] == 'z' &&word[3] == '\0')
 			mode->compressions |= IC_FLAG(ic_xz);
+#endif
+#ifdef HAVE_LIBZSTD
+		else if (word[1] == 'z' && word[2] == 's' && word[3] == 't' &&
+				word[4] == '\0')
+			mode->compressions |= IC_FLAG(ic_zstd);
 #endif
 		else {
 			fprintf(stderr,
@@ -234,8 +248,16 @@ retvalue exportmode_set(struct exportmode *mode, struct configiterator *iter) {
 		if (RET_WAS_ERROR(r))
 			return r;
 	}
+	mode->rsyncable = false;
+	batched = false;
 	while (r != RET_NOTHING) {
-		if (word[0] == '.') {
+		if (strcmp(word, "--batched") == 0) {
+			free(word);
+			batched = true;
+		} else if (strcmp(word, "--rsyncable") == 0) {
+			free(word);
+			mode->rsyncable = true;
+		} else if (word[0] == '.') {
 			fprintf(stderr,
 "Error parsing %s, line %u, column %u:\n"
 "Scripts starting with dot are forbidden to avoid ambiguity ('%s')!\n"
@@ -248,16 +270,36 @@ retvalue exportmode_set(struct exportmode *mode, struct configiterator *iter) {
 			return RET_ERROR;
 		} else {
 			char *fullfilename = configfile_expandname(word, word);
+			bool *n;
+
 			if (FAILEDTOALLOC(fullfilename))
 				return RET_ERROR_OOM;
+			n = realloc(mode->batchedhooks,
+					(mode->hooks.count + 1) * sizeof(bool));
+			if (FAILEDTOALLOC(n)) {
+				free(fullfilename);
+				return RET_ERROR_OOM;
+			}
+			mode->batchedhooks = n;
 			r = strlist_add(&mode->hooks, fullfilename);
 			if (RET_WAS_ERROR(r))
 				return r;
+			n[mode->hooks.count - 1] = batched;
+			batched = false;
 		}
 		r = config_getword(iter, &word);
 		if (RET_WAS_ERROR(r))
 			return r;
 	}
+	if (batched) {
+		fprintf(stderr,
+"Error parsing %s, line %u, column %u:\n"
+"--batched must be followed by the script to call!\n",
+				config_filename(iter),
+				config_markerline(iter),
+				config_markercolumn(iter));
+		return RET_ERROR;
+	}
 	return RET_OK;
 }
 
@@ -307,21 +349,343 @@ static retvalue gotfilename(const char *relname, size_t l, struct release *relea
 	}
 }
 
-static retvalue callexporthook(/*@null@*/const char *hook, const char *relfilename, const char *mode, struct release *release) {
-	pid_t f, c;
-	int status;
-	int io[2];
-	char buffer[1000];
-	int already = 0;
+/* Export hooks are run in the background while the next index files are
+ * generated, at most --jobs (but at least one) at the same time.
+ * A hook marked with --batched is only started once (with the single
+ * argument "batch") and gets the arguments for each index file written
+ * to its stdin as four null-terminated strings. It reports the files
+ * on fd 3 as usual, followed by an empty line once it is done with
+ * that index file.
+ * To get the same Release file as when calling them one after the
+ * other, the files reported by a hook are only added when all hooks
+ * called earlier are done, at the place the hook was called at. */
+
+struct hookprocess {
+	struct hookprocess *next;
+	char *hook;
+	/*@dependent@*/struct release *release;
+	pid_t child;
+	bool batched;
+	/* stdin of a batched hook, -1 otherwise or when closed */
+	int infd;
+	/* fd 3 of the hook, -1 once everything is read */
+	int outfd;
+	char *buffer;
+	size_t len, size;
+};
+
+static struct hookrequest {
+	struct hookrequest *next;
+	/* NULL once done */
+	/*@null@*//*@dependent@*/struct hookprocess *process;
+	/*@dependent@*/struct release *release;
+	/*@null@*//*@dependent@*/struct release_entry *position;
+	/* the files reported so far */
+	struct strlist filenames;
+	retvalue result;
+} *hookrequests = NULL, *lasthookrequest = NULL;
+
+static struct hookprocess *hookprocesses = NULL;
+/* number of requests not yet done */
+static int hooksrunning = 0;
+/* all errors of hooks already done */
+static retvalue hooksresult = RET_NOTHING;
+
+static void hookrequest_done(struct hookrequest *r, retvalue result) {
+	assert (r->process != NULL);
+	r->process = NULL;
+	RET_UPDATE(r->result, result);
+	hooksrunning--;
+}
+
+/* the oldest request a process is not yet done with */
+static struct hookrequest *hookprocess_request(const struct hookprocess *p) {
+	struct hookrequest *r;
 
-	if (hook == NULL)
+	for (r = hookrequests ; r != NULL ; r = r->next) {
+		if (r->process == p)
+			return r;
+	}
+	return NULL;
+}
+
+static retvalue hookprocess_gotline(struct hookprocess *p, const char *line, size_t len) {
+	struct hookrequest *r;
+	char *filename;
+
+	while (len > 0 && xisspace(*line)) {
+		line++;
+		len--;
+	}
+	while (len > 0 && xisspace(line[len - 1]))
+		len--;
+	r = hookprocess_request(p);
+	if (len == 0) {
+		/* empty lines are ignored, but end an reply from
+		 * batched hooks */
+		if (p->batched && r != NULL)
+			hookrequest_done(r, RET_OK);
 		return RET_NOTHING;
+	}
+	if (r == NULL) {
+		fprintf(stderr,
+"Unexpected output '%.*s' from exporthook '%s'!\n",
+				(int)len, line, p->hook);
+		return RET_ERROR;
+	}
+	filename = strndup(line, len);
+	if (FAILEDTOALLOC(filename))
+		return RET_ERROR_OOM;
+	return strlist_add(&r->filenames, filename);
+}
+
+/* read what is available, returns RET_OK at end of file */
+static retvalue hookprocess_read(struct hookprocess *p) {
+	retvalue result = RET_NOTHING, r;
+	ssize_t got;
+	size_t last, j;
+
+	if (p->size - p->len < 1000) {
+		char *n = realloc(p->buffer, p->size + 4096);
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		p->buffer = n;
+		p->size += 4096;
+	}
+	got = read(p->outfd, p->buffer + p->len, p->size - p->len - 1);
+	if (got < 0) {
+		int e = errno;
+		if (e == EINTR || e == EAGAIN)
+			return RET_NOTHING;
+		fprintf(stderr, "Error %d reading from exporthook: %s!\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	p->len += got;
+	if (got == 0)
+		/* the last line might not be terminated */
+		p->buffer[p->len++] = '\0';
+	last = 0;
+	for (j = 0 ; j < p->len ; j++) {
+		if (p->buffer[j] != '\n' && p->buffer[j] != '\0')
+			continue;
+		r = hookprocess_gotline(p, p->buffer + last, j - last);
+		RET_UPDATE(result, r);
+		last = j + 1;
+	}
+	if (last > 0) {
+		if (p->len > last)
+			memmove(p->buffer, p->buffer + last, p->len - last);
+		p->len -= last;
+	}
+	if (RET_WAS_ERROR(result))
+		return result;
+	return (got == 0)?RET_OK:RET_NOTHING;
+}
+
+/* everything is read from the hook, so wait for it to exit */
+static void hookprocess_reap(struct hookprocess *p, retvalue result) {
+	struct hookprocess **pp;
+	struct hookrequest *r;
+	pid_t c;
+	int status;
+
+	(void)close(p->outfd);
+	p->outfd = -1;
+	if (p->infd >= 0) {
+		(void)close(p->infd);
+		p->infd = -1;
+	}
+	do {
+		c = waitpid(p->child, &status, 0);
+	} while (c < 0 && errno == EINTR);
+	if (c < 0) {
+		int e = errno;
+		fprintf(stderr,
+"Error %d while waiting for hook '%s' to finish: %s\n", e, p->hook, strerror(e));
+		RET_UPDATE(result, RET_ERRNO(e));
+	} else if (WIFEXITED(status)) {
+		if (WEXITSTATUS(status) == 0) {
+			if (verbose > 6)
+				printf("Exporthook successfully returned!\n");
+		} else {
+			fprintf(stderr,
+"Exporthook failed with exitcode %d!\n",
+					(int)WEXITSTATUS(status));
+			RET_UPDATE(result, RET_ERROR);
+		}
+	} else if (WIFSIGNALED(status)) {
+		fprintf(stderr, "Exporthook killed by signal %d!\n",
+				(int)(WTERMSIG(status)));
+		RET_UPDATE(result, RET_ERROR);
+	} else {
+		fprintf(stderr,
+"Exporthook terminated abnormally. (status is %x)!\n",
+				status);
+		RET_UPDATE(result, RET_ERROR);
+	}
+	while ((r = hookprocess_request(p)) != NULL) {
+		if (p->batched && !RET_WAS_ERROR(result)) {
+			fprintf(stderr,
+"Exporthook '%s' exited before it was done with all files!\n",
+					p->hook);
+			result = RET_ERROR;
+		}
+		hookrequest_done(r, RET_IS_OK(result)?RET_OK:result);
+	}
+	/* batched hooks can fail after all their requests are done: */
+	RET_UPDATE(hooksresult, result);
 
-	status = pipe(io);
-	if (status < 0) {
+	pp = &hookprocesses;
+	while (*pp != p)
+		pp = &(*pp)->next;
+	*pp = p->next;
+	free(p->hook);
+	free(p->buffer);
+	free(p);
+}
+
+/* add the files of all hooks done in the order they were called */
+static void exporthooks_report(void) {
+	struct hookrequest *r, *o;
+	struct release_entry *last;
+	retvalue ret;
+	int i;
+
+	while ((r = hookrequests) != NULL && r->process == NULL) {
+		hookrequests = r->next;
+		if (hookrequests == NULL)
+			lasthookrequest = NULL;
+		release_insertafter(r->release, r->position);
+		for (i = 0 ; i < r->filenames.count ; i++) {
+			const char *filename = r->filenames.values[i];
+
+			if (RET_WAS_ERROR(r->result))
+				break;
+			ret = gotfilename(filename, strlen(filename),
+					r->release);
+			RET_UPDATE(r->result, ret);
+		}
+		last = release_endinsert(r->release);
+		/* hooks called for the same position come after this one */
+		for (o = hookrequests ; o != NULL ; o = o->next) {
+			if (o->release == r->release
+					&& o->position == r->position)
+				o->position = last;
+		}
+		RET_UPDATE(hooksresult, r->result);
+		strlist_done(&r->filenames);
+		free(r);
+	}
+}
+
+/* wait till some hook has something to say */
+static retvalue exporthooks_poll(void) {
+	struct pollfd *polldata;
+	struct hookprocess *p, *n;
+	int count, i, ret;
+	retvalue r;
+
+	count = 0;
+	for (p = hookprocesses ; p != NULL ; p = p->next)
+		count++;
+	assert (count > 0);
+	polldata = nNEW(count, struct pollfd);
+	if (FAILEDTOALLOC(polldata))
+		return RET_ERROR_OOM;
+	for (p = hookprocesses, i = 0 ; p != NULL ; p = p->next, i++) {
+		polldata[i].fd = p->outfd;
+		polldata[i].events = POLLIN;
+		polldata[i].revents = 0;
+	}
+	ret = poll(polldata, count, -1);
+	if (ret < 0) {
+		int e = errno;
+
+		free(polldata);
+		if (e == EINTR)
+			return RET_NOTHING;
+		fprintf(stderr, "Error %d waiting for exporthooks: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	for (p = hookprocesses, i = 0 ; p != NULL ; p = n, i++) {
+		n = p->next;
+		assert (polldata[i].fd == p->outfd);
+		if (polldata[i].revents == 0)
+			continue;
+		r = hookprocess_read(p);
+		if (r != RET_NOTHING)
+			hookprocess_reap(p, r);
+	}
+	free(polldata);
+	exporthooks_report();
+	return RET_OK;
+}
+
+retvalue export_waithooks(void) {
+	struct hookprocess *p;
+	retvalue result, r;
+
+	/* batched hooks exit once they got everything */
+	for (p = hookprocesses ; p != NULL ; p = p->next) {
+		if (p->infd >= 0) {
+			(void)close(p->infd);
+			p->infd = -1;
+		}
+	}
+	result = RET_NOTHING;
+	while (hookprocesses != NULL) {
+		r = exporthooks_poll();
+		if (RET_WAS_ERROR(r)) {
+			/* cannot wait properly, so at least do not
+			 * leave zombies behind */
+			while (hookprocesses != NULL)
+				hookprocess_reap(hookprocesses, r);
+			result = r;
+		}
+	}
+	exporthooks_report();
+	assert (hookrequests == NULL && hooksrunning == 0);
+	RET_UPDATE(hooksresult, result);
+	result = hooksresult;
+	hooksresult = RET_NOTHING;
+	return result;
+}
+
+static retvalue hookprocess_start(const char *hook, const char *relfilename, const char *mode, struct release *release, bool batched, /*@out@*/struct hookprocess **process_p) {
+	struct hookprocess *p;
+	pid_t f;
+	int io[2], in[2];
+
+	p = zNEW(struct hookprocess);
+	if (FAILEDTOALLOC(p))
+		return RET_ERROR_OOM;
+	p->hook = strdup(hook);
+	if (FAILEDTOALLOC(p->hook)) {
+		free(p);
+		return RET_ERROR_OOM;
+	}
+	p->release = release;
+	p->batched = batched;
+	p->infd = -1;
+
+	if (pipe(io) < 0) {
 		int e = errno;
 		fprintf(stderr, "Error %d creating pipe: %s!\n",
 				e, strerror(e));
+		free(p->hook);
+		free(p);
+		return RET_ERRNO(e);
+	}
+	if (batched && pipe(in) < 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d creating pipe: %s!\n",
+				e, strerror(e));
+		(void)close(io[0]);
+		(void)close(io[1]);
+		free(p->hook);
+		free(p);
 		return RET_ERRNO(e);
 	}
 
@@ -330,14 +694,26 @@ static retvalue callexporthook(/*@null@*/const char *hook, const char *relfilena
 		int e = errno;
 		(void)close(io[0]);
 		(void)close(io[1]);
+		if (batched) {
+			(void)close(in[0]);
+			(void)close(in[1]);
+		}
 		fprintf(stderr, "Error %d while forking for exporthook: %s\n",
 				e, strerror(e));
+		free(p->hook);
+		free(p);
 		return RET_ERRNO(e);
 	}
 	if (f == 0) {
 		char *reltmpfilename;
 		int e;
 
+		if (batched && dup2(in[0], 0) < 0) {
+			e = errno;
+			fprintf(stderr, "Error %d dup2'ing fd %d to 0: %s\n",
+					e, in[0], strerror(e));
+			exit(255);
+		}
 		if (dup2(io[1], 3) < 0) {
 			e = errno;
 			fprintf(stderr, "Error %d dup2'ing fd %d to 3: %s\n",
@@ -350,128 +726,187 @@ static retvalue callexporthook(/*@null@*/const char *hook, const char *relfilena
 		if (io[1] != 3)
 			(void)close(io[1]);
 		closefrom(4);
-		/* backward compatibility */
-		reltmpfilename = calc_addsuffix(relfilename, "new");
-		if (reltmpfilename == NULL) {
-			exit(255);
-		}
 		sethookenvironment(causingfile, NULL, NULL, NULL);
-		(void)execl(hook, hook, release_dirofdist(release),
-				reltmpfilename, relfilename, mode,
-				ENDOFARGUMENTS);
+		if (batched)
+			(void)execl(hook, hook, "batch", ENDOFARGUMENTS);
+		else {
+			/* backward compatibility */
+			reltmpfilename = calc_addsuffix(relfilename, "new");
+			if (reltmpfilename == NULL) {
+				exit(255);
+			}
+			(void)execl(hook, hook, release_dirofdist(release),
+					reltmpfilename, relfilename, mode,
+					ENDOFARGUMENTS);
+		}
 		e = errno;
 		fprintf(stderr, "Error %d while executing '%s': %s\n",
 				e, hook, strerror(e));
 		exit(255);
 	}
-	close(io[1]);
+	(void)close(io[1]);
 	markcloseonexec(io[0]);
+	if (batched) {
+		(void)close(in[0]);
+		markcloseonexec(in[1]);
+		p->infd = in[1];
+	}
+	p->child = f;
+	p->outfd = io[0];
+	p->next = hookprocesses;
+	hookprocesses = p;
+	if (verbose > 6) {
+		if (batched)
+			printf("Called %s 'batch'\n", hook);
+		else
+			printf("Called %s '%s' '%s.new' '%s' '%s'\n",
+				hook, release_dirofdist(release),
+				relfilename, relfilename, mode);
+	}
+	*process_p = p;
+	return RET_OK;
+}
+
+/* send the arguments for another file to a batched hook */
+static retvalue hookprocess_send(struct hookprocess *p, const char *relfilename, const char *mode) {
+	struct sigaction sa, oldsa;
+	char *data;
+	size_t len, done;
+	ssize_t written;
+	int e = 0;
 
+	data = mprintf("%s%c%s.new%c%s%c%s%c",
+			release_dirofdist(p->release), '\0',
+			relfilename, '\0', relfilename, '\0', mode, '\0');
+	if (FAILEDTOALLOC(data))
+		return RET_ERROR_OOM;
+	len = strlen(release_dirofdist(p->release)) + 2 * strlen(relfilename)
+		+ strlen(mode) + 8;
 	if (verbose > 6)
-		printf("Called %s '%s' '%s.new' '%s' '%s'\n",
-			hook, release_dirofdist(release),
+		printf("Sent %s '%s' '%s.new' '%s' '%s'\n",
+			p->hook, release_dirofdist(p->release),
 			relfilename, relfilename, mode);
-	/* read what comes from the client */
-	while (true) {
-		ssize_t r;
-		int last, j;
 
-		r = read(io[0], buffer + already, 999 - already);
-		if (r < 0) {
-			int e = errno;
-			fprintf(stderr,
-"Error %d reading from exporthook: %s!\n",
-					e, strerror(e));
+	/* a hook exiting early is reported when reading from it */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_IGN;
+	(void)sigaction(SIGPIPE, &sa, &oldsa);
+	done = 0;
+	while (done < len) {
+		written = write(p->infd, data + done, len - done);
+		if (written < 0) {
+			e = errno;
+			if (e == EINTR) {
+				e = 0;
+				continue;
+			}
 			break;
 		}
+		done += written;
+	}
+	(void)sigaction(SIGPIPE, &oldsa, NULL);
+	free(data);
+	if (e != 0) {
+		fprintf(stderr,
+"Error %d writing to exporthook '%s': %s\n",
+				e, p->hook, strerror(e));
+		return RET_ERRNO(e);
+	}
+	return RET_OK;
+}
 
-		already += r;
-		if (r == 0) {
-			buffer[already] = '\0';
-			already++;
-		}
-		last = 0;
-		for (j = 0 ; j < already ; j++) {
-			if (buffer[j] == '\n' || buffer[j] == '\0') {
-				int next = j+1;
-				int e = (j>0)?(j-1):j;
-				retvalue ret;
-
-				while (last < j && xisspace(buffer[last]))
-						last++;
-				if (last >= j) {
-					last = next;
-					continue;
-				}
-				while (xisspace(buffer[e])) {
-					e--;
-					assert (e >= last);
-				}
-
-				ret = gotfilename(buffer + last, e - last + 1,
-						release);
-				if (RET_WAS_ERROR(ret)) {
-					(void)close(io[0]);
-					return ret;
-				}
-				last = next;
-			}
-		}
-		if (last > 0) {
-			if (already > last)
-				memmove(buffer, buffer + last, already - last);
-			already -= last;
+static retvalue callexporthook(const char *hook, bool batched, const char *relfilename, const char *mode, struct release *release) {
+	struct hookprocess *p;
+	struct hookrequest *r;
+	int maxrunning = (global.jobs > 1)?global.jobs:1;
+	retvalue ret;
+
+	while (hooksrunning >= maxrunning) {
+		ret = exporthooks_poll();
+		if (RET_WAS_ERROR(ret))
+			return ret;
+	}
+	/* do not start anything new if a hook failed */
+	if (RET_WAS_ERROR(hooksresult))
+		return hooksresult;
+
+	r = zNEW(struct hookrequest);
+	if (FAILEDTOALLOC(r))
+		return RET_ERROR_OOM;
+	strlist_init(&r->filenames);
+	r->release = release;
+	r->position = release_lastentry(release);
+	r->result = RET_OK;
+
+	p = NULL;
+	if (batched) {
+		for (p = hookprocesses ; p != NULL ; p = p->next) {
+			if (p->batched && p->infd >= 0
+					&& p->release == release
+					&& strcmp(p->hook, hook) == 0)
+				break;
 		}
-		if (r == 0)
-			break;
 	}
-	(void)close(io[0]);
-	do {
-		c = waitpid(f, &status, WUNTRACED);
-		if (c < 0) {
-			int e = errno;
-			fprintf(stderr,
-"Error %d while waiting for hook '%s' to finish: %s\n", e, hook, strerror(e));
-			return RET_ERRNO(e);
+	if (p == NULL) {
+		ret = hookprocess_start(hook, relfilename, mode, release,
+				batched, &p);
+		if (RET_WAS_ERROR(ret)) {
+			free(r);
+			return ret;
 		}
-	} while (c != f);
-	if (WIFEXITED(status)) {
-		if (WEXITSTATUS(status) == 0) {
-			if (verbose > 6)
-				printf("Exporthook successfully returned!\n");
-			return RET_OK;
-		} else {
-			fprintf(stderr,
-"Exporthook failed with exitcode %d!\n",
-					(int)WEXITSTATUS(status));
-			return RET_ERROR;
+	}
+	if (batched) {
+		ret = hookprocess_send(p, relfilename, mode);
+		if (RET_WAS_ERROR(ret)) {
+			free(r);
+			return ret;
 		}
-	} else if (WIFSIGNALED(status)) {
-		fprintf(stderr, "Exporthook killed by signal %d!\n",
-				(int)(WTERMSIG(status)));
-		return RET_ERROR;
-	} else {
-		fprintf(stderr,
-"Exporthook terminated abnormally. (status is %x)!\n",
-				status);
-		return RET_ERROR;
 	}
+	r->process = p;
+	hooksrunning++;
+	if (lasthookrequest == NULL)
+		hookrequests = r;
+	else
+		lasthookrequest->next = r;
+	lasthookrequest = r;
+	return RET_OK;
 }
 
-retvalue export_target(const char *relativedir, struct target *target,  const struct exportmode *exportmode, struct release *release, bool onlyifmissing, bool snapshot) {
+static void writepackage(struct filetorelease *file, const struct package *package) {
+	(void)release_writedata(file, package->control, package->controllen);
+	(void)release_writestring(file, "\n");
+	if (package->control[package->controllen-1] != '\n')
+		(void)release_writestring(file, "\n");
+}
+
+/* is this package to be listed in binary-all instead? */
+static retvalue isarchall(struct package *package) {
+	retvalue r;
+
+	r = package_getarchitecture(package);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (r == RET_NOTHING || package->architecture != architecture_all)
+		return RET_NOTHING;
+	return RET_OK;
+}
+
+typedef retvalue export_writer(struct filetorelease *, void *);
+
+/* start the index file, let writer fill it and call the hooks */
+static retvalue export_file(const char *relativedir, const struct exportmode *exportmode, struct release *release, bool onlyifmissing, bool snapshot, export_writer *writer, void *privdata) {
 	retvalue r;
 	struct filetorelease *file;
 	const char *status;
 	char *relfilename;
 	char buffer[100];
-	struct package_cursor iterator;
 
 	relfilename = calc_dirconcat(relativedir, exportmode->filename);
 	if (FAILEDTOALLOC(relfilename))
 		return RET_ERROR_OOM;
 
 	r = release_startfile(release, relfilename, exportmode->compressions,
-		       onlyifmissing, &file);
+		       exportmode->rsyncable, onlyifmissing, &file);
 	if (RET_WAS_ERROR(r)) {
 		free(relfilename);
 		return r;
@@ -490,22 +925,7 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 					exportdescription(exportmode, buffer, 100));
 			status = "new";
 		}
-		r = package_openiterator(target, READONLY, true, &iterator);
-		if (RET_WAS_ERROR(r)) {
-			release_abortfile(file);
-			free(relfilename);
-			return r;
-		}
-		while (package_next(&iterator)) {
-			if (iterator.current.controllen == 0)
-				continue;
-			(void)release_writedata(file, iterator.current.control,
-					iterator.current.controllen);
-			(void)release_writestring(file, "\n");
-			if (iterator.current.control[iterator.current.controllen-1] != '\n')
-				(void)release_writestring(file, "\n");
-		}
-		r = package_closeiterator(&iterator);
+		r = writer(file, privdata);
 		if (RET_WAS_ERROR(r)) {
 			release_abortfile(file);
 			free(relfilename);
@@ -516,6 +936,13 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 			free(relfilename);
 			return r;
 		}
+		if (r == RET_NOTHING) {
+			if (verbose > 5)
+				printf("  content unchanged, keeping old '%s/%s'%s\n",
+					release_dirofdist(release), relfilename,
+					exportdescription(exportmode, buffer, 100));
+			status = "old";
+		}
 	} else {
 		if (verbose > 9)
 			printf("  keeping old '%s/%s'%s\n",
@@ -529,7 +956,8 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 		for (i = 0 ; i < exportmode->hooks.count ; i++) {
 			const char *hook = exportmode->hooks.values[i];
 
-			r = callexporthook(hook, relfilename, status, release);
+			r = callexporthook(hook, exportmode->batchedhooks[i],
+					relfilename, status, release);
 			if (RET_WAS_ERROR(r)) {
 				free(relfilename);
 				return r;
@@ -540,9 +968,206 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 	return RET_OK;
 }
 
+struct targetwriter {
+	struct target *target;
+	bool omitarchall;
+};
+
+static retvalue write_target(struct filetorelease *file, void *privdata) {
+	struct targetwriter *w = privdata;
+	struct package_cursor iterator;
+	retvalue r;
+
+	r = package_openiterator(w->target, READONLY, true, &iterator);
+	if (RET_WAS_ERROR(r))
+		return r;
+	while (package_next(&iterator)) {
+		if (iterator.current.controllen == 0)
+			continue;
+		if (w->omitarchall) {
+			r = isarchall(&iterator.current);
+			if (RET_WAS_ERROR(r)) {
+				(void)package_closeiterator(&iterator);
+				return r;
+			}
+			if (RET_IS_OK(r))
+				continue;
+		}
+		writepackage(file, &iterator.current);
+	}
+	return package_closeiterator(&iterator);
+}
+
+retvalue export_target(const char *relativedir, struct target *target,  const struct exportmode *exportmode, struct release *release, bool onlyifmissing, bool snapshot, bool omitarchall) {
+	struct targetwriter w;
+
+	w.target = target;
+	w.omitarchall = omitarchall;
+	return export_file(relativedir, exportmode, release,
+			onlyifmissing, snapshot, write_target, &w);
+}
+
+/* The architecture all packages of some targets (all of the same component
+ * and packagetype) are merged into one index. As the packages databases are
+ * sorted by name and then by version (newest first), it is enough to always
+ * take the first package from the next architecture all packages of each
+ * target. */
+
+struct archallwriter {
+	int count;
+	struct target **targets;
+	struct package_cursor *iterators;
+	/* if the iterator has a current architecture all package */
+	bool *current;
+};
+
+/* move the iterator to its next architecture all package */
+static retvalue archall_next(struct archallwriter *w, int i) {
+	retvalue r;
+
+	w->current[i] = false;
+	while (package_next(&w->iterators[i])) {
+		struct package *package = &w->iterators[i].current;
+
+		if (package->controllen == 0)
+			continue;
+		r = isarchall(package);
+		if (r == RET_NOTHING)
+			continue;
+		if (RET_WAS_ERROR(r))
+			return r;
+		r = package_getversion(package);
+		if (RET_WAS_ERROR(r))
+			return r;
+		if (r == RET_NOTHING) {
+			fprintf(stderr,
+"Error extracting version number from package control info of '%s'!\n",
+					package->name);
+			return RET_ERROR_MISSING;
+		}
+		w->current[i] = true;
+		return RET_OK;
+	}
+	return w->iterators[i].r;
+}
+
+/* negative if package a is to be written before package b,
+ * zero if both are the same package (in the order of the iterators,
+ * so higher versions first) */
+static retvalue archall_cmp(const struct package *a, const struct package *b, /*@out@*/int *cmp_p) {
+	retvalue r;
+	int c;
+
+	c = strcmp(a->name, b->name);
+	if (c != 0) {
+		*cmp_p = c;
+		return RET_OK;
+	}
+	if (strcmp(a->version, b->version) == 0) {
+		*cmp_p = 0;
+		return RET_OK;
+	}
+	r = dpkgversions_cmp(a->version, b->version, &c);
+	if (RET_IS_OK(r))
+		*cmp_p = -c;
+	return r;
+}
+
+static retvalue merge_archall(struct filetorelease *file, struct archallwriter *w) {
+	retvalue r;
+	int i, smallest, c;
+
+	for (i = 0 ; i < w->count ; i++) {
+		r = archall_next(w, i);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	while (true) {
+		smallest = -1;
+		for (i = 0 ; i < w->count ; i++) {
+			if (!w->current[i])
+				continue;
+			if (smallest < 0) {
+				smallest = i;
+				continue;
+			}
+			r = archall_cmp(&w->iterators[i].current,
+					&w->iterators[smallest].current, &c);
+			if (RET_WAS_ERROR(r))
+				return r;
+			if (c < 0)
+				smallest = i;
+		}
+		if (smallest < 0)
+			return RET_OK;
+		writepackage(file, &w->iterators[smallest].current);
+		/* skip the same package in all other architectures: */
+		for (i = 0 ; i < w->count ; i++) {
+			if (!w->current[i] || i == smallest)
+				continue;
+			r = archall_cmp(&w->iterators[i].current,
+					&w->iterators[smallest].current, &c);
+			if (RET_WAS_ERROR(r))
+				return r;
+			if (c != 0)
+				continue;
+			r = archall_next(w, i);
+			if (RET_WAS_ERROR(r))
+				return r;
+		}
+		r = archall_next(w, smallest);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+}
+
+static retvalue write_archall(struct filetorelease *file, void *privdata) {
+	struct archallwriter *w = privdata;
+	retvalue result, r;
+	int i, opened;
+
+	result = RET_OK;
+	for (opened = 0 ; opened < w->count ; opened++) {
+		result = package_openiterator(w->targets[opened], READONLY,
+				true, &w->iterators[opened]);
+		if (RET_WAS_ERROR(result))
+			break;
+	}
+	if (!RET_WAS_ERROR(result))
+		result = merge_archall(file, w);
+	for (i = 0 ; i < opened ; i++) {
+		r = package_closeiterator(&w->iterators[i]);
+		RET_ENDUPDATE(result, r);
+	}
+	return result;
+}
+
+retvalue export_archall(const char *relativedir, int count, struct target **targets, const struct exportmode *exportmode, struct release *release, bool onlyifmissing, bool snapshot) {
+	struct archallwriter w;
+	retvalue r;
+
+	assert (count > 0);
+
+	w.count = count;
+	w.targets = targets;
+	w.iterators = nzNEW(count, struct package_cursor);
+	w.current = nzNEW(count, bool);
+	if (FAILEDTOALLOC(w.iterators) || FAILEDTOALLOC(w.current)) {
+		free(w.iterators);
+		free(w.current);
+		return RET_ERROR_OOM;
+	}
+	r = export_file(relativedir, exportmode, release,
+			onlyifmissing, snapshot, write_archall, &w);
+	free(w.iterators);
+	free(w.current);
+	return r;
+}
+
 void exportmode_done(struct exportmode *mode) {
 	assert (mode != NULL);
 	free(mode->filename);
 	strlist_done(&mode->hooks);
+	free(mode->batchedhooks);
 	free(mode->release);
 }
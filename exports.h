@@ -10,11 +10,15 @@ struct exportmode {
 	char *filename;
 	/* create uncompressed, create .gz, <future things...> */
 	compressionset compressions;
+	/* make the .gz file rsync friendly (--rsyncable) */
+	bool rsyncable;
 	/* Generate a Release file next to the Indexfile , if non-null*/
 	/*@null@*/
 	char *release;
 	/* programms to start after all are generated */
 	struct strlist hooks;
+	/* which of them get all files through one process (--batched) */
+	/*@null@*/bool *batchedhooks;
 };
 
 retvalue exportmode_init(/*@out@*/struct exportmode *, bool /*uncompressed*/, /*@null@*/const char * /*release*/, const char * /*indexfile*/);
@@ -22,5 +26,9 @@ struct configiterator;
 retvalue exportmode_set(struct exportmode *, struct configiterator *);
 void exportmode_done(struct exportmode *);
 
-retvalue export_target(const char * /*relativedir*/, struct target *, const struct exportmode *, struct release *, bool /*onlyifmissing*/, bool /*snapshot*/);
+retvalue export_target(const char * /*relativedir*/, struct target *, const struct exportmode *, struct release *, bool /*onlyifmissing*/, bool /*snapshot*/, bool /*omitarchall*/);
+/* export the architecture all packages of the given targets into one index */
+retvalue export_archall(const char * /*relativedir*/, int /*count*/, struct target ** /*targets*/, const struct exportmode *, struct release *, bool /*onlyifmissing*/, bool /*snapshot*/);
+/* wait for all export hooks still running in the background */
+retvalue export_waithooks(void);
 #endif
@@ -238,6 +238,14 @@ retvalue extractcontrol(char **control, const char *debfile) {
 	return r;
 }
 
+retvalue extractcontrolandfilelist(char **control, char **filelist, size_t *size, const char *debfile) {
+	if (filelist != NULL) {
+		*filelist = NULL;
+		*size = 0;
+	}
+	return extractcontrol(control, debfile);
+}
+
 retvalue getfilelist(/*@out@*/char **filelist, /*@out@*/size_t *size, const char *debfile) {
 	fprintf(stderr,
 "Extraction of file list without libarchive currently not implemented.\n");
@@ -488,6 +488,11 @@ retvalue fakefilelist(const char *filekey) {
 			"", 1, true, false);
 }
 
+retvalue filelist_store(const char *filekey, const char *filelist, size_t size) {
+	return table_adduniqsizedrecord(rdb_contents, filekey,
+			filelist, size, true, false);
+}
+
 static const char separator_chars[] = "\t    ";
 
 static void filelist_writefiles(char *dir, size_t len,
@@ -17,6 +17,8 @@ retvalue filelist_write(struct filelist_list *list, struct filetorelease *file);
 void filelist_free(/*@only@*/struct filelist_list *);
 
 retvalue fakefilelist(const char *filekey);
+/* cache the file list read while including a package */
+retvalue filelist_store(const char * /*filekey*/, const char * /*filelist*/, size_t);
 retvalue filelists_translate(struct table *, struct table *);
 
 /* for use in routines reading the data: */
@@ -36,6 +36,7 @@
 #include "filelist.h"
 #include "debfile.h"
 #include "pool.h"
+#include "sizes.h"
 #include "database_p.h"
 
 static retvalue files_get_checksums(const char *filekey, /*@out@*/struct checksums **checksums_p) {
@@ -50,47 +51,75 @@ static retvalue files_get_checksums(const char *filekey, /*@out@*/struct checksu
 	return checksums_setall(checksums_p, checksums, checksumslen);
 }
 
+/* the size the size accounting knows for a file (-1 if none or
+ * if there is no size accounting) */
+static off_t files_accountedsize(const char *filekey) {
+	if (!sizes_accountingenabled())
+		return -1;
+	return files_getsize(filekey);
+}
+
 retvalue files_add_checksums(const char *filekey, const struct checksums *checksums) {
 	retvalue r;
 	const char *combined;
 	size_t combinedlen;
+	off_t oldsize;
 
 	assert (rdb_checksums != NULL);
 	r = checksums_getcombined(checksums, &combined, &combinedlen);
 	if (!RET_IS_OK(r))
 		return r;
+	oldsize = files_accountedsize(filekey);
 	r = table_adduniqsizedrecord(rdb_checksums, filekey,
 			combined, combinedlen + 1, true, false);
 	if (!RET_IS_OK(r))
 		return r;
+	r = sizes_filechange(filekey, oldsize,
+			checksums_getfilesize(checksums));
+	if (RET_WAS_ERROR(r))
+		return r;
 	return pool_markadded(filekey);
 }
 
 static retvalue files_replace_checksums(const char *filekey, const struct checksums *checksums) {
-	retvalue r;
+	retvalue r, r2;
 	const char *combined;
 	size_t combinedlen;
+	off_t oldsize;
 
 	assert (rdb_checksums != NULL);
 	r = checksums_getcombined(checksums, &combined, &combinedlen);
 	if (!RET_IS_OK(r))
 		return r;
-	return table_adduniqsizedrecord(rdb_checksums, filekey,
+	oldsize = files_accountedsize(filekey);
+	r = table_adduniqsizedrecord(rdb_checksums, filekey,
 			combined, combinedlen + 1, true, false);
+	if (!RET_IS_OK(r))
+		return r;
+	r2 = sizes_filechange(filekey, oldsize,
+			checksums_getfilesize(checksums));
+	RET_ENDUPDATE(r, r2);
+	return r;
 }
 
 /* remove file's md5sum from database */
 retvalue files_removesilent(const char *filekey) {
 	retvalue r;
+	off_t oldsize;
 
 	if (rdb_contents != NULL)
 		(void)table_deleterecord(rdb_contents, filekey, true);
+	oldsize = files_accountedsize(filekey);
 	r = table_deleterecord(rdb_checksums, filekey, true);
 	if (r == RET_NOTHING) {
 		fprintf(stderr, "Unable to forget unknown filekey '%s'.\n",
 				filekey);
 		return RET_ERROR_MISSING;
 	}
+	if (RET_IS_OK(r)) {
+		retvalue r2 = sizes_filechange(filekey, oldsize, -1);
+		RET_ENDUPDATE(r, r2);
+	}
 	return r;
 }
 
@@ -346,12 +375,74 @@ retvalue files_foreach(per_file_action action, void *privdata) {
 	return result;
 }
 
+/* callback for each registered file without references.
+ * As both tables are sorted by filekey, just walk both in parallel */
+retvalue files_foreachunreferenced(per_file_action action, void *privdata) {
+	retvalue result, r;
+	struct cursor *cursor, *refcursor;
+	const char *filekey, *checksum, *referenced, *by;
+	char *lastreferenced = NULL;
+	size_t size = 0, len;
+	bool refsdone = false;
+	int c;
+
+	r = table_newglobalcursor(rdb_checksums, true, &cursor);
+	if (!RET_IS_OK(r))
+		return r;
+	r = table_newglobalcursor(rdb_references, false, &refcursor);
+	if (!RET_IS_OK(r)) {
+		(void)cursor_close(rdb_checksums, cursor);
+		return r;
+	}
+	result = RET_NOTHING;
+	while (cursor_nexttempdata(rdb_checksums, cursor, &filekey, &checksum, NULL)) {
+		if (interrupted()) {
+			RET_UPDATE(result, RET_ERROR_INTERRUPTED);
+			break;
+		}
+		c = -1;
+		while (!refsdone && (lastreferenced == NULL ||
+				(c = strcmp(lastreferenced, filekey)) < 0)) {
+			if (!cursor_nexttempdata(rdb_references, refcursor,
+						&referenced, &by, NULL)) {
+				refsdone = true;
+				break;
+			}
+			/* keep a copy, the action might use the table */
+			len = strlen(referenced) + 1;
+			if (len > size) {
+				char *n = realloc(lastreferenced, len + 256);
+				if (FAILEDTOALLOC(n)) {
+					RET_UPDATE(result, RET_ERROR_OOM);
+					refsdone = true;
+					break;
+				}
+				lastreferenced = n;
+				size = len + 256;
+			}
+			memcpy(lastreferenced, referenced, len);
+		}
+		if (RET_WAS_ERROR(result))
+			break;
+		if (!refsdone && c == 0)
+			continue;
+		r = action(privdata, filekey);
+		RET_UPDATE(result, r);
+	}
+	free(lastreferenced);
+	r = cursor_close(rdb_references, refcursor);
+	RET_ENDUPDATE(result, r);
+	r = cursor_close(rdb_checksums, cursor);
+	RET_ENDUPDATE(result, r);
+	return result;
+}
+
 static retvalue checkpoolfile(const char *fullfilename, const struct checksums *expected, bool *improveable) {
 	struct checksums *actual;
 	retvalue r;
 	bool improves;
 
-	r = checksums_read(fullfilename, &actual);
+	r = checksums_reread(fullfilename, &actual);
 	if (RET_IS_OK(r)) {
 		if (!checksums_check(expected, actual, &improves)) {
 			fprintf(stderr, "WRONG CHECKSUMS of '%s':\n",
@@ -55,6 +55,8 @@ typedef retvalue per_file_action(void *data, const char *filekey);
 
 /* callback for each registered file */
 retvalue files_foreach(per_file_action, void *);
+/* callback for each registered file not referenced by anything */
+retvalue files_foreachunreferenced(per_file_action, void *);
 
 /* check if all files are corect. (skip md5sum if fast is true) */
 retvalue files_checkpool(bool /*fast*/);
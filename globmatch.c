@@ -19,9 +19,9 @@
 #include <limits.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
 #ifdef TEST_GLOBMATCH
 #include <stdio.h>
-#include <stdlib.h>
 #endif
 #include "error.h"
 #include "globmatch.h"
@@ -170,6 +170,28 @@ bool globmatch(const char *string, const char *pattern) {
 	return possible[l];
 }
 
+enum globform glob_form(const char *pattern, size_t *literallen_p) {
+	const char *p = pattern;
+
+	while (*p != '\0' && *p != '*' && *p != '?' && *p != '[')
+		p++;
+	*literallen_p = p - pattern;
+	if (*p == '\0')
+		return gf_literal;
+	while (*p == '*')
+		p++;
+	if (*p == '\0')
+		return gf_prefix;
+	return gf_general;
+}
+
+char *glob_literalprefix(const char *pattern) {
+	size_t len;
+
+	(void)glob_form(pattern, &len);
+	return strndup(pattern, len);
+}
+
 #ifdef TEST_GLOBMATCH
 int main(int argc, const char *argv[]) {
 	if (argc != 3) {
@@ -3,5 +3,19 @@
 
 bool globmatch(const char * /*string*/, const char */*pattern*/);
 
+/* patterns that do not need globmatch to be checked */
+enum globform {
+	/* everything else */
+	gf_general,
+	/* no special characters at all */
+	gf_literal,
+	/* literal characters followed only by stars */
+	gf_prefix
+};
+enum globform glob_form(const char * /*pattern*/, /*@out@*/size_t * /*literallen*/);
+/* what every string matching the pattern starts with (NULL if out of
+ * memory), to only look at those if they can be found quickly */
+char *glob_literalprefix(const char * /*pattern*/);
+
 #endif
 
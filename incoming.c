@@ -52,6 +52,10 @@
 #include "configparser.h"
 #include "byhandhook.h"
 #include "changes.h"
+#include "debfile.h"
+#include "workers.h"
+#include "filelist.h"
+#include "contents.h"
 
 enum permitflags {
 	/* do not error out on unused files */
@@ -490,9 +494,18 @@ struct candidate {
 		/* set later */
 		bool used;
 		char *tempfilename;
+		/* set by candidates_prefetch: result of copying (and reading
+		 * the control of) this file in advance, RET_NOTHING if not
+		 * tried. If tempfilename is set but used is not, the copy
+		 * is already there with the checksums of the copy here: */
+		retvalue prefetched;
+		struct checksums *copiedchecksums;
 		/* distribution-unspecific contents of the packages */
 		/* - only for FE_BINARY types: */
 		struct deb_headers deb;
+		/* read together with the control if needed for Contents */
+		/*@null@*/char *filelist;
+		size_t filelistsize;
 		/* - only for fe_DSC types */
 		struct dsc_headers dsc;
 		/* only valid while parsing */
@@ -536,11 +549,13 @@ struct candidate {
 
 static void candidate_file_free(/*@only@*/struct candidate_file *f) {
 	checksums_free(f->checksums);
+	checksums_free(f->copiedchecksums);
 	free(f->section);
 	free(f->priority);
 	free(f->name);
 	if (FE_BINARY(f->type))
 		binaries_debdone(&f->deb);
+	free(f->filelist);
 	if (f->type == fe_DSC)
 		sources_done(&f->dsc);
 	if (f->tempfilename != NULL) {
@@ -887,7 +902,6 @@ static retvalue candidate_usefile(const struct incoming *i, const struct candida
 
 	if (file->used && file->tempfilename != NULL)
 		return RET_OK;
-	assert(file->tempfilename == NULL);
 	basefilename = BASENAME(i, file->ofs);
 	for (p = basefilename; *p != '\0' ; p++) {
 		if ((0x80 & *(const unsigned char *)p) != 0) {
@@ -897,19 +911,32 @@ static retvalue candidate_usefile(const struct incoming *i, const struct candida
 			return RET_ERROR;
 		}
 	}
-	tempfilename = calc_dirconcat(i->tempdir, basefilename);
-	if (FAILEDTOALLOC(tempfilename))
-		return RET_ERROR_OOM;
-	origfile = calc_dirconcat(i->directory, basefilename);
-	if (FAILEDTOALLOC(origfile)) {
-		free(tempfilename);
-		return RET_ERROR_OOM;
-	}
-	r = checksums_copyfile(tempfilename, origfile, true, &readchecksums);
-	free(origfile);
-	if (RET_WAS_ERROR(r)) {
-		free(tempfilename);
-		return r;
+	if (file->tempfilename != NULL) {
+		/* already copied by candidates_prefetch */
+		assert (file->copiedchecksums != NULL);
+		tempfilename = file->tempfilename;
+		file->tempfilename = NULL;
+		readchecksums = file->copiedchecksums;
+		file->copiedchecksums = NULL;
+	} else if (RET_WAS_ERROR(file->prefetched)) {
+		/* already reported when it happened */
+		return file->prefetched;
+	} else {
+		tempfilename = calc_dirconcat(i->tempdir, basefilename);
+		if (FAILEDTOALLOC(tempfilename))
+			return RET_ERROR_OOM;
+		origfile = calc_dirconcat(i->directory, basefilename);
+		if (FAILEDTOALLOC(origfile)) {
+			free(tempfilename);
+			return RET_ERROR_OOM;
+		}
+		r = checksums_copyfile(tempfilename, origfile, true,
+				&readchecksums);
+		free(origfile);
+		if (RET_WAS_ERROR(r)) {
+			free(tempfilename);
+			return r;
+		}
 	}
 	if (file->checksums == NULL) {
 		file->checksums = readchecksums;
@@ -995,13 +1022,49 @@ static inline retvalue getsectionprioritycomponent(const struct incoming *i, con
 	return RET_OK;
 }
 
+/* does any distribution this rule can put packages into generate
+ * Contents files listing binary packages of this type? */
+static bool incoming_needfilelist(const struct incoming *i, filetype type) {
+	packagetype_t packagetype;
+	int j;
+
+	if (type == fe_UDEB)
+		packagetype = pt_udeb;
+	else if (type == fe_DDEB)
+		packagetype = pt_ddeb;
+	else
+		packagetype = pt_deb;
+	if (i->default_into != NULL &&
+			contents_needfilelist(i->default_into, packagetype))
+		return true;
+	for (j = 0 ; j < i->allow.count ; j++) {
+		if (i->allow_into[j] != NULL &&
+				contents_needfilelist(i->allow_into[j],
+					packagetype))
+			return true;
+	}
+	return false;
+}
+
 static retvalue candidate_read_deb(struct incoming *i, struct candidate *c, struct candidate_file *file) {
 	retvalue r;
 	size_t l;
 	char *base;
 	const char *packagenametocheck;
 
-	r = binaries_readdeb(&file->deb, file->tempfilename);
+	if (file->deb.control != NULL)
+		/* control chunk already extracted by candidates_prefetch */
+		r = binaries_parsedeb(&file->deb, file->tempfilename);
+	else if (RET_WAS_ERROR(file->prefetched))
+		r = file->prefetched;
+	else {
+		r = extractcontrolandfilelist(&file->deb.control,
+				incoming_needfilelist(i, file->type)
+					?&file->filelist:NULL,
+				&file->filelistsize, file->tempfilename);
+		if (RET_IS_OK(r))
+			r = binaries_parsedeb(&file->deb, file->tempfilename);
+	}
 	if (RET_WAS_ERROR(r))
 		return r;
 	if (strcmp(file->name, file->deb.name) != 0) {
@@ -1779,6 +1842,13 @@ static retvalue candidate_addfiles(struct candidate *c) {
 						f->checksums);
 				if (RET_WAS_ERROR(r))
 					return r;
+				if (f->filelist == NULL)
+					continue;
+				/* no need to read it again for Contents */
+				r = filelist_store(p->filekeys.values[j],
+						f->filelist, f->filelistsize);
+				if (RET_WAS_ERROR(r))
+					return r;
 			}
 		}
 	}
@@ -2416,13 +2486,12 @@ static retvalue candidate_add(struct incoming *i, struct candidate *c) {
 	return r;
 }
 
-static retvalue process_changes(struct incoming *i, int ofs) {
+static retvalue candidate_readandparse(struct incoming *i, int ofs, /*@out@*/struct candidate **result, /*@out@*/bool *broken) {
 	struct candidate *c;
 	retvalue r;
-	int j, k;
-	bool broken = false, tried = false;
 
-	r = candidate_read(i, ofs, &c, &broken);
+	*broken = false;
+	r = candidate_read(i, ofs, &c, broken);
 	if (RET_WAS_ERROR(r))
 		return r;
 	assert (RET_IS_OK(r));
@@ -2431,6 +2500,17 @@ static retvalue process_changes(struct incoming *i, int ofs) {
 		candidate_free(c);
 		return r;
 	}
+	*result = c;
+	return RET_OK;
+}
+
+/* checks and adds an already read and parsed .changes file, frees c */
+static retvalue process_candidate(struct incoming *i, /*@only@*/struct candidate *c, bool broken) {
+	retvalue r;
+	int j, k;
+	int ofs = c->ofs;
+	bool tried = false;
+
 	r = candidate_earlychecks(i, c);
 	if (RET_WAS_ERROR(r)) {
 		if (i->cleanup[cuf_on_error]) {
@@ -2522,6 +2602,254 @@ static retvalue process_changes(struct incoming *i, int ofs) {
 	return r;
 }
 
+static retvalue process_changes(struct incoming *i, int ofs) {
+	struct candidate *c;
+	retvalue r;
+	bool broken;
+
+	r = candidate_readandparse(i, ofs, &c, &broken);
+	if (RET_WAS_ERROR(r))
+		return r;
+	return process_candidate(i, c, broken);
+}
+
+struct prefetch {
+	const struct incoming *i;
+	struct candidate_file *file;
+};
+
+/* called in a worker process: copy the file into the temporary directory
+ * and calculate its checksums, for a .deb also extract the control chunk
+ * (and the file list if needed for Contents files).
+ * Sends the combined checksums (and the control chunk and file list,
+ * separated by a null byte) back. */
+static retvalue prefetch_run(void *privdata, char **data_p, size_t *len_p) {
+	const struct prefetch *p = privdata;
+	const struct incoming *i = p->i;
+	const char *basefilename = BASENAME(i, p->file->ofs);
+	char *origfile, *tempfilename, *control = NULL, *filelist = NULL, *data;
+	struct checksums *checksums;
+	const char *combined;
+	size_t combinedlen, controllen, filelistsize = 0;
+	retvalue r;
+
+	tempfilename = calc_dirconcat(i->tempdir, basefilename);
+	if (FAILEDTOALLOC(tempfilename))
+		return RET_ERROR_OOM;
+	origfile = calc_dirconcat(i->directory, basefilename);
+	if (FAILEDTOALLOC(origfile)) {
+		free(tempfilename);
+		return RET_ERROR_OOM;
+	}
+	r = checksums_copyfile(tempfilename, origfile, true, &checksums);
+	free(origfile);
+	if (RET_WAS_ERROR(r)) {
+		free(tempfilename);
+		return r;
+	}
+	if (FE_BINARY(p->file->type)) {
+		r = extractcontrolandfilelist(&control,
+				incoming_needfilelist(i, p->file->type)
+					?&filelist:NULL,
+				&filelistsize, tempfilename);
+		if (RET_WAS_ERROR(r)) {
+			control = NULL;
+			filelist = NULL;
+		}
+	}
+	free(tempfilename);
+	if (filelist == NULL)
+		filelistsize = 0;
+	(void)checksums_getcombined(checksums, &combined, &combinedlen);
+	controllen = (control == NULL)?0:strlen(control);
+	data = malloc(combinedlen + 2 + controllen + filelistsize);
+	if (FAILEDTOALLOC(data)) {
+		checksums_free(checksums);
+		free(control);
+		free(filelist);
+		return RET_ERROR_OOM;
+	}
+	memcpy(data, combined, combinedlen + 1);
+	if (control != NULL)
+		memcpy(data + combinedlen + 1, control, controllen);
+	*len_p = combinedlen + 1 + controllen;
+	if (filelist != NULL) {
+		data[combinedlen + 1 + controllen] = '\0';
+		memcpy(data + combinedlen + 2 + controllen,
+				filelist, filelistsize);
+		*len_p += 1 + filelistsize;
+	}
+	checksums_free(checksums);
+	free(control);
+	free(filelist);
+	*data_p = data;
+	return r;
+}
+
+static retvalue prefetch_done(void *privdata, retvalue r, const char *data, size_t len) {
+	struct prefetch *p = privdata;
+	const struct incoming *i = p->i;
+	struct candidate_file *file = p->file;
+	const char *end;
+	retvalue r2;
+
+	free(p);
+	/* errors were already printed by the worker, but only count
+	 * once the file is actually used */
+	file->prefetched = r;
+	end = (data == NULL)?NULL:memchr(data, '\0', len);
+	if (end == NULL)
+		/* not even the copy was successful */
+		return RET_OK;
+	file->tempfilename = calc_dirconcat(i->tempdir,
+			BASENAME(i, file->ofs));
+	if (FAILEDTOALLOC(file->tempfilename))
+		return RET_ERROR_OOM;
+	r2 = checksums_parse(&file->copiedchecksums, data);
+	if (RET_WAS_ERROR(r2)) {
+		deletefile(file->tempfilename);
+		free(file->tempfilename);
+		file->tempfilename = NULL;
+		return r2;
+	}
+	end++;
+	if (end < data + len) {
+		const char *controlend = memchr(end, '\0', (data + len) - end);
+
+		if (controlend == NULL)
+			controlend = data + len;
+		file->deb.control = strndup(end, controlend - end);
+		if (FAILEDTOALLOC(file->deb.control))
+			return RET_ERROR_OOM;
+		if (controlend + 1 < data + len) {
+			controlend++;
+			file->filelistsize = (data + len) - controlend;
+			file->filelist = malloc(file->filelistsize);
+			if (FAILEDTOALLOC(file->filelist))
+				return RET_ERROR_OOM;
+			memcpy(file->filelist, controlend,
+					file->filelistsize);
+		}
+	}
+	return RET_OK;
+}
+
+/* copy and checksum all package files of the given .changes files in
+ * parallel worker processes, so candidate_usefile only has to look at
+ * the results. Files listed in more than one .changes file are left alone,
+ * as they would be in each other's way in the temporary directory. */
+static retvalue candidates_prefetch(const struct incoming *i, struct candidate **candidates) {
+	struct workers *workers;
+	struct candidate_file *file;
+	int *listed;
+	int j;
+	retvalue r;
+
+	listed = nzNEW(i->files.count, int);
+	if (FAILEDTOALLOC(listed))
+		return RET_ERROR_OOM;
+	for (j = 0 ; j < i->files.count ; j++) {
+		if (candidates[j] == NULL)
+			continue;
+		for (file = candidates[j]->files ; file != NULL ;
+		                                   file = file->next)
+			listed[file->ofs]++;
+	}
+	r = workers_init(&workers, global.jobs);
+	if (RET_WAS_ERROR(r)) {
+		free(listed);
+		return r;
+	}
+	for (j = 0 ; j < i->files.count ; j++) {
+		if (candidates[j] == NULL)
+			continue;
+		for (file = candidates[j]->files ; file != NULL ;
+		                                   file = file->next) {
+			struct prefetch *p;
+
+			if (!FE_PACKAGE(file->type) || listed[file->ofs] != 1)
+				continue;
+			assert (file->tempfilename == NULL);
+			p = NEW(struct prefetch);
+			if (FAILEDTOALLOC(p)) {
+				r = RET_ERROR_OOM;
+				break;
+			}
+			p->i = i;
+			p->file = file;
+			r = workers_start(workers, prefetch_run, prefetch_done,
+					p);
+			if (RET_WAS_ERROR(r)) {
+				free(p);
+				break;
+			}
+		}
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+	free(listed);
+	RET_ENDUPDATE(r, workers_finish(workers));
+	return r;
+}
+
+/* process all .changes files in parallel as far as possible:
+ * first read all of them, then copy and check all their files in
+ * worker processes, and finally check and add them one after the
+ * other in the same order as without parallel processing.
+ * (If the workers fail, the files not yet copied are copied when
+ * they are used, just like without parallel processing.) */
+static retvalue process_changes_parallel(struct incoming *i, const bool *tocheck) {
+	struct candidate **candidates;
+	bool *broken;
+	retvalue *results;
+	retvalue result, r;
+	int j;
+
+	candidates = nzNEW(i->files.count, struct candidate *);
+	broken = nzNEW(i->files.count, bool);
+	results = nzNEW(i->files.count, retvalue);
+	if (FAILEDTOALLOC(candidates) || FAILEDTOALLOC(broken) ||
+			FAILEDTOALLOC(results)) {
+		free(candidates);
+		free(broken);
+		free(results);
+		return RET_ERROR_OOM;
+	}
+	for (j = 0 ; j < i->files.count ; j++) {
+		if (!tocheck[j])
+			continue;
+		results[j] = candidate_readandparse(i, j,
+				&candidates[j], &broken[j]);
+		if (!RET_IS_OK(results[j]))
+			candidates[j] = NULL;
+	}
+	r = candidates_prefetch(i, candidates);
+	if (RET_WAS_ERROR(r) && r != RET_ERROR_INTERRUPTED) {
+		fprintf(stderr,
+"Could not copy files in parallel, continuing one after the other...\n");
+		r = RET_NOTHING;
+	}
+	result = RET_NOTHING;
+	for (j = 0 ; j < i->files.count ; j++) {
+		if (!tocheck[j])
+			continue;
+		if (candidates[j] == NULL) {
+			RET_UPDATE(result, results[j]);
+		} else if (RET_WAS_ERROR(r)) {
+			candidate_free(candidates[j]);
+		} else {
+			results[j] = process_candidate(i, candidates[j],
+					broken[j]);
+			RET_UPDATE(result, results[j]);
+		}
+	}
+	RET_UPDATE(result, r);
+	free(candidates);
+	free(broken);
+	free(results);
+	return result;
+}
+
 static inline /*@null@*/char *create_uniq_subdir(const char *basedir) {
 	char date[16], *dir;
 	unsigned long number = 0;
@@ -2567,6 +2895,7 @@ retvalue process_incoming(struct distribution *distributions, const char *name,
 	retvalue result, r;
 	int j;
 	char *morguedir;
+	bool *tocheck;
 
 	result = RET_NOTHING;
 
@@ -2574,6 +2903,11 @@ retvalue process_incoming(struct distribution *distributions, const char *name,
 	if (RET_WAS_ERROR(r))
 		return r;
 
+	tocheck = nzNEW(i->files.count, bool);
+	if (FAILEDTOALLOC(tocheck)) {
+		incoming_free(i);
+		return RET_ERROR_OOM;
+	}
 	for (j = 0 ; j < i->files.count ; j ++) {
 		const char *basefilename = i->files.values[j];
 		size_t l = strlen(basefilename);
@@ -2585,9 +2919,17 @@ retvalue process_incoming(struct distribution *distributions, const char *name,
 		if (changesfilename != NULL && strcmp(basefilename, changesfilename) != 0)
 			continue;
 		/* a .changes file, check it */
+		tocheck[j] = true;
+		if (global.jobs > 1)
+			continue;
 		r = process_changes(i, j);
 		RET_UPDATE(result, r);
 	}
+	if (global.jobs > 1) {
+		r = process_changes_parallel(i, tocheck);
+		RET_UPDATE(result, r);
+	}
+	free(tocheck);
 
 	logger_wait();
 	if (i->morguedir == NULL)
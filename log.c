@@ -215,10 +215,16 @@ struct notificator {
 	component_t component;
 	architecture_t architecture;
 	command_t command;
-	bool withcontrol, changesacceptrule;
+	bool withcontrol, changesacceptrule, batched;
+	/* with --batched, the process to send events to once started */
+	/*@dependent@*//*@null@*/struct notification_batch *batch;
 };
 
+static void batch_finish(/*@only@*/struct notification_batch *);
+
 static void notificator_done(/*@special@*/struct notificator *n) /*@releases n->scriptname, n->packagename, n->component, n->architecture@*/{
+	if (n->batch != NULL)
+		batch_finish(n->batch);
 	free(n->scriptname);
 }
 
@@ -283,6 +289,8 @@ static retvalue notificator_parse(struct notificator *n, struct configiterator *
 				case 9:
 					if (strcmp(word, "--changes") == 0)
 						n->changesacceptrule = true;
+					else if (strcmp(word, "--batched") == 0)
+						n->batched = true;
 					else
 						error = true;
 					break;
@@ -672,6 +680,286 @@ static retvalue startchild(void) {
 	return RET_OK;
 }
 
+/* Notificators with --batched get all their events through one process:
+ * It is started once with the single argument "batch" and reads the events
+ * from stdin, each being a list of '\0'-terminated strings (first
+ * REPREPRO_CAUSING_FILE=, REPREPRO_CAUSING_RULE= and REPREPRO_FROM= with
+ * their values if set, then the arguments the script would get when not
+ * batched) ended by an empty string. After a batch of events another
+ * empty string follows, which the script has to acknowledge by writing
+ * a line "ok" to file descriptor 3 before the next batch is sent. */
+
+/* send the events collected so far if there are this many bytes: */
+#define BATCHSIZE 65536
+
+/*@null@*/ static struct notification_batch {
+	/*@null@*/struct notification_batch *next;
+	char *scriptname;
+	pid_t child;
+	/* the child's stdin and where it acknowledges batches */
+	int fd, ackfd;
+	/* the events not yet sent */
+	/*@null@*/char *data;
+	size_t len, size;
+	/* number of events not yet sent or sent but not yet acknowledged */
+	size_t pending, unacknowledged;
+	bool failed;
+} *batches = NULL;
+
+static void batch_fail(struct notification_batch *b, const char *reason) {
+	if (b->failed)
+		return;
+	fprintf(stderr,
+"Batched notification process '%s' %s, %lu events were possibly not processed!\n",
+			b->scriptname, reason,
+			(unsigned long)(b->pending + b->unacknowledged));
+	b->failed = true;
+	if (b->fd >= 0) {
+		(void)close(b->fd);
+		b->fd = -1;
+	}
+}
+
+static retvalue batch_start(struct notificator *n) {
+	struct notification_batch *b, **bb;
+	int infds[2], ackfds[2];
+	pid_t child;
+
+	b = zNEW(struct notification_batch);
+	if (FAILEDTOALLOC(b))
+		return RET_ERROR_OOM;
+	b->scriptname = strdup(n->scriptname);
+	if (FAILEDTOALLOC(b->scriptname)) {
+		free(b);
+		return RET_ERROR_OOM;
+	}
+	b->fd = -1;
+	b->ackfd = -1;
+	/* even if starting fails, remember it so events are not lost
+	 * silently */
+	bb = &batches;
+	while (*bb != NULL)
+		bb = &(*bb)->next;
+	*bb = b;
+	n->batch = b;
+
+	if (pipe(infds) != 0) {
+		int e = errno;
+		fprintf(stderr, "Error creating pipe: %d=%s!\n",
+				e, strerror(e));
+		batch_fail(b, "could not be started");
+		return RET_ERRNO(e);
+	}
+	if (pipe(ackfds) != 0) {
+		int e = errno;
+		fprintf(stderr, "Error creating pipe: %d=%s!\n",
+				e, strerror(e));
+		(void)close(infds[0]);
+		(void)close(infds[1]);
+		batch_fail(b, "could not be started");
+		return RET_ERRNO(e);
+	}
+	child = fork();
+	if (child == 0) {
+		(void)close(infds[1]);
+		(void)close(ackfds[0]);
+		(void)dup2(infds[0], 0);
+		(void)dup2(ackfds[1], 3);
+		closefrom(4);
+		sethookenvironment(NULL, NULL, NULL, NULL);
+		(void)execl(b->scriptname, b->scriptname, "batch", NULL);
+		fprintf(stderr, "Error executing '%s': %s\n", b->scriptname,
+				strerror(errno));
+		_exit(255);
+	}
+	(void)close(infds[0]);
+	(void)close(ackfds[1]);
+	if (child < 0) {
+		int e = errno;
+		fprintf(stderr, "Error forking: %d=%s!\n", e, strerror(e));
+		(void)close(infds[1]);
+		(void)close(ackfds[0]);
+		batch_fail(b, "could not be started");
+		return RET_ERRNO(e);
+	}
+	markcloseonexec(infds[1]);
+	markcloseonexec(ackfds[0]);
+	b->child = child;
+	b->fd = infds[1];
+	b->ackfd = ackfds[0];
+	return RET_OK;
+}
+
+static retvalue batch_append(struct notification_batch *b, const char *prefix, const char *s) {
+	size_t plen = strlen(prefix), slen = strlen(s);
+
+	if (b->len + plen + slen + 2 > b->size) {
+		size_t newsize = b->size + plen + slen + 2 + BATCHSIZE;
+		char *n = realloc(b->data, newsize);
+
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		b->data = n;
+		b->size = newsize;
+	}
+	memcpy(b->data + b->len, prefix, plen);
+	memcpy(b->data + b->len + plen, s, slen + 1);
+	b->len += plen + slen + 1;
+	return RET_OK;
+}
+
+static void batch_waitack(struct notification_batch *b) {
+	char line[10];
+	size_t got = 0;
+	ssize_t r;
+
+	if (b->failed || b->unacknowledged == 0)
+		return;
+	while (got < sizeof(line)) {
+		r = read(b->ackfd, line + got, 1);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		if (line[got] == '\n')
+			break;
+		got++;
+	}
+	if (got == 2 && memcmp(line, "ok", 2) == 0) {
+		b->unacknowledged = 0;
+		return;
+	}
+	batch_fail(b, "did not acknowledge a batch");
+}
+
+/* send all collected events (after the last batch was acknowledged) */
+static void batch_flush(struct notification_batch *b) {
+	struct sigaction sa, oldsa;
+	size_t done = 0;
+	ssize_t written;
+
+	if (b->failed || b->pending == 0)
+		return;
+	batch_waitack(b);
+	if (b->failed)
+		return;
+	assert (b->len < b->size);
+	/* the empty string marking the end of the batch */
+	b->data[b->len++] = '\0';
+	/* a dying script is to be reported, not to kill us */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_IGN;
+	(void)sigaction(SIGPIPE, &sa, &oldsa);
+	while (done < b->len) {
+		written = write(b->fd, b->data + done, b->len - done);
+		if (written < 0) {
+			int e = errno;
+
+			if (e == EINTR)
+				continue;
+			fprintf(stderr,
+"Error '%s' while sending data to '%s'!\n",
+					strerror(e), b->scriptname);
+			break;
+		}
+		done += written;
+	}
+	(void)sigaction(SIGPIPE, &oldsa, NULL);
+	if (done < b->len) {
+		b->len--;
+		batch_fail(b, "could not be sent its events");
+		return;
+	}
+	b->unacknowledged = b->pending;
+	b->pending = 0;
+	b->len = 0;
+}
+
+static retvalue batch_add(struct notificator *n, char **arguments, /*@null@*/const char *causing, /*@null@*/const char *causingrule, /*@null@*/const char *suitefrom) {
+	struct notification_batch *b;
+	retvalue r = RET_OK;
+
+	if (n->batch == NULL) {
+		r = batch_start(n);
+		if (RET_WAS_ERROR(r) && n->batch == NULL)
+			return r;
+	}
+	b = n->batch;
+	if (b->failed) {
+		b->pending++;
+		return RET_ERROR;
+	}
+	if (causing != NULL)
+		r = batch_append(b, "REPREPRO_CAUSING_FILE=", causing);
+	if (!RET_WAS_ERROR(r) && causingrule != NULL)
+		r = batch_append(b, "REPREPRO_CAUSING_RULE=", causingrule);
+	if (!RET_WAS_ERROR(r) && suitefrom != NULL)
+		r = batch_append(b, "REPREPRO_FROM=", suitefrom);
+	for (; !RET_WAS_ERROR(r) && *arguments != NULL ; arguments++)
+		r = batch_append(b, "", *arguments);
+	if (!RET_WAS_ERROR(r))
+		r = batch_append(b, "", "");
+	if (RET_WAS_ERROR(r))
+		return r;
+	b->pending++;
+	if (b->len >= BATCHSIZE)
+		batch_flush(b);
+	return RET_OK;
+}
+
+/* send everything left, wait for the acknowledgement and the process
+ * (only when the notificator is no longer needed, as the process is to
+ * get the events of all .changes files processed in one run) */
+static void batch_finish(/*@only@*/struct notification_batch *b) {
+	struct notification_batch **bb;
+	pid_t child;
+	int status;
+
+	for (bb = &batches ; *bb != NULL ; bb = &(*bb)->next) {
+		if (*bb == b) {
+			*bb = b->next;
+			break;
+		}
+	}
+	/* if interrupted, what is left was already reported by
+	 * logger_warn_waiting */
+	if (!interrupted()) {
+		batch_flush(b);
+		batch_waitack(b);
+	}
+	if (b->fd >= 0)
+		(void)close(b->fd);
+	if (b->ackfd >= 0)
+		(void)close(b->ackfd);
+	if (b->child > 0) {
+		do {
+			child = waitpid(b->child, &status, 0);
+		} while (child < 0 && errno == EINTR);
+		if (child < 0) {
+			int e = errno;
+			fprintf(stderr,
+"Error calling waitpid on notification child: %d=%s\n",
+					e, strerror(e));
+		} else if (WIFSIGNALED(status)) {
+			fprintf(stderr,
+"Notification process '%s' killed with signal %d!\n",
+					b->scriptname, WTERMSIG(status));
+		} else if (!WIFEXITED(status)) {
+			fprintf(stderr,
+"Notification process '%s' failed!\n",
+					b->scriptname);
+		} else if (WEXITSTATUS(status) != 0) {
+			fprintf(stderr,
+"Notification process '%s' returned with exit code %d!\n",
+					b->scriptname,
+					(int)(WEXITSTATUS(status)));
+		}
+	}
+	free(b->scriptname);
+	free(b->data);
+	free(b);
+}
+
 static retvalue notificator_enqueuechanges(struct notificator *n, const char *codename, const char *name, const char *version, const char *safefilename, /*@null@*/const char *filekey) {
 	size_t count, i, j;
 	char **arguments;
@@ -708,6 +996,15 @@ static retvalue notificator_enqueuechanges(struct notificator *n, const char *co
 			free(arguments);
 			return RET_ERROR_OOM;
 		}
+	if (n->batched) {
+		retvalue r;
+
+		r = batch_add(n, arguments + 1, causingfile, NULL, NULL);
+		for (j = 0 ; j < count ; j++)
+			free(arguments[j]);
+		free(arguments);
+		return r;
+	}
 	if (processes == NULL) {
 		p = NEW(struct notification_process);
 		processes = p;
@@ -843,6 +1140,16 @@ static retvalue notificator_enqueue(struct notificator *n, struct target *target
 			return RET_ERROR_OOM;
 		}
 	}
+	if (n->batched) {
+		retvalue r;
+
+		r = batch_add(n, arguments + 1, causingfile, causingrule,
+				suitefrom);
+		for (i = 0 ; i < count ; i++)
+			free(arguments[i]);
+		free(arguments);
+		return r;
+	}
 	if (processes == NULL) {
 		p = NEW(struct notification_process);
 		processes = p;
@@ -912,6 +1219,14 @@ static retvalue notificator_enqueue(struct notificator *n, struct target *target
 }
 
 void logger_wait(void) {
+	struct notification_batch *b;
+
+	/* the batch processes keep running till logger_free,
+	 * only wait till they processed everything so far */
+	for (b = batches ; b != NULL && !interrupted() ; b = b->next) {
+		batch_flush(b);
+		batch_waitack(b);
+	}
 	while (processes != NULL) {
 		catchchildren();
 		if (interrupted())
@@ -929,6 +1244,16 @@ void logger_wait(void) {
 
 void logger_warn_waiting(void) {
 	struct notification_process *p;
+	struct notification_batch *b;
+
+	for (b = batches ; b != NULL ; b = b->next) {
+		if (b->pending + b->unacknowledged == 0)
+			continue;
+		fprintf(stderr,
+"WARNING: %lu events for batched notificator '%s' were not processed!\n",
+				(unsigned long)(b->pending + b->unacknowledged),
+				b->scriptname);
+	}
 
 	if (processes != NULL) {
 		(void)fputs(
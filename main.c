@@ -116,6 +116,7 @@ static char /*@only@*/
 	*unlzma = NULL,
 	*unxz = NULL,
 	*lunzip = NULL,
+	*unzstd = NULL,
 	*gnupghome = NULL;
 static int 	listmax = -1;
 static int 	listskip = 0;
@@ -126,6 +127,8 @@ static bool	keepunreferenced = false;
 static bool	keepunusednew = false;
 static bool	askforpassphrase = false;
 static bool	guessgpgtty = true;
+static bool	signaturecache = false;
+static bool	checksumcache = false;
 static bool	skipold = true;
 static size_t   waitforlock = 0;
 static enum exportwhen export = EXPORT_CHANGED;
@@ -142,7 +145,7 @@ static off_t reservedotherspace = 1024*1024;
  * to change something owned by lower owners. */
 enum config_option_owner config_state,
 #define O(x) owner_ ## x = CONFIG_OWNER_DEFAULT
-O(fast), O(x_morguedir), O(x_outdir), O(x_basedir), O(x_distdir), O(x_dbdir), O(x_listdir), O(x_confdir), O(x_logdir), O(x_methoddir), O(x_section), O(x_priority), O(x_component), O(x_architecture), O(x_packagetype), O(nothingiserror), O(nolistsdownload), O(keepunusednew), O(keepunreferenced), O(keeptemporaries), O(keepdirectories), O(askforpassphrase), O(skipold), O(export), O(waitforlock), O(spacecheckmode), O(reserveddbspace), O(reservedotherspace), O(guessgpgtty), O(verbosedatabase), O(gunzip), O(bunzip2), O(unlzma), O(unxz), O(lunzip), O(gnupghome), O(listformat), O(listmax), O(listskip), O(onlysmalldeletes), O(endhook), O(outhook);
+O(fast), O(x_morguedir), O(x_outdir), O(x_basedir), O(x_distdir), O(x_dbdir), O(x_listdir), O(x_confdir), O(x_logdir), O(x_methoddir), O(x_section), O(x_priority), O(x_component), O(x_architecture), O(x_packagetype), O(nothingiserror), O(nolistsdownload), O(keepunusednew), O(keepunreferenced), O(keeptemporaries), O(keepdirectories), O(askforpassphrase), O(skipold), O(export), O(waitforlock), O(spacecheckmode), O(reserveddbspace), O(reservedotherspace), O(guessgpgtty), O(verbosedatabase), O(gunzip), O(bunzip2), O(unlzma), O(unxz), O(lunzip), O(unzstd), O(gnupghome), O(listformat), O(listmax), O(listskip), O(onlysmalldeletes), O(endhook), O(outhook), O(jobs), O(signaturecache), O(checksumcache);
 #undef O
 
 #define CONFIGSET(variable, value) if (owner_ ## variable <= config_state) { \
@@ -340,6 +343,10 @@ ACTION_N(n, n, n, dumpuncompressors) {
 				printf(
 "not supported (install lzip or use --lunzip to tell where lunzip is).\n");
 				break;
+			case c_zstd:
+				printf(
+"not supported (install zstd or use --unzstd to tell where unzstd is).\n");
+				break;
 			default:
 				printf("not supported\n");
 		}
@@ -585,23 +592,16 @@ ACTION_R(n, n, n, n, dumpreferences) {
 	return references_dump();
 }
 
-static retvalue checkifreferenced(UNUSED(void *data), const char *filekey) {
-	retvalue r;
-
-	r = references_isused(filekey);
-	if (r == RET_NOTHING) {
-		printf("%s\n", filekey);
-		return RET_OK;
-	} else if (RET_IS_OK(r)) {
-		return RET_NOTHING;
-	} else
-		return r;
+static retvalue printfilekey(UNUSED(void *data), const char *filekey) {
+	if (puts(filekey) == EOF)
+		return RET_ERROR;
+	return RET_OK;
 }
 
 ACTION_RF(n, n, n, n, dumpunreferenced) {
 	retvalue result;
 
-	result = files_foreach(checkifreferenced, NULL);
+	result = files_foreachunreferenced(printfilekey, NULL);
 	return result;
 }
 
@@ -618,7 +618,12 @@ static retvalue deleteifunreferenced(UNUSED(void *data), const char *filekey) {
 		return r;
 }
 
+static retvalue collectfilekey(void *data, const char *filekey) {
+	return strlist_add_dup(data, filekey);
+}
+
 ACTION_RF(n, n, n, n, deleteunreferenced) {
+	struct strlist unreferenced;
 	retvalue result;
 
 	if (keepunreferenced) {
@@ -633,7 +638,11 @@ ACTION_RF(n, n, n, n, deleteunreferenced) {
 "if you are sure you want to delete those files.\n");
 		return RET_ERROR;
 	}
-	result = files_foreach(deleteifunreferenced, NULL);
+	strlist_init(&unreferenced);
+	result = files_foreachunreferenced(collectfilekey, &unreferenced);
+	if (RET_IS_OK(result))
+		result = pool_deletefiles(&unreferenced);
+	strlist_done(&unreferenced);
 	return result;
 }
 
@@ -856,6 +865,8 @@ static retvalue package_source_fits(struct package *package, void *data) {
 
 static retvalue remove_packages(struct distribution *distribution, struct removesrcdata *toremove) {
 	trackingdb tracks;
+	const struct removesrcdata *d;
+	struct strlist sources;
 	retvalue result, r;
 
 	r = distribution_prepareforwriting(distribution);
@@ -903,11 +914,25 @@ static retvalue remove_packages(struct distribution *distribution, struct remove
 		RET_ENDUPDATE(result, r);
 		return result;
 	}
-	return package_remove_each(distribution,
+	/* only look at the packages of those sources (if the index
+	 * allows that), package_source_fits checks all of them anyway */
+	strlist_init(&sources);
+	for (d = toremove ; d->sourcename != NULL ; d++) {
+		if (strlist_in(&sources, d->sourcename))
+			continue;
+		r = strlist_add_dup(&sources, d->sourcename);
+		if (RET_WAS_ERROR(r)) {
+			strlist_done(&sources);
+			return r;
+		}
+	}
+	result = package_remove_each_source(distribution,
 			// TODO: why not arch comp pt here?
 			atom_unknown, atom_unknown, atom_unknown,
-			package_source_fits, NULL,
+			&sources, package_source_fits, NULL,
 			toremove);
+	strlist_done(&sources);
+	return result;
 }
 
 ACTION_D(n, n, y, removesrc) {
@@ -1073,6 +1098,7 @@ ACTION_D(y, n, y, removematched) {
 	struct distribution *distribution;
 	trackingdb tracks;
 	struct trackingdata trackingdata;
+	char *prefix;
 
 	assert (argc == 3);
 
@@ -1108,11 +1134,16 @@ ACTION_D(y, n, y, removematched) {
 	} else
 		tracks = NULL;
 
-	result = package_remove_each(distribution,
-			components, architectures, packagetypes,
+	prefix = glob_literalprefix(argv[2]);
+	if (FAILEDTOALLOC(prefix))
+		result = RET_ERROR_OOM;
+	else
+		result = package_remove_each_prefix(distribution,
+			components, architectures, packagetypes, prefix,
 			package_matches_glob,
 			(tracks != NULL)?&trackingdata:NULL,
 			(void*)argv[2]);
+	free(prefix);
 	if (tracks != NULL) {
 		trackingdata_finish(tracks, &trackingdata);
 		r = tracking_done(tracks, distribution);
@@ -1524,6 +1555,7 @@ static retvalue listmatchprint(struct package *package, void *data) {
 ACTION_B(y, n, y, listmatched) {
 	retvalue r, result;
 	struct distribution *distribution;
+	char *prefix;
 
 	assert (argc == 3);
 
@@ -1532,9 +1564,13 @@ ACTION_B(y, n, y, listmatched) {
 	if (RET_WAS_ERROR(r)) {
 		return r;
 	}
-	result = package_foreach(distribution,
-			components, architectures, packagetypes,
+	prefix = glob_literalprefix(argv[2]);
+	if (FAILEDTOALLOC(prefix))
+		return RET_ERROR_OOM;
+	result = package_foreach_prefix(distribution,
+			components, architectures, packagetypes, prefix,
 			listmatchprint, NULL, (void*)argv[2]);
+	free(prefix);
 	return result;
 }
 
@@ -1625,9 +1661,40 @@ ACTION_B(n, n, n, dumpcontents) {
 	return result;
 }
 
+ACTION_B(n, n, n, dumpshared) {
+	retvalue result, r;
+	struct table *shared;
+	const char *key, *data;
+	struct cursor *cursor;
+
+	assert (argc == 2);
+
+	result = database_opensharedpackages(argv[1], true, &shared);
+	if (RET_WAS_ERROR(result))
+		return result;
+	r = table_newglobalcursor(shared, true, &cursor);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r)) {
+		(void)table_close(shared);
+		return r;
+	}
+	result = RET_NOTHING;
+	while (cursor_nexttempdata(shared, cursor, &key, &data, NULL)) {
+		/* only the use count, the control chunk follows it */
+		printf("'%s' -> %lu\n", key, strtoul(data, NULL, 10));
+		result = RET_OK;
+	}
+	r = cursor_close(shared, cursor);
+	RET_ENDUPDATE(result, r);
+	r = table_close(shared);
+	RET_ENDUPDATE(result, r);
+	return result;
+}
+
 ACTION_F(n, n, y, y, export) {
 	retvalue result, r;
-	struct distribution *d;
+	struct distribution *d, **queue;
+	int i, queued;
 
 	if (export == EXPORT_NEVER || export == EXPORT_SILENT_NEVER) {
 		fprintf(stderr,
@@ -1639,6 +1706,17 @@ ACTION_F(n, n, y, y, export) {
 	assert (result != RET_NOTHING);
 	if (RET_WAS_ERROR(result))
 		return result;
+	/* with --jobs, collect them to export them in parallel */
+	queue = NULL;
+	queued = 0;
+	if (global.jobs > 1) {
+		i = 0;
+		for (d = alldistributions ; d != NULL ; d = d->next)
+			i++;
+		queue = nNEW(i, struct distribution *);
+		if (FAILEDTOALLOC(queue))
+			return RET_ERROR_OOM;
+	}
 	result = RET_NOTHING;
 	for (d = alldistributions ; d != NULL ; d = d->next) {
 		if (!d->selected)
@@ -1655,6 +1733,10 @@ ACTION_F(n, n, y, y, export) {
 		if (verbose > 0) {
 			printf("Exporting %s...\n", d->codename);
 		}
+		if (queue != NULL) {
+			queue[queued++] = d;
+			continue;
+		}
 		r = distribution_fullexport(d);
 		if (RET_IS_OK(r))
 			/* avoid being exported again */
@@ -1664,6 +1746,16 @@ ACTION_F(n, n, y, y, export) {
 			return r;
 		}
 	}
+	if (queue != NULL) {
+		r = distribution_fullexportmany(queue, queued);
+		if (RET_IS_OK(r)) {
+			/* avoid being exported again */
+			for (i = 0 ; i < queued ; i++)
+				queue[i]->lookedat = false;
+		}
+		RET_UPDATE(result, r);
+		free(queue);
+	}
 	return result;
 }
 
@@ -2758,6 +2850,10 @@ ACTION_RF(n, n, y, y, sizes) {
 	return sizes_distributions(alldistributions, argc > 1);
 }
 
+ACTION_RF(n, n, n, n, recountsizes) {
+	return sizes_recount();
+}
+
 /***********************include******************************************/
 
 ACTION_D(y, y, y, includedeb) {
@@ -2880,16 +2976,10 @@ ACTION_D(y, y, y, includedeb) {
 	} else {
 		tracks = NULL;
 	}
-	result = RET_NOTHING;
-	for (i = 2 ; i < argc ; i++) {
-		const char *filename = argv[i];
-
-		r = deb_add(component, architectures,
-				section, priority, packagetype,
-				distribution, filename,
-				delete, tracks);
-		RET_UPDATE(result, r);
-	}
+	result = deb_addmany(component, architectures,
+			section, priority, packagetype,
+			distribution, argc - 2, argv + 2,
+			delete, tracks);
 
 	distribution_unloadoverrides(distribution);
 
@@ -2903,6 +2993,7 @@ ACTION_D(y, y, y, includedsc) {
 	retvalue result, r;
 	struct distribution *distribution;
 	trackingdb tracks;
+	int i;
 	component_t component = atom_unknown;
 
 	if (components != NULL) {
@@ -2916,8 +3007,7 @@ ACTION_D(y, y, y, includedsc) {
 		component = components->atoms[0];
 	}
 
-
-	assert (argc == 3);
+	assert (argc >= 3);
 
 	if (limitations_missed(architectures, architecture_source)) {
 		fprintf(stderr,
@@ -2929,9 +3019,11 @@ ACTION_D(y, y, y, includedsc) {
 "Cannot put a source package anywhere else than in type 'dsc'!\n");
 		return RET_ERROR;
 	}
-	if (!endswith(argv[2], ".dsc") && !IGNORING(extension,
-"includedsc called with a file not ending with '.dsc'\n"))
-		return RET_ERROR;
+	for (i = 2 ; i < argc ; i++) {
+		if (!endswith(argv[i], ".dsc") && !IGNORING(extension,
+"includedsc called with file '%s' not ending with '.dsc'\n", argv[i]))
+			return RET_ERROR;
+	}
 
 	result = distribution_get(alldistributions, argv[1], true, &distribution);
 	assert (result != RET_NOTHING);
@@ -2962,8 +3054,12 @@ ACTION_D(y, y, y, includedsc) {
 		tracks = NULL;
 	}
 
-	result = dsc_add(component, section, priority,
-			distribution, argv[2], delete, tracks);
+	result = RET_NOTHING;
+	for (i = 2 ; i < argc ; i++) {
+		r = dsc_add(component, section, priority,
+				distribution, argv[i], delete, tracks);
+		RET_UPDATE(result, r);
+	}
 	logger_wait();
 
 	distribution_unloadoverrides(distribution);
@@ -3616,6 +3712,10 @@ ACTION_D(n, n, n, clearvanished) {
 		}
 		/* derference anything left */
 		references_remove(identifier);
+		/* and the shared control data */
+		r = target_releaseshared(identifier);
+		if (RET_WAS_ERROR(r))
+			return r;
 		/* remove the database */
 		database_droppackages(identifier);
 	}
@@ -4004,6 +4104,8 @@ static const struct action {
 		0, 0, "_addmd5sums < data"},
 	{"_dumpcontents", 	A_ROB(dumpcontents)|MAY_UNUSED,
 		1, 1, "_dumpcontents <identifier>"},
+	{"_dumpshared", 	A_ROB(dumpshared)|MAY_UNUSED,
+		1, 1, "_dumpshared <identifier without architecture>"},
 	{"_removereferences", 	A__R(removereferences),
 		1, 1, "_removereferences <identifier>"},
 	{"_removereference", 	A__R(removereference),
@@ -4044,6 +4146,8 @@ static const struct action {
 		0, -1, "check [<distributions>]"},
 	{"sizes", 		A_RF(sizes),
 		0, -1, "check [<distributions>]"},
+	{"recountsizes", 	A_RF(recountsizes),
+		0, 0, "recountsizes"},
 	{"reoverride", 		A_Fact(reoverride),
 		0, -1, "[-T ...] [-C ...] [-A ...] reoverride [<distributions>]"},
 	{"repairdescriptions", 	A_Fact(repairdescriptions),
@@ -4121,7 +4225,7 @@ static const struct action {
 	{"includeddeb",		A_Dactsp(includedeb)|NEED_DELNEW,
 		2, -1, "[--delete] includeddeb <distribution> <.ddeb-file>"},
 	{"includedsc",		A_Dactsp(includedsc)|NEED_DELNEW,
-		2, 2, "[--delete] includedsc <distribution> <package>"},
+		2, -1, "[--delete] includedsc <distribution> <.dsc-file>"},
 	{"include",		A_Dactsp(include)|NEED_DELNEW,
 		2, 2, "[--delete] include <distribution> <.changes-file>"},
 	{"generatefilelists",	A_F(generatefilelists),
@@ -4354,9 +4458,12 @@ static retvalue callaction(command_t command, const struct action *action, int a
 	/* adding files may check references to see if they were added */
 	if (ISSET(needs, NEED_FILESDB))
 		needs |= NEED_REFERENCES;
-
 	if (ISSET(needs, NEED_REFERENCES))
 		result = database_openreferences();
+	/* changing references needs file sizes for size accounting */
+	if (RET_IS_OK(result) && ISSET(needs, NEED_REFERENCES)
+			&& !ISSET(needs, IS_RO) && sizes_accountingenabled())
+		needs |= NEED_FILESDB;
 
 	assert (result != RET_NOTHING);
 	if (RET_IS_OK(result)) {
@@ -4364,6 +4471,14 @@ static retvalue callaction(command_t command, const struct action *action, int a
 		if (ISSET(needs, NEED_FILESDB))
 			result = database_openfiles();
 
+		if (RET_IS_OK(result) && signaturecache
+				&& !ISSET(needs, IS_RO))
+			result = database_opensignaturecache();
+
+		if (RET_IS_OK(result) && checksumcache
+				&& !ISSET(needs, IS_RO))
+			result = database_openchecksumscache();
+
 		if (RET_IS_OK(result)) {
 			if (outhook != NULL) {
 				r = outhook_start();
@@ -4491,6 +4606,7 @@ LO_BUNZIP2,
 LO_UNLZMA,
 LO_UNXZ,
 LO_LZIP,
+LO_UNZSTD,
 LO_GNUPGHOME,
 LO_LISTFORMAT,
 LO_LISTSKIP,
@@ -4503,6 +4619,11 @@ LO_RESTRICT_FILE_BIN,
 LO_RESTRICT_FILE_SRC,
 LO_ENDHOOK,
 LO_OUTHOOK,
+LO_JOBS,
+LO_SIGNATURECACHE,
+LO_NOSIGNATURECACHE,
+LO_CHECKSUMCACHE,
+LO_NOCHECKSUMCACHE,
 LO_UNIGNORE};
 static int longoption = 0;
 const char *programname;
@@ -4580,6 +4701,7 @@ static void handle_option(int c, const char *argument) {
 " -C, --component <component>: 	     Add,list or delete only in component.\n"
 " -A, --architecture <architecture>: Add,list or delete only to architecture.\n"
 " -T, --type <type>:                 Add,list or delete only type (dsc,deb,udeb,ddeb).\n"
+"     --jobs <count>:                Use up to <count> worker processes.\n"
 "\n"
 "actions (selection, for more see manpage):\n"
 " dumpreferences:    Print all saved references\n"
@@ -4783,6 +4905,9 @@ static void handle_option(int c, const char *argument) {
 				case LO_LZIP:
 					CONFIGDUP(lunzip, argument);
 					break;
+				case LO_UNZSTD:
+					CONFIGDUP(unzstd, argument);
+					break;
 				case LO_GNUPGHOME:
 					CONFIGDUP(gnupghome, argument);
 					break;
@@ -4792,6 +4917,23 @@ static void handle_option(int c, const char *argument) {
 				case LO_OUTHOOK:
 					CONFIGDUP(outhook, argument);
 					break;
+				case LO_JOBS:
+					i = parse_number("--jobs",
+							argument, 1024);
+					CONFIGGSET(jobs, i);
+					break;
+				case LO_SIGNATURECACHE:
+					CONFIGSET(signaturecache, true);
+					break;
+				case LO_NOSIGNATURECACHE:
+					CONFIGSET(signaturecache, false);
+					break;
+				case LO_CHECKSUMCACHE:
+					CONFIGSET(checksumcache, true);
+					break;
+				case LO_NOCHECKSUMCACHE:
+					CONFIGSET(checksumcache, false);
+					break;
 				case LO_LISTMAX:
 					i = parse_number("--list-max",
 							argument, INT_MAX);
@@ -5099,6 +5241,7 @@ int main(int argc, char *argv[]) {
 		{"unlzma", required_argument, &longoption, LO_UNLZMA},
 		{"unxz", required_argument, &longoption, LO_UNXZ},
 		{"lunzip", required_argument, &longoption, LO_LZIP},
+		{"unzstd", required_argument, &longoption, LO_UNZSTD},
 		{"gnupghome", required_argument, &longoption, LO_GNUPGHOME},
 		{"list-format", required_argument, &longoption, LO_LISTFORMAT},
 		{"list-skip", required_argument, &longoption, LO_LISTSKIP},
@@ -5115,6 +5258,11 @@ int main(int argc, char *argv[]) {
 		{"restrict-file-binary", required_argument, &longoption, LO_RESTRICT_FILE_BIN},
 		{"endhook", required_argument, &longoption, LO_ENDHOOK},
 		{"outhook", required_argument, &longoption, LO_OUTHOOK},
+		{"jobs", required_argument, &longoption, LO_JOBS},
+		{"signaturecache", no_argument, &longoption, LO_SIGNATURECACHE},
+		{"nosignaturecache", no_argument, &longoption, LO_NOSIGNATURECACHE},
+		{"checksumcache", no_argument, &longoption, LO_CHECKSUMCACHE},
+		{"nochecksumcache", no_argument, &longoption, LO_NOCHECKSUMCACHE},
 		{NULL, 0, NULL, 0}
 	};
 	const struct action *a;
@@ -5265,12 +5413,15 @@ int main(int argc, char *argv[]) {
 		unxz = expand_plus_prefix(unxz, "unxz", "boc", true);
 	if (lunzip != NULL && lunzip[0] == '+')
 		lunzip = expand_plus_prefix(lunzip, "lunzip", "boc", true);
-	uncompressions_check(gunzip, bunzip2, unlzma, unxz, lunzip);
+	if (unzstd != NULL && unzstd[0] == '+')
+		unzstd = expand_plus_prefix(unzstd, "unzstd", "boc", true);
+	uncompressions_check(gunzip, bunzip2, unlzma, unxz, lunzip, unzstd);
 	free(gunzip);
 	free(bunzip2);
 	free(unlzma);
 	free(unxz);
 	free(lunzip);
+	free(unzstd);
 
 	a = all_actions;
 	while (a->name != NULL) {
@@ -5333,8 +5484,3 @@ int main(int argc, char *argv[]) {
 	signatures_done();
 	myexit(EXIT_FAILURE);
 }
-
-retvalue package_newcontrol_by_cursor(struct package_cursor *cursor, const char *newcontrol, size_t newcontrollen) {
-	return cursor_replace(cursor->target->packages, cursor->cursor,
-			newcontrol, newcontrollen);
-}
@@ -2,6 +2,9 @@
 #define REPREPRO_PACKAGE_H
 
 #include "atoms.h"
+#ifndef REPREPRO_STRLIST_H
+#include "strlist.h"
+#endif
 
 struct package {
 	/*@temp@*/ struct target *target;
@@ -17,6 +20,9 @@ struct package {
 	/* used to keep the memory that might be needed for the above,
 	 * only to be used to free once this struct is abandoned */
 	char *pkgchunk, *pkgname, *pkgversion, *pkgsource, *pkgsrcversion;
+	/* if the control chunk is shared with other architectures,
+	 * its key in the shared table */
+	/*@null@*/char *sharedkey;
 };
 struct distribution;
 struct target;
@@ -29,11 +35,16 @@ typedef retvalue action_each_package(struct package *, void *);
 
 /* call <action> for each package of <distribution> */
 retvalue package_foreach(struct distribution *, /*@null@*/const struct atomlist *, /*@null@*/const struct atomlist *, /*@null@*/const struct atomlist *, action_each_package, /*@null@*/action_each_target, void *);
+/* same but only for packages with names starting with the given prefix */
+retvalue package_foreach_prefix(struct distribution *, /*@null@*/const struct atomlist *, /*@null@*/const struct atomlist *, /*@null@*/const struct atomlist *, /*@null@*/const char * /*prefix*/, action_each_package, /*@null@*/action_each_target, void *);
 /* same but different ways to restrict it */
 retvalue package_foreach_c(struct distribution *, /*@null@*/const struct atomlist *, architecture_t, packagetype_t, action_each_package, void *);
 
 /* delete every package decider returns RET_OK for */
 retvalue package_remove_each(struct distribution *, const struct atomlist *, const struct atomlist *, const struct atomlist *, action_each_package /*decider*/, struct trackingdata *, void *);
+retvalue package_remove_each_prefix(struct distribution *, const struct atomlist *, const struct atomlist *, const struct atomlist *, /*@null@*/const char * /*prefix*/, action_each_package /*decider*/, struct trackingdata *, void *);
+/* same but only looking at packages of the given source if possible */
+retvalue package_remove_each_source(struct distribution *, const struct atomlist *, const struct atomlist *, const struct atomlist *, const struct strlist * /*sources*/, action_each_package /*decider*/, struct trackingdata *, void *);
 
 
 retvalue package_get(struct target *, const char * /*name*/, /*@null@*/ const char */*version*/, /*@out@*/ struct package *);
@@ -44,6 +55,7 @@ static inline void package_done(struct package *pkg) {
 	free(pkg->pkgversion);
 	free(pkg->pkgsource);
 	free(pkg->pkgsrcversion);
+	free(pkg->sharedkey);
 	memset(pkg, 0, sizeof(*pkg));
 }
 
@@ -69,9 +81,13 @@ struct package_cursor {
 	struct cursor *cursor;
 	struct package current;
 	bool close_database;
+	/* errors while reading packages not known to the cursor */
+	retvalue r;
 };
 
 retvalue package_openiterator(struct target *, bool /*readonly*/, bool /*duplicate*/, /*@out@*/struct package_cursor *);
+retvalue package_openprefixiterator(struct target *, bool /*readonly*/, bool /*duplicate*/, /*@null@*/const char * /*prefix*/, /*@out@*/struct package_cursor *);
+retvalue package_opensourceiterator(struct target *, bool /*readonly*/, const char * /*source*/, /*@out@*/struct package_cursor *);
 retvalue package_openduplicateiterator(struct target *t, const char *name, long long, /*@out@*/struct package_cursor *tc);
 bool package_next(struct package_cursor *);
 retvalue package_closeiterator(struct package_cursor *);
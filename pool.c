@@ -37,6 +37,7 @@
 #include "files.h"
 #include "sources.h"
 #include "outhook.h"
+#include "workers.h"
 
 /* for now save them only in memory. In later times some way to store
  * them on disk would be nice */
@@ -430,6 +431,47 @@ static inline retvalue movefiletomorgue(const char *filekey, const char *filenam
 	}
 }
 
+/* try to delete parent directories of a deleted file, until one gives
+ * errors (hopefully because it still contains files),
+ * the argument is modified in the process */
+static void removeemptydirs(char *filename) {
+	size_t fixedpartlen = strlen(global.outdir);
+	char *p;
+	int err, en;
+
+	while ((p = strrchr(filename, '/')) != NULL) {
+		/* do not try to remove parts of the mirrordir */
+		if ((size_t)(p-filename) <= fixedpartlen+1)
+			break;
+		*p ='\0';
+		/* try to rmdir the directory, this will
+		 * fail if there are still other files or directories
+		 * in it: */
+		err = rmdir(filename);
+		if (err == 0) {
+			if (verbose > 1) {
+				printf(
+"removed now empty directory %s\n",
+						filename);
+			}
+		} else {
+			en = errno;
+			if (en != ENOTEMPTY && en != ENOENT) {
+				//TODO: check here if only some
+				//other error was first and it
+				//is not empty so we do not have
+				//to remove it anyway...
+				fprintf(stderr,
+"ignoring error %d trying to rmdir %s: %s\n", en, filename, strerror(en));
+			}
+			/* parent directories will contain this one
+			 * thus not be empty, in other words:
+			 * everything's done */
+			break;
+		}
+	}
+}
+
 /* delete the file and possible parent directories,
  * if not new and morguedir set, first move/copy there */
 static retvalue deletepoolfile(const char *filekey, bool new) {
@@ -452,46 +494,8 @@ static retvalue deletepoolfile(const char *filekey, bool new) {
 		free(filename);
 		return r;
 	}
-	if (!global.keepdirectories) {
-		/* try to delete parent directories, until one gives
-		 * errors (hopefully because it still contains files) */
-		size_t fixedpartlen = strlen(global.outdir);
-		char *p;
-		int err, en;
-
-		while ((p = strrchr(filename, '/')) != NULL) {
-			/* do not try to remove parts of the mirrordir */
-			if ((size_t)(p-filename) <= fixedpartlen+1)
-				break;
-			*p ='\0';
-			/* try to rmdir the directory, this will
-			 * fail if there are still other files or directories
-			 * in it: */
-			err = rmdir(filename);
-			if (err == 0) {
-				if (verbose > 1) {
-					printf(
-"removed now empty directory %s\n",
-							filename);
-				}
-			} else {
-				en = errno;
-				if (en != ENOTEMPTY) {
-					//TODO: check here if only some
-					//other error was first and it
-					//is not empty so we do not have
-					//to remove it anyway...
-					fprintf(stderr,
-"ignoring error %d trying to rmdir %s: %s\n", en, filename, strerror(en));
-				}
-				/* parent directories will contain this one
-				 * thus not be empty, in other words:
-				 * everything's done */
-				break;
-			}
-		}
-
-	}
+	if (!global.keepdirectories)
+		removeemptydirs(filename);
 	free(filename);
 	return RET_OK;
 }
@@ -510,6 +514,219 @@ retvalue pool_delete(const char *filekey) {
 	return files_remove(filekey);
 }
 
+/* Deleting many files: the files are moved to the morgue or unlinked
+ * in batches of files in the same directory (in parallel worker processes
+ * with --jobs), parent directories are only looked at afterwards. */
+
+struct pooldeletion {
+	char *filekey;
+	bool new;
+	/* the node in the remembered changes to update, if any */
+	char *node;
+	retvalue r;
+};
+
+struct deletionbatch {
+	struct pooldeletion *files;
+	int count;
+};
+
+#define DELETIONBATCH_MAX 256
+
+static retvalue deletionbatch_run(void *privdata, char **data_p, size_t *len_p) {
+	struct deletionbatch *b = privdata;
+	int *results;
+	int i;
+
+	results = nNEW(b->count, int);
+	if (FAILEDTOALLOC(results))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < b->count ; i++) {
+		const char *filekey = b->files[i].filekey;
+		char *filename;
+		retvalue r;
+
+		if (interrupted()) {
+			results[i] = RET_ERROR_INTERRUPTED;
+			continue;
+		}
+		filename = files_calcfullfilename(filekey);
+		if (FAILEDTOALLOC(filename)) {
+			results[i] = RET_ERROR_OOM;
+			continue;
+		}
+		r = movefiletomorgue(filekey, filename, b->files[i].new);
+		if (r == RET_NOTHING)
+			fprintf(stderr, "%s not found, forgetting anyway\n",
+					filename);
+		free(filename);
+		results[i] = r;
+	}
+	*data_p = (char *)results;
+	*len_p = b->count * sizeof(int);
+	return RET_OK;
+}
+
+static retvalue deletionbatch_done(void *privdata, retvalue r, const char *data, size_t len) {
+	struct deletionbatch *b = privdata;
+	int i;
+
+	if (!RET_WAS_ERROR(r) && (data == NULL ||
+				len != b->count * sizeof(int)))
+		r = RET_ERROR;
+	for (i = 0 ; i < b->count ; i++) {
+		int result;
+
+		if (RET_WAS_ERROR(r)) {
+			b->files[i].r = r;
+			continue;
+		}
+		memcpy(&result, data + i * sizeof(int), sizeof(int));
+		b->files[i].r = result;
+	}
+	/* errors are reported by the caller for each file */
+	return RET_OK;
+}
+
+static inline bool samedirectory(const char *filekey1, const char *filekey2) {
+	size_t len = dirs_basename(filekey1) - filekey1;
+
+	return len == (size_t)(dirs_basename(filekey2) - filekey2) &&
+		strncmp(filekey1, filekey2, len) == 0;
+}
+
+static int reversestrcmp(const void *a, const void *b) {
+	return strcmp(*(char * const *)b, *(char * const *)a);
+}
+
+/* remove the now empty directories, the deepest first */
+static retvalue deletepoolfiles_dirs(struct pooldeletion *files, int count) {
+	const char *last = NULL;
+	char **dirs;
+	int i, dircount = 0;
+
+	dirs = nNEW(count, char *);
+	if (FAILEDTOALLOC(dirs))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < count ; i++) {
+		if (RET_WAS_ERROR(files[i].r))
+			continue;
+		/* files in the same directory are next to each other */
+		if (last != NULL && samedirectory(last, files[i].filekey))
+			continue;
+		last = files[i].filekey;
+		dirs[dircount] = files_calcfullfilename(files[i].filekey);
+		if (FAILEDTOALLOC(dirs[dircount]))
+			break;
+		dircount++;
+	}
+	qsort(dirs, dircount, sizeof(char *), reversestrcmp);
+	for (i = 0 ; i < dircount ; i++) {
+		removeemptydirs(dirs[i]);
+		free(dirs[i]);
+	}
+	free(dirs);
+	return RET_OK;
+}
+
+static retvalue deletepoolfiles(struct pooldeletion *files, int count) {
+	struct deletionbatch *batches;
+	struct workers *workers;
+	int i, batchcount = 0;
+	retvalue result, r;
+
+	batches = nNEW(count, struct deletionbatch);
+	if (FAILEDTOALLOC(batches))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < count ; i++) {
+		files[i].r = RET_NOTHING;
+		if (!files[i].new)
+			outhook_send("POOLDELETE", files[i].filekey,
+					NULL, NULL);
+		if (batchcount > 0) {
+			struct deletionbatch *b = &batches[batchcount - 1];
+
+			if (b->count < DELETIONBATCH_MAX &&
+					samedirectory(b->files[0].filekey,
+						files[i].filekey)) {
+				b->count++;
+				continue;
+			}
+		}
+		batches[batchcount].files = files + i;
+		batches[batchcount].count = 1;
+		batchcount++;
+	}
+	r = workers_init(&workers, global.jobs);
+	if (RET_WAS_ERROR(r)) {
+		free(batches);
+		return r;
+	}
+	result = RET_NOTHING;
+	for (i = 0 ; i < batchcount ; i++) {
+		r = workers_start(workers, deletionbatch_run,
+				deletionbatch_done, &batches[i]);
+		if (RET_WAS_ERROR(r)) {
+			int j;
+
+			result = r;
+			for (; i < batchcount ; i++)
+				for (j = 0 ; j < batches[i].count ; j++)
+					batches[i].files[j].r = r;
+			break;
+		}
+	}
+	r = workers_finish(workers);
+	RET_UPDATE(result, r);
+	free(batches);
+	for (i = 0 ; i < count ; i++)
+		RET_UPDATE(result, files[i].r);
+	if (!global.keepdirectories) {
+		r = deletepoolfiles_dirs(files, count);
+		RET_UPDATE(result, r);
+	}
+	return result;
+}
+
+static void pooldeletions_free(struct pooldeletion *files, int count) {
+	int i;
+
+	for (i = 0 ; i < count ; i++)
+		free(files[i].filekey);
+	free(files);
+}
+
+retvalue pool_deletefiles(const struct strlist *filekeys) {
+	struct pooldeletion *files;
+	int i;
+	retvalue result, r;
+
+	if (filekeys->count == 0)
+		return RET_NOTHING;
+	files = nzNEW(filekeys->count, struct pooldeletion);
+	if (FAILEDTOALLOC(files))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < filekeys->count ; i++) {
+		if (verbose >= 1)
+			printf("deleting and forgetting %s\n",
+					filekeys->values[i]);
+		files[i].filekey = strdup(filekeys->values[i]);
+		if (FAILEDTOALLOC(files[i].filekey)) {
+			pooldeletions_free(files, i);
+			return RET_ERROR_OOM;
+		}
+	}
+	result = deletepoolfiles(files, filekeys->count);
+	for (i = 0 ; i < filekeys->count ; i++) {
+		if (RET_WAS_ERROR(files[i].r))
+			continue;
+		r = files_remove(files[i].filekey);
+		RET_UPDATE(result, r);
+	}
+	pooldeletions_free(files, filekeys->count);
+	return result;
+}
+
 /* called from files_remove: */
 retvalue pool_markdeleted(const char *filekey) {
 	pool_havedeleted = true;
@@ -523,6 +740,34 @@ static bool first, onlycount;
 static long woulddelete_count;
 static component_t current_component;
 static const char *sourcename = NULL;
+/* files to delete, collected while walking */
+static struct pooldeletion *todelete = NULL;
+static int todelete_count, todelete_size;
+
+static void remembertodelete(/*@only@*/char *filekey, char *node) {
+	struct pooldeletion *d;
+
+	if (FAILEDTOALLOC(filekey)) {
+		result = RET_ERROR_OOM;
+		return;
+	}
+	if (todelete_count >= todelete_size) {
+		d = realloc(todelete, (todelete_size + 1024)
+				* sizeof(struct pooldeletion));
+		if (FAILEDTOALLOC(d)) {
+			free(filekey);
+			result = RET_ERROR_OOM;
+			return;
+		}
+		todelete = d;
+		todelete_size += 1024;
+	}
+	d = &todelete[todelete_count++];
+	d->filekey = filekey;
+	d->new = (*node & pl_ADDED) != 0;
+	d->node = node;
+	d->r = RET_NOTHING;
+}
 
 static void removeifunreferenced(const void *nodep, const VISIT which, UNUSED(const int depth)) {
 	char *node; const char *filekey;
@@ -546,23 +791,7 @@ static void removeifunreferenced(const void *nodep, const VISIT which, UNUSED(co
 		woulddelete_count++;
 		return;
 	}
-
-	if (verbose >= 0 && first) {
-		printf("Deleting files no longer referenced...\n");
-		first = false;
-	}
-	if (verbose >= 1)
-		printf("deleting and forgetting %s\n", filekey);
-	r = deletepoolfile(filekey, (*node & pl_ADDED) != 0);
-	RET_UPDATE(result, r);
-	if (!RET_WAS_ERROR(r)) {
-		r = files_removesilent(filekey);
-		RET_UPDATE(result, r);
-		if (!RET_WAS_ERROR(r))
-			*node &= ~pl_UNREFERENCED;
-		if (RET_IS_OK(r))
-			*node |= pl_DELETED;
-	}
+	remembertodelete(strdup(filekey), node);
 }
 
 
@@ -591,24 +820,7 @@ static void removeifunreferenced2(const void *nodep, const VISIT which, UNUSED(c
 		free(filekey);
 		return;
 	}
-	if (verbose >= 0 && first) {
-		printf("Deleting files no longer referenced...\n");
-		first = false;
-	}
-	if (verbose >= 1)
-		printf("deleting and forgetting %s\n", filekey);
-	r = deletepoolfile(filekey, (*node & pl_ADDED) != 0);
-	RET_UPDATE(result, r);
-	if (!RET_WAS_ERROR(r)) {
-		r = files_removesilent(filekey);
-		RET_UPDATE(result, r);
-		if (!RET_WAS_ERROR(r))
-			*node &= ~pl_UNREFERENCED;
-		if (RET_IS_OK(r))
-			*node |= pl_DELETED;
-	}
-	RET_UPDATE(result, r);
-	free(filekey);
+	remembertodelete(filekey, node);
 }
 
 static void removeunreferenced_from_component(const void *nodep, const VISIT which, UNUSED(const int depth)) {
@@ -632,7 +844,6 @@ retvalue pool_removeunreferenced(bool delete) {
 		return RET_NOTHING;
 
 	result = RET_NOTHING;
-	first = true;
 	onlycount = !delete;
 	woulddelete_count = 0;
 	for (c = 1 ; c <= reserved_components ; c++) {
@@ -642,6 +853,36 @@ retvalue pool_removeunreferenced(bool delete) {
 				removeunreferenced_from_component);
 	}
 	twalk(legacy_file_changes, removeifunreferenced);
+	if (todelete_count > 0 && !RET_WAS_ERROR(result)
+			&& !interrupted()) {
+		int i;
+		retvalue r;
+
+		if (verbose >= 0)
+			printf("Deleting files no longer referenced...\n");
+		if (verbose >= 1)
+			for (i = 0 ; i < todelete_count ; i++)
+				printf("deleting and forgetting %s\n",
+						todelete[i].filekey);
+		r = deletepoolfiles(todelete, todelete_count);
+		RET_UPDATE(result, r);
+		for (i = 0 ; i < todelete_count ; i++) {
+			char *node = todelete[i].node;
+
+			if (RET_WAS_ERROR(todelete[i].r))
+				continue;
+			r = files_removesilent(todelete[i].filekey);
+			RET_UPDATE(result, r);
+			if (!RET_WAS_ERROR(r))
+				*node &= ~pl_UNREFERENCED;
+			if (RET_IS_OK(r))
+				*node |= pl_DELETED;
+		}
+	}
+	pooldeletions_free(todelete, todelete_count);
+	todelete = NULL;
+	todelete_count = 0;
+	todelete_size = 0;
 	if (interrupted())
 		result = RET_ERROR_INTERRUPTED;
 	if (!delete && woulddelete_count > 0) {
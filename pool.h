@@ -7,6 +7,9 @@
 #ifndef REPREPRO_DATABASE_H
 #include "database.h"
 #endif
+#ifndef REPREPRO_STRLIST_H
+#include "strlist.h"
+#endif
 
 extern bool pool_havedereferenced;
 
@@ -24,6 +27,8 @@ void pool_tidyadded(bool deletenew);
 
 /* delete and forget a single file */
 retvalue pool_delete(const char *);
+/* delete and forget many files (in parallel with --jobs) */
+retvalue pool_deletefiles(const struct strlist *);
 
 /* notify outhook of new files */
 void pool_sendnewfiles(void);
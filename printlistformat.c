@@ -33,33 +33,145 @@
 #include "package.h"
 #include "printlistformat.h"
 
-retvalue listformat_print(const char *listformat, struct package *package) {
-	struct target *target = package->target;
+/* A list format is compiled into a list of segments once,
+ * so that printing a package only needs to look at the chunk once
+ * and can write everything in one go. */
+
+enum segmentkind {
+	sk_literal,
+	sk_identifier, sk_basename, sk_fullfilename, sk_filekey,
+	sk_type, sk_codename, sk_architecture, sk_component,
+	sk_source, sk_sourceversion, sk_package,
+	/* a field of the control chunk */
+	sk_field
+};
+
+static const struct {
+	const char *name;
+	enum segmentkind kind;
+} specialvariables[] = {
+	{"{$identifier", sk_identifier},
+	{"{$basename", sk_basename},
+	{"{$fullfilename", sk_fullfilename},
+	{"{$filekey", sk_filekey},
+	{"{$type", sk_type},
+	{"{$codename", sk_codename},
+	{"{$architecture", sk_architecture},
+	{"{$component", sk_component},
+	{"{$source", sk_source},
+	{"{$sourceversion", sk_sourceversion},
+	{"{package", sk_package},
+	{NULL, sk_literal}
+};
+
+struct listformatsegment {
+	enum segmentkind kind;
+	/* for sk_literal the text, for sk_field the index in fieldnames */
+	size_t start, len;
+	/* as in dpkg-query: 0 unlimited, < 0 right aligned */
+	long length;
+};
+
+static struct listformatplan {
+	/* the format this plan was compiled from */
+	char *format;
+	int count;
+	struct listformatsegment *segments;
+	/* the text of all literal segments */
+	char *text;
+	size_t textlen;
+	int fieldcount;
+	char **fieldnames;
+	bool needfilekeys;
+} plan;
+
+/* the output of one package, written at once */
+static struct {
+	char *data;
+	size_t len, size;
+} out;
+
+static void plan_done(void) {
+	int i;
+
+	free(plan.format);
+	free(plan.segments);
+	free(plan.text);
+	for (i = 0 ; i < plan.fieldcount ; i++)
+		free(plan.fieldnames[i]);
+	free(plan.fieldnames);
+	memset(&plan, 0, sizeof(plan));
+}
+
+static retvalue plan_addsegment(enum segmentkind kind, size_t start, size_t len, long length) {
+	struct listformatsegment *n;
+
+	/* merge with the previous literal text */
+	if (kind == sk_literal && plan.count > 0 &&
+			plan.segments[plan.count - 1].kind == sk_literal) {
+		plan.segments[plan.count - 1].len += len;
+		return RET_OK;
+	}
+	n = realloc(plan.segments,
+			(plan.count + 1) * sizeof(struct listformatsegment));
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	plan.segments = n;
+	n += plan.count++;
+	n->kind = kind;
+	n->start = start;
+	n->len = len;
+	n->length = length;
+	return RET_OK;
+}
+
+static retvalue plan_addtext(const char *text, size_t len) {
+	char *n;
 	retvalue r;
-	const char *p, *q;
 
-	if (verbose >= 15)
-		fprintf(stderr, "trace: listformat_print(package={name: %s, version: %s, pkgname: %s}) called.\n",
-		        package->name, package->version, package->pkgname);
+	n = realloc(plan.text, plan.textlen + len + 1);
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	plan.text = n;
+	memcpy(plan.text + plan.textlen, text, len);
+	r = plan_addsegment(sk_literal, plan.textlen, len, 0);
+	plan.textlen += len;
+	return r;
+}
 
-	if (listformat == NULL) {
+static retvalue plan_addfield(const char *name, size_t len, long length) {
+	char **n;
+	int i;
 
-		r = package_getversion(package);
-		if (RET_IS_OK(r)) {
-			printf( "%s: %s %s\n",
-					target->identifier, package->name,
-					package->version);
-		} else {
-			printf("Could not retrieve version from %s in %s\n",
-					package->name, target->identifier);
-		}
-		return r;
+	for (i = 0 ; i < plan.fieldcount ; i++) {
+		if (strncasecmp(plan.fieldnames[i], name, len) == 0
+				&& plan.fieldnames[i][len] == '\0')
+			return plan_addsegment(sk_field, i, 0, length);
 	}
-	/* try to produce the same output dpkg-query --show produces: */
+	n = realloc(plan.fieldnames, (plan.fieldcount + 1) * sizeof(char*));
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	plan.fieldnames = n;
+	n[plan.fieldcount] = strndup(name, len);
+	if (FAILEDTOALLOC(n[plan.fieldcount]))
+		return RET_ERROR_OOM;
+	plan.fieldcount++;
+	return plan_addsegment(sk_field, i, 0, length);
+}
+
+/* try to produce the same output dpkg-query --show produces: */
+static retvalue plan_compile(const char *listformat) {
+	const char *p, *q, *e;
+	retvalue r;
+	int i;
+
+	plan.format = strdup(listformat);
+	if (FAILEDTOALLOC(plan.format))
+		return RET_ERROR_OOM;
 	for (p = listformat ; *p != '\0' ; p++) {
+		enum segmentkind kind;
 		long length;
-		char *value;
-		const char *v;
+		char c;
 
 		if (*p == '\\') {
 			p++;
@@ -67,26 +179,31 @@ retvalue listformat_print(const char *listformat, struct package *package) {
 				break;
 			switch (*p) {
 				case 'n':
-					putchar('\n');
+					c = '\n';
 					break;
 				case 't':
-					putchar('\t');
+					c = '\t';
 					break;
 				case 'r':
-					putchar('\r');
+					c = '\r';
 					break;
 				/* extension \0 produces zero byte
 				 * (useful for xargs -0) */
 				case '0':
-					putchar('\0');
+					c = '\0';
 					break;
 				default:
-					putchar(*p);
+					c = *p;
 			}
+			r = plan_addtext(&c, 1);
+			if (RET_WAS_ERROR(r))
+				return r;
 			continue;
 		}
 		if (*p != '$' || p[1] != '{') {
-			putchar(*p);
+			r = plan_addtext(p, 1);
+			if (RET_WAS_ERROR(r))
+				return r;
 			continue;
 		}
 		p++;
@@ -95,138 +212,247 @@ retvalue listformat_print(const char *listformat, struct package *package) {
 		while (*q != '\0' && *q != '}' && *q != ';')
 			q++;
 		if (*q == '\0' || q == p) {
-			putchar('$');
-			putchar('{');
-			continue;
-		}
-		if (q - p == 12 && strncasecmp(p, "{$identifier", 12) == 0) {
-			value = NULL;
-			v = target->identifier;
-		} else if (   (q - p == 10 && strncasecmp(p, "{$basename", 10) == 0)
-		           || (q - p == 14 && strncasecmp(p, "{$fullfilename", 14) == 0)
-		           || (q - p ==  9 && strncasecmp(p, "{$filekey", 9) == 0)) {
-			struct strlist filekeys;
-			r = target->getfilekeys(package->control, &filekeys);
-			if (RET_WAS_ERROR(r))
-				return r;
-			if (RET_IS_OK(r) && filekeys.count > 0) {
-				if (q - p == 9) { /* filekey */
-					value = filekeys.values[0];
-					filekeys.values[0] = NULL;
-					v = value;
-				} else if (q - p == 10) { /* basename */
-					value = filekeys.values[0];
-					filekeys.values[0] = NULL;
-					v = dirs_basename(value);;
-				} else { /* fullfilename */
-					value = calc_dirconcat(global.basedir,
-							filekeys.values[0]);
-					if (FAILEDTOALLOC(value))
-						return RET_ERROR_OOM;
-					v = value;
-				}
-				strlist_done(&filekeys);
-			} else {
-				value = NULL;
-				v = "";
-			}
-		} else if (q - p == 6 && strncasecmp(p, "{$type", 6) == 0) {
-			value = NULL;
-			v = atoms_packagetypes[target->packagetype];
-		} else if (q - p == 10 &&
-				strncasecmp(p, "{$codename", 10) == 0) {
-			value = NULL;
-			v = target->distribution->codename;
-		} else if (q - p == 14 &&
-				strncasecmp(p, "{$architecture", 14) == 0) {
-			value = NULL;
-			v = atoms_architectures[target->architecture];
-		} else if (q - p == 11 &&
-				strncasecmp(p, "{$component", 11) == 0) {
-			value = NULL;
-			v = atoms_components[target->component];
-		} else if (q - p == 8 && strncasecmp(p, "{$source", 8) == 0) {
-			r = package_getsource(package);
-			if (RET_WAS_ERROR(r))
-				return r;
-			if (RET_IS_OK(r)) {
-				value = NULL;
-				v = package->source;
-			} else {
-				value = NULL;
-				v = "";
-			}
-		} else if (q - p == 15 && strncasecmp(p, "{$sourceversion", 15) == 0) {
-			r = package_getsource(package);
-			if (RET_WAS_ERROR(r))
-				return r;
-			if (RET_IS_OK(r)) {
-				value = NULL;
-				v = package->sourceversion;
-			} else {
-				value = NULL;
-				v = "";
-			}
-		} else if (q - p == 8 && strncasecmp(p, "{package", 8) == 0) {
-			value = NULL;
-			v = package->name;
-		} else {
-			char *variable = strndup(p + 1, q - (p + 1));
-			if (FAILEDTOALLOC(variable))
-				return RET_ERROR_OOM;
-			r = chunk_getwholedata(package->control,
-					variable, &value);
-			free(variable);
+			r = plan_addtext("${", 2);
 			if (RET_WAS_ERROR(r))
 				return r;
-			if (RET_IS_OK(r)) {
-				v = value;
-				while (*v != '\0' && xisspace(*v))
-					v++;
-			} else {
-				value = NULL;
-				v = "";
+			continue;
+		}
+		kind = sk_field;
+		for (i = 0 ; specialvariables[i].name != NULL ; i++) {
+			size_t l = strlen(specialvariables[i].name);
+
+			if ((size_t)(q - p) == l && strncasecmp(p,
+					specialvariables[i].name, l) == 0) {
+				kind = specialvariables[i].kind;
+				break;
 			}
 		}
 		if (*q == ';') {
 			/* dpkg-query allows octal an hexadecimal,
 			 * so we do, too */
-			length = strtol(q + 1, (char**)&p, 0);
-			if (*p != '}') {
-				free(value);
-				putchar('$');
-				putchar('{');
+			length = strtol(q + 1, (char**)&e, 0);
+			if (*e != '}') {
+				r = plan_addtext("${", 2);
+				if (RET_WAS_ERROR(r))
+					return r;
+				if (*e == '\0')
+					break;
+				p = e;
 				continue;
 			}
 		} else {
-			p = q;
+			e = q;
 			length = 0;
 		}
-		/* as in dpkg-query, length 0 means unlimited */
-		if (length == 0) {
-			fputs(v, stdout);
-		} else {
-			long value_length = strlen(v);
+		if (kind == sk_field)
+			r = plan_addfield(p + 1, q - (p + 1), length);
+		else
+			r = plan_addsegment(kind, 0, 0, length);
+		if (RET_WAS_ERROR(r))
+			return r;
+		if (kind == sk_basename || kind == sk_fullfilename
+				|| kind == sk_filekey)
+			plan.needfilekeys = true;
+		p = e;
+	}
+	return RET_OK;
+}
+
+static retvalue out_add(const char *data, size_t len) {
+	if (out.size - out.len < len) {
+		size_t newsize = out.size + len + 4096;
+		char *n = realloc(out.data, newsize);
+
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		out.data = n;
+		out.size = newsize;
+	}
+	memcpy(out.data + out.len, data, len);
+	out.len += len;
+	return RET_OK;
+}
 
-			if (length < 0) {
-				length = -length;
-				while (value_length < length) {
-					putchar(' ');
-					length--;
+static retvalue out_addspaces(long count) {
+	static const char spaces[] = "                                ";
+	retvalue r;
+
+	while (count > 0) {
+		long l = (count < (long)sizeof(spaces) - 1)?
+			count:(long)sizeof(spaces) - 1;
+
+		r = out_add(spaces, l);
+		if (RET_WAS_ERROR(r))
+			return r;
+		count -= l;
+	}
+	return RET_OK;
+}
+
+/* as in dpkg-query, length 0 means unlimited */
+static retvalue out_addvalue(const char *v, size_t value_length, long length) {
+	retvalue r;
+
+	if (length == 0)
+		return out_add(v, value_length);
+	if (length < 0) {
+		length = -length;
+		if ((long)value_length < length) {
+			r = out_addspaces(length - value_length);
+			if (RET_WAS_ERROR(r))
+				return r;
+			length = value_length;
+		}
+	}
+	if ((long)value_length > length)
+		return out_add(v, length);
+	r = out_add(v, value_length);
+	if (RET_WAS_ERROR(r))
+		return r;
+	return out_addspaces(length - value_length);
+}
+
+static retvalue print_segments(struct package *package) {
+	struct target *target = package->target;
+	struct chunkslice fields[plan.fieldcount + 1];
+	struct strlist filekeys;
+	bool havefilekeys = false;
+	char *value;
+	const char *v;
+	size_t len;
+	retvalue r;
+	int i;
+
+	if (plan.fieldcount > 0)
+		chunk_getwholeslices(package->control, plan.fieldcount,
+				(const char * const *)plan.fieldnames, fields);
+	if (plan.needfilekeys) {
+		r = target->getfilekeys(package->control, &filekeys);
+		if (RET_WAS_ERROR(r))
+			return r;
+		havefilekeys = RET_IS_OK(r);
+		if (havefilekeys && filekeys.count == 0) {
+			strlist_done(&filekeys);
+			havefilekeys = false;
+		}
+	}
+	r = RET_OK;
+	for (i = 0 ; i < plan.count ; i++) {
+		const struct listformatsegment *s = &plan.segments[i];
+
+		value = NULL;
+		v = NULL;
+		switch (s->kind) {
+			case sk_literal:
+				r = out_add(plan.text + s->start, s->len);
+				if (RET_WAS_ERROR(r))
+					break;
+				continue;
+			case sk_identifier:
+				v = target->identifier;
+				break;
+			case sk_filekey:
+				if (havefilekeys)
+					v = filekeys.values[0];
+				break;
+			case sk_basename:
+				if (havefilekeys)
+					v = dirs_basename(filekeys.values[0]);
+				break;
+			case sk_fullfilename:
+				if (!havefilekeys)
+					break;
+				value = calc_dirconcat(global.basedir,
+						filekeys.values[0]);
+				if (FAILEDTOALLOC(value))
+					r = RET_ERROR_OOM;
+				v = value;
+				break;
+			case sk_type:
+				v = atoms_packagetypes[target->packagetype];
+				break;
+			case sk_codename:
+				v = target->distribution->codename;
+				break;
+			case sk_architecture:
+				v = atoms_architectures[target->architecture];
+				break;
+			case sk_component:
+				v = atoms_components[target->component];
+				break;
+			case sk_source:
+			case sk_sourceversion:
+				r = package_getsource(package);
+				if (RET_IS_OK(r))
+					v = (s->kind == sk_source)?
+						package->source:
+						package->sourceversion;
+				break;
+			case sk_package:
+				v = package->name;
+				break;
+			case sk_field:
+				v = fields[s->start].value;
+				len = fields[s->start].len;
+				if (v == NULL)
+					break;
+				while (len > 0 && xisspace(*v)) {
+					v++;
+					len--;
 				}
-			}
-			if (value_length > length) {
-				fwrite(v, length, 1, stdout);
-				length = 0;
-			} else if (value_length > 0) {
-				fwrite(v, value_length, 1, stdout);
-				length -= value_length;
-			}
-			while (length-- > 0)
-				putchar(' ');
+				r = out_addvalue(v, len, s->length);
+				if (RET_WAS_ERROR(r))
+					break;
+				continue;
 		}
+		if (RET_WAS_ERROR(r))
+			break;
+		if (v == NULL)
+			v = "";
+		r = out_addvalue(v, strlen(v), s->length);
 		free(value);
+		if (RET_WAS_ERROR(r))
+			break;
 	}
-	return RET_OK;
+	if (havefilekeys)
+		strlist_done(&filekeys);
+	return RET_WAS_ERROR(r)?r:RET_OK;
 }
 
+retvalue listformat_print(const char *listformat, struct package *package) {
+	struct target *target = package->target;
+	retvalue r;
+
+	if (verbose >= 15)
+		fprintf(stderr, "trace: listformat_print(package={name: %s, version: %s, pkgname: %s}) called.\n",
+		        package->name, package->version, package->pkgname);
+
+	if (listformat == NULL) {
+
+		r = package_getversion(package);
+		if (RET_IS_OK(r)) {
+			printf( "%s: %s %s\n",
+					target->identifier, package->name,
+					package->version);
+		} else {
+			printf("Could not retrieve version from %s in %s\n",
+					package->name, target->identifier);
+		}
+		return r;
+	}
+	if (plan.format == NULL || strcmp(plan.format, listformat) != 0) {
+		plan_done();
+		r = plan_compile(listformat);
+		if (RET_WAS_ERROR(r)) {
+			plan_done();
+			return r;
+		}
+	}
+	out.len = 0;
+	r = print_segments(package);
+	/* also write what was done before an error, as that was
+	 * printed before, too */
+	if (out.len > 0)
+		(void)fwrite(out.data, out.len, 1, stdout);
+	return r;
+}
@@ -29,6 +29,7 @@
 #include "dirs.h"
 #include "database_p.h"
 #include "pool.h"
+#include "sizes.h"
 #include "reference.h"
 
 retvalue references_isused( const char *what) {
@@ -55,37 +56,56 @@ retvalue references_check(const char *referee, const struct strlist *filekeys) {
 
 /* add an reference to a file for an identifier. multiple calls */
 retvalue references_increment(const char *needed, const char *neededby) {
-	retvalue r;
+	retvalue r, r2;
+	char *oldset = NULL;
 
 	if (verbose >= 15)
 		fprintf(stderr, "trace: references_insert(needed=%s, neededby=%s) called.\n",
 		        needed, neededby);
 
+	r2 = sizes_startchange(needed, &oldset);
+	if (RET_WAS_ERROR(r2))
+		return r2;
 	r = table_addrecord(rdb_references, needed,
 			neededby, strlen(neededby), false);
 	if (RET_IS_OK(r) && verbose > 8)
 		printf("Adding reference to '%s' by '%s'\n", needed, neededby);
+	if (RET_IS_OK(r2)) {
+		r2 = sizes_endchange(needed, oldset);
+		RET_ENDUPDATE(r, r2);
+	}
 	return r;
 }
 
 /* remove reference for a file from a given reference */
 retvalue references_decrement(const char *needed, const char *neededby) {
-	retvalue r;
+	retvalue r, r2;
+	char *oldset = NULL;
 
+	r2 = sizes_startchange(needed, &oldset);
+	if (RET_WAS_ERROR(r2))
+		return r2;
 	r = table_removerecord(rdb_references, needed, neededby);
-	if (r == RET_NOTHING)
+	if (r == RET_NOTHING) {
+		free(oldset);
 		return r;
+	}
 	if (RET_WAS_ERROR(r)) {
+		free(oldset);
 		fprintf(stderr,
 "Error while trying to removing reference to '%s' by '%s'\n",
 				needed, neededby);
 		return r;
 	}
+	if (RET_IS_OK(r2)) {
+		r2 = sizes_endchange(needed, oldset);
+		if (RET_WAS_ERROR(r2))
+			return r2;
+	}
 	if (verbose > 8)
 		fprintf(stderr, "Removed reference to '%s' by '%s'\n",
 				needed, neededby);
 	if (RET_IS_OK(r)) {
-		retvalue r2;
 		r2 = pool_dereferenced(needed);
 		RET_UPDATE(r, r2);
 	}
@@ -133,8 +153,18 @@ retvalue references_add(const char *identifier, const struct strlist *files) {
 
 	for (i = 0 ; i < files->count ; i++) {
 		const char *filekey = files->values[i];
+		char *oldset = NULL;
+		retvalue r2;
+
+		r2 = sizes_startchange(filekey, &oldset);
+		if (RET_WAS_ERROR(r2))
+			return r2;
 		r = table_addrecord(rdb_references, filekey,
 				identifier, strlen(identifier), true);
+		if (RET_IS_OK(r2)) {
+			r2 = sizes_endchange(filekey, oldset);
+			RET_ENDUPDATE(r, r2);
+		}
 		if (RET_WAS_ERROR(r))
 			return r;
 	}
@@ -169,12 +199,18 @@ retvalue references_remove(const char *neededby) {
 	retvalue result, r;
 	const char *found_to, *found_by;
 	size_t datalen, l;
+	struct strlist filekeys, references;
+	bool accounting;
+	int i;
 
 	r = table_newglobalcursor(rdb_references, true, &cursor);
 	if (!RET_IS_OK(r))
 		return r;
 
 	l = strlen(neededby);
+	accounting = sizes_accountingenabled();
+	strlist_init(&filekeys);
+	strlist_init(&references);
 
 	result = RET_NOTHING;
 	while (cursor_nexttempdata(rdb_references, cursor,
@@ -182,6 +218,21 @@ retvalue references_remove(const char *neededby) {
 
 		if (datalen >= l && strncmp(found_by, neededby, l) == 0 &&
 		    (found_by[l] == '\0' || found_by[l] == ' ')) {
+			if (accounting) {
+				/* the size accounting needs to look at the
+				 * other references of the file, which is not
+				 * safe with this cursor at a deleted record,
+				 * so only collect them here */
+				r = strlist_add_dup(&filekeys, found_to);
+				if (!RET_WAS_ERROR(r))
+					r = strlist_add_dup(&references,
+							found_by);
+				if (RET_WAS_ERROR(r)) {
+					result = r;
+					break;
+				}
+				continue;
+			}
 			if (verbose > 8)
 				fprintf(stderr,
 "Removing reference to '%s' by '%s'\n",
@@ -197,6 +248,38 @@ retvalue references_remove(const char *neededby) {
 	}
 	r = cursor_close(rdb_references, cursor);
 	RET_ENDUPDATE(result, r);
+
+	for (i = 0 ; !RET_WAS_ERROR(result) && i < filekeys.count ; i++) {
+		const char *filekey = filekeys.values[i];
+		char *oldset = NULL;
+		retvalue r2;
+
+		if (verbose > 8)
+			fprintf(stderr,
+"Removing reference to '%s' by '%s'\n",
+				filekey, neededby);
+		r2 = sizes_startchange(filekey, &oldset);
+		if (RET_WAS_ERROR(r2)) {
+			result = r2;
+			break;
+		}
+		r = table_removerecord(rdb_references, filekey,
+				references.values[i]);
+		RET_UPDATE(result, r);
+		if (RET_IS_OK(r2)) {
+			if (RET_IS_OK(r))
+				r2 = sizes_endchange(filekey, oldset);
+			else
+				free(oldset);
+			RET_UPDATE(result, r2);
+		}
+		if (RET_IS_OK(r)) {
+			r = pool_dereferenced(filekey);
+			RET_ENDUPDATE(result, r);
+		}
+	}
+	strlist_done(&filekeys);
+	strlist_done(&references);
 	return result;
 }
 
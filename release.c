@@ -29,12 +29,18 @@
 #include <fcntl.h>
 #include <time.h>
 #include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 #ifdef HAVE_LIBBZ2
 #include <bzlib.h>
 #endif
 #ifdef HAVE_LIBLZMA
 #include <lzma.h>
 #endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 #define CHECKSUMS_CONTEXT visible
 #include "error.h"
 #include "ignore.h"
@@ -55,6 +61,15 @@
 #define BZBUFSIZE 40960
 // TODO: what is the correct value here:
 #define XZBUFSIZE 40960
+#define ZSTBUFSIZE 40960
+#ifdef HAVE_LIBZSTD
+/* older zstd.h only have this in the static-linking-only part */
+#ifndef ZSTD_CLEVEL_DEFAULT
+#define ZSTD_CLEVEL_DEFAULT 3
+#endif
+#endif
+/* how much index data to keep before giving up hope it is unchanged */
+#define DEFERRED_MAXSIZE (64*1024*1024)
 
 struct release {
 	/* The base-directory of the distribution we are exporting */
@@ -76,12 +91,20 @@ struct release {
 		char *fullfinalfilename;
 		char *fulltemporaryfilename;
 		char *symlinktarget;
+		/* a .gz file written with --rsyncable */
+		bool rsyncable;
 		/* name chks NULL NULL NULL: add old filename or virtual file
 		 * name chks file file NULL: rename new file and publish
 		 * name NULL file file NULL: rename new file
 		 * name NULL file NULL NULL: delete if done
 		 * name NULL file NULL file: create symlink */
 	} *files;
+	/* if set, new entries are added after insertafter
+	 * (or at the start if that is NULL) instead of at the end */
+	bool inserting;
+	/*@null@*//*@dependent@*/struct release_entry *insertafter;
+	/* the entry newreleaseentry added last */
+	/*@null@*//*@dependent@*/struct release_entry *lastadded;
 	/* the Release file in preperation
 	 * (only valid between _prepare and _finish) */
 	struct signedfile *signedfile;
@@ -159,7 +182,18 @@ static retvalue newreleaseentry(struct release *release, /*@only@*/ char *relati
 	n->fullfinalfilename = fullfinalfilename;
 	n->fulltemporaryfilename = fulltemporaryfilename;
 	n->symlinktarget = symlinktarget;
-	if (release->files == NULL)
+	n->rsyncable = false;
+	release->lastadded = n;
+	if (release->inserting) {
+		if (release->insertafter == NULL) {
+			n->next = release->files;
+			release->files = n;
+		} else {
+			n->next = release->insertafter->next;
+			release->insertafter->next = n;
+		}
+		release->insertafter = n;
+	} else if (release->files == NULL)
 		release->files = n;
 	else {
 		p = release->files;
@@ -219,7 +253,7 @@ retvalue release_init(struct release **release, const char *codename, const char
 			}
 		}
 	}
-	r = database_openreleasecache(codename, &n->cachedb);
+	r = database_openreleasecache(codename, false, &n->cachedb);
 	assert (r != RET_NOTHING);
 	if (RET_WAS_ERROR(r)) {
 		n->cachedb = NULL;
@@ -267,6 +301,28 @@ retvalue release_initsnapshot(const char *codename, const char *name, struct rel
 	return RET_OK;
 }
 
+struct release_entry *release_lastentry(struct release *release) {
+	struct release_entry *e = release->files;
+
+	if (e == NULL)
+		return NULL;
+	while (e->next != NULL)
+		e = e->next;
+	return e;
+}
+
+void release_insertafter(struct release *release, struct release_entry *position) {
+	assert (!release->inserting);
+	release->inserting = true;
+	release->insertafter = position;
+}
+
+struct release_entry *release_endinsert(struct release *release) {
+	assert (release->inserting);
+	release->inserting = false;
+	return release->insertafter;
+}
+
 retvalue release_adddel(struct release *release, /*@only@*/char *reltmpfile) {
 	char *filename;
 
@@ -376,6 +432,10 @@ static char *calc_compressedname(const char *name, enum indexcompression ic) {
 #ifdef HAVE_LIBLZMA
 		case ic_xz:
 			return calc_addsuffix(name, "xz");
+#endif
+#ifdef HAVE_LIBZSTD
+		case ic_zstd:
+			return calc_addsuffix(name, "zst");
 #endif
 		default:
 			assert ("Huh?" == NULL);
@@ -383,9 +443,35 @@ static char *calc_compressedname(const char *name, enum indexcompression ic) {
 	}
 }
 
+/* Whether a .gz file was written with --rsyncable is recorded in the
+ * cache next to its checksums, so that switching it regenerates the
+ * file even if its content did not change. */
+static inline bool isgzfile(const char *relativefilename) {
+	size_t l = strlen(relativefilename);
+
+	return l > 3 && strcmp(relativefilename + l - 3, ".gz") == 0;
+}
+
+static inline char *rsyncablekey(const char *relativefilename) {
+	return mprintf("%s|rsyncable", relativefilename);
+}
+
+/* RET_NOTHING if the cached .gz file was not written as requested */
+static retvalue checkcachedrsyncable(struct release *release, const char *gzfilename, bool rsyncable) {
+	char *key;
+	bool was;
+
+	key = rsyncablekey(gzfilename);
+	if (FAILEDTOALLOC(key))
+		return RET_ERROR_OOM;
+	was = table_recordexists(release->cachedb, key);
+	free(key);
+	return (was == rsyncable)?RET_OK:RET_NOTHING;
+}
+
 static retvalue release_usecached(struct release *release,
 				const char *relfilename,
-				compressionset compressions) {
+				compressionset compressions, bool rsyncable) {
 	retvalue result, r;
 	enum indexcompression ic;
 	char *filename[ic_count];
@@ -431,6 +517,9 @@ static retvalue release_usecached(struct release *release,
 	}
 	if (RET_IS_OK(result) && release->cachedb == NULL)
 		result = RET_NOTHING;
+	if (RET_IS_OK(result) && filename[ic_gzip] != NULL)
+		result = checkcachedrsyncable(release, filename[ic_gzip],
+				rsyncable);
 	if (!RET_IS_OK(result)) {
 		for (ic = ic_uncompressed ; ic < ic_count ; ic++)
 			free(filename[ic]);
@@ -504,11 +593,17 @@ static retvalue release_usecached(struct release *release,
 		r = newreleaseentry(release, filename[ic],
 				checksums[ic],
 				NULL, NULL, NULL);
+		if (RET_IS_OK(r) && ic == ic_gzip)
+			release->lastadded->rsyncable = rsyncable;
 		RET_UPDATE(result, r);
 	}
 	return result;
 }
 
+/* size of the window of the rolling sum deciding where to flush
+ * with --rsyncable (as in gzip) */
+#define RSYNCWINDOW 4096
+#define RSYNCMASK (RSYNCWINDOW - 1)
 
 struct filetorelease {
 	retvalue state;
@@ -522,9 +617,23 @@ struct filetorelease {
 	} f[ic_count];
 	/* input buffer, to checksum/compress data at once */
 	unsigned char *buffer; size_t waiting_bytes;
+	/* if the compressed files may be reused, data is only collected
+	 * and compressed once the uncompressed checksum is known */
+	bool deferring;
+	unsigned char *deferred; size_t deferred_len, deferred_size;
 	/* output buffer for gzip compression */
 	unsigned char *gzoutputbuffer; size_t gz_waiting_bytes;
 	z_stream gzstream;
+	/* flush at content defined points (like gzip --rsyncable),
+	 * using the sum of the last RSYNCWINDOW bytes */
+	bool gzrsyncable, gzrsyncwindowfull;
+	unsigned char *gzrsyncwindow; size_t gzrsyncpos;
+	unsigned long gzrsyncsum;
+#ifdef HAVE_LIBDEFLATE
+	/* with libdeflate all data is collected and compressed at once */
+	bool gzinmemory;
+	unsigned char *gzinput; size_t gzinput_len, gzinput_size;
+#endif
 #ifdef HAVE_LIBBZ2
 	/* output buffer for bzip2 compression */
 	char *bzoutputbuffer; size_t bz_waiting_bytes;
@@ -535,6 +644,11 @@ struct filetorelease {
 	unsigned char *xzoutputbuffer; size_t xz_waiting_bytes;
 	lzma_stream xzstream;
 #endif
+#ifdef HAVE_LIBZSTD
+	/* output buffer for zstd compression */
+	unsigned char *zstoutputbuffer; size_t zst_waiting_bytes;
+	ZSTD_CStream *zststream;
+#endif
 };
 
 void release_abortfile(struct filetorelease *file) {
@@ -552,10 +666,15 @@ void release_abortfile(struct filetorelease *file) {
 		free(file->f[i].symlinkas);
 	}
 	free(file->buffer);
+	free(file->deferred);
 	free(file->gzoutputbuffer);
+	free(file->gzrsyncwindow);
 	if (file->gzstream.next_out != NULL) {
 		(void)deflateEnd(&file->gzstream);
 	}
+#ifdef HAVE_LIBDEFLATE
+	free(file->gzinput);
+#endif
 #ifdef HAVE_LIBBZ2
 	free(file->bzoutputbuffer);
 	if (file->bzstream.next_out != NULL) {
@@ -568,6 +687,12 @@ void release_abortfile(struct filetorelease *file) {
 		lzma_end(&file->xzstream);
 	}
 #endif
+#ifdef HAVE_LIBZSTD
+	free(file->zstoutputbuffer);
+	if (file->zststream != NULL)
+		(void)ZSTD_freeCStream(file->zststream);
+#endif
+	free(file);
 }
 
 bool release_oldexists(struct filetorelease *file) {
@@ -632,9 +757,17 @@ static retvalue writetofile(struct openfile *file, const unsigned char *data, si
 	return RET_OK;
 }
 
-static retvalue initgzcompression(struct filetorelease *f) {
+static retvalue initgzcompression(struct filetorelease *f, bool rsyncable) {
 	int zret;
 
+#ifdef HAVE_LIBDEFLATE
+	/* libdeflate cannot flush in between, so only use it if not needed */
+	if (!rsyncable) {
+		f->gzinmemory = true;
+		return RET_OK;
+	}
+#endif
+	f->gzrsyncable = rsyncable;
 	if ((zlibCompileFlags() & (1<<17)) !=0) {
 		fprintf(stderr, "libz compiled without .gz supporting code\n");
 		return RET_ERROR;
@@ -642,6 +775,11 @@ static retvalue initgzcompression(struct filetorelease *f) {
 	f->gzoutputbuffer = malloc(GZBUFSIZE);
 	if (FAILEDTOALLOC(f->gzoutputbuffer))
 		return RET_ERROR_OOM;
+	if (rsyncable) {
+		f->gzrsyncwindow = malloc(RSYNCWINDOW);
+		if (FAILEDTOALLOC(f->gzrsyncwindow))
+			return RET_ERROR_OOM;
+	}
 	f->gzstream.next_in = NULL;
 	f->gzstream.avail_in = 0;
 	f->gzstream.next_out = f->gzoutputbuffer;
@@ -732,6 +870,27 @@ static retvalue initxzcompression(struct filetorelease *f) {
 }
 #endif
 
+#ifdef HAVE_LIBZSTD
+
+static retvalue initzstcompression(struct filetorelease *f) {
+	size_t ret;
+
+	f->zstoutputbuffer = malloc(ZSTBUFSIZE);
+	if (FAILEDTOALLOC(f->zstoutputbuffer))
+		return RET_ERROR_OOM;
+	f->zststream = ZSTD_createCStream();
+	if (FAILEDTOALLOC(f->zststream))
+		return RET_ERROR_OOM;
+	ret = ZSTD_initCStream(f->zststream, ZSTD_CLEVEL_DEFAULT);
+	if (ZSTD_isError(ret)) {
+		fprintf(stderr, "Error from libzstd's ZSTD_initCStream: "
+				"%s\n", ZSTD_getErrorName(ret));
+		return RET_ERROR;
+	}
+	return RET_OK;
+}
+#endif
+
 
 static const char * const ics[ic_count] = { "", ".gz"
 #ifdef HAVE_LIBBZ2
@@ -740,6 +899,9 @@ static const char * const ics[ic_count] = { "", ".gz"
 #ifdef HAVE_LIBLZMA
        	, ".xz"
 #endif
+#ifdef HAVE_LIBZSTD
+       	, ".zst"
+#endif
 };
 
 static inline retvalue setfilename(struct filetorelease *n, const char *relfilename, /*@null@*/const char *symlinkas, enum indexcompression ic) {
@@ -778,12 +940,13 @@ static inline void warnfilename(struct release *release, const char *relfilename
 	free(fullfilename);
 }
 
-static retvalue startfile(struct release *release, const char *filename, /*@null@*/const char *symlinkas, compressionset compressions, bool usecache, struct filetorelease **file) {
+static retvalue startfile(struct release *release, const char *filename, /*@null@*/const char *symlinkas, compressionset compressions, bool rsyncable, bool usecache, struct filetorelease **file) {
 	struct filetorelease *n;
 	enum indexcompression i;
 
 	if (usecache) {
-		retvalue r = release_usecached(release, filename, compressions);
+		retvalue r = release_usecached(release, filename, compressions,
+				rsyncable);
 		if (r != RET_NOTHING) {
 			if (RET_IS_OK(r))
 				return RET_NOTHING;
@@ -832,7 +995,7 @@ static retvalue startfile(struct release *release, const char *filename, /*@null
 			return r;
 		}
 		checksumscontext_init(&n->f[ic_gzip].context);
-		r = initgzcompression(n);
+		r = initgzcompression(n, rsyncable);
 		if (RET_WAS_ERROR(r)) {
 			release_abortfile(n);
 			return r;
@@ -873,18 +1036,43 @@ static retvalue startfile(struct release *release, const char *filename, /*@null
 			return r;
 		}
 	}
+#endif
+#ifdef HAVE_LIBZSTD
+	if ((compressions & IC_FLAG(ic_zstd)) != 0) {
+		retvalue r;
+		r = setfilename(n, filename, symlinkas, ic_zstd);
+		if (!RET_WAS_ERROR(r))
+			r = openfile(release->dirofdist, &n->f[ic_zstd]);
+		if (RET_WAS_ERROR(r)) {
+			release_abortfile(n);
+			return r;
+		}
+		checksumscontext_init(&n->f[ic_zstd].context);
+		r = initzstcompression(n);
+		if (RET_WAS_ERROR(r)) {
+			release_abortfile(n);
+			return r;
+		}
+	}
 #endif
 	checksumscontext_init(&n->f[ic_uncompressed].context);
+	/* if the old files are there, they can be kept when the content
+	 * did not change, so only compress once that is known to differ */
+	n->deferring = release->cachedb != NULL
+		&& (compressions & ~IC_FLAG(ic_uncompressed)) != 0
+		&& release_oldexists(n);
 	*file = n;
 	return RET_OK;
 }
 
-retvalue release_startfile(struct release *release, const char *filename, compressionset compressions, bool usecache, struct filetorelease **file) {
-	return startfile(release, filename, NULL, compressions, usecache, file);
+retvalue release_startfile(struct release *release, const char *filename, compressionset compressions, bool rsyncable, bool usecache, struct filetorelease **file) {
+	return startfile(release, filename, NULL, compressions, rsyncable,
+			usecache, file);
 }
 
-retvalue release_startlinkedfile(struct release *release, const char *filename, const char *symlinkas, compressionset compressions, bool usecache, struct filetorelease **file) {
-	return startfile(release, filename, symlinkas, compressions, usecache, file);
+retvalue release_startlinkedfile(struct release *release, const char *filename, const char *symlinkas, compressionset compressions, bool rsyncable, bool usecache, struct filetorelease **file) {
+	return startfile(release, filename, symlinkas, compressions, rsyncable,
+			usecache, file);
 }
 
 void release_warnoldfileorlink(struct release *release, const char *filename, compressionset compressions) {
@@ -934,6 +1122,20 @@ static inline char *calc_relative_path(const char *target, const char *linkname)
 	return n;
 }
 
+static retvalue releasesymlink(struct release *release, struct openfile *f) {
+	char *symlinktarget;
+	retvalue r;
+
+	if (f->symlinkas == NULL)
+		return RET_NOTHING;
+	symlinktarget = calc_relative_path(f->relativefilename, f->symlinkas);
+	if (FAILEDTOALLOC(symlinktarget))
+		return RET_ERROR_OOM;
+	r = release_addsymlink(release, f->symlinkas, symlinktarget);
+	f->symlinkas = NULL;
+	return r;
+}
+
 static retvalue releasefile(struct release *release, struct openfile *f) {
 	struct checksums *checksums;
 	retvalue r;
@@ -951,16 +1153,10 @@ static retvalue releasefile(struct release *release, struct openfile *f) {
 	r = checksums_from_context(&checksums, &f->context);
 	if (RET_WAS_ERROR(r))
 		return r;
-	if (f->symlinkas) {
-		char *symlinktarget = calc_relative_path(f->relativefilename,
-				f->symlinkas);
-		if (FAILEDTOALLOC(symlinktarget))
-			return RET_ERROR_OOM;
-		r = release_addsymlink(release, f->symlinkas,
-				symlinktarget);
-		f->symlinkas = NULL;
-		if (RET_WAS_ERROR(r))
-			return r;
+	r = releasesymlink(release, f);
+	if (RET_WAS_ERROR(r)) {
+		checksums_free(checksums);
+		return r;
 	}
 
 	r = newreleaseentry(release, f->relativefilename, checksums,
@@ -973,19 +1169,70 @@ static retvalue releasefile(struct release *release, struct openfile *f) {
 	return r;
 }
 
-static retvalue writegz(struct filetorelease *f) {
-	int zret;
+#ifdef HAVE_LIBDEFLATE
+static retvalue collectgz(struct filetorelease *f, const unsigned char *data, size_t len) {
+	if (f->gzinput_size - f->gzinput_len < len) {
+		size_t newsize = f->gzinput_size * 2 + len;
+		unsigned char *n = realloc(f->gzinput, newsize);
 
-	assert (f->f[ic_gzip].fd >= 0);
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		f->gzinput = n;
+		f->gzinput_size = newsize;
+	}
+	memcpy(f->gzinput + f->gzinput_len, data, len);
+	f->gzinput_len += len;
+	return RET_OK;
+}
 
-	f->gzstream.next_in = f->buffer;
-	f->gzstream.avail_in = INPUT_BUFFER_SIZE;
+/* compress everything collected with libdeflate in one go */
+static retvalue finishgzinmemory(struct filetorelease *f) {
+	struct libdeflate_compressor *c;
+	unsigned char *out;
+	size_t outlen;
+	retvalue r;
+
+	r = collectgz(f, f->buffer, f->waiting_bytes);
+	if (RET_WAS_ERROR(r))
+		return r;
+	/* same level as Z_DEFAULT_COMPRESSION */
+	c = libdeflate_alloc_compressor(6);
+	if (FAILEDTOALLOC(c))
+		return RET_ERROR_OOM;
+	outlen = libdeflate_gzip_compress_bound(c, f->gzinput_len);
+	out = malloc(outlen);
+	if (FAILEDTOALLOC(out)) {
+		libdeflate_free_compressor(c);
+		return RET_ERROR_OOM;
+	}
+	outlen = libdeflate_gzip_compress(c, f->gzinput, f->gzinput_len,
+			out, outlen);
+	libdeflate_free_compressor(c);
+	free(f->gzinput);
+	f->gzinput = NULL;
+	if (outlen == 0) {
+		fprintf(stderr, "Error from libdeflate's gzip_compress!\n");
+		free(out);
+		return RET_ERROR;
+	}
+	r = writetofile(&f->f[ic_gzip], out, outlen);
+	assert (r != RET_NOTHING);
+	free(out);
+	return r;
+}
+#endif
+
+static retvalue deflategz(struct filetorelease *f, const unsigned char *data, size_t len, int flush) {
+	int zret;
+
+	f->gzstream.next_in = (unsigned char*)data;
+	f->gzstream.avail_in = len;
 
 	do {
 		f->gzstream.next_out = f->gzoutputbuffer + f->gz_waiting_bytes;
 		f->gzstream.avail_out = GZBUFSIZE - f->gz_waiting_bytes;
 
-		zret = deflate(&f->gzstream, Z_NO_FLUSH);
+		zret = deflate(&f->gzstream, flush);
 		f->gz_waiting_bytes = GZBUFSIZE - f->gzstream.avail_out;
 
 		if ((zret == Z_OK && f->gz_waiting_bytes >= GZBUFSIZE / 2)
@@ -1007,7 +1254,15 @@ static retvalue writegz(struct filetorelease *f) {
 		 * gets possible again it should finally produce more output
 		 * and return Z_OK and always terminate. Hopefully... */
 	} while (zret == Z_BUF_ERROR
-			|| (zret == Z_OK && f->gzstream.avail_in != 0));
+			|| (zret == Z_OK && f->gzstream.avail_in != 0)
+			|| (zret == Z_OK && flush != Z_NO_FLUSH
+				&& f->gzstream.avail_out == 0));
+
+	/* a flush that found the output buffer exactly filled has
+	 * nothing more to do in the next round */
+	if (zret == Z_BUF_ERROR && flush != Z_NO_FLUSH
+			&& f->gzstream.avail_in == 0)
+		zret = Z_OK;
 
 	f->gzstream.next_in = NULL;
 	f->gzstream.avail_in = 0;
@@ -1025,13 +1280,76 @@ static retvalue writegz(struct filetorelease *f) {
 	return RET_OK;
 }
 
+/* Like gzip --rsyncable: whenever the sum of the last RSYNCWINDOW bytes
+ * is a multiple of RSYNCWINDOW, flush the compressor to a byte boundary
+ * (keeping its dictionary, like gzip does). So a change in the
+ * uncompressed data only changes the compressed data till shortly after
+ * the next such point and the rest can still be reused by rsync or zsync. */
+static retvalue writegz(struct filetorelease *f, const unsigned char *data, size_t len) {
+	size_t i, start, pos;
+	unsigned long sum;
+	bool full;
+	retvalue r;
+
+	assert (f->f[ic_gzip].fd >= 0);
+
+#ifdef HAVE_LIBDEFLATE
+	if (f->gzinmemory)
+		return collectgz(f, data, len);
+#endif
+
+	if (!f->gzrsyncable)
+		return deflategz(f, data, len, Z_NO_FLUSH);
+
+	sum = f->gzrsyncsum;
+	pos = f->gzrsyncpos;
+	full = f->gzrsyncwindowfull;
+	start = 0;
+	for (i = 0 ; i < len ; i++) {
+		if (full)
+			sum -= f->gzrsyncwindow[pos];
+		f->gzrsyncwindow[pos] = data[i];
+		sum += data[i];
+		pos = (pos + 1) & RSYNCMASK;
+		if (pos == 0)
+			full = true;
+		/* only look at full windows, as gzip does */
+		if (!full || (sum & RSYNCMASK) != 0)
+			continue;
+		r = deflategz(f, data + start, i + 1 - start, Z_SYNC_FLUSH);
+		if (RET_WAS_ERROR(r))
+			return r;
+		start = i + 1;
+	}
+	f->gzrsyncsum = sum;
+	f->gzrsyncpos = pos;
+	f->gzrsyncwindowfull = full;
+	if (start == len)
+		return RET_OK;
+	return deflategz(f, data + start, len - start, Z_NO_FLUSH);
+}
+
 static retvalue finishgz(struct filetorelease *f) {
 	int zret;
 
 	assert (f->f[ic_gzip].fd >= 0);
 
-	f->gzstream.next_in = f->buffer;
-	f->gzstream.avail_in = f->waiting_bytes;
+#ifdef HAVE_LIBDEFLATE
+	if (f->gzinmemory)
+		return finishgzinmemory(f);
+#endif
+
+	if (f->gzrsyncable) {
+		/* the rest needs to be looked at for flush points, too */
+		retvalue r = writegz(f, f->buffer, f->waiting_bytes);
+		if (RET_WAS_ERROR(r))
+			return r;
+		f->gzstream.next_in = NULL;
+		f->gzstream.avail_in = 0;
+	} else {
+		f->gzstream.next_in = f->buffer;
+		f->gzstream.avail_in = f->waiting_bytes;
+	}
 
 	do {
 		f->gzstream.next_out = f->gzoutputbuffer + f->gz_waiting_bytes;
@@ -1092,13 +1410,13 @@ static retvalue finishgz(struct filetorelease *f) {
 
 #ifdef HAVE_LIBBZ2
 
-static retvalue writebz(struct filetorelease *f) {
+static retvalue writebz(struct filetorelease *f, const unsigned char *data, size_t len) {
 	int bzret;
 
 	assert (f->f[ic_bzip2].fd >= 0);
 
-	f->bzstream.next_in = (char*)f->buffer;
-	f->bzstream.avail_in = INPUT_BUFFER_SIZE;
+	f->bzstream.next_in = (char*)data;
+	f->bzstream.avail_in = len;
 
 	do {
 		f->bzstream.next_out = f->bzoutputbuffer + f->bz_waiting_bytes;
@@ -1185,13 +1503,13 @@ static retvalue finishbz(struct filetorelease *f) {
 
 #ifdef HAVE_LIBLZMA
 
-static retvalue writexz(struct filetorelease *f) {
+static retvalue writexz(struct filetorelease *f, const unsigned char *data, size_t len) {
 	lzma_ret xzret;
 
 	assert (f->f[ic_xz].fd >= 0);
 
-	f->xzstream.next_in = f->buffer;
-	f->xzstream.avail_in = INPUT_BUFFER_SIZE;
+	f->xzstream.next_in = data;
+	f->xzstream.avail_in = len;
 
 	do {
 		f->xzstream.next_out = f->xzoutputbuffer + f->xz_waiting_bytes;
@@ -1268,6 +1586,263 @@ static retvalue finishxz(struct filetorelease *f) {
 }
 #endif
 
+#ifdef HAVE_LIBZSTD
+
+static retvalue writezst(struct filetorelease *f, const unsigned char *data, size_t len) {
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t ret;
+
+	assert (f->f[ic_zstd].fd >= 0);
+
+	in.src = data;
+	in.size = len;
+	in.pos = 0;
+
+	do {
+		out.dst = f->zstoutputbuffer;
+		out.size = ZSTBUFSIZE;
+		out.pos = f->zst_waiting_bytes;
+
+		ret = ZSTD_compressStream(f->zststream, &out, &in);
+		f->zst_waiting_bytes = out.pos;
+
+		if (ZSTD_isError(ret)) {
+			fprintf(stderr, "Error from libzstd's "
+					"ZSTD_compressStream: %s\n",
+					ZSTD_getErrorName(ret));
+			return RET_ERROR;
+		}
+		if (f->zst_waiting_bytes >= ZSTBUFSIZE / 2) {
+			retvalue r;
+			r = writetofile(&f->f[ic_zstd],
+					f->zstoutputbuffer,
+					f->zst_waiting_bytes);
+			assert (r != RET_NOTHING);
+			if (RET_WAS_ERROR(r))
+				return r;
+			f->zst_waiting_bytes = 0;
+		}
+	} while (in.pos < in.size);
+	return RET_OK;
+}
+
+static retvalue finishzst(struct filetorelease *f) {
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t ret;
+	bool finished;
+
+	assert (f->f[ic_zstd].fd >= 0);
+
+	in.src = f->buffer;
+	in.size = f->waiting_bytes;
+	in.pos = 0;
+
+	do {
+		out.dst = f->zstoutputbuffer;
+		out.size = ZSTBUFSIZE;
+		out.pos = f->zst_waiting_bytes;
+
+		/* first the rest of the input, then everything buffered
+		 * till ZSTD_endStream tells there is nothing left: */
+		finished = false;
+		if (in.pos < in.size)
+			ret = ZSTD_compressStream(f->zststream, &out, &in);
+		else {
+			ret = ZSTD_endStream(f->zststream, &out);
+			finished = ret == 0;
+		}
+		f->zst_waiting_bytes = out.pos;
+
+		if (ZSTD_isError(ret)) {
+			fprintf(stderr, "Error from libzstd finishing stream: "
+					"%s\n", ZSTD_getErrorName(ret));
+			return RET_ERROR;
+		}
+		if (f->zst_waiting_bytes > 0) {
+			retvalue r;
+			r = writetofile(&f->f[ic_zstd],
+					f->zstoutputbuffer,
+					f->zst_waiting_bytes);
+			assert (r != RET_NOTHING);
+			if (RET_WAS_ERROR(r))
+				return r;
+			f->zst_waiting_bytes = 0;
+		}
+	} while (!finished);
+
+	(void)ZSTD_freeCStream(f->zststream);
+	f->zststream = NULL;
+	free(f->zstoutputbuffer);
+	f->zstoutputbuffer = NULL;
+
+	return RET_OK;
+}
+#endif
+
+static retvalue compressdata(struct filetorelease *file, const unsigned char *data, size_t len) {
+	retvalue result, r;
+
+	result = RET_OK;
+	if (file->f[ic_gzip].relativefilename != NULL) {
+		r = writegz(file, data, len);
+		RET_UPDATE(result, r);
+	}
+#ifdef HAVE_LIBBZ2
+	if (file->f[ic_bzip2].relativefilename != NULL) {
+		r = writebz(file, data, len);
+		RET_UPDATE(result, r);
+	}
+#endif
+#ifdef HAVE_LIBLZMA
+	if (file->f[ic_xz].relativefilename != NULL) {
+		r = writexz(file, data, len);
+		RET_UPDATE(result, r);
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	if (file->f[ic_zstd].relativefilename != NULL) {
+		r = writezst(file, data, len);
+		RET_UPDATE(result, r);
+	}
+#endif
+	return result;
+}
+
+static void freedeferred(struct filetorelease *file) {
+	free(file->deferred);
+	file->deferred = NULL;
+	file->deferred_len = 0;
+	file->deferred_size = 0;
+	file->deferring = false;
+}
+
+/* keep the buffer to compress it later, unless that gets too much */
+static retvalue deferdata(struct filetorelease *file) {
+	retvalue r;
+
+	if (file->deferred_len + INPUT_BUFFER_SIZE > DEFERRED_MAXSIZE) {
+		r = compressdata(file, file->deferred, file->deferred_len);
+		freedeferred(file);
+		if (RET_WAS_ERROR(r))
+			return r;
+		return compressdata(file, file->buffer, INPUT_BUFFER_SIZE);
+	}
+	if (file->deferred_size - file->deferred_len < INPUT_BUFFER_SIZE) {
+		size_t newsize = file->deferred_size * 2 + INPUT_BUFFER_SIZE;
+		unsigned char *n;
+
+		if (newsize > DEFERRED_MAXSIZE)
+			newsize = DEFERRED_MAXSIZE;
+		n = realloc(file->deferred, newsize);
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		file->deferred = n;
+		file->deferred_size = newsize;
+	}
+	memcpy(file->deferred + file->deferred_len, file->buffer,
+			INPUT_BUFFER_SIZE);
+	file->deferred_len += INPUT_BUFFER_SIZE;
+	return RET_OK;
+}
+
+/* If the cache says the old files have exactly the content just generated,
+ * add them to the Release file instead of the new ones.
+ * Returns RET_NOTHING if anything differs or is missing. */
+static retvalue keepunchanged(struct release *release, struct filetorelease *file) {
+	struct checksumscontext context;
+	struct checksums *current, *checksums[ic_count];
+	enum indexcompression ic;
+	char *combinedchecksum;
+	retvalue r;
+
+	/* do not finalize the context itself, it is still needed if the
+	 * new files are used after all */
+	context = file->f[ic_uncompressed].context;
+	r = checksums_from_context(&current, &context);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	for (ic = ic_uncompressed ; ic < ic_count ; ic++)
+		checksums[ic] = NULL;
+	for (ic = ic_uncompressed ; ic < ic_count ; ic++) {
+		struct openfile *f = &file->f[ic];
+
+		if (f->relativefilename == NULL)
+			continue;
+		if (f->fullfinalfilename != NULL
+				&& !isregularfile(f->fullfinalfilename)) {
+			r = RET_NOTHING;
+			break;
+		}
+		r = table_getrecord(release->cachedb, false,
+				f->relativefilename, &combinedchecksum, NULL);
+		if (!RET_IS_OK(r))
+			break;
+		r = checksums_parse(&checksums[ic], combinedchecksum);
+		free(combinedchecksum);
+		if (!RET_IS_OK(r))
+			break;
+		if (ic == ic_uncompressed) {
+			if (!checksums_check(checksums[ic], current, NULL)) {
+				r = RET_NOTHING;
+				break;
+			}
+			checksums_free(checksums[ic]);
+			checksums[ic] = current;
+			current = NULL;
+		} else {
+			if (ic == ic_gzip) {
+				r = checkcachedrsyncable(release,
+						f->relativefilename,
+						file->gzrsyncable);
+				if (!RET_IS_OK(r))
+					break;
+			}
+			r = checksums_complete(&checksums[ic],
+					f->fullfinalfilename);
+			if (r == RET_ERROR_WRONG_MD5)
+				r = RET_NOTHING;
+			if (!RET_IS_OK(r))
+				break;
+		}
+	}
+	checksums_free(current);
+	if (!RET_IS_OK(r)) {
+		for (ic = ic_uncompressed ; ic < ic_count ; ic++)
+			checksums_free(checksums[ic]);
+		return r;
+	}
+
+	/* the new uncompressed file is no longer needed, the other
+	 * temporary files are removed by release_abortfile */
+	if (file->f[ic_uncompressed].fulltemporaryfilename != NULL)
+		(void)unlink(file->f[ic_uncompressed].fulltemporaryfilename);
+	for (ic = ic_uncompressed ; ic < ic_count ; ic++) {
+		struct openfile *f = &file->f[ic];
+
+		if (f->relativefilename == NULL)
+			continue;
+		r = releasesymlink(release, f);
+		if (!RET_WAS_ERROR(r)) {
+			r = newreleaseentry(release, f->relativefilename,
+					checksums[ic], NULL, NULL, NULL);
+			f->relativefilename = NULL;
+			checksums[ic] = NULL;
+			if (RET_IS_OK(r) && ic == ic_gzip)
+				release->lastadded->rsyncable =
+					file->gzrsyncable;
+		}
+		if (RET_WAS_ERROR(r)) {
+			for (; ic < ic_count ; ic++)
+				checksums_free(checksums[ic]);
+			return r;
+		}
+	}
+	return RET_OK;
+}
+
 retvalue release_finishfile(struct release *release, struct filetorelease *file) {
 	retvalue result, r;
 	enum indexcompression i;
@@ -1293,6 +1868,21 @@ retvalue release_finishfile(struct release *release, struct filetorelease *file)
 		}
 		file->f[ic_uncompressed].fd = -1;
 	}
+	if (file->deferring) {
+		r = keepunchanged(release, file);
+		if (RET_IS_OK(r)) {
+			release_abortfile(file);
+			return RET_NOTHING;
+		}
+		if (r == RET_NOTHING)
+			r = compressdata(file, file->deferred,
+					file->deferred_len);
+		freedeferred(file);
+		if (RET_WAS_ERROR(r)) {
+			release_abortfile(file);
+			return r;
+		}
+	}
 	if (file->f[ic_gzip].fd >= 0) {
 		r = finishgz(file);
 		if (RET_WAS_ERROR(r)) {
@@ -1338,6 +1928,22 @@ retvalue release_finishfile(struct release *release, struct filetorelease *file)
 		}
 		file->f[ic_xz].fd = -1;
 	}
+#endif
+#ifdef HAVE_LIBZSTD
+	if (file->f[ic_zstd].fd >= 0) {
+		r = finishzst(file);
+		if (RET_WAS_ERROR(r)) {
+			release_abortfile(file);
+			return r;
+		}
+		if (close(file->f[ic_zstd].fd) != 0) {
+			int e = errno;
+			file->f[ic_zstd].fd = -1;
+			release_abortfile(file);
+			return RET_ERRNO(e);
+		}
+		file->f[ic_zstd].fd = -1;
+	}
 #endif
 	release->new = true;
 	result = RET_OK;
@@ -1348,15 +1954,21 @@ retvalue release_finishfile(struct release *release, struct filetorelease *file)
 			release_abortfile(file);
 			return r;
 		}
+		if (RET_IS_OK(r) && i == ic_gzip)
+			release->lastadded->rsyncable = file->gzrsyncable;
 		RET_UPDATE(result, r);
 	}
 	free(file->buffer);
 	free(file->gzoutputbuffer);
+	free(file->gzrsyncwindow);
 #ifdef HAVE_LIBBZ2
 	free(file->bzoutputbuffer);
 #endif
 #ifdef HAVE_LIBLZMA
 	assert(file->xzoutputbuffer == NULL);
+#endif
+#ifdef HAVE_LIBZSTD
+	assert(file->zstoutputbuffer == NULL);
 #endif
 	free(file);
 	return result;
@@ -1374,25 +1986,12 @@ static retvalue release_processbuffer(struct filetorelease *file) {
 			file->buffer, INPUT_BUFFER_SIZE);
 	RET_UPDATE(result, r);
 
-	if (file->f[ic_gzip].relativefilename != NULL) {
-		r = writegz(file);
-		RET_UPDATE(result, r);
-	}
-	RET_UPDATE(file->state, result);
-#ifdef HAVE_LIBBZ2
-	if (file->f[ic_bzip2].relativefilename != NULL) {
-		r = writebz(file);
-		RET_UPDATE(result, r);
-	}
-	RET_UPDATE(file->state, result);
-#endif
-#ifdef HAVE_LIBLZMA
-	if (file->f[ic_xz].relativefilename != NULL) {
-		r = writexz(file);
-		RET_UPDATE(result, r);
-	}
+	if (file->deferring)
+		r = deferdata(file);
+	else
+		r = compressdata(file, file->buffer, INPUT_BUFFER_SIZE);
+	RET_UPDATE(result, r);
 	RET_UPDATE(file->state, result);
-#endif
 	return result;
 }
 
@@ -1431,16 +2030,16 @@ retvalue release_writedata(struct filetorelease *file, const char *data, size_t
 }
 
 /* Generate a "Release"-file for arbitrary directory */
-retvalue release_directorydescription(struct release *release, const struct distribution *distribution, const struct target *target, const char *releasename, bool onlyifneeded) {
+retvalue release_directorydescription(struct release *release, const struct distribution *distribution, const char *relativedirectory, component_t component, architecture_t architecture, const char *releasename, bool onlyifneeded) {
 	retvalue r;
 	struct filetorelease *f;
 	char *relfilename;
 
-	relfilename = calc_dirconcat(target->relativedirectory, releasename);
+	relfilename = calc_dirconcat(relativedirectory, releasename);
 	if (FAILEDTOALLOC(relfilename))
 		return RET_ERROR_OOM;
 	r = startfile(release, relfilename, NULL,
-			IC_FLAG(ic_uncompressed), onlyifneeded, &f);
+			IC_FLAG(ic_uncompressed), false, onlyifneeded, &f);
 	free(relfilename);
 	if (RET_WAS_ERROR(r) || r == RET_NOTHING)
 		return r;
@@ -1454,12 +2053,10 @@ retvalue release_directorydescription(struct release *release, const struct dist
 
 	release_writeheader("Archive", distribution->suite);
 	release_writeheader("Version", distribution->version);
-	release_writeheader("Component",
-			atoms_components[target->component]);
+	release_writeheader("Component", atoms_components[component]);
 	release_writeheader("Origin", distribution->origin);
 	release_writeheader("Label", distribution->label);
-	release_writeheader("Architecture",
-			atoms_architectures[target->architecture]);
+	release_writeheader("Architecture", atoms_architectures[architecture]);
 	release_writeheader("NotAutomatic", distribution->notautomatic);
 	release_writeheader("ButAutomaticUpgrades",
 			distribution->butautomaticupgrades);
@@ -1487,6 +2084,21 @@ static retvalue storechecksums(struct release *release) {
 		if (RET_WAS_ERROR(r))
 			return r;
 
+		if (isgzfile(file->relativefilename)) {
+			char *key = rsyncablekey(file->relativefilename);
+
+			if (FAILEDTOALLOC(key))
+				return RET_ERROR_OOM;
+			r = table_deleterecord(release->cachedb, key, true);
+			if (!RET_WAS_ERROR(r) && file->checksums != NULL
+					&& file->rsyncable)
+				r = table_adduniqsizedrecord(release->cachedb,
+						key, "", 1, false, false);
+			free(key);
+			if (RET_WAS_ERROR(r))
+				return r;
+		}
+
 		if (file->checksums == NULL)
 			continue;
 
@@ -1562,6 +2174,19 @@ static void omitunusedspecialreleaseentry(struct release *release, struct releas
 	release_freeentry(e);
 }
 
+/* with a binary-all index apt is only to look there for architecture all
+ * packages, so no No-Support-for-Architecture-all field is written */
+static bool release_hasarchallindex(const struct distribution *distribution) {
+	const struct target *target;
+
+	for (target = distribution->targets ; target != NULL ;
+	                                      target = target->next) {
+		if (target_hasarchallindex(target))
+			return true;
+	}
+	return false;
+}
+
 /* Generate a main "Release" file for a distribution */
 retvalue release_prepare(struct release *release, struct distribution *distribution, bool onlyifneeded) {
 	size_t s;
@@ -1662,6 +2287,8 @@ retvalue release_prepare(struct release *release, struct distribution *distribut
 		writechar(' ');
 		writestring(atoms_architectures[a]);
 	}
+	if (release_hasarchallindex(distribution))
+		writestring(" all");
 	writestring("\nComponents:");
 	for (i = 0 ; i < distribution->components.count ; i++) {
 		component_t c = distribution->components.atoms[i];
@@ -1886,6 +2513,161 @@ retvalue release_finish(/*@only@*/struct release *release, struct distribution *
 	return result;
 }
 
+/* When exporting in a worker process, the files (to be) generated there
+ * are sent to the parent, which then does the rest of the work.
+ * Each entry is stored as its five fields, each either '-' for NULL
+ * or '+' followed by the 0-terminated string. */
+
+/* in a worker process (see database_forked) the handle of the cache
+ * inherited from the parent cannot be used, so open it again to read it */
+retvalue release_forked(struct release *release, const char *codename) {
+	retvalue r;
+
+	if (release->cachedb == NULL)
+		return RET_NOTHING;
+	release->cachedb = NULL;
+	r = database_openreleasecache(codename, true, &release->cachedb);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r))
+		release->cachedb = NULL;
+	return r;
+}
+
+static void serializestring(char **p_p, /*@null@*/const char *s) {
+	char *p = *p_p;
+
+	if (s == NULL) {
+		*(p++) = '-';
+	} else {
+		size_t l = strlen(s);
+		*(p++) = '+';
+		memcpy(p, s, l + 1);
+		p += l + 1;
+	}
+	*p_p = p;
+}
+
+retvalue release_serialize(const struct release *release, char **data_p, size_t *len_p) {
+	const struct release_entry *file;
+	const char *combined;
+	size_t len, combinedlen;
+	char *data, *p;
+	retvalue r;
+
+#define serializedlen(s) (((s) == NULL)?1:strlen(s) + 2)
+	len = 1;
+	for (file = release->files ; file != NULL ; file = file->next) {
+		len += serializedlen(file->relativefilename);
+		len += serializedlen(file->fullfinalfilename);
+		len += serializedlen(file->fulltemporaryfilename);
+		len += serializedlen(file->symlinktarget);
+		if (file->checksums == NULL)
+			len += 1;
+		else {
+			r = checksums_getcombined(file->checksums,
+					&combined, &combinedlen);
+			if (RET_WAS_ERROR(r))
+				return r;
+			len += combinedlen + 2;
+		}
+	}
+#undef serializedlen
+	data = malloc(len);
+	if (FAILEDTOALLOC(data))
+		return RET_ERROR_OOM;
+	p = data;
+	*(p++) = release->new ? 'N' : 'O';
+	for (file = release->files ; file != NULL ; file = file->next) {
+		combined = NULL;
+		if (file->checksums != NULL)
+			(void)checksums_getcombined(file->checksums,
+					&combined, &combinedlen);
+		serializestring(&p, file->relativefilename);
+		serializestring(&p, combined);
+		serializestring(&p, file->fullfinalfilename);
+		serializestring(&p, file->fulltemporaryfilename);
+		serializestring(&p, file->symlinktarget);
+	}
+	assert ((size_t)(p - data) == len);
+	*data_p = data;
+	*len_p = len;
+	return RET_OK;
+}
+
+static retvalue deserializestring(const char **p_p, const char *end, /*@out@*/char **s_p) {
+	const char *p = *p_p, *e;
+
+	if (p < end && *p == '-') {
+		*s_p = NULL;
+		*p_p = p + 1;
+		return RET_OK;
+	}
+	if (p >= end || *p != '+' ||
+			(e = memchr(p + 1, '\0', end - (p + 1))) == NULL) {
+		fputs("Internal error: malformed data from export process!\n",
+				stderr);
+		return RET_ERROR_INTERNAL;
+	}
+	*s_p = strdup(p + 1);
+	if (FAILEDTOALLOC(*s_p))
+		return RET_ERROR_OOM;
+	*p_p = e + 1;
+	return RET_OK;
+}
+
+retvalue release_deserialize(struct release *release, const char *data, size_t len) {
+	const char *p = data, *end = data + len;
+	char *relativefilename, *combined, *fullfinalfilename,
+	     *fulltemporaryfilename, *symlinktarget;
+	struct checksums *checksums;
+	retvalue r;
+
+	if (len < 1 || (*p != 'N' && *p != 'O')) {
+		fputs("Internal error: malformed data from export process!\n",
+				stderr);
+		return RET_ERROR_INTERNAL;
+	}
+	if (*p == 'N')
+		release->new = true;
+	p++;
+	while (p < end) {
+		relativefilename = combined = fullfinalfilename =
+			fulltemporaryfilename = symlinktarget = NULL;
+		checksums = NULL;
+		r = deserializestring(&p, end, &relativefilename);
+		if (RET_IS_OK(r))
+			r = deserializestring(&p, end, &combined);
+		if (RET_IS_OK(r))
+			r = deserializestring(&p, end, &fullfinalfilename);
+		if (RET_IS_OK(r))
+			r = deserializestring(&p, end, &fulltemporaryfilename);
+		if (RET_IS_OK(r))
+			r = deserializestring(&p, end, &symlinktarget);
+		if (RET_IS_OK(r) && combined != NULL)
+			r = checksums_parse(&checksums, combined);
+		free(combined);
+		if (RET_IS_OK(r) && relativefilename == NULL) {
+			fputs(
+"Internal error: malformed data from export process!\n", stderr);
+			r = RET_ERROR_INTERNAL;
+		}
+		if (!RET_IS_OK(r)) {
+			free(relativefilename);
+			checksums_free(checksums);
+			free(fullfinalfilename);
+			free(fulltemporaryfilename);
+			free(symlinktarget);
+			return r;
+		}
+		r = newreleaseentry(release, relativefilename, checksums,
+				fullfinalfilename, fulltemporaryfilename,
+				symlinktarget);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	return RET_OK;
+}
+
 retvalue release_mkdir(struct release *release, const char *relativedirectory) {
 	char *dirname;
 	retvalue r;
@@ -11,6 +11,9 @@
 #ifndef REPREPRO_DATABASE_H
 #include "database.h"
 #endif
+#ifndef REPREPRO_ATOMS_H
+#include "atoms.h"
+#endif
 
 struct release;
 
@@ -21,6 +24,9 @@ enum indexcompression {ic_uncompressed=0, ic_gzip,
 #endif
 #ifdef HAVE_LIBLZMA
 			ic_xz,
+#endif
+#ifdef HAVE_LIBZSTD
+			ic_zstd,
 #endif
 			ic_count /* fake item to get count */
 };
@@ -41,10 +47,20 @@ retvalue release_addsilentnew(struct release *, /*@only@*/char *, /*@only@*/char
 retvalue release_adddel(struct release *, /*@only@*/char *);
 retvalue release_addold(struct release *, /*@only@*/char *);
 
+/* Entries are normally added at the end of the list of files.
+ * To add them later at the place they would have been added now,
+ * remember the position with release_lastentry and enclose the
+ * release_add* calls in release_insertafter and release_endinsert
+ * (which returns the position after the added entries). */
+struct release_entry;
+/*@null@*/struct release_entry *release_lastentry(struct release *);
+void release_insertafter(struct release *, /*@null@*/struct release_entry *);
+/*@null@*/struct release_entry *release_endinsert(struct release *);
+
 struct filetorelease;
 
-retvalue release_startfile(struct release *, const char * /*filename*/, compressionset, bool /*usecache*/, struct filetorelease **);
-retvalue release_startlinkedfile(struct release *, const char * /*filename*/, const char * /*symlinkas*/, compressionset, bool /*usecache*/, struct filetorelease **);
+retvalue release_startfile(struct release *, const char * /*filename*/, compressionset, bool /*rsyncable*/, bool /*usecache*/, struct filetorelease **);
+retvalue release_startlinkedfile(struct release *, const char * /*filename*/, const char * /*symlinkas*/, compressionset, bool /*rsyncable*/, bool /*usecache*/, struct filetorelease **);
 void release_warnoldfileorlink(struct release *, const char *, compressionset);
 
 /* return true if an old file is already there */
@@ -55,14 +71,20 @@ retvalue release_writedata(struct filetorelease *, const char *, size_t);
 #define release_writestring(file, data) release_writedata(file, data, strlen(data))
 
 void release_abortfile(/*@only@*/struct filetorelease *);
+/* returns RET_NOTHING if the content is unchanged and the old files kept */
 retvalue release_finishfile(struct release *, /*@only@*/struct filetorelease *);
 
 struct distribution;
 struct target;
-retvalue release_directorydescription(struct release *, const struct distribution *, const struct target *, const char * /*filename*/, bool /*onlyifneeded*/);
+retvalue release_directorydescription(struct release *, const struct distribution *, const char * /*relativedirectory*/, component_t, architecture_t, const char * /*filename*/, bool /*onlyifneeded*/);
 
 void release_free(/*@only@*/struct release *);
 retvalue release_prepare(struct release *, struct distribution *, bool /*onlyneeded*/);
 retvalue release_finish(/*@only@*/struct release *, struct distribution *);
 
+/* pass the files generated in a worker process to the parent */
+retvalue release_forked(struct release *, const char * /*codename*/);
+retvalue release_serialize(const struct release *, /*@out@*/char **, /*@out@*/size_t *);
+retvalue release_deserialize(struct release *, const char *, size_t);
+
 #endif
@@ -147,10 +147,17 @@ struct remote_index {
 
 	/* if using pdiffs, the content of the Packages.diff/Index: */
 	struct diffindex *diffindex;
-	/* the last patch queued to be applied */
-	char *patchfilename;
-	/*@dependant@*/const struct diffindex_patch *selectedpatch;
-	bool deletecompressedpatch;
+	/* the patches queued to be applied (in the order to apply them),
+	 * all are downloaded before applying them at once */
+	int patchcount, patchesmissing;
+	struct queuedpatch {
+		/*@dependant@*/struct remote_index *ri;
+		/*@dependant@*/const struct diffindex_patch *patch;
+		char *filename;
+		bool deletecompressed;
+	} *patches;
+	/* one patch failed, so the others are no longer needed */
+	bool patchesfailed;
 
 	bool queued;
 	bool needed;
@@ -169,11 +176,22 @@ struct cachedlistfile {
 };
 
 
+static void remote_index_freepatches(struct remote_index *i) {
+	int j;
+
+	for (j = 0 ; j < i->patchcount ; j++)
+		free(i->patches[j].filename);
+	free(i->patches);
+	i->patches = NULL;
+	i->patchcount = 0;
+	i->patchesmissing = 0;
+}
+
 static void remote_index_free(/*@only@*/struct remote_index *i) {
 	if (i == NULL)
 		return;
 	free(i->cachefilename);
-	free(i->patchfilename);
+	remote_index_freepatches(i);
 	free(i->filename_in_release);
 	diffindex_free(i->diffindex);
 	checksums_free(i->oldchecksums);
@@ -1830,16 +1848,17 @@ static retvalue index_callback(enum queue_action action, void *privdata, UNUSED(
 
 static queue_callback diff_got_callback;
 
-static retvalue queue_next_diff(struct remote_index *ri) {
+static retvalue queue_diffs(struct remote_index *ri) {
 	struct remote_distribution *rd = ri->from;
 	struct remote_repository *rr = rd->repository;
-	int i;
+	struct diffindex *diffindex = ri->diffindex;
+	int i, first, count;
 	retvalue r;
 
-	for (i = 0 ; i < ri->diffindex->patchcount ; i++) {
+	first = -1;
+	for (i = 0 ; i < diffindex->patchcount ; i++) {
 		bool improves;
-		struct diffindex_patch *p = &ri->diffindex->patches[i];
-		char *patchsuffix, *c;
+		struct diffindex_patch *p = &diffindex->patches[i];
 
 		if (p->done || p->frompackages == NULL)
 			continue;
@@ -1850,15 +1869,43 @@ static retvalue queue_next_diff(struct remote_index *ri) {
 		/* p->frompackages should only have sha1 and oldchecksums
 		 * should definitely list a sha1 hash */
 		assert (!improves);
+		first = i;
+		break;
+	}
+	if (first < 0) {
+		/* no patch matches, try next possibility... */
+		fprintf(stderr,
+"Error: available '%s' not listed in '%s.diffindex'.\n",
+				ri->cachefilename, ri->cachefilename);
+		return queue_next_encoding(rd, ri);
+	}
+	/* with merged patches the first one is all that is needed,
+	 * otherwise each patch results in what the next one starts with */
+	if (diffindex->merged)
+		count = 1;
+	else
+		count = diffindex->patchcount - first;
 
-		p->done = true;
+	assert (ri->patches == NULL);
+	ri->patches = nzNEW(count, struct queuedpatch);
+	if (FAILEDTOALLOC(ri->patches))
+		return RET_ERROR_OOM;
+	ri->patchcount = count;
+	ri->patchesmissing = count;
+	ri->patchesfailed = false;
+	for (i = 0 ; i < count ; i++) {
+		struct queuedpatch *q = &ri->patches[i];
+		struct diffindex_patch *p = &diffindex->patches[first + i];
+		char *c;
 
-		free(ri->patchfilename);
-		ri->patchfilename = mprintf("%s.diff-%s", ri->cachefilename,
+		p->done = true;
+		q->ri = ri;
+		q->patch = p;
+		q->filename = mprintf("%s.diff-%s", ri->cachefilename,
 				p->name);
-		if (FAILEDTOALLOC(ri->patchfilename))
+		if (FAILEDTOALLOC(q->filename))
 			return RET_ERROR_OOM;
-		c = ri->patchfilename + strlen(ri->cachefilename);
+		c = q->filename + strlen(ri->cachefilename);
 		while (*c != '\0') {
 			if ((*c < '0' || *c > '9')
 					&& (*c < 'A' || *c > 'Z')
@@ -1867,64 +1914,92 @@ static retvalue queue_next_diff(struct remote_index *ri) {
 				*c = '_';
 			c++;
 		}
-		ri->selectedpatch = p;
-		patchsuffix = mprintf(".diff/%s.gz", p->name);
+	}
+	/* tell the downloader we want all of them at once */
+	for (i = 0 ; i < count ; i++) {
+		struct queuedpatch *q = &ri->patches[i];
+		char *patchsuffix;
+
+		patchsuffix = mprintf(".diff/%s.gz", q->patch->name);
 		if (FAILEDTOALLOC(patchsuffix))
 			return RET_ERROR_OOM;
-
-		/* found a matching patch, tell the downloader we want it */
 		r = aptmethod_enqueueindex(rr->download, rd->suite_base_dir,
 				ri->filename_in_release,
 				patchsuffix,
-				ri->patchfilename, ".gz",
-				diff_got_callback, ri, p);
+				q->filename, ".gz",
+				diff_got_callback, q, NULL);
 		free(patchsuffix);
-		return r;
+		if (RET_WAS_ERROR(r))
+			return r;
 	}
-	/* no patch matches, try next possibility... */
-	fprintf(stderr, "Error: available '%s' not listed in '%s.diffindex'.\n",
-			ri->cachefilename, ri->cachefilename);
-	return queue_next_encoding(rd, ri);
+	return RET_OK;
 }
 
-static retvalue diff_uncompressed(void *privdata, const char *compressed, bool failed) {
-	struct remote_index *ri = privdata;
+/* one of the patches could not be retrieved, so get the whole file
+ * instead (the other patches are ignored once they arrive) */
+static retvalue diffs_failed(struct remote_index *ri) {
+	int i;
+
+	if (ri->patchesfailed)
+		return RET_OK;
+	ri->patchesfailed = true;
+	for (i = 0 ; i < ri->patchcount ; i++)
+		(void)unlink(ri->patches[i].filename);
+	return queue_next_encoding(ri->from, ri);
+}
+
+/* all patches are there, so combine them and apply them at once */
+static retvalue diffs_apply(struct remote_index *ri) {
 	struct remote_distribution *rd = ri->from;
-	const struct diffindex_patch *p = ri->selectedpatch;
+	struct rred_patch **rps;
+	struct modification **ms, *m;
 	char *tempfilename;
-	struct rred_patch *rp;
 	FILE *f;
-	int i;
+	int i, count = ri->patchcount;
 	retvalue r;
 	bool dummy;
 
-	if (ri->deletecompressedpatch)
-		(void)unlink(compressed);
-	if (failed)
-		return RET_ERROR;
-
-	r = checksums_test(ri->patchfilename, p->checksums, NULL);
-	if (r == RET_NOTHING) {
-		fprintf(stderr, "Mysteriously vanished file '%s'!\n",
-				ri->patchfilename);
-		r = RET_ERROR_MISSING;
+	rps = nzNEW(count, struct rred_patch *);
+	ms = nzNEW(count, struct modification *);
+	if (FAILEDTOALLOC(rps) || FAILEDTOALLOC(ms)) {
+		free(rps);
+		free(ms);
+		return RET_ERROR_OOM;
 	}
-	if (r == RET_ERROR_WRONG_MD5)
-		fprintf(stderr, "Corrupted package diff '%s'!\n",
-				ri->patchfilename);
-	if (RET_WAS_ERROR(r))
+	r = RET_OK;
+	for (i = 0 ; i < count ; i++) {
+		r = patch_load(ri->patches[i].filename,
+				checksums_getfilesize(
+					ri->patches[i].patch->checksums),
+				&rps[i]);
+		ASSERT_NOT_NOTHING(r);
+		if (RET_WAS_ERROR(r))
+			break;
+		ms[i] = patch_getmodifications(rps[i]);
+	}
+	if (RET_WAS_ERROR(r)) {
+		while (--i >= 0) {
+			modification_freelist(ms[i]);
+			patch_free(rps[i]);
+		}
+		free(rps);
+		free(ms);
 		return r;
-
-	r = patch_load(ri->patchfilename,
-			checksums_getfilesize(p->checksums), &rp);
-	ASSERT_NOT_NOTHING(r);
-	if (RET_WAS_ERROR(r))
+	}
+	r = combine_patchlist(&m, ms, count);
+	free(ms);
+	if (!RET_WAS_ERROR(r)) {
+		tempfilename = calc_addsuffix(ri->cachefilename, "tmp");
+		if (FAILEDTOALLOC(tempfilename)) {
+			modification_freelist(m);
+			r = RET_ERROR_OOM;
+		}
+	}
+	if (RET_WAS_ERROR(r)) {
+		for (i = 0 ; i < count ; i++)
+			patch_free(rps[i]);
+		free(rps);
 		return r;
-
-	tempfilename = calc_addsuffix(ri->cachefilename, "tmp");
-	if (FAILEDTOALLOC(tempfilename)) {
-		patch_free(rp);
-		return RET_ERROR_OOM;
 	}
 	(void)unlink(tempfilename);
 	i = rename(ri->cachefilename, tempfilename);
@@ -1934,7 +2009,10 @@ static retvalue diff_uncompressed(void *privdata, const char *compressed, bool f
 				e, ri->cachefilename, tempfilename,
 				strerror(e));
 		free(tempfilename);
-		patch_free(rp);
+		modification_freelist(m);
+		for (i = 0 ; i < count ; i++)
+			patch_free(rps[i]);
+		free(rps);
 		return RET_ERRNO(e);
 	}
 	f = fopen(ri->cachefilename, "w");
@@ -1946,16 +2024,22 @@ static retvalue diff_uncompressed(void *privdata, const char *compressed, bool f
 		ri->olduncompressed->deleted = true;
 		ri->olduncompressed = NULL;
 		free(tempfilename);
-		patch_free(rp);
+		modification_freelist(m);
+		for (i = 0 ; i < count ; i++)
+			patch_free(rps[i]);
+		free(rps);
 		return RET_ERRNO(e);
 	}
-	r = patch_file(f, tempfilename, patch_getconstmodifications(rp));
+	r = patch_file(f, tempfilename, m);
 	(void)unlink(tempfilename);
-	(void)unlink(ri->patchfilename);
-	free(ri->patchfilename);
-	ri->patchfilename = NULL;
 	free(tempfilename);
-	patch_free(rp);
+	modification_freelist(m);
+	for (i = 0 ; i < count ; i++) {
+		patch_free(rps[i]);
+		(void)unlink(ri->patches[i].filename);
+	}
+	free(rps);
+	remote_index_freepatches(ri);
 	if (RET_WAS_ERROR(r)) {
 		(void)fclose(f);
 		remove_old_uncompressed(ri);
@@ -1997,22 +2081,60 @@ static retvalue diff_uncompressed(void *privdata, const char *compressed, bool f
 		/* we have a winner */
 		return indexfile_mark_got(rd, ri, ri->oldchecksums);
 	}
-	/* let's see what patch we need next */
-	return queue_next_diff(ri);
+	/* maybe some other patch now applies (if the history was not what
+	 * it was expected to be) */
+	return queue_diffs(ri);
+}
+
+static retvalue diff_uncompressed(void *privdata, const char *compressed, bool failed) {
+	struct queuedpatch *q = privdata;
+	struct remote_index *ri = q->ri;
+	retvalue r;
+
+	if (q->deletecompressed)
+		(void)unlink(compressed);
+	if (failed)
+		return RET_ERROR;
+	if (ri->patchesfailed) {
+		(void)unlink(q->filename);
+		return RET_OK;
+	}
+
+	r = checksums_test(q->filename, q->patch->checksums, NULL);
+	if (r == RET_NOTHING) {
+		fprintf(stderr, "Mysteriously vanished file '%s'!\n",
+				q->filename);
+		r = RET_ERROR_MISSING;
+	}
+	if (r == RET_ERROR_WRONG_MD5)
+		fprintf(stderr, "Corrupted package diff '%s'!\n",
+				q->filename);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	assert (ri->patchesmissing > 0);
+	if (--ri->patchesmissing > 0)
+		return RET_OK;
+	return diffs_apply(ri);
 }
 
 static retvalue diff_got_callback(enum queue_action action, void *privdata, UNUSED(void *privdata2), UNUSED(const char *uri), const char *gotfilename, const char *wantedfilename, UNUSED(/*@null@*/const struct checksums *gotchecksums), UNUSED(const char *methodname)) {
-	struct remote_index *ri = privdata;
+	struct queuedpatch *q = privdata;
 	retvalue r;
 
 	if (action == qa_error)
-		return queue_next_encoding(ri->from, ri);
+		return diffs_failed(q->ri);
 	if (action != qa_got)
 		return RET_ERROR;
 
-	ri->deletecompressedpatch = strcmp(gotfilename, wantedfilename) == 0;
-	r = uncompress_queue_file(gotfilename, ri->patchfilename,
-			c_gzip, diff_uncompressed, ri);
+	q->deletecompressed = strcmp(gotfilename, wantedfilename) == 0;
+	if (q->ri->patchesfailed) {
+		if (q->deletecompressed)
+			(void)unlink(gotfilename);
+		return RET_OK;
+	}
+	r = uncompress_queue_file(gotfilename, q->filename,
+			c_gzip, diff_uncompressed, q);
 	if (RET_WAS_ERROR(r))
 		(void)unlink(gotfilename);
 	return r;
@@ -2099,5 +2221,5 @@ static retvalue diff_callback(enum queue_action action, void *privdata, UNUSED(v
 			return queue_next_encoding(rd, ri);
 		}
 	}
-	return queue_next_diff(ri);
+	return queue_diffs(ri);
 }
@@ -583,6 +583,407 @@ retvalue combine_patches(struct modification **result_p, /*@only@*/struct modifi
 	return RET_OK;
 }
 
+/* merge patches to be applied one after the other into a single one.
+ * Merging them one by one into the result would look at the (growing)
+ * result again for each patch, so they are merged pairwise instead,
+ * every modification thus only being part of log(count) merges.
+ * The list is used as scratch space and all its items are consumed. */
+retvalue combine_patchlist(struct modification **result_p, struct modification **list, int count) {
+	retvalue r;
+	int i;
+
+	if (count <= 0) {
+		*result_p = NULL;
+		return RET_OK;
+	}
+	while (count > 1) {
+		for (i = 0 ; 2 * i + 1 < count ; i++) {
+			r = combine_patches(&list[i], list[2 * i],
+					list[2 * i + 1]);
+			if (RET_WAS_ERROR(r)) {
+				int j;
+
+				for (j = 0 ; j < i ; j++)
+					modification_freelist(list[j]);
+				for (j = 2 * i + 2 ; j < count ; j++)
+					modification_freelist(list[j]);
+				return r;
+			}
+		}
+		if ((count & 1) != 0)
+			list[i] = list[count - 1];
+		count = (count + 1) / 2;
+	}
+	*result_p = list[0];
+	return RET_OK;
+}
+
+/* Generating a patch between two versions of a Packages or Sources file:
+ * Those are lists of stanzas sorted by their first line ("Package: name"),
+ * so they can be compared in one pass by merging the stanzas by that line.
+ * All stanzas with the same first line (multiple versions of a package)
+ * are handled as one group; only groups that changed are compared line by
+ * line. If the files are not in that form, RET_NOTHING is returned. */
+
+/* do not compare changed groups line by line if larger than that: */
+#define MAXDIFFCELLS (1 << 20)
+
+struct stanzagroup {
+	const char *start, *end;
+	int lines;
+	/* the first line without the newline */
+	const char *key;
+	size_t keylen;
+};
+
+static inline const char *nextline(const char *p) {
+	while (*p != '\n')
+		p++;
+	return p + 1;
+}
+
+/* the files are known to end with a newline, so this never runs over */
+static const char *group_read(const char *p, const char *e, /*@out@*/struct stanzagroup *g) {
+	g->start = p;
+	g->lines = 0;
+	g->key = p;
+	g->keylen = nextline(p) - p - 1;
+	while (true) {
+		/* a stanza are all lines till an empty one,
+		 * the following empty lines are counted to it */
+		while (p < e && *p != '\n') {
+			p = nextline(p);
+			g->lines++;
+		}
+		while (p < e && *p == '\n') {
+			p++;
+			g->lines++;
+		}
+		if (p >= e || g->keylen == 0)
+			break;
+		if ((size_t)(e - p) <= g->keylen
+				|| memcmp(p, g->key, g->keylen) != 0
+				|| p[g->keylen] != '\n')
+			break;
+	}
+	g->end = p;
+	return p;
+}
+
+static int group_cmp(const struct stanzagroup *a, const struct stanzagroup *b) {
+	int c;
+
+	c = memcmp(a->key, b->key,
+			(a->keylen < b->keylen)?a->keylen:b->keylen);
+	if (c != 0)
+		return c;
+	if (a->keylen < b->keylen)
+		return -1;
+	return (a->keylen > b->keylen)?1:0;
+}
+
+/* append a modification, joining it with the last one if possible */
+static retvalue diff_add(struct modification **first_p, struct modification **last_p, int oldlinestart, int oldlinecount, const char *content, size_t len, int newlinecount) {
+	struct modification *last = *last_p, *n;
+
+	if (last != NULL &&
+	    last->oldlinestart + last->oldlinecount == oldlinestart) {
+		if (newlinecount == 0) {
+			last->oldlinecount += oldlinecount;
+			return RET_OK;
+		}
+		if (last->newlinecount == 0) {
+			last->oldlinecount += oldlinecount;
+			last->content = content;
+			last->len = len;
+			last->newlinecount = newlinecount;
+			return RET_OK;
+		}
+		if (last->content + last->len == content) {
+			last->oldlinecount += oldlinecount;
+			last->len += len;
+			last->newlinecount += newlinecount;
+			return RET_OK;
+		}
+	}
+	n = zNEW(struct modification);
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	n->oldlinestart = oldlinestart;
+	n->oldlinecount = oldlinecount;
+	n->newlinecount = newlinecount;
+	if (newlinecount > 0) {
+		n->content = content;
+		n->len = len;
+	}
+	n->previous = last;
+	if (last == NULL)
+		*first_p = n;
+	else
+		last->next = n;
+	*last_p = n;
+	return RET_OK;
+}
+
+static const char **group_splitlines(const struct stanzagroup *g) {
+	const char **lines, *p;
+	int i;
+
+	lines = nNEW(g->lines + 1, const char *);
+	if (FAILEDTOALLOC(lines))
+		return NULL;
+	p = g->start;
+	for (i = 0 ; i < g->lines ; i++) {
+		lines[i] = p;
+		p = nextline(p);
+	}
+	assert (p == g->end);
+	lines[g->lines] = p;
+	return lines;
+}
+
+static inline bool sameline(const char **a, int i, const char **b, int j) {
+	size_t len = a[i+1] - a[i];
+
+	return len == (size_t)(b[j+1] - b[j]) && memcmp(a[i], b[j], len) == 0;
+}
+
+/* compare two differing groups with the same first line, oldline being
+ * the line number of the old one */
+static retvalue diff_group(struct modification **first_p, struct modification **last_p, const struct stanzagroup *o, int oldline, const struct stanzagroup *n) {
+	const char **ol, **nl;
+	int prefix, suffix, oc, nc, i, j, is, js;
+	int *lcs;
+	retvalue r;
+
+	ol = group_splitlines(o);
+	if (FAILEDTOALLOC(ol))
+		return RET_ERROR_OOM;
+	nl = group_splitlines(n);
+	if (FAILEDTOALLOC(nl)) {
+		free(ol);
+		return RET_ERROR_OOM;
+	}
+	prefix = 0;
+	while (prefix < o->lines && prefix < n->lines &&
+			sameline(ol, prefix, nl, prefix))
+		prefix++;
+	suffix = 0;
+	while (suffix < o->lines - prefix && suffix < n->lines - prefix &&
+			sameline(ol, o->lines - suffix - 1,
+				nl, n->lines - suffix - 1))
+		suffix++;
+	oc = o->lines - prefix - suffix;
+	nc = n->lines - prefix - suffix;
+	ol += prefix;
+	nl += prefix;
+	if (oc == 0 || nc == 0 || (long)(oc + 1) * (nc + 1) > MAXDIFFCELLS) {
+		r = diff_add(first_p, last_p, oldline + prefix, oc,
+				nl[0], nl[nc] - nl[0], nc);
+		free(ol - prefix);
+		free(nl - prefix);
+		return r;
+	}
+	/* lcs[i*(nc+1)+j]: longest common subsequence of ol[i..] and nl[j..] */
+	lcs = nNEW((oc + 1) * (nc + 1), int);
+	if (FAILEDTOALLOC(lcs)) {
+		free(ol - prefix);
+		free(nl - prefix);
+		return RET_ERROR_OOM;
+	}
+#define LCS(i, j) lcs[(i) * (nc + 1) + (j)]
+	for (i = oc ; i >= 0 ; i--) {
+		for (j = nc ; j >= 0 ; j--) {
+			if (i == oc || j == nc)
+				LCS(i, j) = 0;
+			else if (sameline(ol, i, nl, j))
+				LCS(i, j) = LCS(i + 1, j + 1) + 1;
+			else if (LCS(i + 1, j) >= LCS(i, j + 1))
+				LCS(i, j) = LCS(i + 1, j);
+			else
+				LCS(i, j) = LCS(i, j + 1);
+		}
+	}
+	r = RET_OK;
+	i = 0; j = 0;
+	while (i < oc || j < nc) {
+		if (i < oc && j < nc && sameline(ol, i, nl, j)) {
+			i++; j++;
+			continue;
+		}
+		/* collect everything till the next common line: */
+		is = i; js = j;
+		while (i < oc || j < nc) {
+			if (i < oc && j < nc && sameline(ol, i, nl, j))
+				break;
+			if (j >= nc || (i < oc && LCS(i + 1, j) >= LCS(i, j + 1)))
+				i++;
+			else
+				j++;
+		}
+		r = diff_add(first_p, last_p, oldline + prefix + is, i - is,
+				nl[js], nl[j] - nl[js], j - js);
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+#undef LCS
+	free(lcs);
+	free(ol - prefix);
+	free(nl - prefix);
+	return r;
+}
+
+static retvalue mapfile(const char *filename, /*@out@*/int *fd_p, /*@out@*/char **data_p, /*@out@*/off_t *len_p) {
+	struct stat s;
+	int fd, e;
+	char *data;
+
+	fd = open(filename, O_NOCTTY|O_RDONLY);
+	if (fd < 0) {
+		e = errno;
+		fprintf(stderr,
+"Error %d opening '%s' for reading: %s\n", e, filename, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (fstat(fd, &s) != 0) {
+		e = errno;
+		fprintf(stderr,
+"Error %d retrieving length of '%s': %s\n", e, filename, strerror(e));
+		(void)close(fd);
+		return RET_ERRNO(e);
+	}
+	if (s.st_size == 0) {
+		/* cannot be mapped, and not worth it anyway */
+		(void)close(fd);
+		return RET_NOTHING;
+	}
+	data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		e = errno;
+		fprintf(stderr,
+"Error %d mapping '%s' into memory: %s\n", e, filename, strerror(e));
+		(void)close(fd);
+		return RET_ERRNO(e);
+	}
+	*fd_p = fd;
+	*data_p = data;
+	*len_p = s.st_size;
+	return RET_OK;
+}
+
+/* a patch can only express lines consisting of a single dot with extra
+ * commands, so leave those to diff */
+static bool hasdotline(const char *p, const char *e) {
+	while (p < e) {
+		if (p[0] == '.' && p + 1 < e && p[1] == '\n')
+			return true;
+		p = nextline(p);
+	}
+	return false;
+}
+
+static retvalue stanzadiff(const char *o, const char *oe, const char *n, const char *ne, /*@out@*/struct modification **modifications_p) {
+	struct modification *first = NULL, *last = NULL;
+	struct stanzagroup og, ng, prevog, prevng;
+	bool haveold = false, havenew = false, haveprevold = false,
+	     haveprevnew = false;
+	int oldline = 1;
+	retvalue r = RET_OK;
+	int c;
+
+	while (true) {
+		if (!haveold && o < oe) {
+			o = group_read(o, oe, &og);
+			if (haveprevold && group_cmp(&prevog, &og) >= 0)
+				break;
+			haveold = true;
+		}
+		if (!havenew && n < ne) {
+			n = group_read(n, ne, &ng);
+			if (haveprevnew && group_cmp(&prevng, &ng) >= 0)
+				break;
+			havenew = true;
+		}
+		if (!haveold && !havenew) {
+			*modifications_p = first;
+			return RET_OK;
+		}
+		if (!havenew)
+			c = -1;
+		else if (!haveold)
+			c = 1;
+		else
+			c = group_cmp(&og, &ng);
+		if (c < 0) {
+			r = diff_add(&first, &last, oldline, og.lines,
+					NULL, 0, 0);
+		} else if (c > 0) {
+			r = diff_add(&first, &last, oldline, 0,
+					ng.start, ng.end - ng.start, ng.lines);
+		} else if (og.end - og.start != ng.end - ng.start
+				|| memcmp(og.start, ng.start,
+					og.end - og.start) != 0) {
+			r = diff_group(&first, &last, &og, oldline, &ng);
+		}
+		if (RET_WAS_ERROR(r))
+			break;
+		if (c <= 0) {
+			oldline += og.lines;
+			prevog = og;
+			haveprevold = true;
+			haveold = false;
+		}
+		if (c >= 0) {
+			prevng = ng;
+			haveprevnew = true;
+			havenew = false;
+		}
+	}
+	modification_freelist(first);
+	if (RET_WAS_ERROR(r))
+		return r;
+	/* not sorted, so this is not usable */
+	return RET_NOTHING;
+}
+
+retvalue patch_diff(const char *oldfilename, const char *newfilename, struct rred_patch **patch_p) {
+	struct rred_patch *patch;
+	char *olddata;
+	off_t oldlen;
+	int oldfd;
+	retvalue r;
+
+	patch = zNEW(struct rred_patch);
+	if (FAILEDTOALLOC(patch))
+		return RET_ERROR_OOM;
+	patch->fd = -1;
+	r = mapfile(newfilename, &patch->fd, &patch->data, &patch->len);
+	if (!RET_IS_OK(r)) {
+		free(patch);
+		return r;
+	}
+	r = mapfile(oldfilename, &oldfd, &olddata, &oldlen);
+	if (!RET_IS_OK(r)) {
+		patch_free(patch);
+		return r;
+	}
+	if (olddata[oldlen - 1] != '\n' || patch->data[patch->len - 1] != '\n'
+			|| hasdotline(patch->data, patch->data + patch->len))
+		r = RET_NOTHING;
+	else
+		r = stanzadiff(olddata, olddata + oldlen,
+				patch->data, patch->data + patch->len,
+				&patch->modifications);
+	(void)munmap(olddata, oldlen);
+	(void)close(oldfd);
+	if (!RET_IS_OK(r)) {
+		patch_free(patch);
+		return r;
+	}
+	*patch_p = patch;
+	return RET_OK;
+}
+
 retvalue patch_file(FILE *o, const char *source, const struct modification *patch) {
 	FILE *i;
 	int currentline, ignore, c;
@@ -59,6 +59,7 @@ static const struct option options[] = {
 	{"max-patch-count", required_argument, NULL, 'N'},
 	{"reprepro-hook", no_argument, NULL, 'R'},
 	{"patch", no_argument, NULL, 'p'},
+	{"diff", no_argument, NULL, 'd'},
 	{NULL, 0, NULL, 0}
 };
 
@@ -69,10 +70,14 @@ static void usage(FILE *f) {
 "Syntax:\n"
 "	rredtool <directory> <newfile> <oldfile> <mode>\n"
 "	 update .diff directory (to be called from reprepro)\n"
+"	rredtool batch\n"
+"	 the same for many files (to be called from reprepro with --batched)\n"
 "	rredtool --merge <patches..>\n"
 "	 merge patches into one patch\n"
 "	rredtool --patch <file> <patches..>\n"
-"	 apply patches to file\n", f);
+"	 apply patches to file\n"
+"	rredtool --diff <oldfile> <newfile>\n"
+"	 create patch between two Packages or Sources files\n", f);
 }
 
 static const char tab[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
@@ -886,6 +891,11 @@ static retvalue ed_diff(const char *oldfullfilename, const char *newfullfilename
 	int fd;
 	retvalue r;
 
+	/* Packages and Sources files can be compared without diff: */
+	r = patch_diff(oldfullfilename, newfullfilename, rred_p);
+	if (r != RET_NOTHING)
+		return r;
+
 	argv[0] = "diff";
 	argv[1] = "--ed";
 	argv[2] = "--minimal";
@@ -1310,6 +1320,36 @@ static retvalue handle_diff_dir(const char *args[4]) {
 	return r;
 }
 
+/* called as batched export hook: the arguments for each file come
+ * null-terminated on stdin, an empty line tells reprepro it is done */
+static retvalue handle_diff_batch(void) {
+	char *args[4] = {NULL, NULL, NULL, NULL};
+	size_t sizes[4] = {0, 0, 0, 0};
+	retvalue r = RET_NOTHING;
+	int i;
+
+	while (true) {
+		for (i = 0 ; i < 4 ; i++) {
+			if (getdelim(&args[i], &sizes[i], '\0', stdin) < 0)
+				break;
+		}
+		if (i == 0 && !ferror(stdin))
+			break;
+		if (i < 4) {
+			fputs("Unexpected end of input!\n", stderr);
+			r = RET_ERROR;
+			break;
+		}
+		r = handle_diff_dir((const char **)args);
+		if (RET_WAS_ERROR(r))
+			break;
+		dprintf(3, "\n");
+	}
+	for (i = 0 ; i < 4 ; i++)
+		free(args[i]);
+	return r;
+}
+
 static void write_to_file(const void *data, size_t len, void *to) {
 	FILE *f = to;
 	fwrite(data, len, 1, f);
@@ -1317,16 +1357,17 @@ static void write_to_file(const void *data, size_t len, void *to) {
 
 int main(int argc, const char *argv[]) {
 	struct rred_patch *patches[argc];
-	struct modification *m;
+	struct modification *modifications[argc], *m;
 	retvalue r;
 	bool mergemode = false;
 	bool patchmode = false;
+	bool diffmode = false;
 	bool repreprohook = false;
 	int i, count;
 	const char *sourcename;
 	int debug = 0;
 
-	while ((i = getopt_long(argc, (char**)argv, "+hVDmpR", options, NULL)) != -1) {
+	while ((i = getopt_long(argc, (char**)argv, "+hVDmpdR", options, NULL)) != -1) {
 		switch (i) {
 			case 'h':
 				usage(stdout);
@@ -1344,6 +1385,9 @@ int main(int argc, const char *argv[]) {
 			case 'p':
 				patchmode = 1;
 				break;
+			case 'd':
+				diffmode = 1;
+				break;
 			case 'N':
 				max_patch_count = atoi(optarg);
 				break;
@@ -1368,7 +1412,43 @@ int main(int argc, const char *argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	if (diffmode && (repreprohook || mergemode || patchmode)) {
+		fprintf(stderr,
+"--diff cannot be combined with other modes!\n");
+		return EXIT_FAILURE;
+	}
+	if (diffmode) {
+		if (optind + 2 != argc) {
+			usage(stderr);
+			return EXIT_FAILURE;
+		}
+		r = ed_diff(argv[optind], argv[optind + 1], &patches[0]);
+		if (RET_IS_OK(r)) {
+			modification_printaspatch(stdout,
+					patch_getconstmodifications(patches[0]),
+					write_to_file);
+			patch_free(patches[0]);
+			if (ferror(stdout)) {
+				fputs("Error writing to stdout!\n", stderr);
+				r = RET_ERROR;
+			}
+		}
+		if (r == RET_ERROR_OOM)
+			fputs("Out of memory!\n", stderr);
+		if (RET_WAS_ERROR(r))
+			return EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
 	if (repreprohook || (!mergemode && !patchmode)) {
+		if (optind + 1 == argc && strcmp(argv[optind], "batch") == 0) {
+			r = handle_diff_batch();
+			if (r == RET_ERROR_OOM) {
+				fputs("Out of memory!\n", stderr);
+			}
+			if (RET_WAS_ERROR(r))
+				return EXIT_FAILURE;
+			return EXIT_SUCCESS;
+		}
 		if (optind + 4 != argc) {
 			usage(stderr);
 			return EXIT_FAILURE;
@@ -1416,27 +1496,29 @@ int main(int argc, const char *argv[]) {
 		fprintf(stderr, "Not enough patches for operation...\n");
 		return EXIT_FAILURE;
 	}
-	m = patch_getmodifications(patches[0]);
-	for (i = 1; i < count ; i++) {
-		struct modification *a = patch_getmodifications(patches[i]);
+	for (i = 0 ; i < count ; i++) {
+		modifications[i] = patch_getmodifications(patches[i]);
 		if (debug) {
-			fputs("--------RESULT SO FAR--------\n", stderr);
-			modification_printaspatch(stderr, m, write_to_file);
-			fputs("--------TO BE MERGED WITH-----\n", stderr);
-			modification_printaspatch(stderr, a, write_to_file);
-			fputs("-------------END--------------\n", stderr);
+			fprintf(stderr, "--------PATCH %d--------\n", i + 1);
+			modification_printaspatch(stderr, modifications[i],
+					write_to_file);
 		}
-		r = combine_patches(&m, m, a);
-		if (RET_WAS_ERROR(r)) {
-			for (i = 0 ; i < count ; i++) {
-				patch_free(patches[i]);
-			}
-			if (r == RET_ERROR_OOM)
-				fputs("Out of memory!\n", stderr);
-			else
-				fputs("Aborting...\n", stderr);
-			return EXIT_FAILURE;
+	}
+	r = combine_patchlist(&m, modifications, count);
+	if (RET_WAS_ERROR(r)) {
+		for (i = 0 ; i < count ; i++) {
+			patch_free(patches[i]);
 		}
+		if (r == RET_ERROR_OOM)
+			fputs("Out of memory!\n", stderr);
+		else
+			fputs("Aborting...\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (debug) {
+		fputs("-------------RESULT-----------\n", stderr);
+		modification_printaspatch(stderr, m, write_to_file);
+		fputs("-------------END--------------\n", stderr);
 	}
 	r = RET_OK;
 	if (mergemode) {
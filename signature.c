@@ -24,6 +24,7 @@
 #include <time.h>
 #include <string.h>
 #include <fcntl.h>
+#include <stdint.h>
 
 #include "signature_p.h"
 #include "mprintf.h"
@@ -32,6 +33,7 @@
 #include "names.h"
 #include "chunks.h"
 #include "readtextfile.h"
+#include "sha256.h"
 
 #ifdef HAVE_LIBGPGME
 gpgme_ctx_t context = NULL;
@@ -111,18 +113,242 @@ void signatures_done(void) {
 #endif /* HAVE_LIBGPGME */
 }
 
+static /*@null@*/ signaturecache_get *cache_get = NULL;
+static /*@null@*/ signaturecache_put *cache_put = NULL;
+
+void signature_setcache(signaturecache_get *get, signaturecache_put *put) {
+	cache_get = get;
+	cache_put = put;
+}
+
 #ifdef HAVE_LIBGPGME
-/* retrieve a list of fingerprints of keys having signed (valid) or
- * which are mentioned in the signature (all). set broken if all signatures
- * was broken (hints to a broken file, as opposed to expired or whatever
- * else may make a signature invalid)). */
-static retvalue checksigs(const char *filename, struct signatures **signatures_p, bool *broken) {
+void verifiedsignatures_free(struct verifiedsignatures *verified) {
+	int i;
+
+	if (verified == NULL)
+		return;
+	for (i = 0 ; i < verified->count ; i++)
+		free(verified->signatures[i].fpr);
+	free(verified);
+}
+
+static inline void sha256_addstring(struct SHA256_Context *c, const char *s) {
+	SHA256Update(c, (const uint8_t*)s, strlen(s) + 1);
+}
+
+/* A digest of everything in the keyring that can change the outcome of
+ * a verification, so that cached results are not used any more once a key
+ * was added, removed, revoked or expired. */
+static bool keyringdigest_known = false;
+static uint8_t keyringdigest[SHA256_DIGEST_SIZE];
+
+static retvalue calculate_keyringdigest(void) {
+	struct SHA256_Context c;
+	gpg_error_t err;
+	gpgme_key_t key;
+	gpgme_subkey_t subkey;
+	char buffer[100];
+
+	if (keyringdigest_known)
+		return RET_OK;
+	SHA256Init(&c);
+	err = gpgme_op_keylist_start(context, NULL, 0);
+	if (err != 0)
+		return gpgerror(err);
+	while ((err = gpgme_op_keylist_next(context, &key)) == 0) {
+		for (subkey = key->subkeys ; subkey != NULL ;
+				subkey = subkey->next) {
+			sha256_addstring(&c, (subkey->fpr != NULL)
+					? subkey->fpr : subkey->keyid);
+			snprintf(buffer, sizeof(buffer), "%d%d%d%d%d %ld",
+					(int)subkey->revoked,
+					(int)subkey->expired,
+					(int)subkey->disabled,
+					(int)subkey->invalid,
+					(int)subkey->can_sign,
+					(long)subkey->expires);
+			sha256_addstring(&c, buffer);
+		}
+		sha256_addstring(&c, "");
+		gpgme_key_unref(key);
+	}
+	if (gpg_err_code(err) != GPG_ERR_EOF) {
+		(void)gpgme_op_keylist_end(context);
+		return gpgerror(err);
+	}
+	err = gpgme_op_keylist_end(context);
+	if (err != 0)
+		return gpgerror(err);
+	SHA256Final(&c, keyringdigest);
+	keyringdigest_known = true;
+	return RET_OK;
+}
+
+static retvalue signaturecache_key(const char *sig, size_t siglen, const char *signedtext, size_t signedlen, /*@out@*/char key[2*SHA256_DIGEST_SIZE+1]) {
+	static const char tohex[16] = "0123456789abcdef";
+	struct SHA256_Context c;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	char buffer[30];
+	retvalue r;
+	int i;
+
+	r = calculate_keyringdigest();
+	if (RET_WAS_ERROR(r))
+		return r;
+	SHA256Init(&c);
+	SHA256Update(&c, keyringdigest, SHA256_DIGEST_SIZE);
+	snprintf(buffer, sizeof(buffer), "%s %llu",
+			(signedtext == NULL)?"inline":"detached",
+			(unsigned long long)siglen);
+	sha256_addstring(&c, buffer);
+	SHA256Update(&c, (const uint8_t*)sig, siglen);
+	if (signedtext != NULL)
+		SHA256Update(&c, (const uint8_t*)signedtext, signedlen);
+	SHA256Final(&c, digest);
+	for (i = 0 ; i < SHA256_DIGEST_SIZE ; i++) {
+		key[2*i] = tohex[digest[i] >> 4];
+		key[2*i+1] = tohex[digest[i] & 0xF];
+	}
+	key[2*SHA256_DIGEST_SIZE] = '\0';
+	return RET_OK;
+}
+
+/* only results not depending on anything but the data and the keyring
+ * (and the current time, see below) are cached */
+static bool cacheable(gpg_err_code_t status) {
+	switch (status) {
+		case GPG_ERR_NO_ERROR:
+		case GPG_ERR_KEY_EXPIRED:
+		case GPG_ERR_CERT_REVOKED:
+		case GPG_ERR_SIG_EXPIRED:
+		case GPG_ERR_BAD_SIGNATURE:
+		case GPG_ERR_NO_PUBKEY:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* cache records look like:
+ * <count>\n
+ * <status> <timestamp> <exp_timestamp> <fingerprint>\n (<count> times)
+ * <the plain data for inline signatures> */
+static retvalue signaturecache_lookup(const char *key, /*@out@*/struct verifiedsignatures **verified_p, /*@null@*//*@out@*/char **plain_p, /*@null@*//*@out@*/size_t *plainlen_p) {
+	const char *data, *p;
+	char *e;
+	size_t len;
+	unsigned long count;
+	struct verifiedsignatures *verified;
+	time_t now = time(NULL);
+	retvalue r;
+	int i;
+
+	r = cache_get(key, &data, &len);
+	if (!RET_IS_OK(r))
+		return r;
+	count = strtoul(data, &e, 10);
+	if (*e != '\n' || count == 0 || count > 1000)
+		return RET_NOTHING;
+	p = e + 1;
+	verified = calloc(1, sizeof(struct verifiedsignatures)
+			+ count * sizeof(struct verifiedsignature));
+	if (FAILEDTOALLOC(verified))
+		return RET_ERROR_OOM;
+	for (i = 0 ; (unsigned long)i < count ; i++) {
+		struct verifiedsignature *v = &verified->signatures[i];
+		const char *fpr;
+
+		v->status = strtoul(p, &e, 10);
+		if (*e != ' ')
+			break;
+		v->timestamp = strtoul(e + 1, &e, 10);
+		if (*e != ' ')
+			break;
+		v->exp_timestamp = strtoul(e + 1, &e, 10);
+		if (*e != ' ')
+			break;
+		fpr = e + 1;
+		p = strchr(fpr, '\n');
+		if (p == NULL || !cacheable(v->status))
+			break;
+		v->fpr = strndup(fpr, p - fpr);
+		if (FAILEDTOALLOC(v->fpr)) {
+			verifiedsignatures_free(verified);
+			return RET_ERROR_OOM;
+		}
+		verified->count++;
+		p++;
+		/* a signature may have expired since it was cached: */
+		if (v->status == GPG_ERR_NO_ERROR && v->exp_timestamp != 0
+				&& v->exp_timestamp <= (unsigned long)now)
+			v->status = GPG_ERR_SIG_EXPIRED;
+	}
+	if ((unsigned long)verified->count != count) {
+		if (verbose > 5)
+			fprintf(stderr,
+"Ignoring unparseable signature cache entry %s.\n", key);
+		verifiedsignatures_free(verified);
+		return RET_NOTHING;
+	}
+	if (plain_p != NULL) {
+		size_t plainlen = len - (p - data);
+		char *plain;
+
+		plain = malloc(plainlen + 1);
+		if (FAILEDTOALLOC(plain)) {
+			verifiedsignatures_free(verified);
+			return RET_ERROR_OOM;
+		}
+		memcpy(plain, p, plainlen);
+		plain[plainlen] = '\0';
+		*plain_p = plain;
+		*plainlen_p = plainlen;
+	}
+	*verified_p = verified;
+	return RET_OK;
+}
+
+static retvalue signaturecache_store(const char *key, const struct verifiedsignatures *verified, /*@null@*/const char *plain, size_t plainlen) {
+	char *data, *p;
+	size_t len;
+	retvalue r;
+	int i;
+
+	if (verified->count <= 0)
+		return RET_NOTHING;
+	if (plain != NULL && memchr(plain, '\0', plainlen) != NULL)
+		return RET_NOTHING;
+	len = 20 + plainlen;
+	for (i = 0 ; i < verified->count ; i++) {
+		if (!cacheable(verified->signatures[i].status))
+			return RET_NOTHING;
+		len += 70 + strlen(verified->signatures[i].fpr);
+	}
+	data = malloc(len + 1);
+	if (FAILEDTOALLOC(data))
+		return RET_ERROR_OOM;
+	p = data + sprintf(data, "%d\n", verified->count);
+	for (i = 0 ; i < verified->count ; i++) {
+		const struct verifiedsignature *v = &verified->signatures[i];
+
+		p += sprintf(p, "%u %lu %lu %s\n", (unsigned int)v->status,
+				v->timestamp, v->exp_timestamp, v->fpr);
+	}
+	if (plain != NULL) {
+		memcpy(p, plain, plainlen);
+		p += plainlen;
+	}
+	*p = '\0';
+	r = cache_put(key, data, p - data + 1);
+	free(data);
+	return r;
+}
+
+static retvalue copy_verify_result(/*@out@*/struct verifiedsignatures **verified_p) {
 	gpgme_verify_result_t result;
 	gpgme_signature_t s;
-	bool had_valid = false, had_broken = false;
-	size_t count;
-	struct signatures *signatures;
-	struct signature *sig;
+	struct verifiedsignatures *verified;
+	int count;
 
 	result = gpgme_op_verify_result(context);
 	if (result == NULL) {
@@ -130,25 +356,155 @@ static retvalue checksigs(const char *filename, struct signatures **signatures_p
 "Internal error communicating with libgpgme: no result record!\n\n");
 		return RET_ERROR_GPGME;
 	}
-	if (signatures_p != NULL) {
-		count = 0;
-		for (s = result->signatures ; s != NULL ; s = s->next) {
-			count++;
+	count = 0;
+	for (s = result->signatures ; s != NULL ; s = s->next) {
+		count++;
+	}
+	verified = calloc(1, sizeof(struct verifiedsignatures) +
+			count * sizeof(struct verifiedsignature));
+	if (FAILEDTOALLOC(verified))
+		return RET_ERROR_OOM;
+	for (s = result->signatures ; s != NULL ; s = s->next) {
+		struct verifiedsignature *v =
+			&verified->signatures[verified->count];
+
+		v->fpr = strdup(s->fpr);
+		if (FAILEDTOALLOC(v->fpr)) {
+			verifiedsignatures_free(verified);
+			return RET_ERROR_OOM;
+		}
+		verified->count++;
+		v->status = gpg_err_code(s->status);
+		v->timestamp = s->timestamp;
+		v->exp_timestamp = s->exp_timestamp;
+	}
+	*verified_p = verified;
+	return RET_OK;
+}
+
+retvalue signature_verify(const char *sig, size_t siglen, const char *signedtext, size_t signedlen, struct verifiedsignatures **verified_p, char **plain_p, size_t *plainlen_p) {
+	gpg_error_t err;
+	gpgme_data_t dh_gpg, dh_signed = NULL, dh_plain = NULL;
+	struct verifiedsignatures *verified;
+	char key[2*SHA256_DIGEST_SIZE+1];
+	char *gpgmeplain, *plain = NULL;
+	size_t plainlen = 0;
+	bool usecache = cache_get != NULL;
+	retvalue r;
+
+	assert ((signedtext == NULL) == (plain_p != NULL));
+
+	r = signature_init(false);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	if (usecache) {
+		r = signaturecache_key(sig, siglen, signedtext, signedlen,
+				key);
+		if (RET_WAS_ERROR(r))
+			return r;
+		r = signaturecache_lookup(key, verified_p, plain_p, plainlen_p);
+		if (r != RET_NOTHING)
+			return r;
+	}
+
+	err = gpgme_data_new_from_mem(&dh_gpg, sig, siglen, 0);
+	if (err != 0)
+		return gpgerror(err);
+	if (signedtext != NULL)
+		err = gpgme_data_new_from_mem(&dh_signed,
+				signedtext, signedlen, 0);
+	else
+		err = gpgme_data_new(&dh_plain);
+	if (err != 0) {
+		gpgme_data_release(dh_gpg);
+		return gpgerror(err);
+	}
+	err = gpgme_op_verify(context, dh_gpg, dh_signed, dh_plain);
+	gpgme_data_release(dh_gpg);
+	if (dh_signed != NULL)
+		gpgme_data_release(dh_signed);
+	if (gpg_err_code(err) == GPG_ERR_NO_DATA) {
+		if (dh_plain != NULL)
+			gpgme_data_release(dh_plain);
+		return RET_NOTHING;
+	}
+	if (err != 0) {
+		if (dh_plain != NULL)
+			gpgme_data_release(dh_plain);
+		return gpgerror(err);
+	}
+	r = copy_verify_result(&verified);
+	if (RET_WAS_ERROR(r)) {
+		if (dh_plain != NULL)
+			gpgme_data_release(dh_plain);
+		return r;
+	}
+	if (dh_plain != NULL) {
+		gpgmeplain = gpgme_data_release_and_get_mem(dh_plain,
+				&plainlen);
+		/* NULL is left to the caller to complain about */
+		if (gpgmeplain != NULL) {
+			plain = malloc(plainlen + 1);
+			if (!FAILEDTOALLOC(plain)) {
+				memcpy(plain, gpgmeplain, plainlen);
+				plain[plainlen] = '\0';
+			}
+#ifdef HAVE_GPGPME_FREE
+			gpgme_free(gpgmeplain);
+#else
+			free(gpgmeplain);
+#endif
+			if (FAILEDTOALLOC(plain)) {
+				verifiedsignatures_free(verified);
+				return RET_ERROR_OOM;
+			}
 		}
+	}
+	if (usecache && (plain != NULL || plain_p == NULL)) {
+		r = signaturecache_store(key, verified, plain, plainlen);
+		if (RET_WAS_ERROR(r)) {
+			free(plain);
+			verifiedsignatures_free(verified);
+			return r;
+		}
+	}
+	if (plain_p != NULL) {
+		*plain_p = plain;
+		*plainlen_p = plainlen;
+	}
+	*verified_p = verified;
+	return RET_OK;
+}
+
+/* retrieve a list of fingerprints of keys having signed (valid) or
+ * which are mentioned in the signature (all). set broken if all signatures
+ * was broken (hints to a broken file, as opposed to expired or whatever
+ * else may make a signature invalid)). */
+static retvalue checksigs(const char *filename, const struct verifiedsignatures *verified, struct signatures **signatures_p, bool *broken) {
+	const struct verifiedsignature *s;
+	bool had_valid = false, had_broken = false;
+	struct signatures *signatures;
+	struct signature *sig;
+	int i;
+
+	if (signatures_p != NULL) {
 		signatures = calloc(1, sizeof(struct signatures) +
-				count * sizeof(struct signature));
+				verified->count * sizeof(struct signature));
 		if (FAILEDTOALLOC(signatures))
 			return RET_ERROR_OOM;
-		signatures->count = count;
+		signatures->count = verified->count;
 		signatures->validcount = 0;
 		sig = signatures->signatures;
 	} else {
 		signatures = NULL;
 		sig = NULL;
 	}
-	for (s = result->signatures ; s != NULL ; s = s->next) {
+	for (i = 0 ; i < verified->count ; i++) {
 		enum signature_state state = sist_error;
 
+		s = &verified->signatures[i];
+
 		if (signatures_p != NULL) {
 			sig->keyid = strdup(s->fpr);
 			if (FAILEDTOALLOC(sig->keyid)) {
@@ -156,7 +512,7 @@ static retvalue checksigs(const char *filename, struct signatures **signatures_p
 				return RET_ERROR_OOM;
 			}
 		}
-		switch (gpg_err_code(s->status)) {
+		switch (s->status) {
 			case GPG_ERR_NO_ERROR:
 				had_valid = true;
 				state = sist_valid;
@@ -233,7 +589,7 @@ static retvalue checksigs(const char *filename, struct signatures **signatures_p
 			fprintf(stderr,
 "Error checking signature (gpgme returned unexpected value %d)!\n"
 "Please file a bug report, so reprepro can handle this in the future.\n",
-				gpg_err_code(s->status));
+				s->status);
 			signatures_free(signatures);
 			return RET_ERROR_GPGME;
 		}
@@ -322,53 +678,34 @@ void signatures_free(struct signatures *signatures) {
 #ifdef HAVE_LIBGPGME
 static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const char *filenametoshow, char **chunkread, /*@null@*/ /*@out@*/struct signatures **signatures_p, bool *brokensignature) {
 	char *chunk;
-	gpg_error_t err;
-	gpgme_data_t dh, dh_gpg;
 	size_t plain_len;
 	char *plain_data;
 	retvalue r;
 	struct signatures *signatures = NULL;
+	struct verifiedsignatures *verified;
 	bool foundbroken = false;
 
-	r = signature_init(false);
-	if (RET_WAS_ERROR(r))
-		return r;
-
-	err = gpgme_data_new_from_mem(&dh_gpg, buffer, bufferlen, 0);
-	if (err != 0)
-		return gpgerror(err);
-
-	err = gpgme_data_new(&dh);
-	if (err != 0) {
-		gpgme_data_release(dh_gpg);
-		return gpgerror(err);
-	}
-	err = gpgme_op_verify(context, dh_gpg, NULL, dh);
-	if (gpg_err_code(err) == GPG_ERR_NO_DATA) {
+	r = signature_verify(buffer, bufferlen, NULL, 0,
+			&verified, &plain_data, &plain_len);
+	if (r == RET_NOTHING) {
 		if (verbose > 5)
 			fprintf(stderr,
 "Data seems not to be signed trying to use directly....\n");
-		gpgme_data_release(dh);
-		gpgme_data_release(dh_gpg);
 		return RET_NOTHING;
 	} else {
-		if (err != 0) {
-			gpgme_data_release(dh_gpg);
-			gpgme_data_release(dh);
-			return gpgerror(err);
-		}
+		if (RET_WAS_ERROR(r))
+			return r;
 		if (signatures_p != NULL || brokensignature != NULL) {
-			r = checksigs(filenametoshow,
+			r = checksigs(filenametoshow, verified,
 				(signatures_p!=NULL)?&signatures:NULL,
 				(brokensignature!=NULL)?&foundbroken:NULL);
 			if (RET_WAS_ERROR(r)) {
-				gpgme_data_release(dh_gpg);
-				gpgme_data_release(dh);
+				verifiedsignatures_free(verified);
+				free(plain_data);
 				return r;
 			}
 		}
-		gpgme_data_release(dh_gpg);
-		plain_data = gpgme_data_release_and_get_mem(dh, &plain_len);
+		verifiedsignatures_free(verified);
 		if (plain_data == NULL) {
 			fprintf(stderr,
 "(not yet fatal) ERROR: libgpgme failed to extract the plain data out of\n"
@@ -385,6 +722,7 @@ static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const
 			r = check_primary_keys(signatures);
 			if (RET_WAS_ERROR(r)) {
 				signatures_free(signatures);
+				free(plain_data);
 				return r;
 			}
 		}
@@ -419,11 +757,7 @@ static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const
 		} else
 			*chunkread = chunk;
 	}
-#ifdef HAVE_GPGPME_FREE
-	gpgme_free(plain_data);
-#else
 	free(plain_data);
-#endif
 	if (RET_IS_OK(r)) {
 		if (signatures_p != NULL)
 			*signatures_p = signatures;
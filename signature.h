@@ -63,4 +63,10 @@ retvalue signedfile_create(struct signedfile *, const char *, char **, char **,
 void signedfile_free(/*@only@*/struct signedfile *);
 
 void signatures_done(void);
+
+/* persistent cache for the results of signature verification,
+ * the data given to put is always 0-terminated (with len including it) */
+typedef retvalue signaturecache_get(const char * /*key*/, /*@out@*/const char ** /*data_p*/, /*@out@*/size_t * /*len_p*/);
+typedef retvalue signaturecache_put(const char * /*key*/, const char * /*data*/, size_t /*len*/);
+void signature_setcache(/*@null@*/signaturecache_get *, /*@null@*/signaturecache_put *);
 #endif
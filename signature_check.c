@@ -305,11 +305,12 @@ void signature_requirements_free(struct signature_requirement *list) {
 	}
 }
 
-static bool key_good(const struct requested_key *req, const gpgme_signature_t signatures) {
+static bool key_good(const struct requested_key *req, const struct verifiedsignatures *signatures) {
 	const struct known_key *k = req->key;
-	gpgme_signature_t sig;
+	int j;
 
-	for (sig = signatures ; sig != NULL ; sig = sig->next) {
+	for (j = 0 ; j < signatures->count ; j++) {
+		const struct verifiedsignature *sig = &signatures->signatures[j];
 		const char *fpr = sig->fpr;
 		size_t l = strlen(sig->fpr);
 		int i;
@@ -346,8 +347,7 @@ static bool key_good(const struct requested_key *req, const gpgme_signature_t si
 		/* only accept perfectly good signatures and silently
 		   ignore everything else. Those are warned about or
 		   even accepted in the run with key_good_enough */
-		if (gpg_err_code(sig->status) == GPG_ERR_NO_ERROR
-				&& !key_expired)
+		if (sig->status == GPG_ERR_NO_ERROR && !key_expired)
 			return true;
 		/* we have to continue otherwise,
 		   as another subkey might still follow */
@@ -357,11 +357,12 @@ static bool key_good(const struct requested_key *req, const gpgme_signature_t si
 	return false;
 }
 
-static bool key_good_enough(const struct requested_key *req, const gpgme_signature_t signatures, const char *releasegpg, const char *release) {
+static bool key_good_enough(const struct requested_key *req, const struct verifiedsignatures *signatures, const char *releasegpg, const char *release) {
 	const struct known_key *k = req->key;
-	gpgme_signature_t sig;
+	int j;
 
-	for (sig = signatures ; sig != NULL ; sig = sig->next) {
+	for (j = 0 ; j < signatures->count ; j++) {
+		const struct verifiedsignature *sig = &signatures->signatures[j];
 		const char *fpr = sig->fpr;
 		size_t l = strlen(sig->fpr);
 		int i;
@@ -396,7 +397,7 @@ static bool key_good_enough(const struct requested_key *req, const gpgme_signatu
 		   if it is not acceptable, we still have to look at the other
 		   signatures, as a signature with another subkey is following
 		 */
-		switch (gpg_err_code(sig->status)) {
+		switch (sig->status) {
 			case GPG_ERR_NO_ERROR:
 				if (! key_expired)
 					return true;
@@ -487,7 +488,7 @@ static bool key_good_enough(const struct requested_key *req, const gpgme_signatu
 		fprintf(stderr,
 "Error checking signature (gpgme returned unexpected value %d)!\n"
 "Please file a bug report, so reprepro can handle this in the future.\n",
-			gpg_err_code(sig->status));
+			sig->status);
 		return false;
 	}
 	return false;
@@ -561,12 +562,14 @@ retvalue signature_requirement_add(struct signature_requirement **list_p, const
 	return RET_OK;
 }
 
-static void print_signatures(FILE *f, gpgme_signature_t s, const char *releasegpg) {
+static void print_signatures(FILE *f, const struct verifiedsignatures *signatures, const char *releasegpg) {
+	const struct verifiedsignature *s;
 	char timebuffer[20];
 	struct tm *tm;
 	time_t t;
+	int i;
 
-	if (s == NULL) {
+	if (signatures->count == 0) {
 		fprintf(f, "gpgme reported no signatures in '%s':\n"
 "Either there are really none or something else is strange.\n"
 "One known reason for this effect is forgeting -b when signing.\n",
@@ -575,11 +578,12 @@ static void print_signatures(FILE *f, gpgme_signature_t s, const char *releasegp
 	}
 
 	fprintf(f, "Signatures in '%s':\n", releasegpg);
-	for (; s != NULL ; s = s->next) {
+	for (i = 0 ; i < signatures->count ; i++) {
+		s = &signatures->signatures[i];
 		t = s->timestamp; tm = localtime(&t);
 		strftime(timebuffer, 19, "%Y-%m-%d", tm);
 		fprintf(f, "'%s' (signed %s): ", s->fpr, timebuffer);
-		switch (gpg_err_code(s->status)) {
+		switch (s->status) {
 			case GPG_ERR_NO_ERROR:
 				fprintf(f, "valid\n");
 				continue;
@@ -608,18 +612,10 @@ static void print_signatures(FILE *f, gpgme_signature_t s, const char *releasegp
 	}
 }
 
-static inline retvalue verify_signature(const struct signature_requirement *requirements, const char *releasegpg, const char *releasename) {
-	gpgme_verify_result_t result;
+static inline retvalue verify_signature(const struct signature_requirement *requirements, const struct verifiedsignatures *signatures, const char *releasegpg, const char *releasename) {
 	int i;
 	const struct signature_requirement *req;
 
-	result = gpgme_op_verify_result(context);
-	if (result == NULL) {
-		fprintf(stderr,
-"Internal error communicating with libgpgme: no result record!\n\n");
-		return RET_ERROR_GPGME;
-	}
-
 	for (req = requirements ; req != NULL ; req = req->next) {
 		bool fulfilled = false;
 
@@ -629,14 +625,14 @@ static inline retvalue verify_signature(const struct signature_requirement *requ
 
 		for (i = 0 ; (size_t)i < req->num_keys ; i++) {
 
-			if (key_good(&req->keys[i], result->signatures)) {
+			if (key_good(&req->keys[i], signatures)) {
 				fulfilled = true;
 				break;
 			}
 		}
 		for (i = 0 ; !fulfilled && (size_t)i < req->num_keys ; i++) {
 
-			if (key_good_enough(&req->keys[i], result->signatures,
+			if (key_good_enough(&req->keys[i], signatures,
 						releasegpg, releasename)) {
 				fulfilled = true;
 				break;
@@ -646,7 +642,7 @@ static inline retvalue verify_signature(const struct signature_requirement *requ
 			fprintf(stderr,
 "ERROR: Condition '%s' not fulfilled for '%s'.\n",
 					req->condition, releasegpg);
-			print_signatures(stderr, result->signatures,
+			print_signatures(stderr, signatures,
 					releasegpg);
 			return RET_ERROR_BADSIG;
 		}
@@ -656,14 +652,63 @@ static inline retvalue verify_signature(const struct signature_requirement *requ
 		}
 	}
 	if (verbose > 20)
-		print_signatures(stdout, result->signatures, releasegpg);
+		print_signatures(stdout, signatures, releasegpg);
+	return RET_OK;
+}
+
+/* read a file into memory, unlike readtextfile also allowing binary data */
+static retvalue readsignaturefile(const char *filename, /*@out@*/char **data_p, /*@out@*/size_t *len_p) {
+	size_t size = 4096, len = 0;
+	ssize_t got;
+	char *data, *h;
+	int fd, e;
+
+	fd = open(filename, O_RDONLY|O_NOCTTY);
+	if (fd < 0) {
+		e = errno;
+		fprintf(stderr, "Error opening '%s': %s\n",
+				filename, strerror(e));
+		return RET_ERRNO(e);
+	}
+	data = malloc(size);
+	if (FAILEDTOALLOC(data)) {
+		(void)close(fd);
+		return RET_ERROR_OOM;
+	}
+	while ((got = read(fd, data + len, size - len)) != 0) {
+		if (got < 0) {
+			e = errno;
+			if (e == EINTR)
+				continue;
+			fprintf(stderr, "Error reading '%s': %s\n",
+					filename, strerror(e));
+			(void)close(fd);
+			free(data);
+			return RET_ERRNO(e);
+		}
+		len += got;
+		if (len == size) {
+			size *= 2;
+			h = realloc(data, size);
+			if (FAILEDTOALLOC(h)) {
+				(void)close(fd);
+				free(data);
+				return RET_ERROR_OOM;
+			}
+			data = h;
+		}
+	}
+	(void)close(fd);
+	*data_p = data;
+	*len_p = len;
 	return RET_OK;
 }
 
 retvalue signature_check(const struct signature_requirement *requirements, const char *releasegpg, const char *releasename, const char *releasedata, size_t releaselen) {
-	gpg_error_t err;
-	int gpgfd;
-	gpgme_data_t dh, dh_gpg;
+	struct verifiedsignatures *signatures;
+	char *gpgdata;
+	size_t gpglen;
+	retvalue r;
 
 	assert (requirements != NULL);
 
@@ -672,74 +717,47 @@ retvalue signature_check(const struct signature_requirement *requirements, const
 
 	assert (context != NULL);
 
-	/* Read the file and its signature into memory: */
-	gpgfd = open(releasegpg, O_RDONLY|O_NOCTTY);
-	if (gpgfd < 0) {
-		int e = errno;
-		fprintf(stderr, "Error opening '%s': %s\n",
-				releasegpg, strerror(e));
-		return RET_ERRNO(e);
-	}
-	err = gpgme_data_new_from_fd(&dh_gpg, gpgfd);
-	if (err != 0) {
-		(void)close(gpgfd);
-		fprintf(stderr, "Error reading '%s':\n", releasegpg);
-		return gpgerror(err);
-	}
-	err = gpgme_data_new_from_mem(&dh, releasedata, releaselen, 0);
-	if (err != 0) {
-		gpgme_data_release(dh_gpg);
-		return gpgerror(err);
-	}
+	/* Read the signature into memory: */
+	r = readsignaturefile(releasegpg, &gpgdata, &gpglen);
+	if (RET_WAS_ERROR(r))
+		return r;
 
 	/* Verify the signature */
 
-	err = gpgme_op_verify(context, dh_gpg, dh, NULL);
-	gpgme_data_release(dh_gpg);
-	gpgme_data_release(dh);
-	close(gpgfd);
-	if (err != 0) {
+	r = signature_verify(gpgdata, gpglen, releasedata, releaselen,
+			&signatures, NULL, NULL);
+	free(gpgdata);
+	if (r == RET_NOTHING) {
+		fprintf(stderr, "Error verifying '%s': no signature found!\n",
+				releasegpg);
+		return RET_ERROR_BADSIG;
+	}
+	if (RET_WAS_ERROR(r)) {
 		fprintf(stderr, "Error verifying '%s':\n", releasegpg);
-		return gpgerror(err);
+		return r;
 	}
 
-	return verify_signature(requirements, releasegpg, releasename);
+	r = verify_signature(requirements, signatures, releasegpg, releasename);
+	verifiedsignatures_free(signatures);
+	return r;
 }
 
 retvalue signature_check_inline(const struct signature_requirement *requirements, const char *filename, char **chunk_p) {
-	gpg_error_t err;
-	gpgme_data_t dh, dh_gpg;
-	int fd;
-
-	fd = open(filename, O_RDONLY|O_NOCTTY);
-	if (fd < 0) {
-		int e = errno;
-		fprintf(stderr, "Error opening '%s': %s\n",
-				filename, strerror(e));
-		return RET_ERRNO(e);
-	}
-	err = gpgme_data_new_from_fd(&dh_gpg, fd);
-	if (err != 0) {
-		(void)close(fd);
-		return gpgerror(err);
-	}
-
-	err = gpgme_data_new(&dh);
-	if (err != 0) {
-		(void)close(fd);
-		gpgme_data_release(dh_gpg);
-		return gpgerror(err);
-	}
-	err = gpgme_op_verify(context, dh_gpg, NULL, dh);
-	(void)close(fd);
-	if (gpg_err_code(err) == GPG_ERR_NO_DATA) {
-		char *chunk; const char *n;
-		size_t len;
-		retvalue r;
-
-		gpgme_data_release(dh);
-		gpgme_data_release(dh_gpg);
+	struct verifiedsignatures *signatures;
+	char *data, *plain_data, *chunk;
+	size_t datalen, plain_len, len;
+	const char *n;
+	retvalue r;
 
+	r = readsignaturefile(filename, &data, &datalen);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = signature_verify(data, datalen, NULL, 0,
+			&signatures, &plain_data, &plain_len);
+	free(data);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (r == RET_NOTHING) {
 		r = readtextfile(filename, filename, &chunk, &len);
 		assert (r != RET_NOTHING);
 		if (RET_WAS_ERROR(r))
@@ -766,55 +784,43 @@ retvalue signature_check_inline(const struct signature_requirement *requirements
 		if (FAILEDTOALLOC(*chunk_p))
 			*chunk_p = chunk;
 		return RET_OK;
-	} else {
-		char *plain_data, *chunk;
-		const char *n;
-		size_t plain_len, len;
-		retvalue r;
-
-		if (err != 0) {
-			gpgme_data_release(dh_gpg);
-			gpgme_data_release(dh);
-			return gpgerror(err);
-		}
-		gpgme_data_release(dh_gpg);
-		plain_data = gpgme_data_release_and_get_mem(dh, &plain_len);
-		if (plain_data == NULL) {
-			fprintf(stderr,
+	}
+	if (plain_data == NULL) {
+		fprintf(stderr,
 "Error: libgpgme failed to extract the plain data out of\n"
 "'%s'.\n"
 "While it did so in a way indicating running out of memory, experience says\n"
 "this also happens when gpg returns a error code it does not understand.\n"
 "To check this please try running gpg --verify '%s' manually.\n"
 "Continuing extracting it ignoring all signatures...",
-					filename, filename);
-			return RET_ERROR;
-		}
-		chunk = malloc(plain_len+1);
-		if (FAILEDTOALLOC(chunk))
-			return RET_ERROR_OOM;
-		len = chunk_extract(chunk, plain_data, plain_len, false, &n);
-#ifdef HAVE_GPGPME_FREE
-		gpgme_free(plain_data);
-#else
+				filename, filename);
+		verifiedsignatures_free(signatures);
+		return RET_ERROR;
+	}
+	chunk = malloc(plain_len+1);
+	if (FAILEDTOALLOC(chunk)) {
 		free(plain_data);
-#endif
-		assert (len <= plain_len);
-		if (plain_len != (size_t)(n - plain_data)) {
-			fprintf(stderr,
-"Cannot parse '%s': extraced signed data looks malformed.\n",
-				filename);
-			r = RET_ERROR;
-		} else
-			r = verify_signature(requirements, filename, NULL);
-		if (RET_IS_OK(r)) {
-			*chunk_p = realloc(chunk, len+1);
-			if (FAILEDTOALLOC(*chunk_p))
-				*chunk_p = chunk;
-		} else
-			free(chunk);
-		return r;
+		verifiedsignatures_free(signatures);
+		return RET_ERROR_OOM;
 	}
+	len = chunk_extract(chunk, plain_data, plain_len, false, &n);
+	assert (len <= plain_len);
+	if (plain_len != (size_t)(n - plain_data)) {
+		fprintf(stderr,
+"Cannot parse '%s': extraced signed data looks malformed.\n",
+			filename);
+		r = RET_ERROR;
+	} else
+		r = verify_signature(requirements, signatures, filename, NULL);
+	free(plain_data);
+	verifiedsignatures_free(signatures);
+	if (RET_IS_OK(r)) {
+		*chunk_p = realloc(chunk, len+1);
+		if (FAILEDTOALLOC(*chunk_p))
+			*chunk_p = chunk;
+	} else
+		free(chunk);
+	return r;
 }
 #else /* HAVE_LIBGPGME */
 
@@ -14,5 +14,23 @@ extern gpgme_ctx_t context;
 
 #ifdef HAVE_LIBGPGME
 retvalue gpgerror(gpg_error_t err);
+
+/* the parts of a verification result reprepro looks at,
+ * so they can also be taken from the signature cache */
+struct verifiedsignatures {
+	int count;
+	struct verifiedsignature {
+		char *fpr;
+		gpg_err_code_t status;
+		unsigned long timestamp, exp_timestamp;
+	} signatures[];
+};
+void verifiedsignatures_free(/*@null@*//*@only@*/struct verifiedsignatures *);
+
+/* like gpgme_op_verify, but using the signature cache if there is one.
+ * Without signed text the signature is inline and the plain text is
+ * returned (malloced and 0-terminated, NULL if gpgme did not return any).
+ * Returns RET_NOTHING if no signature was found */
+retvalue signature_verify(const char * /*sig*/, size_t, /*@null@*/const char * /*signedtext*/, size_t, /*@out@*/struct verifiedsignatures **, /*@null@*//*@out@*/char ** /*plain_p*/, /*@null@*//*@out@*/size_t * /*plainlen_p*/);
 #endif
 #endif
@@ -203,6 +203,347 @@ static retvalue count_sizes(struct cursor *cursor, bool specific, struct distrib
 	return RET_OK;
 }
 
+/* Incremental size accounting:
+ *
+ * Which distributions reference a file (and whether only by snapshots) is
+ * its set of owners. For every such set, the "sizes" table in references.db
+ * records how many bytes and files have exactly this set of owners.
+ * This is all that is needed to answer sizes, and it only changes if a
+ * file gains the first or loses the last reference of some distribution.
+ *
+ * As this costs some time when changing references, it is only maintained
+ * after recountsizes was run once (which stores SIZES_ENABLED).
+ * Files not (yet) in checksums.db have no known size and are left out
+ * until they are added there. */
+
+#define SIZES_ENABLED "!"
+
+/* whether SIZES_ENABLED is there, -1 if not yet looked up */
+static int accountingenabled = -1;
+
+struct owners {
+	int count, size;
+	struct owner {
+		char *name;
+		size_t len;
+		/* '|' normal, '=' only snapshots, '+' both,
+		 * '?' not a distribution */
+		char kind;
+	} *owners;
+};
+
+static void owners_reset(struct owners *o) {
+	int i;
+
+	for (i = 0 ; i < o->count ; i++)
+		free(o->owners[i].name);
+	o->count = 0;
+}
+
+static void owners_done(struct owners *o) {
+	owners_reset(o);
+	free(o->owners);
+}
+
+static retvalue owners_add(struct owners *o, const char *data) {
+	const char *p;
+	size_t len;
+	char kind;
+	int i;
+
+	if (data[0] == 'u' && data[1] == '|')
+		data += 2;
+	else if (data[0] == 's' && data[1] == '=')
+		data += 2;
+	p = data;
+	while (*p != '\0' && *p != ' ' && *p != '|' && *p != '=')
+		p++;
+	if (*p == '\0')
+		kind = '?';
+	else if (*p == '=')
+		kind = '=';
+	else
+		kind = '|';
+	len = p - data;
+	for (i = 0 ; i < o->count ; i++) {
+		struct owner *e = &o->owners[i];
+
+		if (e->len != len || memcmp(e->name, data, len) != 0)
+			continue;
+		if (e->kind != kind && e->kind != '?')
+			e->kind = '+';
+		return RET_OK;
+	}
+	if (o->count >= o->size) {
+		struct owner *n;
+
+		n = realloc(o->owners, (o->size + 16) * sizeof(struct owner));
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		o->owners = n;
+		o->size += 16;
+	}
+	o->owners[o->count].name = strndup(data, len);
+	if (FAILEDTOALLOC(o->owners[o->count].name))
+		return RET_ERROR_OOM;
+	o->owners[o->count].len = len;
+	o->owners[o->count].kind = kind;
+	o->count++;
+	return RET_OK;
+}
+
+static int owner_compare(const void *a, const void *b) {
+	return strcmp(((const struct owner *)a)->name,
+			((const struct owner *)b)->name);
+}
+
+/* the canonical form of a set of owners: space separated names each
+ * followed by the kind, NULL if there are no owners */
+static retvalue owners_join(struct owners *o, /*@out@*/char **set_p) {
+	size_t len = 0;
+	char *set, *p;
+	int i;
+
+	if (o->count == 0) {
+		*set_p = NULL;
+		return RET_NOTHING;
+	}
+	qsort(o->owners, o->count, sizeof(struct owner), owner_compare);
+	for (i = 0 ; i < o->count ; i++)
+		len += o->owners[i].len + 2;
+	set = malloc(len);
+	if (FAILEDTOALLOC(set))
+		return RET_ERROR_OOM;
+	p = set;
+	for (i = 0 ; i < o->count ; i++) {
+		if (i > 0)
+			*(p++) = ' ';
+		memcpy(p, o->owners[i].name, o->owners[i].len);
+		p += o->owners[i].len;
+		*(p++) = o->owners[i].kind;
+	}
+	*p = '\0';
+	*set_p = set;
+	return RET_OK;
+}
+
+static retvalue ownerset_of(const char *filekey, /*@out@*/char **set_p) {
+	struct owners o = {0, 0, NULL};
+	struct cursor *cursor;
+	const char *key, *data;
+	size_t len;
+	retvalue result, r;
+
+	r = table_newduplicatecursor(rdb_references, filekey, 0,
+			&cursor, &key, &data, &len);
+	if (r == RET_NOTHING) {
+		*set_p = NULL;
+		return RET_OK;
+	}
+	if (RET_WAS_ERROR(r))
+		return r;
+	do {
+		result = owners_add(&o, data);
+		if (RET_WAS_ERROR(result))
+			break;
+	} while (cursor_nexttempdata(rdb_references, cursor,
+				&key, &data, &len));
+	r = cursor_close(rdb_references, cursor);
+	RET_ENDUPDATE(result, r);
+	if (!RET_WAS_ERROR(result)) {
+		result = owners_join(&o, set_p);
+		if (result == RET_NOTHING)
+			result = RET_OK;
+	}
+	owners_done(&o);
+	return result;
+}
+
+bool sizes_accountingenabled(void) {
+	if (rdb_sizes == NULL)
+		return false;
+	if (accountingenabled < 0)
+		accountingenabled = RET_IS_OK(table_gettemprecord(rdb_sizes,
+					SIZES_ENABLED, NULL, NULL));
+	return accountingenabled > 0;
+}
+
+static retvalue sizes_account(const char *set, long long bytes, long long files) {
+	const char *data;
+	unsigned long long oldbytes = 0, oldfiles = 0;
+	char buffer[100];
+	retvalue r;
+
+	r = table_gettemprecord(rdb_sizes, set, &data, NULL);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (RET_IS_OK(r) && sscanf(data, "%llu %llu",
+				&oldbytes, &oldfiles) != 2) {
+		fprintf(stderr, "Malformed size accounting data for '%s'!\n",
+				set);
+		return RET_ERROR;
+	}
+	oldbytes += bytes;
+	oldfiles += files;
+	if (oldfiles == 0)
+		return table_deleterecord(rdb_sizes, set, true);
+	snprintf(buffer, sizeof(buffer), "%llu %llu", oldbytes, oldfiles);
+	return table_adduniqsizedrecord(rdb_sizes, set, buffer,
+			strlen(buffer) + 1, true, false);
+}
+
+retvalue sizes_startchange(const char *filekey, char **oldset_p) {
+	if (!sizes_accountingenabled())
+		return RET_NOTHING;
+	return ownerset_of(filekey, oldset_p);
+}
+
+retvalue sizes_endchange(const char *filekey, char *oldset) {
+	char *newset;
+	off_t filesize;
+	retvalue r;
+
+	r = ownerset_of(filekey, &newset);
+	if (RET_WAS_ERROR(r)) {
+		free(oldset);
+		return r;
+	}
+	if (oldset == newset || (oldset != NULL && newset != NULL &&
+				strcmp(oldset, newset) == 0)) {
+		free(oldset);
+		free(newset);
+		return RET_NOTHING;
+	}
+	if (rdb_checksums == NULL)
+		filesize = -1;
+	else
+		filesize = files_getsize(filekey);
+	r = RET_NOTHING;
+	/* without a known size it is accounted once it gets one */
+	if (filesize >= 0) {
+		if (oldset != NULL)
+			r = sizes_account(oldset, -(long long)filesize, -1);
+		if (newset != NULL && !RET_WAS_ERROR(r))
+			r = sizes_account(newset, filesize, 1);
+	}
+	free(oldset);
+	free(newset);
+	return r;
+}
+
+retvalue sizes_filechange(const char *filekey, off_t oldsize, off_t newsize) {
+	char *set;
+	retvalue r;
+
+	if (oldsize == newsize || !sizes_accountingenabled())
+		return RET_NOTHING;
+	r = ownerset_of(filekey, &set);
+	if (RET_WAS_ERROR(r) || set == NULL)
+		return r;
+	r = RET_NOTHING;
+	if (oldsize >= 0)
+		r = sizes_account(set, -(long long)oldsize, -1);
+	if (newsize >= 0 && !RET_WAS_ERROR(r))
+		r = sizes_account(set, newsize, 1);
+	free(set);
+	return r;
+}
+
+static struct distribution_sizes *sizes_find(struct distribution_sizes *ds, const char *name, size_t len) {
+	while (ds != NULL && (ds->codename_len != len ||
+				memcmp(ds->codename, name, len) != 0))
+		ds = ds->next;
+	return ds;
+}
+
+/* like count_sizes, but from the accounting data */
+static retvalue sum_sizes(bool specific, struct distribution_sizes *ds, unsigned long long *all_p, unsigned long long *onlyall_p) {
+	struct cursor *cursor;
+	const char *set, *data, *p, *e;
+	unsigned long long bytes, files, all = 0, onlyall = 0;
+	struct distribution_sizes *s;
+	retvalue result, r;
+
+	r = table_newglobalcursor(rdb_sizes, true, &cursor);
+	if (!RET_IS_OK(r))
+		return r;
+	result = RET_OK;
+	while (cursor_nexttempdata(rdb_sizes, cursor, &set, &data, NULL)) {
+		bool onlyone, any = false, onlyselected = true;
+
+		if (strcmp(set, SIZES_ENABLED) == 0)
+			continue;
+		if (sscanf(data, "%llu %llu", &bytes, &files) != 2) {
+			fprintf(stderr,
+"Malformed size accounting data for '%s'!\n", set);
+			result = RET_ERROR;
+			break;
+		}
+		onlyone = strchr(set, ' ') == NULL;
+		for (p = set ; *p != '\0' ; p = (*e == '\0')?e:e + 1) {
+			char kind;
+
+			e = strchr(p, ' ');
+			if (e == NULL)
+				e = p + strlen(p);
+			assert (e > p);
+			kind = e[-1];
+			if (kind == '?')
+				s = NULL;
+			else
+				s = sizes_find(ds, p, e - p - 1);
+			if (s == NULL && !specific && kind != '?') {
+				struct distribution_sizes **s_p = &ds->next;
+
+				while (*s_p != NULL)
+					s_p = &(*s_p)->next;
+				s = zNEW(struct distribution_sizes);
+				if (FAILEDTOALLOC(s)) {
+					result = RET_ERROR_OOM;
+					break;
+				}
+				*s_p = s;
+				s->v = strndup(p, e - p);
+				if (FAILEDTOALLOC(s->v)) {
+					result = RET_ERROR_OOM;
+					break;
+				}
+				s->v[e - p - 1] = '*';
+				s->codename = s->v;
+				s->codename_len = e - p - 1;
+			}
+			if (s == NULL) {
+				onlyselected = false;
+				continue;
+			}
+			/* only listed because of !specific */
+			if (s->v != NULL)
+				onlyselected = false;
+			any = true;
+			s->withsnapshots.all += bytes;
+			if (onlyone)
+				s->withsnapshots.onlyhere += bytes;
+			if (kind == '=')
+				continue;
+			s->this.all += bytes;
+			if (onlyone)
+				s->this.onlyhere += bytes;
+		}
+		if (RET_WAS_ERROR(result))
+			break;
+		if (any) {
+			all += bytes;
+			if (onlyselected)
+				onlyall += bytes;
+		}
+	}
+	r = cursor_close(rdb_sizes, cursor);
+	RET_ENDUPDATE(result, r);
+	*all_p = all;
+	*onlyall_p = onlyall;
+	return result;
+}
+
 retvalue sizes_distributions(struct distribution *alldistributions, bool specific) {
 	struct cursor *cursor;
 	retvalue result, r;
@@ -225,14 +566,18 @@ retvalue sizes_distributions(struct distribution *alldistributions, bool specifi
 	}
 	if (ds == NULL)
 		return RET_NOTHING;
-	r = table_newglobalcursor(rdb_references, true, &cursor);
-	if (!RET_IS_OK(r)) {
-		distribution_sizes_freelist(ds);
-		return r;
+	if (sizes_accountingenabled()) {
+		result = sum_sizes(specific, ds, &all, &onlyall);
+	} else {
+		r = table_newglobalcursor(rdb_references, true, &cursor);
+		if (!RET_IS_OK(r)) {
+			distribution_sizes_freelist(ds);
+			return r;
+		}
+		result = count_sizes(cursor, specific, ds, &all, &onlyall);
+		r = cursor_close(rdb_references, cursor);
+		RET_ENDUPDATE(result, r);
 	}
-	result = count_sizes(cursor, specific, ds, &all, &onlyall);
-	r = cursor_close(rdb_references, cursor);
-	RET_ENDUPDATE(result, r);
 	if (RET_IS_OK(result)) {
 		printf("%-15s %13s %13s %13s %13s\n",
 				"Codename", "Size", "Only", "Size(+s)",
@@ -254,3 +599,236 @@ retvalue sizes_distributions(struct distribution *alldistributions, bool specifi
 	distribution_sizes_freelist(ds);
 	return result;
 }
+
+struct setsize {
+	struct setsize *next;
+	char *set;
+	unsigned long long bytes, files;
+	bool seen;
+};
+#define SETSIZE_HASHSIZE 1024
+
+static unsigned int set_hash(const char *set) {
+	unsigned int h = 0;
+
+	while (*set != '\0')
+		h = h * 31 + (unsigned char)*(set++);
+	return h % SETSIZE_HASHSIZE;
+}
+
+static retvalue setsizes_add(struct setsize **hash, /*@only@*/char *set, off_t size) {
+	struct setsize *s;
+
+	for (s = hash[set_hash(set)] ; s != NULL ; s = s->next) {
+		if (strcmp(s->set, set) == 0)
+			break;
+	}
+	if (s == NULL) {
+		s = zNEW(struct setsize);
+		if (FAILEDTOALLOC(s)) {
+			free(set);
+			return RET_ERROR_OOM;
+		}
+		s->set = set;
+		s->next = hash[set_hash(set)];
+		hash[set_hash(set)] = s;
+	} else
+		free(set);
+	s->bytes += size;
+	s->files++;
+	return RET_OK;
+}
+
+static void setsizes_free(struct setsize **hash) {
+	int i;
+
+	for (i = 0 ; i < SETSIZE_HASHSIZE ; i++) {
+		while (hash[i] != NULL) {
+			struct setsize *s = hash[i];
+
+			hash[i] = s->next;
+			free(s->set);
+			free(s);
+		}
+	}
+	free(hash);
+}
+
+/* add the file and its owners collected so far */
+static retvalue recount_file(struct setsize **hash, const char *filekey, struct owners *o) {
+	char *set;
+	off_t size;
+	retvalue r;
+
+	r = owners_join(o, &set);
+	owners_reset(o);
+	if (!RET_IS_OK(r))
+		return r;
+	size = files_getsize(filekey);
+	if (size < 0) {
+		fprintf(stderr, "Cannot determine size of '%s'!\n", filekey);
+		free(set);
+		return RET_ERROR;
+	}
+	return setsizes_add(hash, set, size);
+}
+
+/* compare the stored data with the counted one */
+static retvalue recount_compare(struct setsize **hash) {
+	struct cursor *cursor;
+	const char *set, *data;
+	unsigned long long bytes, files;
+	struct setsize *s;
+	int i, differences = 0;
+	retvalue result, r;
+
+	r = table_newglobalcursor(rdb_sizes, true, &cursor);
+	if (!RET_IS_OK(r))
+		return r;
+	result = RET_OK;
+	while (cursor_nexttempdata(rdb_sizes, cursor, &set, &data, NULL)) {
+		if (strcmp(set, SIZES_ENABLED) == 0)
+			continue;
+		if (sscanf(data, "%llu %llu", &bytes, &files) != 2) {
+			bytes = 0;
+			files = 0;
+		}
+		for (s = hash[set_hash(set)] ; s != NULL ; s = s->next) {
+			if (strcmp(s->set, set) == 0)
+				break;
+		}
+		if (s == NULL) {
+			fprintf(stderr,
+"Size accounting had %llu bytes in %llu files owned by '%s', but there are none.\n",
+					bytes, files, set);
+			differences++;
+			continue;
+		}
+		s->seen = true;
+		if (s->bytes != bytes || s->files != files) {
+			fprintf(stderr,
+"Size accounting had %llu bytes in %llu files owned by '%s', but there are %llu bytes in %llu files.\n",
+					bytes, files, set, s->bytes, s->files);
+			differences++;
+		}
+	}
+	r = cursor_close(rdb_sizes, cursor);
+	RET_ENDUPDATE(result, r);
+	if (RET_WAS_ERROR(result))
+		return result;
+	for (i = 0 ; i < SETSIZE_HASHSIZE ; i++) {
+		for (s = hash[i] ; s != NULL ; s = s->next) {
+			if (s->seen)
+				continue;
+			fprintf(stderr,
+"Size accounting missed %llu bytes in %llu files owned by '%s'.\n",
+					s->bytes, s->files, s->set);
+			differences++;
+		}
+	}
+	if (differences > 0)
+		fprintf(stderr,
+"Size accounting was inconsistent (%d differences), fixing it now.\n",
+				differences);
+	else if (verbose > 0)
+		printf("Size accounting was consistent.\n");
+	return RET_OK;
+}
+
+retvalue sizes_recount(void) {
+	struct setsize **hash;
+	struct owners o = {0, 0, NULL};
+	struct cursor *cursor;
+	const char *key, *data;
+	char *last_file = NULL;
+	char buffer[100];
+	struct setsize *s;
+	int i;
+	retvalue result, r;
+
+	assert (rdb_sizes != NULL);
+
+	hash = nzNEW(SETSIZE_HASHSIZE, struct setsize *);
+	if (FAILEDTOALLOC(hash))
+		return RET_ERROR_OOM;
+	r = table_newglobalcursor(rdb_references, true, &cursor);
+	if (RET_WAS_ERROR(r)) {
+		free(hash);
+		return r;
+	}
+	result = RET_OK;
+	if (RET_IS_OK(r)) {
+		while (cursor_nexttempdata(rdb_references, cursor,
+					&key, &data, NULL)) {
+			if (last_file == NULL || strcmp(last_file, key) != 0) {
+				if (last_file != NULL) {
+					result = recount_file(hash,
+							last_file, &o);
+					free(last_file);
+					if (RET_WAS_ERROR(result)) {
+						last_file = NULL;
+						break;
+					}
+				}
+				last_file = strdup(key);
+				if (FAILEDTOALLOC(last_file)) {
+					result = RET_ERROR_OOM;
+					break;
+				}
+			}
+			result = owners_add(&o, data);
+			if (RET_WAS_ERROR(result))
+				break;
+			if (interrupted()) {
+				result = RET_ERROR_INTERRUPTED;
+				break;
+			}
+		}
+		r = cursor_close(rdb_references, cursor);
+		RET_ENDUPDATE(result, r);
+		if (last_file != NULL && !RET_WAS_ERROR(result))
+			result = recount_file(hash, last_file, &o);
+		free(last_file);
+	}
+	owners_done(&o);
+	if (!RET_WAS_ERROR(result) && sizes_accountingenabled())
+		result = recount_compare(hash);
+	if (RET_WAS_ERROR(result)) {
+		setsizes_free(hash);
+		return result;
+	}
+
+	/* replace the old data */
+	r = table_newglobalcursor(rdb_sizes, true, &cursor);
+	if (RET_IS_OK(r)) {
+		while (cursor_nexttempdata(rdb_sizes, cursor,
+					&key, &data, NULL)) {
+			r = cursor_delete(rdb_sizes, cursor, key, NULL);
+			RET_UPDATE(result, r);
+			if (RET_WAS_ERROR(r))
+				break;
+		}
+		r = cursor_close(rdb_sizes, cursor);
+	}
+	RET_ENDUPDATE(result, r);
+	for (i = 0 ; i < SETSIZE_HASHSIZE && !RET_WAS_ERROR(result) ; i++) {
+		for (s = hash[i] ; s != NULL ; s = s->next) {
+			snprintf(buffer, sizeof(buffer), "%llu %llu",
+					s->bytes, s->files);
+			r = table_adduniqsizedrecord(rdb_sizes, s->set,
+					buffer, strlen(buffer) + 1,
+					false, false);
+			RET_UPDATE(result, r);
+			if (RET_WAS_ERROR(r))
+				break;
+		}
+	}
+	setsizes_free(hash);
+	if (RET_WAS_ERROR(result))
+		return result;
+	r = table_adduniqsizedrecord(rdb_sizes, SIZES_ENABLED,
+			"", 1, false, false);
+	if (RET_IS_OK(r))
+		accountingenabled = 1;
+	return r;
+}
@@ -2,5 +2,18 @@
 #define REPREPRO_SIZES_H
 
 retvalue sizes_distributions(struct distribution * /*all*/, bool /* specific */);
+/* recalculate everything, store it for incremental accounting */
+retvalue sizes_recount(void);
+/* if references changes need to be accounted (needs the files database) */
+bool sizes_accountingenabled(void);
+
+/* to be called around every change of the references of a file
+ * (start returns RET_NOTHING if no accounting is needed,
+ * end always frees the oldset and must only be called after RET_OK) */
+retvalue sizes_startchange(const char * /*filekey*/, /*@out@*/char ** /*oldset_p*/);
+retvalue sizes_endchange(const char * /*filekey*/, /*@only@*//*@null@*/char * /*oldset*/);
+/* to be called if the size of a file is now known or no longer known
+ * (i.e. it was added to or removed from checksums.db), -1 if unknown */
+retvalue sizes_filechange(const char * /*filekey*/, off_t /*oldsize*/, off_t /*newsize*/);
 
 #endif
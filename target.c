@@ -229,6 +229,7 @@ retvalue target_initpackagesdb(struct target *target, bool readonly) {
 		target->packages = NULL;
 		return r;
 	}
+	target->packagesreadonly = readonly;
 	return r;
 }
 
@@ -243,6 +244,287 @@ retvalue target_closepackagesdb(struct target *target) {
 		r = table_close(target->packages);
 		target->packages = NULL;
 	}
+	if (target->sharedpackages != NULL) {
+		retvalue r2 = table_close(target->sharedpackages);
+		target->sharedpackages = NULL;
+		RET_UPDATE(r, r2);
+	}
+	return r;
+}
+
+/* Architecture all packages of distributions with ShareArchitectureAll
+ * are only stored once for all architectures of a component: in
+ * sharedpackages.db with key "<name>|<version>|<number>" and as data
+ * the count of targets using it, a newline and the control chunk.
+ * The packages table of each architecture only gets a stub with the
+ * version and number (and the Source field for the index by source). */
+#define SHAREDSTUB "Shared-Control: "
+
+static inline bool control_isshared(const char *control) {
+	return strncmp(control, SHAREDSTUB, sizeof(SHAREDSTUB) - 1) == 0;
+}
+
+static inline bool target_sharesarchall(const struct target *target, architecture_t architecture) {
+	return target->distribution->sharearchall &&
+		architecture == architecture_all &&
+		target->architecture != architecture_all &&
+		target->packagetype != pt_dsc;
+}
+
+/* the shared table of the targets of a packages identifier
+ * only differing in the architecture */
+static retvalue shared_open(const char *identifier, bool readonly, /*@out@*/struct table **table_p) {
+	const char *e;
+	char *shared;
+	retvalue r;
+
+	e = strrchr(identifier, '|');
+	assert (e != NULL);
+	shared = strndup(identifier, e - identifier);
+	if (FAILEDTOALLOC(shared))
+		return RET_ERROR_OOM;
+	r = database_opensharedpackages(shared, readonly, table_p);
+	free(shared);
+	return r;
+}
+
+static retvalue target_opensharedpackages(struct target *target) {
+	retvalue r;
+
+	if (target->sharedpackages != NULL)
+		return RET_OK;
+	r = shared_open(target->identifier, target->packagesreadonly,
+			&target->sharedpackages);
+	if (RET_WAS_ERROR(r))
+		target->sharedpackages = NULL;
+	return r;
+}
+
+/* get the shared record, *chunk_p pointing into the returned data */
+static retvalue shared_get(struct table *shared, const char *identifier, const char *key, /*@out@*/char **data_p, /*@out@*/unsigned long *count_p, /*@out@*/const char **chunk_p) {
+	char *data, *e;
+	retvalue r;
+
+	r = table_getrecord(shared, false, key, &data, NULL);
+	if (!RET_IS_OK(r))
+		return r;
+	*count_p = strtoul(data, &e, 10);
+	if (*e != '\n') {
+		fprintf(stderr,
+"Malformed shared control data '%s' for '%s'!\n",
+				key, identifier);
+		free(data);
+		return RET_ERROR;
+	}
+	*data_p = data;
+	*chunk_p = e + 1;
+	return RET_OK;
+}
+
+/* one target less is using this shared control chunk */
+static retvalue shared_decrement(struct table *shared, const char *identifier, const char *key) {
+	char *data, *newdata;
+	const char *chunk;
+	unsigned long count;
+	retvalue r;
+
+	r = shared_get(shared, identifier, key, &data, &count, &chunk);
+	if (!RET_IS_OK(r))
+		return r;
+	if (count <= 1) {
+		free(data);
+		return table_deleterecord(shared, key, false);
+	}
+	newdata = mprintf("%lu\n%s", count - 1, chunk);
+	free(data);
+	if (FAILEDTOALLOC(newdata))
+		return RET_ERROR_OOM;
+	r = table_replacerecord(shared, key, newdata);
+	free(newdata);
+	return r;
+}
+
+static retvalue shared_release(struct target *target, const char *key) {
+	retvalue r;
+
+	r = target_opensharedpackages(target);
+	if (RET_WAS_ERROR(r))
+		return r;
+	return shared_decrement(target->sharedpackages, target->identifier,
+			key);
+}
+
+/* store a control chunk in the shared table, returning the stub to
+ * put into the packages table of the target instead */
+static retvalue shared_add(struct target *target, const char *name, const char *version, const char *control, /*@out@*/char **stub_p, /*@out@*/char **key_p) {
+	char *key, *data, *source, *stub;
+	const char *chunk;
+	unsigned long count, number;
+	retvalue r;
+
+	r = target_opensharedpackages(target);
+	if (RET_WAS_ERROR(r))
+		return r;
+	/* look for this chunk or a free number: */
+	for (number = 0 ; ; number++) {
+		key = mprintf("%s|%s|%lu", name, version, number);
+		if (FAILEDTOALLOC(key))
+			return RET_ERROR_OOM;
+		r = shared_get(target->sharedpackages, target->identifier,
+				key, &data, &count, &chunk);
+		if (RET_WAS_ERROR(r)) {
+			free(key);
+			return r;
+		}
+		if (r == RET_NOTHING) {
+			data = mprintf("1\n%s", control);
+			if (FAILEDTOALLOC(data)) {
+				free(key);
+				return RET_ERROR_OOM;
+			}
+			r = table_adduniqrecord(target->sharedpackages,
+					key, data);
+			break;
+		}
+		if (strcmp(chunk, control) == 0) {
+			char *newdata;
+
+			newdata = mprintf("%lu\n%s", count + 1, chunk);
+			free(data);
+			if (FAILEDTOALLOC(newdata)) {
+				free(key);
+				return RET_ERROR_OOM;
+			}
+			data = newdata;
+			r = table_replacerecord(target->sharedpackages,
+					key, data);
+			break;
+		}
+		free(data);
+		free(key);
+	}
+	free(data);
+	if (RET_WAS_ERROR(r)) {
+		free(key);
+		return r;
+	}
+
+	r = chunk_getvalue(control, "Source", &source);
+	if (RET_WAS_ERROR(r)) {
+		(void)shared_release(target, key);
+		free(key);
+		return r;
+	}
+	if (RET_IS_OK(r)) {
+		stub = mprintf(SHAREDSTUB "%s %lu\nSource: %s\n",
+				version, number, source);
+		free(source);
+	} else
+		stub = mprintf(SHAREDSTUB "%s %lu\n", version, number);
+	if (FAILEDTOALLOC(stub)) {
+		(void)shared_release(target, key);
+		free(key);
+		return RET_ERROR_OOM;
+	}
+	*stub_p = stub;
+	*key_p = key;
+	return RET_OK;
+}
+
+/* "Shared-Control: <version> <number>" -> "<name>|<version>|<number>" */
+static retvalue shared_keyfromstub(const char *identifier, const char *name, const char *stub, /*@out@*/char **key_p) {
+	const char *p, *e;
+	char *key, *space;
+
+	p = stub + sizeof(SHAREDSTUB) - 1;
+	e = strchr(p, '\n');
+	if (e == NULL) {
+		fprintf(stderr, "Malformed data for '%s' in '%s'!\n",
+				name, identifier);
+		return RET_ERROR;
+	}
+	key = mprintf("%s|%.*s", name, (int)(e - p), p);
+	if (FAILEDTOALLOC(key))
+		return RET_ERROR_OOM;
+	space = strchr(key + strlen(name) + 1, ' ');
+	if (space == NULL) {
+		fprintf(stderr, "Malformed data for '%s' in '%s'!\n",
+				name, identifier);
+		free(key);
+		return RET_ERROR;
+	}
+	*space = '|';
+	*key_p = key;
+	return RET_OK;
+}
+
+/* if the control data of pkg is only a stub, replace it with
+ * the shared control chunk */
+static retvalue package_resolveshared(struct package *pkg) {
+	struct target *target = pkg->target;
+	const char *chunk;
+	char *key, *data;
+	unsigned long count;
+	retvalue r;
+
+	if (!control_isshared(pkg->control))
+		return RET_NOTHING;
+	r = shared_keyfromstub(target->identifier, pkg->name, pkg->control,
+			&key);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = target_opensharedpackages(target);
+	if (!RET_WAS_ERROR(r))
+		r = shared_get(target->sharedpackages, target->identifier,
+				key, &data, &count, &chunk);
+	if (r == RET_NOTHING) {
+		fprintf(stderr,
+"Shared control data '%s' for '%s' in '%s' is missing!\n",
+				key, pkg->name, target->identifier);
+		r = RET_ERROR;
+	}
+	if (RET_WAS_ERROR(r)) {
+		free(key);
+		return r;
+	}
+	pkg->controllen = strlen(chunk);
+	memmove(data, chunk, pkg->controllen + 1);
+	free(pkg->pkgchunk);
+	pkg->pkgchunk = data;
+	pkg->control = data;
+	free(pkg->sharedkey);
+	pkg->sharedkey = key;
+	return RET_OK;
+}
+
+/* write the control data of a new package (or replace the one
+ * the cursor points to), shared if possible */
+static retvalue target_storecontrol(struct target *target, const char *name, const char *version, const char *control, architecture_t architecture, /*@null@*/struct cursor *cursor) {
+	char *key, *stub = NULL, *sharedkey = NULL;
+	retvalue r;
+
+	if (target_sharesarchall(target, architecture)) {
+		r = shared_add(target, name, version, control,
+				&stub, &sharedkey);
+		if (RET_WAS_ERROR(r))
+			return r;
+		control = stub;
+	}
+	if (cursor != NULL)
+		r = cursor_replace(target->packages, cursor,
+				control, strlen(control));
+	else {
+		key = package_primarykey(name, version);
+		if (FAILEDTOALLOC(key))
+			r = RET_ERROR_OOM;
+		else
+			r = table_adduniqrecord(target->packages, key, control);
+		free(key);
+	}
+	if (RET_WAS_ERROR(r) && sharedkey != NULL)
+		(void)shared_release(target, sharedkey);
+	free(sharedkey);
+	free(stub);
 	return r;
 }
 
@@ -271,6 +553,10 @@ retvalue package_remove(struct package *old, struct logger *logger, struct track
 	key = package_primarykey(old->name, old->version);
 	result = table_deleterecord(old->target->packages, key, false);
 	free(key);
+	if (RET_IS_OK(result) && old->sharedkey != NULL) {
+		r = shared_release(old->target, old->sharedkey);
+		RET_UPDATE(result, r);
+	}
 	if (RET_IS_OK(result)) {
 		old->target->wasmodified = true;
 		if (trackingdata != NULL && old->source != NULL
@@ -350,6 +636,10 @@ retvalue package_remove_by_cursor(struct package_cursor *tc, struct logger *logg
 		printf("removing '%s=%s' from '%s'...\n",
 				old->name, old->version, old->target->identifier);
 	result = cursor_delete(target->packages, tc->cursor, old->name, old->version);
+	if (RET_IS_OK(result) && old->sharedkey != NULL) {
+		r = shared_release(target, old->sharedkey);
+		RET_UPDATE(result, r);
+	}
 	if (RET_IS_OK(result)) {
 		old->target->wasmodified = true;
 		if (trackingdata != NULL && old->source != NULL
@@ -375,6 +665,92 @@ retvalue package_remove_by_cursor(struct package_cursor *tc, struct logger *logg
 	return result;
 }
 
+retvalue package_newcontrol_by_cursor(struct package_cursor *cursor, const char *newcontrol, size_t newcontrollen) {
+	struct package *current = &cursor->current;
+	architecture_t architecture = atom_unknown;
+	retvalue r, r2;
+
+	if (current->sharedkey == NULL &&
+			!cursor->target->distribution->sharearchall)
+		return cursor_replace(cursor->target->packages, cursor->cursor,
+				newcontrol, newcontrollen);
+	r = package_getarchitecture(current);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r2 = package_getversion(current);
+	if (RET_WAS_ERROR(r2))
+		return r2;
+	/* only share it (again) if it is still a valid package */
+	if (RET_IS_OK(r) && RET_IS_OK(r2))
+		architecture = current->architecture;
+	r = target_storecontrol(cursor->target, current->name,
+			current->version, newcontrol,
+			architecture, cursor->cursor);
+	if (RET_IS_OK(r) && current->sharedkey != NULL) {
+		r2 = shared_release(cursor->target, current->sharedkey);
+		RET_UPDATE(r, r2);
+	}
+	return r;
+}
+
+/* before dropping the packages of a no longer existing target,
+ * give back the shared control chunks it uses */
+retvalue target_releaseshared(const char *identifier) {
+	struct table *packages, *shared;
+	struct cursor *cursor;
+	struct strlist keys;
+	const char *name, *control;
+	retvalue result, r;
+	int i;
+
+	if (strchr(identifier, '|') == NULL)
+		return RET_NOTHING;
+	r = database_openpackages(identifier, true, &packages);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = table_newglobalcursor(packages, true, &cursor);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r)) {
+		(void)table_close(packages);
+		return r;
+	}
+	strlist_init(&keys);
+	result = RET_NOTHING;
+	while (cursor_nexttempdata(packages, cursor, &name, &control, NULL)) {
+		char *key;
+
+		if (!control_isshared(control))
+			continue;
+		r = shared_keyfromstub(identifier, name, control, &key);
+		if (!RET_WAS_ERROR(r))
+			r = strlist_add(&keys, key);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+	r = cursor_close(packages, cursor);
+	RET_ENDUPDATE(result, r);
+	r = table_close(packages);
+	RET_ENDUPDATE(result, r);
+	if (RET_WAS_ERROR(result) || keys.count == 0) {
+		strlist_done(&keys);
+		return result;
+	}
+	r = shared_open(identifier, false, &shared);
+	if (RET_WAS_ERROR(r)) {
+		strlist_done(&keys);
+		return r;
+	}
+	for (i = 0 ; !RET_WAS_ERROR(result) && i < keys.count ; i++) {
+		r = shared_decrement(shared, identifier, keys.values[i]);
+		RET_UPDATE(result, r);
+	}
+	r = table_close(shared);
+	RET_ENDUPDATE(result, r);
+	strlist_done(&keys);
+	return result;
+}
+
 static retvalue archive_package(struct target *target, const struct package *package, const struct strlist *files, /*@null@*/const char *causingrule, /*@null@*/const char *suitefrom) {
 	struct strlist filekeys;
 	struct target *archive_target;
@@ -488,14 +864,16 @@ static retvalue addpackages(struct target *target, const char *packagename, cons
 		if (RET_IS_OK(r)) {
 			r = table_deleterecord(table, key, false);
 			RET_UPDATE(result, r);
+			if (RET_IS_OK(r) && old->sharedkey != NULL) {
+				r = shared_release(target, old->sharedkey);
+				RET_UPDATE(result, r);
+			}
 		}
 		free(key);
 	}
 
-	key = package_primarykey(packagename, version);
-	r = table_adduniqrecord(table, key, controlchunk);
-	free(key);
-
+	r = target_storecontrol(target, packagename, version, controlchunk,
+			architecture, NULL);
 	if (RET_WAS_ERROR(r))
 		return r;
 
@@ -607,6 +985,8 @@ retvalue target_addpackage(struct target *target, struct logger *logger, const c
 				old.control = iterator.current.control;
 				old.controllen = iterator.current.controllen;
 				old.version = iterator.current.version;
+				old.sharedkey = iterator.current.sharedkey;
+				iterator.current.sharedkey = NULL;
 			}
 		}
 	} else {
@@ -1023,6 +1403,14 @@ retvalue target_redochecksums(struct target *target, struct distribution *distri
 
 /* export a database */
 
+/* if the architecture all packages of this target are exported into
+ * a common binary-all index instead of the target's own one */
+bool target_hasarchallindex(const struct target *target) {
+	return target->distribution->exportoptions[deo_binaryall] &&
+		target->packagetype == pt_deb &&
+		target->architecture != architecture_all;
+}
+
 retvalue target_export(struct target *target, bool onlyneeded, bool snapshot, struct release *release) {
 	retvalue result;
 	bool onlymissing;
@@ -1041,7 +1429,8 @@ retvalue target_export(struct target *target, bool onlyneeded, bool snapshot, st
 	onlymissing = onlyneeded && !target->wasmodified;
 
 	result = export_target(target->relativedirectory, target,
-			target->exportmode, release, onlymissing, snapshot);
+			target->exportmode, release, onlymissing, snapshot,
+			target_hasarchallindex(target));
 
 	if (!RET_WAS_ERROR(result) && !snapshot) {
 		target->saved_wasmodified =
@@ -1110,6 +1499,11 @@ retvalue package_get(struct target *target, const char *name, const char *versio
 		pkg->target = target;
 		pkg->name = name;
 		pkg->control = pkg->pkgchunk;
+		r = package_resolveshared(pkg);
+		if (RET_WAS_ERROR(r)) {
+			package_done(pkg);
+			result = r;
+		}
 	}
 	if (database_closed) {
 		r = target_closepackagesdb(target);
@@ -1122,20 +1516,62 @@ retvalue package_get(struct target *target, const char *name, const char *versio
 }
 
 retvalue package_openiterator(struct target *t, bool readonly, bool duplicate, /*@out@*/struct package_cursor *tc) {
+	return package_openprefixiterator(t, readonly, duplicate, NULL, tc);
+}
+
+/* only iterate over packages with names starting with prefix */
+retvalue package_openprefixiterator(struct target *t, bool readonly, bool duplicate, const char *prefix, /*@out@*/struct package_cursor *tc) {
 	retvalue r, r2;
 	struct cursor *c;
 
 	if (verbose >= 15)
-		fprintf(stderr, "trace: package_openiterator(target={identifier: %s}, readonly=%s, duplicate=%s) called.\n",
-		        t->identifier, readonly ? "true" : "false", duplicate ? "true" : "false");
+		fprintf(stderr, "trace: package_openiterator(target={identifier: %s}, readonly=%s, duplicate=%s, prefix=%s) called.\n",
+		        t->identifier, readonly ? "true" : "false", duplicate ? "true" : "false", prefix == NULL ? "NULL" : prefix);
 
 	tc->close_database = t->packages == NULL;
 	r = target_initpackagesdb(t, readonly);
 	assert (r != RET_NOTHING);
 	if (RET_WAS_ERROR(r))
 		return r;
-	r = table_newglobalcursor(t->packages, duplicate, &c);
+	if (prefix != NULL)
+		r = table_newprefixcursor(t->packages, duplicate, prefix, &c);
+	else
+		r = table_newglobalcursor(t->packages, duplicate, &c);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r)) {
+		r2 = target_closepackagesdb(t);
+		RET_UPDATE(r, r2);
+		return r;
+	}
+	tc->target = t;
+	tc->cursor = c;
+	tc->r = RET_OK;
+	memset(&tc->current, 0, sizeof(tc->current));
+	return RET_OK;
+}
+
+/* iterate over all packages of the given source (and maybe more,
+ * so the caller still has to check the source of each package),
+ * RET_NOTHING if there is no index, then the caller has to look
+ * at all packages */
+retvalue package_opensourceiterator(struct target *t, bool readonly, const char *source, /*@out@*/struct package_cursor *tc) {
+	retvalue r, r2;
+	struct cursor *c;
+
+	tc->close_database = t->packages == NULL;
+	r = target_initpackagesdb(t, readonly);
 	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = table_newsourcecursor(t->packages, source, &c);
+	if (r == RET_NOTHING) {
+		if (tc->close_database) {
+			r = target_closepackagesdb(t);
+			if (RET_WAS_ERROR(r))
+				return r;
+		}
+		return RET_NOTHING;
+	}
 	if (RET_WAS_ERROR(r)) {
 		r2 = target_closepackagesdb(t);
 		RET_UPDATE(r, r2);
@@ -1143,6 +1579,7 @@ retvalue package_openiterator(struct target *t, bool readonly, bool duplicate, /
 	}
 	tc->target = t;
 	tc->cursor = c;
+	tc->r = RET_OK;
 	memset(&tc->current, 0, sizeof(tc->current));
 	return RET_OK;
 }
@@ -1172,6 +1609,12 @@ retvalue package_openduplicateiterator(struct target *t, const char *name, long
 	tc->current.target = t;
 	tc->target = t;
 	tc->cursor = c;
+	tc->r = package_resolveshared(&tc->current);
+	if (RET_WAS_ERROR(tc->r)) {
+		r = package_closeiterator(tc);
+		return r;
+	}
+	tc->r = RET_OK;
 	return RET_OK;
 }
 
@@ -1182,13 +1625,24 @@ bool package_next(struct package_cursor *tc) {
 		fprintf(stderr, "trace: package_next(tc={current: {name: %s, version: %s}}) called.\n", tc->current.name, tc->current.version);
 
 	package_done(&tc->current);
+	if (RET_WAS_ERROR(tc->r))
+		return false;
 	success = cursor_nexttempdata(tc->target->packages, tc->cursor,
 			&tc->current.name, &tc->current.control,
 			&tc->current.controllen);
 	if (!success)
 		memset(&tc->current, 0, sizeof(tc->current));
-	else
+	else {
+		retvalue r;
+
 		tc->current.target = tc->target;
+		r = package_resolveshared(&tc->current);
+		if (RET_WAS_ERROR(r)) {
+			tc->r = r;
+			package_done(&tc->current);
+			return false;
+		}
+	}
 	return success;
 }
 
@@ -1197,6 +1651,8 @@ retvalue package_closeiterator(struct package_cursor *tc) {
 
 	package_done(&tc->current);
 	result = cursor_close(tc->target->packages, tc->cursor);
+	if (RET_WAS_ERROR(tc->r))
+		result = tc->r;
 	if (tc->close_database) {
 		r = target_closepackagesdb(tc->target);
 		RET_UPDATE(result, r);
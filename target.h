@@ -67,6 +67,9 @@ struct target {
 	struct target *next;
 	/* is initialized as soon as needed: */
 	struct table *packages;
+	/* the shared architecture all chunks, opened when first needed */
+	/*@null@*/struct table *sharedpackages;
+	bool packagesreadonly;
 	/* do not allow write operations */
 	bool readonly;
 	/* has noexport option */
@@ -81,8 +84,11 @@ retvalue target_initialize_dbinary(/*@dependant@*/struct distribution *, compone
 retvalue target_initialize_binary(/*@dependant@*/struct distribution *, component_t, architecture_t, /*@dependent@*/const struct exportmode *, bool /*readonly*/, bool /*noexport*/, /*@NULL@*/const char *fakecomponentprefix, /*@out@*/struct target **);
 retvalue target_initialize_source(/*@dependant@*/struct distribution *, component_t, /*@dependent@*/const struct exportmode *, bool /*readonly*/, bool /*noexport*/, /*@NULL@*/const char *fakecomponentprefix, /*@out@*/struct target **);
 retvalue target_free(struct target *);
+/* give back shared control data of an identifier about to be dropped */
+retvalue target_releaseshared(const char *);
 
 retvalue target_export(struct target *, bool /*onlyneeded*/, bool /*snapshot*/, struct release *);
+bool target_hasarchallindex(const struct target *);
 
 /* This opens up the database, if db != NULL, *db will be set to it.. */
 retvalue target_initpackagesdb(struct target *, bool /*readonly*/);
@@ -57,33 +57,101 @@ static inline bool check_field(enum term_comparison c, const char *value, const
 	}
 }
 
+/* like check_field, but for a value not 0-terminated */
+static bool check_slice(const struct term_atom *atom, const struct chunkslice *value) {
+	enum term_comparison c = atom->comparison;
+	const char *with = atom->generic.comparewith;
+	char buffer[256], *copy;
+	size_t l;
+	bool result;
+	int i;
+
+	switch (c) {
+		case tc_none:
+			return true;
+		case tc_globmatch:
+		case tc_notglobmatch:
+			l = atom->generic.literallen;
+			if (atom->generic.globform == gf_literal)
+				result = value->len == l &&
+					memcmp(value->value, with, l) == 0;
+			else if (atom->generic.globform == gf_prefix)
+				result = value->len >= l &&
+					memcmp(value->value, with, l) == 0;
+			else if (l > value->len ||
+					memcmp(value->value, with, l) != 0)
+				/* literal start does not match */
+				result = false;
+			else {
+				if (value->len < sizeof(buffer))
+					copy = buffer;
+				else {
+					copy = malloc(value->len + 1);
+					if (FAILEDTOALLOC(copy))
+						return false;
+				}
+				memcpy(copy, value->value, value->len);
+				copy[value->len] = '\0';
+				result = globmatch(copy, with);
+				if (copy != buffer)
+					free(copy);
+			}
+			return (c == tc_globmatch) == result;
+		default:
+			l = strlen(with);
+			i = memcmp(value->value, with,
+					(value->len < l)?value->len:l);
+			if (i == 0 && value->len != l)
+				i = (value->len < l)?-1:1;
+			if (i < 0)
+				return c == tc_strictless
+					|| c == tc_lessorequal
+					|| c == tc_notequal;
+			else if (i > 0)
+				return  c == tc_strictmore
+					|| c == tc_moreorequal
+					|| c == tc_notequal;
+			else
+				return c == tc_lessorequal
+					|| c == tc_moreorequal
+					|| c == tc_equal;
+	}
+}
+
 /* this has a target argument instead of using package->target
  * as the package might come from one distribution/architecture/...
  * and the decision being about adding it somewhere else */
 retvalue term_decidepackage(const term *condition, struct package *package, struct target *target) {
 	const struct term_atom *atom = condition;
+	/* the values of all fields needed, looked up together
+	 * when the first one is needed */
+	struct chunkslice values[(condition == NULL)?1:
+			(condition->fieldcount + 1)];
+	bool havevalues = false;
 
 	while (atom != NULL) {
-		bool correct; char *value;
+		bool correct;
 		enum term_comparison c = atom->comparison;
-		retvalue r;
 
 		if (atom->isspecial) {
 			correct = atom->special.type->compare(c,
 					&atom->special.comparewith,
 					package, target);
 		} else {
-			r = chunk_getvalue(package->control,
-					atom->generic.key, &value);
-			if (RET_WAS_ERROR(r))
-				return r;
-			if (r == RET_NOTHING) {
+			const struct chunkslice *value;
+
+			if (!havevalues) {
+				chunk_getslices(package->control,
+						condition->fieldcount,
+						condition->fields, values);
+				havevalues = true;
+			}
+			value = &values[atom->generic.field];
+			if (value->value == NULL) {
 				correct = (c == tc_notequal
 						|| c == tc_notglobmatch);
 			} else {
-				correct = check_field(c, value,
-						atom->generic.comparewith);
-				free(value);
+				correct = check_slice(atom, value);
 			}
 		}
 		if (atom->negated)
@@ -44,11 +44,48 @@ void term_free(term *t) {
 			free(t->generic.comparewith);
 		}
 		strlist_done(&t->architectures);
+		free(t->fields);
 		free(t);
 		t = next;
 	}
 }
 
+/* prepare everything to look at generic atoms */
+static retvalue collectfields(struct term_atom *first) {
+	struct term_atom *a, *b;
+	int count = 0;
+
+	for (a = first ; a != NULL ; a = a->next) {
+		if (a->isspecial)
+			continue;
+		if (a->comparison == tc_globmatch ||
+				a->comparison == tc_notglobmatch)
+			a->generic.globform = glob_form(
+					a->generic.comparewith,
+					&a->generic.literallen);
+		for (b = first ; b != a ; b = b->next) {
+			if (!b->isspecial && strcasecmp(b->generic.key,
+						a->generic.key) == 0)
+				break;
+		}
+		if (b != a)
+			a->generic.field = b->generic.field;
+		else
+			a->generic.field = count++;
+	}
+	if (count == 0)
+		return RET_OK;
+	first->fields = nzNEW(count, const char *);
+	if (FAILEDTOALLOC(first->fields))
+		return RET_ERROR_OOM;
+	first->fieldcount = count;
+	for (a = first ; a != NULL ; a = a->next) {
+		if (!a->isspecial)
+			first->fields[a->generic.field] = a->generic.key;
+	}
+	return RET_OK;
+}
+
 static retvalue parseatom(const char **formula, /*@out@*/struct term_atom **atom, int options, const struct term_special *specials) {
 	struct term_atom *a;
 	const char *f = *formula;
@@ -381,6 +418,11 @@ retvalue term_compile(term **term_p, const char *origformula, int options, const
 		term_free(first);
 		return RET_ERROR;
 	}
+	r = collectfields(first);
+	if (RET_WAS_ERROR(r)) {
+		term_free(first);
+		return r;
+	}
 	*term_p = first;
 	return RET_OK;
 }
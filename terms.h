@@ -1,6 +1,10 @@
 #ifndef REPREPRO_TERMS_H
 #define REPREPRO_TERMS_H
 
+#ifndef REPREPRO_GLOBMATCH_H
+#include "globmatch.h"
+#endif
+
 enum term_comparison { tc_none=0, tc_equal, tc_strictless, tc_strictmore,
 				  tc_lessorequal, tc_moreorequal,
 				  tc_notequal, tc_globmatch, tc_notglobmatch};
@@ -26,6 +30,11 @@ typedef struct term_atom {
 			char *key;
 			/* version/value requirement */
 			char *comparewith;
+			/* index of key in the fields of the first atom */
+			int field;
+			/* for tc_globmatch and tc_notglobmatch */
+			enum globform globform;
+			size_t literallen;
 		} generic;
 		struct {
 			const struct term_special *type;
@@ -35,6 +44,10 @@ typedef struct term_atom {
 			} comparewith;
 		} special;
 	};
+	/* only in the first atom: the different keys of all generic atoms,
+	 * so their values can be looked up at once */
+	int fieldcount;
+	/*@dependent@*/const char **fields;
 } term;
 
 struct term_special {
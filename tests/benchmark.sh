@@ -0,0 +1,266 @@
+#!/bin/sh
+# Rough benchmarks of some parts of reprepro, using generated data.
+#
+# Syntax: benchmark.sh [--reprepro <binary>] [--rredtool <binary>]
+#                     <benchmark> [<count>]
+#
+# To compare two builds, run the same benchmark with each of them.
+# All numbers include starting reprepro and opening the database.
+
+set -e -u
+
+export LC_ALL=C
+
+REPREPRO="${0%/*}/../reprepro"
+RREDTOOL="${0%/*}/../rredtool"
+
+while [ $# -gt 0 ] ; do
+	case "$1" in
+		--reprepro)
+			shift
+			REPREPRO="$1"
+			shift
+			;;
+		--rredtool)
+			shift
+			RREDTOOL="$1"
+			shift
+			;;
+		--*)
+			echo "Unsupported option $1" >&2
+			exit 1
+			;;
+		*)
+			break
+			;;
+	esac
+done
+if [ $# -lt 1 ] || [ $# -gt 2 ] ; then
+	echo "Syntax: benchmark.sh [--reprepro <binary>] [--rredtool <binary>] filter|flood|rred|gzip [<count>]" >&2
+	exit 1
+fi
+REPREPRO="$(readlink -f "$REPREPRO")"
+RREDTOOL="$(readlink -f "$RREDTOOL")"
+BENCHMARK="$1"
+COUNT="${2:-20000}"
+
+WORKDIR="$(mktemp -d)"
+trap 'rm -rf "$WORKDIR"' EXIT
+cd "$WORKDIR"
+
+now() {
+	date +%s.%N
+}
+
+# report: <what> <items> <unit> <start> <end>
+report() {
+	awk -v what="$1" -v items="$2" -v unit="$3" -v start="$4" -v end="$5" \
+		'BEGIN { t = end - start ; if (t <= 0) t = 0.001 ;
+			printf "%-50s %8.3f s %12.0f %s/s\n", what, t, items / t, unit }'
+}
+
+# genindex <count> <arch> <first> <round> <file>:
+# a Packages file with <count> packages, all with the given file.
+# Architecture all packages are only in it if <first> is 1.
+# With a <round> larger than 0 some packages get other versions and
+# one is missing, to get a series of files as with many updates.
+genindex() {
+	awk -v count="$1" -v arch="$2" -v first="$3" -v round="$4" \
+	    -v file="$5" \
+	    -v size="$(stat -c %s "$5")" \
+	    -v md5="$(md5sum "$5" | cut -d' ' -f1)" \
+	'BEGIN { split("admin devel doc libs net utils", sections, " ");
+	for (i = 1 ; i <= count ; i++) {
+		s = int(i / 3);
+		all = (s % 4 == 0);
+		if (all && !first)
+			continue;
+		if (round > 0 && i == (round * 37) % count + 1)
+			continue;
+		print "Package: pkg" i;
+		if (round > 0 && i % 50 == round % 50)
+			print "Version: 1." s "-1+b" round;
+		else
+			print "Version: 1." s "-1";
+		print "Source: src" s " (1." s ")";
+		print "Architecture: " (all ? "all" : arch);
+		print "Filename: " file;
+		print "Section: " sections[i % 6 + 1];
+		print "Priority: " (i % 10 == 0 ? "important" : "optional");
+		print "Maintainer: Some One <someone@example.org>";
+		print "Installed-Size: " (i % 5000);
+		if (i % 7 != 0)
+			print "Depends: libc6 (>= 2." (i % 30) "), pkg" (i + 1);
+		print "Description: benchmark package " i;
+		print " This package only exists to be looked at.";
+		print "Size: " size;
+		print "MD5sum: " md5;
+		print "";
+	} }'
+}
+
+# a repository with <count> binary packages for each given architecture,
+# all using the same file, as only the package data matters here.
+# The packages of every 4th source are Architecture: all, those are
+# only put into the first architecture (as flood would need to).
+setuprepository() {
+	local count="$1" arch first=1
+	shift
+
+	mkdir -p conf pool/main/b/bench
+	echo "Codename: bench" > conf/distributions
+	echo "Architectures: $*" >> conf/distributions
+	echo "Components: main" >> conf/distributions
+	echo "export silent-never" > conf/options
+	echo "benchmark" > pool/main/b/bench/bench_1_all.deb
+	"$REPREPRO" -s -b . _detect pool/main/b/bench/bench_1_all.deb
+	for arch in "$@" ; do
+		genindex "$count" "$arch" "$first" 0 \
+			pool/main/b/bench/bench_1_all.deb > index."$arch"
+		# _addpackage needs the names, so give it some at a time:
+		sed -n -e 's/^Package: //p' index."$arch" | \
+		xargs -n 1000 "$REPREPRO" -s -b . -C main -A "$arch" -T deb \
+			_addpackage bench index."$arch"
+		first=0
+	done
+}
+
+benchmark_filter() {
+	local formula start end runs=5 i
+
+	setuprepository "$COUNT" abacus
+	for formula in \
+		'Package (% pkg1*)' \
+		'Section (== utils), Priority (== optional)' \
+		'Source (== src7) | Package (== pkg7)' \
+		'Installed-Size (>> 1000), !Depends, Section (% *s)' \
+		'$Source (== src7), $SourceVersion (>> 1.5)' ; do
+		start="$(now)"
+		i=0
+		while [ $i -lt $runs ] ; do
+			"$REPREPRO" -b . listfilter bench "$formula" > /dev/null
+			i=$((i + 1))
+		done
+		end="$(now)"
+		report "$formula" "$((COUNT * runs))" packages "$start" "$end"
+	done
+}
+
+# flood with different numbers of packages, to see how its runtime
+# grows with their number:
+benchmark_flood() {
+	local count start end
+
+	for count in $((COUNT / 4)) $((COUNT / 2)) "$COUNT" $((COUNT * 2)) ; do
+		mkdir flood"$count"
+		cd flood"$count"
+		setuprepository "$count" abacus calculator coal
+		start="$(now)"
+		"$REPREPRO" -b . flood bench > /dev/null
+		end="$(now)"
+		cd ..
+		rm -r flood"$count"
+		report "flood with $count packages per architecture" \
+			"$((count * 3))" packages "$start" "$end"
+	done
+}
+
+# merge series of patches between Packages files of <count> packages
+# (as done by rredtool when updating the .diff directories) and apply
+# them, to see how that grows with the length of the series:
+benchmark_rred() {
+	local length patches start end runs=5 i
+
+	echo "benchmark" > bench.deb
+	genindex "$COUNT" abacus 1 0 bench.deb > Packages.0
+	i=1
+	while [ $i -le 64 ] ; do
+		genindex "$COUNT" abacus 1 $i bench.deb > Packages.$i
+		"$RREDTOOL" --diff Packages.$((i - 1)) Packages.$i > patch.$i
+		i=$((i + 1))
+	done
+	for length in 2 8 32 64 ; do
+		patches="$(i=1 ; while [ $i -le $length ] ; do
+			echo patch.$i ; i=$((i + 1)) ; done)"
+		start="$(now)"
+		i=0
+		while [ $i -lt $runs ] ; do
+			"$RREDTOOL" --merge $patches > merged
+			i=$((i + 1))
+		done
+		end="$(now)"
+		report "merge $length patches" "$((length * runs))" patches \
+			"$start" "$end"
+		start="$(now)"
+		i=0
+		while [ $i -lt $runs ] ; do
+			"$RREDTOOL" --patch Packages.0 merged > patched
+			i=$((i + 1))
+		done
+		end="$(now)"
+		report "apply the merged $length patches" "$((COUNT * runs))" \
+			packages "$start" "$end"
+		if ! cmp -s patched Packages.$length ; then
+			echo "Merging $length patches gave a wrong result!" >&2
+			exit 1
+		fi
+	done
+}
+
+# writing and reading .gz files, to compare builds with and without
+# libdeflate (which compresses and uncompresses in memory at once
+# instead of using zlib as stream):
+benchmark_gzip() {
+	local start end runs=5 i gz size gzsize
+
+	setuprepository "$COUNT" abacus
+	echo "DebIndices: Packages Release . .gz" >> conf/distributions
+	gz=dists/bench/main/binary-abacus/Packages.gz
+	start="$(now)"
+	i=0
+	while [ $i -lt $runs ] ; do
+		"$REPREPRO" -b . export bench > /dev/null
+		i=$((i + 1))
+	done
+	end="$(now)"
+	report "export with Packages.gz" "$((COUNT * runs))" packages \
+		"$start" "$end"
+	size="$(stat -c %s dists/bench/main/binary-abacus/Packages)"
+	gzsize="$(stat -c %s "$gz")"
+	awk -v size="$size" -v gzsize="$gzsize" 'BEGIN {
+		printf "%-50s %10d bytes (%.2f%%)\n", "Packages.gz size",
+			gzsize, 100 * gzsize / size }'
+	start="$(now)"
+	i=0
+	while [ $i -lt $runs ] ; do
+		rm -f uncompressed
+		"$REPREPRO" __uncompress .gz "$gz" uncompressed
+		i=$((i + 1))
+	done
+	end="$(now)"
+	report "__uncompress of Packages.gz" "$((size / 1024 * runs))" kB \
+		"$start" "$end"
+	if ! cmp -s uncompressed dists/bench/main/binary-abacus/Packages ; then
+		echo "Uncompressing gave a wrong result!" >&2
+		exit 1
+	fi
+}
+
+case "$BENCHMARK" in
+	filter)
+		benchmark_filter
+		;;
+	flood)
+		benchmark_flood
+		;;
+	rred)
+		benchmark_rred
+		;;
+	gzip)
+		benchmark_gzip
+		;;
+	*)
+		echo "Unknown benchmark '$BENCHMARK'!" >&2
+		exit 1
+		;;
+esac
@@ -107,6 +107,7 @@ else
 	REPREPRO="$SRCDIR/reprepro"
 fi
 RREDTOOL="$(dirname "$REPREPRO")/rredtool"
+CHANGESTOOL="$(dirname "$REPREPRO")/changestool"
 
 if [ -z "$TESTOPTIONS" ] ; then
 	if [ -z "$USE_VALGRIND" ] ; then
@@ -212,7 +213,7 @@ runtest() {
 	( cd "dir_$1" || exit 1
 	  export TESTNAME
 	  export SRCDIR TESTSDIR
-	  export TESTTOOL RREDTOOL REPREPRO
+	  export TESTTOOL RREDTOOL CHANGESTOOL REPREPRO
 	  export TRACKINGTESTOPTIONS TESTOPTIONS REPREPROOPTIONS verbosity
   	  WORKDIR="$WORKDIR/dir_$1" CALLEDFROMTESTSUITE=true dash $TESTSHELLOPTS "$SRCDIR/tests/$1.test"
 	) > "log_$1" 2>&1 || rc=$?
@@ -266,6 +267,8 @@ else
 	runtest override
 	runtest includeasc
 	runtest listcodenames
+	runtest sharearchall
+	runtest jobs
 fi
 echo "$number_tests tests, $number_success succeded, $number_failed failed, $number_skipped skipped, $number_missing missing"
 exit 0
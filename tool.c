@@ -39,6 +39,7 @@
 #include "debfile.h"
 #include "sourceextraction.h"
 #include "uncompression.h"
+#include "workers.h"
 
 /* for compatibility with used code */
 int verbose=0;
@@ -46,6 +47,9 @@ bool interrupted(void) {
 	return false;
 }
 
+/* maximum number of worker processes (--jobs) */
+static int jobs = 1;
+
 static void about(bool help) NORETURN;
 static void about(bool help) {
 	fprintf(help?stdout:stderr,
@@ -1364,25 +1368,137 @@ static retvalue write_changes_file(const char *changesfilename, struct changes *
 	return RET_OK;
 }
 
+/* Reading the checksums of many files in worker processes (--jobs).
+ * The checksums are passed back in their combined form, results[i] is
+ * NULL if fullfilenames[i] could not be read. */
+
+struct checksumsjob {
+	const char *fullfilename;
+	struct checksums **result_p;
+};
+
+static retvalue checksumsjob_read(void *privdata, char **data_p, size_t *len_p) {
+	struct checksumsjob *job = privdata;
+	struct checksums *checksums;
+	const char *combined;
+	size_t len;
+	retvalue r;
+
+	r = checksums_read(job->fullfilename, &checksums);
+	if (!RET_IS_OK(r))
+		return r;
+	r = checksums_getcombined(checksums, &combined, &len);
+	if (RET_IS_OK(r)) {
+		*data_p = strndup(combined, len);
+		if (FAILEDTOALLOC(*data_p))
+			r = RET_ERROR_OOM;
+		else
+			*len_p = len + 1;
+	}
+	checksums_free(checksums);
+	return r;
+}
+
+static retvalue checksumsjob_done(void *privdata, retvalue r, const char *data, size_t len) {
+	struct checksumsjob *job = privdata;
+
+	if (r == RET_ERROR_OOM)
+		return r;
+	// assume everything else is not fatal and means
+	// a file not readable...
+	if (!RET_IS_OK(r) || data == NULL || data[len - 1] != '\0')
+		return RET_NOTHING;
+	r = checksums_parse(job->result_p, data);
+	if (r == RET_ERROR_OOM)
+		return r;
+	if (!RET_IS_OK(r))
+		*job->result_p = NULL;
+	return RET_NOTHING;
+}
+
+static retvalue readchecksums(int count, /*@null@*/const char * const *fullfilenames, /*@out@*/struct checksums **results) {
+	struct checksumsjob *todo;
+	struct workers *workers;
+	retvalue result, r;
+	int i;
+
+	for (i = 0 ; i < count ; i++)
+		results[i] = NULL;
+	todo = nNEW(count, struct checksumsjob);
+	if (FAILEDTOALLOC(todo))
+		return RET_ERROR_OOM;
+	r = workers_init(&workers, jobs);
+	if (RET_WAS_ERROR(r)) {
+		free(todo);
+		return r;
+	}
+	result = RET_OK;
+	for (i = 0 ; i < count ; i++) {
+		if (fullfilenames[i] == NULL)
+			continue;
+		todo[i].fullfilename = fullfilenames[i];
+		todo[i].result_p = &results[i];
+		r = workers_start(workers, checksumsjob_read,
+				checksumsjob_done, &todo[i]);
+		if (RET_WAS_ERROR(r)) {
+			result = r;
+			break;
+		}
+	}
+	r = workers_finish(workers);
+	RET_ENDUPDATE(result, r);
+	free(todo);
+	if (RET_WAS_ERROR(result)) {
+		for (i = 0 ; i < count ; i++) {
+			checksums_free(results[i]);
+			results[i] = NULL;
+		}
+		return result;
+	}
+	return RET_OK;
+}
+
 static retvalue getchecksums(struct changes *changes) {
 	struct fileentry *file;
+	const char **fullfilenames;
+	struct checksums **results;
+	int count, i;
 	retvalue r;
 
+	count = 0;
 	for (file = changes->files; file != NULL ; file = file->next) {
-
 		if (file->fullfilename == NULL)
 			continue;
 		assert (file->realchecksums == NULL);
-
-		r = checksums_read(file->fullfilename, &file->realchecksums);
-		if (r == RET_ERROR_OOM)
-			return r;
-		else if (!RET_IS_OK(r)) {
-			// assume everything else is not fatal and means
-			// a file not readable...
-			file->realchecksums = NULL;
-		}
+		count++;
+	}
+	if (count == 0)
+		return RET_OK;
+	fullfilenames = nNEW(count, const char *);
+	if (FAILEDTOALLOC(fullfilenames))
+		return RET_ERROR_OOM;
+	results = nNEW(count, struct checksums *);
+	if (FAILEDTOALLOC(results)) {
+		free(fullfilenames);
+		return RET_ERROR_OOM;
+	}
+	i = 0;
+	for (file = changes->files; file != NULL ; file = file->next) {
+		if (file->fullfilename != NULL)
+			fullfilenames[i++] = file->fullfilename;
+	}
+	r = readchecksums(count, fullfilenames, results);
+	free(fullfilenames);
+	if (RET_WAS_ERROR(r)) {
+		free(results);
+		return r;
 	}
+	i = 0;
+	for (file = changes->files; file != NULL ; file = file->next) {
+		if (file->fullfilename != NULL)
+			file->realchecksums = results[i++];
+	}
+	free(results);
 	return RET_OK;
 }
 
@@ -2475,7 +2591,7 @@ static retvalue adddscs(const char *changesfilename, struct changes *c, int argc
 		return RET_NOTHING;
 }
 
-static retvalue adddeb(struct changes *c, const char *debfilename, const struct strlist *searchpath) {
+static retvalue adddeb(struct changes *c, const char *debfilename, const struct strlist *searchpath, /*@null@*/struct checksums **prefetched_p) {
 	retvalue r;
 	struct fileentry *f;
 	struct binaryfile *deb;
@@ -2618,9 +2734,14 @@ static retvalue adddeb(struct changes *c, const char *debfilename, const struct
 	deb->binary->files = deb;
 	deb->binary->missedinheader = false;
 	c->modified = true;
-	r = checksums_read(f->fullfilename, &f->realchecksums);
-	if (RET_WAS_ERROR(r))
-		return r;
+	if (prefetched_p != NULL && *prefetched_p != NULL) {
+		f->realchecksums = *prefetched_p;
+		*prefetched_p = NULL;
+	} else {
+		r = checksums_read(f->fullfilename, &f->realchecksums);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
 	f->checksumsfromchanges = checksums_dup(f->realchecksums);
 	if (FAILEDTOALLOC(f->checksumsfromchanges))
 		return RET_ERROR_OOM;
@@ -2653,18 +2774,82 @@ static retvalue adddeb(struct changes *c, const char *debfilename, const struct
 	return RET_OK;
 }
 
+/* with --jobs, read the checksums of all files to be added at once */
+static retvalue prefetchchecksums(const struct changes *c, int argc, char **argv, const struct strlist *searchpath, /*@out@*/struct checksums ***prefetched_p) {
+	char **fullfilenames;
+	struct checksums **prefetched = NULL;
+	retvalue r = RET_OK;
+	int i;
+
+	*prefetched_p = NULL;
+	if (jobs <= 1 || argc <= 1)
+		return RET_NOTHING;
+	fullfilenames = nzNEW(argc, char *);
+	if (FAILEDTOALLOC(fullfilenames))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < argc ; i++) {
+		/* adddsc reads and checksums .dsc files itself */
+		if (endswith(argv[i], ".dsc"))
+			continue;
+		/* files not found are reported when adding them */
+		r = findfile(argv[i], c, searchpath, ".", &fullfilenames[i]);
+		if (RET_WAS_ERROR(r))
+			break;
+		if (r == RET_NOTHING)
+			fullfilenames[i] = NULL;
+	}
+	if (!RET_WAS_ERROR(r)) {
+		prefetched = nNEW(argc, struct checksums *);
+		if (FAILEDTOALLOC(prefetched))
+			r = RET_ERROR_OOM;
+		else
+			r = readchecksums(argc,
+				(const char * const *)fullfilenames,
+				prefetched);
+	}
+	for (i = 0 ; i < argc ; i++)
+		free(fullfilenames[i]);
+	free(fullfilenames);
+	if (RET_WAS_ERROR(r)) {
+		free(prefetched);
+		return r;
+	}
+	*prefetched_p = prefetched;
+	return RET_OK;
+}
+
+static void prefetched_free(int count, /*@only@*//*@null@*/struct checksums **prefetched) {
+	int i;
+
+	if (prefetched == NULL)
+		return;
+	for (i = 0 ; i < count ; i++)
+		checksums_free(prefetched[i]);
+	free(prefetched);
+}
+
 static retvalue adddebs(const char *changesfilename, struct changes *c, int argc, char **argv, const struct strlist *searchpath, bool fakefields) {
+	struct checksums **prefetched;
+	retvalue r;
+	int i;
+
 	if (argc <= 0) {
 		fprintf(stderr,
 "Filenames of .deb files to include expected!\n");
 		return RET_ERROR;
 	}
-	while (argc > 0) {
-		retvalue r = adddeb(c, argv[0], searchpath);
-		if (RET_WAS_ERROR(r))
+	r = prefetchchecksums(c, argc, argv, searchpath, &prefetched);
+	if (RET_WAS_ERROR(r))
+		return r;
+	for (i = 0 ; i < argc ; i++) {
+		r = adddeb(c, argv[i], searchpath,
+				(prefetched == NULL)?NULL:&prefetched[i]);
+		if (RET_WAS_ERROR(r)) {
+			prefetched_free(argc, prefetched);
 			return r;
-		argc--; argv++;
+		}
 	}
+	prefetched_free(argc, prefetched);
 	if (c->modified) {
 		return write_changes_file(changesfilename, c,
 				CHANGES_WRITE_ALL, fakefields);
@@ -2672,7 +2857,7 @@ static retvalue adddebs(const char *changesfilename, struct changes *c, int argc
 		return RET_NOTHING;
 }
 
-static retvalue addrawfile(struct changes *c, const char *filename, const struct strlist *searchpath) {
+static retvalue addrawfile(struct changes *c, const char *filename, const struct strlist *searchpath, /*@null@*/struct checksums **prefetched_p) {
 	retvalue r;
 	struct fileentry *f;
 	char *fullfilename, *basefilename;
@@ -2690,11 +2875,16 @@ static retvalue addrawfile(struct changes *c, const char *filename, const struct
 		free(fullfilename);
 		return RET_ERROR_OOM;
 	}
-	r = checksums_read(fullfilename, &checksums);
-	if (RET_WAS_ERROR(r)) {
-		free(fullfilename);
-		free(basefilename);
-		return r;
+	if (prefetched_p != NULL && *prefetched_p != NULL) {
+		checksums = *prefetched_p;
+		*prefetched_p = NULL;
+	} else {
+		r = checksums_read(fullfilename, &checksums);
+		if (RET_WAS_ERROR(r)) {
+			free(fullfilename);
+			free(basefilename);
+			return r;
+		}
 	}
 	r = add_file(c, basefilename, fullfilename, ft_UNKNOWN, &f);
 	// fullfilename and basefilename now belong to *f or are already free'd
@@ -2743,17 +2933,27 @@ static retvalue addrawfile(struct changes *c, const char *filename, const struct
 }
 
 static retvalue addrawfiles(const char *changesfilename, struct changes *c, int argc, char **argv, const struct strlist *searchpath, bool fakefields) {
+	struct checksums **prefetched;
+	retvalue r;
+	int i;
+
 	if (argc <= 0) {
 		fprintf(stderr,
 "Filenames of files to add (without further parsing) expected!\n");
 		return RET_ERROR;
 	}
-	while (argc > 0) {
-		retvalue r = addrawfile(c, argv[0], searchpath);
-		if (RET_WAS_ERROR(r))
+	r = prefetchchecksums(c, argc, argv, searchpath, &prefetched);
+	if (RET_WAS_ERROR(r))
+		return r;
+	for (i = 0 ; i < argc ; i++) {
+		r = addrawfile(c, argv[i], searchpath,
+				(prefetched == NULL)?NULL:&prefetched[i]);
+		if (RET_WAS_ERROR(r)) {
+			prefetched_free(argc, prefetched);
 			return r;
-		argc--; argv++;
+		}
 	}
+	prefetched_free(argc, prefetched);
 	if (c->modified) {
 		return write_changes_file(changesfilename, c,
 				CHANGES_WRITE_FILES, fakefields);
@@ -2762,27 +2962,37 @@ static retvalue addrawfiles(const char *changesfilename, struct changes *c, int
 }
 
 static retvalue addfiles(const char *changesfilename, struct changes *c, int argc, char **argv, const struct strlist *searchpath, bool fakefields) {
+	struct checksums **prefetched;
+	retvalue r;
+	int i;
+
 	if (argc <= 0) {
 		fprintf(stderr, "Filenames of files to add expected!\n");
 		return RET_ERROR;
 	}
-	while (argc > 0) {
-		retvalue r;
-		const char *filename = argv[0];
+	r = prefetchchecksums(c, argc, argv, searchpath, &prefetched);
+	if (RET_WAS_ERROR(r))
+		return r;
+	for (i = 0 ; i < argc ; i++) {
+		const char *filename = argv[i];
 		size_t l = strlen(filename);
+		struct checksums **prefetched_p;
 
+		prefetched_p = (prefetched == NULL)?NULL:&prefetched[i];
 		if ((l > 4 && strcmp(filename+l-4, ".deb") == 0) ||
 			(l > 5 && strcmp(filename+l-5, ".ddeb") == 0) ||
 		    (l > 5 && strcmp(filename+l-5, ".udeb") == 0))
-			r = adddeb(c, filename, searchpath);
+			r = adddeb(c, filename, searchpath, prefetched_p);
 		else if ((l > 4 && strcmp(filename+l-4, ".dsc") == 0))
 			r = adddsc(c, filename, searchpath);
 		else
-			r = addrawfile(c, argv[0], searchpath);
-		if (RET_WAS_ERROR(r))
+			r = addrawfile(c, filename, searchpath, prefetched_p);
+		if (RET_WAS_ERROR(r)) {
+			prefetched_free(argc, prefetched);
 			return r;
-		argc--; argv++;
+		}
 	}
+	prefetched_free(argc, prefetched);
 	if (c->modified) {
 		return write_changes_file(changesfilename, c,
 				CHANGES_WRITE_ALL, fakefields);
@@ -2975,6 +3185,8 @@ int main(int argc, char *argv[]) {
 		{"unlzma", required_argument, &longoption, 3},
 		{"unxz", required_argument, &longoption, 4},
 		{"lunzip", required_argument, &longoption, 5},
+		{"unzstd", required_argument, &longoption, 7},
+		{"jobs", required_argument, &longoption, 8},
 		{NULL, 0, NULL, 0},
 	};
 	int c;
@@ -2985,7 +3197,7 @@ int main(int argc, char *argv[]) {
 	struct strlist searchpath;
 	struct changes *changesdata;
 	char *gunzip = NULL, *bunzip2 = NULL, *unlzma = NULL,
-	     *unxz = NULL, *lunzip = NULL;
+	     *unxz = NULL, *lunzip = NULL, *unzstd = NULL;
 	retvalue r;
 
 	strlist_init(&searchpath);
@@ -3013,6 +3225,22 @@ int main(int argc, char *argv[]) {
 						create_file = true;
 						all_fields = true;
 						break;
+					case 7:
+						unzstd = strdup(optarg);
+						break;
+					case 8: {
+						char *e;
+						long l = strtol(optarg, &e, 10);
+
+						if (*optarg == '\0' || *e != '\0'
+								|| l < 1 || l > 1024) {
+							fprintf(stderr,
+"Invalid argument to --jobs: '%s'!\n", optarg);
+							exit(EXIT_FAILURE);
+						}
+						jobs = l;
+						break;
+					}
 				}
 				break;
 			case 'h':
@@ -3035,7 +3263,7 @@ int main(int argc, char *argv[]) {
 		about(false);
 	}
 	signature_init(false);
-	uncompressions_check(gunzip, bunzip2, unlzma, unxz, lunzip);
+	uncompressions_check(gunzip, bunzip2, unlzma, unxz, lunzip, unzstd);
 
 	changesfilename = argv[optind];
 	if (strcmp(changesfilename, "-") != 0 &&
@@ -26,14 +26,21 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/stat.h>
 #include <poll.h>
 #include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 #ifdef HAVE_LIBBZ2
 #include <bzlib.h>
 #endif
 #ifdef HAVE_LIBLZMA
 #include <lzma.h>
 #endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 
 #include "globals.h"
 #include "error.h"
@@ -42,18 +49,18 @@
 #include "uncompression.h"
 
 const char * const uncompression_suffix[c_COUNT] = {
-	"", ".gz", ".bz2", ".lzma", ".xz", ".lz" };
+	"", ".gz", ".bz2", ".lzma", ".xz", ".lz", ".zst" };
 
 /* So help messages can hint what option to try */
 const char * const uncompression_option[c_COUNT] = {
-	NULL, NULL, "--bunzip2", "--unlzma", "--unxz", "--lunzip" };
+	NULL, NULL, "--bunzip2", "--unlzma", "--unxz", "--lunzip", "--unzstd" };
 /* how those are called in the config file */
 const char * const uncompression_config[c_COUNT] = {
-	".", ".gz", ".bz2", ".lzma", ".xz", ".lz" };
+	".", ".gz", ".bz2", ".lzma", ".xz", ".lz", ".zst" };
 
 
 /*@null@*/ char *extern_uncompressors[c_COUNT] = {
-	NULL, NULL, NULL, NULL, NULL};
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL};
 
 /*@null@*/ static struct uncompress_task {
 	struct uncompress_task *next;
@@ -348,12 +355,13 @@ static void search_binary(/*@null@*/const char *setting, const char *default_pro
 }
 
 /* check for existence of external programs */
-void uncompressions_check(const char *gunzip, const char *bunzip2, const char *unlzma, const char *unxz, const char *lunzip) {
+void uncompressions_check(const char *gunzip, const char *bunzip2, const char *unlzma, const char *unxz, const char *lunzip, const char *unzstd) {
 	search_binary(gunzip,  "gunzip",  &extern_uncompressors[c_gzip]);
 	search_binary(bunzip2, "bunzip2", &extern_uncompressors[c_bzip2]);
 	search_binary(unlzma,  "unlzma",  &extern_uncompressors[c_lzma]);
 	search_binary(unxz,    "unxz",    &extern_uncompressors[c_xz]);
 	search_binary(lunzip,  "lunzip",  &extern_uncompressors[c_lunzip]);
+	search_binary(unzstd,  "unzstd",  &extern_uncompressors[c_zstd]);
 }
 
 static inline retvalue builtin_uncompress(const char *compressed, const char *destination, enum compression compression) {
@@ -526,6 +534,8 @@ struct compressedfile {
 	enum compression compression;
 	bool external;
 	bool closefd;
+	/* the whole file was already uncompressed into memory */
+	bool inmemory;
 	int error;
 	pid_t pid;
 	int fd, infd, pipeinfd;
@@ -538,6 +548,11 @@ struct compressedfile {
 			int ofs;
 			int ready;
 		} intermediate;
+		/* used if inmemory is set: */
+		struct inmemory_buffer {
+			char *data;
+			size_t len, ofs;
+		} memory;
 		/* used if an internal decompression != c_none is used: */
 		struct uncompression {
 			unsigned char *buffer;
@@ -549,6 +564,15 @@ struct compressedfile {
 #endif
 #ifdef HAVE_LIBLZMA
 				lzma_stream lzma;
+#endif
+#ifdef HAVE_LIBZSTD
+				struct {
+					ZSTD_DStream *stream;
+					ZSTD_inBuffer in;
+					/* the last frame was completely
+					 * decoded and flushed */
+					bool frameended;
+				} zstd;
 #endif
 			};
 			enum uncompression_error {
@@ -726,6 +750,32 @@ static inline retvalue start_xz(struct compressedfile *f, int *errno_p, const ch
 }
 #endif
 
+#ifdef HAVE_LIBZSTD
+static inline retvalue start_zstd(struct compressedfile *f, int *errno_p, const char **msg_p) {
+	size_t ret;
+
+	memset(&f->uncompress.zstd, 0, sizeof(f->uncompress.zstd));
+	f->uncompress.zstd.stream = ZSTD_createDStream();
+	if (f->uncompress.zstd.stream == NULL) {
+		*errno_p = ENOMEM;
+		*msg_p = "Out of Memory";
+		return RET_ERROR_OOM;
+	}
+	ret = ZSTD_initDStream(f->uncompress.zstd.stream);
+	if (ZSTD_isError(ret)) {
+		(void)ZSTD_freeDStream(f->uncompress.zstd.stream);
+		f->uncompress.zstd.stream = NULL;
+		*errno_p = -EINVAL;
+		*msg_p = "libzstd not working";
+		return RET_ERROR;
+	}
+	f->uncompress.zstd.in.src = f->uncompress.buffer;
+	f->uncompress.zstd.in.size = f->uncompress.available;
+	f->uncompress.zstd.in.pos = 0;
+	return RET_OK;
+}
+#endif
+
 static retvalue start_builtin(struct compressedfile *f, int *errno_p, const char **msg_p) {
 	retvalue r;
 
@@ -758,6 +808,10 @@ static retvalue start_builtin(struct compressedfile *f, int *errno_p, const char
 			return start_lzma(f, errno_p, msg_p);
 		case c_xz:
 			return start_xz(f, errno_p, msg_p);
+#endif
+#ifdef HAVE_LIBZSTD
+		case c_zstd:
+			return start_zstd(f, errno_p, msg_p);
 #endif
 		default:
 			assert (false);
@@ -766,6 +820,120 @@ static retvalue start_builtin(struct compressedfile *f, int *errno_p, const char
 	/* not reached */
 }
 
+#ifdef HAVE_LIBDEFLATE
+/* larger files are uncompressed with zlib as stream instead */
+#define INMEMORY_MAXSIZE (32*1024*1024)
+
+/* read a not too large gzip file completely and uncompress it at once
+ * with libdeflate, which is much faster than zlib.
+ * Returns RET_NOTHING (with the file still open and at its start) if the
+ * file is too large or there is not enough memory for its uncompressed
+ * content, so it can be uncompressed as stream instead.
+ * Otherwise f->fd is closed, even in case of an error. */
+static retvalue gunzip_inmemory(struct compressedfile *f) {
+	struct libdeflate_decompressor *d;
+	struct stat s;
+	unsigned char *in;
+	char *out;
+	size_t inlen, done, ofs, size, inused, outgot;
+	enum libdeflate_result res;
+	ssize_t got;
+	int e;
+
+	if (fstat(f->fd, &s) != 0 || s.st_size < 18 ||
+			s.st_size > INMEMORY_MAXSIZE)
+		return RET_NOTHING;
+	inlen = s.st_size;
+	in = malloc(inlen);
+	if (FAILEDTOALLOC(in)) {
+		(void)close(f->fd);
+		return RET_ERROR_OOM;
+	}
+	done = 0;
+	while (done < inlen) {
+		got = read(f->fd, in + done, inlen - done);
+		if (got < 0 && errno == EINTR && !interrupted())
+			continue;
+		if (got <= 0) {
+			e = (got < 0)?errno:EIO;
+			fprintf(stderr, "Error %d reading '%s': %s\n",
+					e, f->filename, strerror(e));
+			(void)close(f->fd);
+			free(in);
+			return RET_ERRNO(e);
+		}
+		done += got;
+	}
+
+	/* the last 4 bytes are the uncompressed size of the last member
+	 * (modulo 2^32), which is a good guess for a start (but do not
+	 * believe it too much, the buffer can still grow later): */
+	size = in[inlen - 4] | (in[inlen - 3] << 8) |
+		(in[inlen - 2] << 16) | ((size_t)in[inlen - 1] << 24);
+	if (size < inlen)
+		size = 4 * inlen;
+	else if (size > 16 * inlen)
+		size = 16 * inlen;
+	d = libdeflate_alloc_decompressor();
+	if (FAILEDTOALLOC(d)) {
+		(void)close(f->fd);
+		free(in);
+		return RET_ERROR_OOM;
+	}
+	out = malloc(size);
+	/* there might be multiple concatenated gzip members: */
+	ofs = 0; done = 0;
+	res = LIBDEFLATE_INSUFFICIENT_SPACE;
+	while (out != NULL && ofs < inlen) {
+		res = libdeflate_gzip_decompress_ex(d, in + ofs, inlen - ofs,
+				out + done, size - done, &inused, &outgot);
+		if (res == LIBDEFLATE_INSUFFICIENT_SPACE) {
+			char *n;
+
+			size *= 2;
+			n = realloc(out, size);
+			if (n == NULL) {
+				free(out);
+				out = NULL;
+				break;
+			}
+			out = n;
+			continue;
+		}
+		if (res != LIBDEFLATE_SUCCESS)
+			break;
+		ofs += inused;
+		done += outgot;
+	}
+	libdeflate_free_decompressor(d);
+	free(in);
+	if (out == NULL) {
+		/* too large for memory, so read it again as stream: */
+		if (lseek(f->fd, 0, SEEK_SET) == 0)
+			return RET_NOTHING;
+		e = errno;
+		fprintf(stderr, "Error %d seeking in '%s': %s\n",
+				e, f->filename, strerror(e));
+		(void)close(f->fd);
+		return RET_ERRNO(e);
+	}
+	(void)close(f->fd);
+	f->fd = -1;
+	if (ofs < inlen) {
+		free(out);
+		fprintf(stderr,
+"Error uncompressing '%s': invalid gzip data (or trailing garbage)\n",
+				f->filename);
+		return RET_ERROR;
+	}
+	f->inmemory = true;
+	f->memory.data = out;
+	f->memory.len = done;
+	f->memory.ofs = 0;
+	return RET_OK;
+}
+#endif
+
 retvalue uncompress_open(/*@out@*/struct compressedfile **file_p, const char *filename, enum compression compression) {
 	struct compressedfile *f;
 	int fd, e;
@@ -800,6 +968,20 @@ retvalue uncompress_open(/*@out@*/struct compressedfile **file_p, const char *fi
 					e, filename, strerror(e));
 			return RET_ERRNO(e);
 		}
+#ifdef HAVE_LIBDEFLATE
+		if (f->compression == c_gzip) {
+			r = gunzip_inmemory(f);
+			if (RET_WAS_ERROR(r)) {
+				free(f->filename);
+				free(f);
+				return r;
+			}
+			if (RET_IS_OK(r)) {
+				*file_p = f;
+				return RET_OK;
+			}
+		}
+#endif
 		if (f->compression != c_none) {
 			r = start_builtin(f, &e, &msg);
 			if (RET_WAS_ERROR(r)) {
@@ -1368,6 +1550,63 @@ static inline int read_lzma(struct compressedfile *f, void *buffer, int size) {
 }
 #endif
 
+#ifdef HAVE_LIBZSTD
+static inline int read_zstd(struct compressedfile *f, void *buffer, int size) {
+	ZSTD_outBuffer out;
+	size_t ret;
+	retvalue r;
+	bool eoi;
+
+	assert (f->compression == c_zstd);
+	assert (size >= 0);
+
+	if (size == 0)
+		return 0;
+
+	out.dst = buffer;
+	out.size = size;
+	out.pos = 0;
+	do {
+		eoi = false;
+		if (f->uncompress.zstd.in.pos >= f->uncompress.zstd.in.size) {
+			f->uncompress.available = 0;
+			r = uncompression_read_internal_buffer(f);
+			if (RET_WAS_ERROR(r)) {
+				f->error = errno;
+				return -1;
+			}
+			f->uncompress.zstd.in.src = f->uncompress.buffer;
+			f->uncompress.zstd.in.size = f->uncompress.available;
+			f->uncompress.zstd.in.pos = 0;
+			eoi = f->uncompress.available == 0;
+		}
+		if (eoi && f->uncompress.zstd.frameended) {
+			f->uncompress.hadeos = true;
+			return out.pos;
+		}
+
+		ret = ZSTD_decompressStream(f->uncompress.zstd.stream,
+				&out, &f->uncompress.zstd.in);
+		if (ZSTD_isError(ret)) {
+			fprintf(stderr, "Error decompressing zstd data: %s\n",
+					ZSTD_getErrorName(ret));
+			f->uncompress.error = ue_UNCOMPRESSION_ERROR;
+			return -1;
+		}
+		/* 0 means a frame is finished, but there might be more */
+		f->uncompress.zstd.frameended = ret == 0;
+
+		if (eoi && out.pos == 0) {
+			/* no more data but the frame did not end */
+			f->uncompress.error = ue_WRONG_LENGTH;
+			return -1;
+		}
+		/* repeat if no output was produced: */
+	} while (out.pos == 0);
+	return out.pos;
+}
+#endif
+
 int uncompress_read(struct compressedfile *file, void *buffer, int size) {
 	ssize_t s;
 
@@ -1385,6 +1624,16 @@ int uncompress_read(struct compressedfile *file, void *buffer, int size) {
 
 	assert (!file->external);
 
+	if (file->inmemory) {
+		size_t left = file->memory.len - file->memory.ofs;
+
+		if ((size_t)size > left)
+			size = left;
+		memcpy(buffer, file->memory.data + file->memory.ofs, size);
+		file->memory.ofs += size;
+		return size;
+	}
+
 	if (file->error != 0 || file->uncompress.error != ue_NO_ERROR)
 		return -1;
 
@@ -1414,6 +1663,10 @@ int uncompress_read(struct compressedfile *file, void *buffer, int size) {
 		case c_xz:
 		case c_lzma:
 			return read_lzma(file, buffer, size);
+#endif
+#ifdef HAVE_LIBZSTD
+		case c_zstd:
+			return read_zstd(file, buffer, size);
 #endif
 		default:
 			assert (false);
@@ -1490,6 +1743,12 @@ static retvalue uncompress_commonclose(struct compressedfile *file, int *errno_p
 	}
 	assert (!file->external);
 
+	if (file->inmemory) {
+		free(file->memory.data);
+		file->memory.data = NULL;
+		return RET_OK;
+	}
+
 	if (file->error != 0) {
 		*errno_p = file->error;
 		*msg_p = strerror(file->error);
@@ -1547,6 +1806,14 @@ static retvalue uncompress_commonclose(struct compressedfile *file, int *errno_p
 			if (RET_WAS_ERROR(result))
 				return result;
 			return RET_OK;
+#endif
+#ifdef HAVE_LIBZSTD
+		case c_zstd:
+			(void)ZSTD_freeDStream(file->uncompress.zstd.stream);
+			file->uncompress.zstd.stream = NULL;
+			if (RET_WAS_ERROR(result))
+				return result;
+			return RET_OK;
 #endif
 		default:
 			assert (file->external);
@@ -1614,6 +1881,8 @@ retvalue uncompress_error(struct compressedfile *file) {
 		}
 	}
 	assert (!file->external);
+	if (file->inmemory)
+		return RET_OK;
 	if (file->uncompress.error != ue_NO_ERROR) {
 		if (file->uncompress.error == ue_TRAILING_GARBAGE)
 			fprintf(stderr,
@@ -1662,6 +1931,8 @@ void uncompress_abort(struct compressedfile *file) {
 					extern_uncompressors[file->compression],
 					(int)(WTERMSIG(status)));
 		}
+	} else if (file->inmemory) {
+		free(file->memory.data);
 	} else {
 		if (file->closefd && file->fd >= 0)
 			(void)close(file->fd);
@@ -1687,6 +1958,14 @@ void uncompress_abort(struct compressedfile *file) {
 				memset(&file->uncompress.lzma, 0,
 						sizeof(file->uncompress.lzma));
 				break;
+#endif
+#ifdef HAVE_LIBZSTD
+			case c_zstd:
+				(void)ZSTD_freeDStream(
+						file->uncompress.zstd.stream);
+				memset(&file->uncompress.zstd, 0,
+						sizeof(file->uncompress.zstd));
+				break;
 #endif
 			default:
 				assert (file->external);
@@ -0,0 +1,323 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "error.h"
+#include "filecntl.h"
+#include "workers.h"
+
+struct workers {
+	int maxrunning, running;
+	/* all started jobs whose done function was not yet called,
+	 * in the order they were started */
+	struct job {
+		struct job *next;
+		worker_done *done;
+		void *privdata;
+		pid_t child;
+		/* the read end of the pipe, -1 once everything is read */
+		int fd;
+		char *buffer;
+		size_t len, size;
+		retvalue result;
+	} *jobs, *lastjob;
+	retvalue result;
+};
+
+retvalue workers_init(struct workers **workers_p, int maxrunning) {
+	struct workers *w;
+
+	w = zNEW(struct workers);
+	if (FAILEDTOALLOC(w))
+		return RET_ERROR_OOM;
+	w->maxrunning = maxrunning;
+	w->result = RET_NOTHING;
+	*workers_p = w;
+	return RET_OK;
+}
+
+static void job_free(/*@only@*/struct job *j) {
+	if (j->fd >= 0)
+		(void)close(j->fd);
+	free(j->buffer);
+	free(j);
+}
+
+static NORETURN void child_run(int fd, worker_run *run, void *privdata) {
+	char *data = NULL;
+	size_t len = 0, done;
+	int r;
+	ssize_t written;
+
+	r = run(privdata, &data, &len);
+	if (data == NULL)
+		len = 0;
+	(void)fflush(stdout);
+	/* first the return value, then the data till end of file: */
+	written = write(fd, &r, sizeof(r));
+	if (written != (ssize_t)sizeof(r))
+		_exit(EXIT_FAILURE);
+	done = 0;
+	while (done < len) {
+		written = write(fd, data + done, len - done);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			_exit(EXIT_FAILURE);
+		}
+		done += written;
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+static retvalue job_read(struct job *j) {
+	ssize_t got;
+
+	if (j->size - j->len < 4096) {
+		char *n = realloc(j->buffer, j->size + 16384);
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		j->buffer = n;
+		j->size += 16384;
+	}
+	got = read(j->fd, j->buffer + j->len, j->size - j->len);
+	if (got < 0) {
+		int e = errno;
+		if (e == EINTR || e == EAGAIN)
+			return RET_NOTHING;
+		fprintf(stderr, "Error %d reading from worker process: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (got > 0) {
+		j->len += got;
+		return RET_NOTHING;
+	}
+	return RET_OK;
+}
+
+/* the child closed its end of the pipe, so collect its exit status */
+static void job_reap(struct workers *w, struct job *j, retvalue readresult) {
+	int status;
+	pid_t pid;
+
+	(void)close(j->fd);
+	j->fd = -1;
+	do {
+		pid = waitpid(j->child, &status, 0);
+	} while (pid < 0 && errno == EINTR);
+	j->child = 0;
+	w->running--;
+	if (pid < 0) {
+		int e = errno;
+		fprintf(stderr,
+"Error %d calling waitpid on worker process: %s\n",
+				e, strerror(e));
+		j->result = RET_ERRNO(e);
+	} else if (WIFSIGNALED(status)) {
+		fprintf(stderr, "Worker process killed by signal %d!\n",
+				(int)(WTERMSIG(status)));
+		j->result = RET_ERROR;
+	} else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0
+			|| j->len < sizeof(int)) {
+		fprintf(stderr, "Worker process failed!\n");
+		j->result = RET_ERROR;
+	} else if (RET_WAS_ERROR(readresult)) {
+		j->result = readresult;
+	} else {
+		int r;
+
+		memcpy(&r, j->buffer, sizeof(r));
+		j->result = r;
+	}
+}
+
+/* call the done function of all finished jobs that are next in order */
+static void workers_report(struct workers *w) {
+	struct job *j;
+	retvalue r;
+
+	while ((j = w->jobs) != NULL && j->child == 0) {
+		if (j->len <= sizeof(int))
+			r = j->done(j->privdata, j->result, NULL, 0);
+		else
+			r = j->done(j->privdata, j->result,
+					j->buffer + sizeof(int),
+					j->len - sizeof(int));
+		RET_UPDATE(w->result, r);
+		w->jobs = j->next;
+		if (w->jobs == NULL)
+			w->lastjob = NULL;
+		job_free(j);
+	}
+}
+
+/* wait till at least one running child is finished */
+static retvalue workers_wait(struct workers *w) {
+	struct pollfd *polldata;
+	struct job *j;
+	int count, i, ret;
+	int finished = 0;
+	retvalue r;
+
+	polldata = nNEW(w->running, struct pollfd);
+	if (FAILEDTOALLOC(polldata))
+		return RET_ERROR_OOM;
+	while (finished == 0) {
+		count = 0;
+		for (j = w->jobs ; j != NULL ; j = j->next) {
+			if (j->child == 0)
+				continue;
+			assert (count < w->running);
+			polldata[count].fd = j->fd;
+			polldata[count].events = POLLIN;
+			polldata[count].revents = 0;
+			count++;
+		}
+		assert (count > 0);
+		ret = poll(polldata, count, -1);
+		if (ret < 0) {
+			int e = errno;
+			if (e == EINTR)
+				continue;
+			fprintf(stderr, "Error %d waiting for workers: %s\n",
+					e, strerror(e));
+			free(polldata);
+			return RET_ERRNO(e);
+		}
+		i = 0;
+		for (j = w->jobs ; j != NULL ; j = j->next) {
+			if (j->child == 0)
+				continue;
+			assert (polldata[i].fd == j->fd);
+			if (polldata[i++].revents == 0)
+				continue;
+			r = job_read(j);
+			if (r == RET_NOTHING)
+				continue;
+			job_reap(w, j, r);
+			finished++;
+		}
+	}
+	free(polldata);
+	workers_report(w);
+	return RET_OK;
+}
+
+retvalue workers_start(struct workers *w, worker_run *run, worker_done *done, void *privdata) {
+	struct job *j;
+	int filedes[2];
+	retvalue r;
+	pid_t child;
+
+	if (w->maxrunning <= 1) {
+		char *data = NULL;
+		size_t len = 0;
+
+		r = run(privdata, &data, &len);
+		r = done(privdata, r, data, (data == NULL)?0:len);
+		free(data);
+		RET_UPDATE(w->result, r);
+		return RET_WAS_ERROR(r)?r:RET_OK;
+	}
+	while (w->running >= w->maxrunning) {
+		r = workers_wait(w);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	if (interrupted())
+		return RET_ERROR_INTERRUPTED;
+	j = zNEW(struct job);
+	if (FAILEDTOALLOC(j))
+		return RET_ERROR_OOM;
+	j->done = done;
+	j->privdata = privdata;
+	if (pipe(filedes) != 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d creating pipe: %s\n",
+				e, strerror(e));
+		free(j);
+		return RET_ERRNO(e);
+	}
+	/* do not let the child output things still buffered here */
+	(void)fflush(stdout);
+	(void)fflush(stderr);
+	child = fork();
+	if (child == 0) {
+		(void)close(filedes[0]);
+		child_run(filedes[1], run, privdata);
+	}
+	(void)close(filedes[1]);
+	if (child < 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d forking: %s\n", e, strerror(e));
+		(void)close(filedes[0]);
+		free(j);
+		return RET_ERRNO(e);
+	}
+	markcloseonexec(filedes[0]);
+	j->fd = filedes[0];
+	j->child = child;
+	w->running++;
+	if (w->lastjob == NULL)
+		w->jobs = j;
+	else
+		w->lastjob->next = j;
+	w->lastjob = j;
+	return RET_OK;
+}
+
+retvalue workers_finish(struct workers *w) {
+	retvalue result, r;
+
+	result = RET_NOTHING;
+	while (w->running > 0) {
+		r = workers_wait(w);
+		if (RET_WAS_ERROR(r)) {
+			/* cannot wait properly, so at least do not
+			 * leave zombies behind */
+			struct job *j;
+
+			for (j = w->jobs ; j != NULL ; j = j->next) {
+				if (j->child == 0)
+					continue;
+				(void)close(j->fd);
+				j->fd = -1;
+				(void)waitpid(j->child, NULL, 0);
+				j->child = 0;
+				j->result = r;
+			}
+			w->running = 0;
+			result = r;
+		}
+	}
+	workers_report(w);
+	assert (w->jobs == NULL);
+	RET_UPDATE(w->result, result);
+	result = w->result;
+	free(w);
+	return result;
+}
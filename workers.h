@@ -0,0 +1,31 @@
+#ifndef REPREPRO_WORKERS_H
+#define REPREPRO_WORKERS_H
+
+#ifndef REPREPRO_ERROR_H
+#include "error.h"
+#endif
+
+/* Run independent pieces of work in forked child processes.
+ *
+ * The run function is called in the child and may only do things not
+ * changing any state of the parent (no database access, no atoms interned),
+ * as all effects but the returned data are lost.
+ * The returned data (malloced or NULL, also possible with an error) is sent
+ * to the parent, where the done function is called with it and the return
+ * value, always in the order the jobs were started.
+ *
+ * With a maximum of 1 (or less) everything is run directly in the
+ * calling process instead. */
+
+typedef retvalue worker_run(void * /*privdata*/, /*@out@*/char ** /*data_p*/, /*@out@*/size_t * /*len_p*/);
+typedef retvalue worker_done(void * /*privdata*/, retvalue, /*@null@*/const char * /*data*/, size_t /*len*/);
+
+struct workers;
+
+retvalue workers_init(/*@out@*/struct workers **, int /*maxrunning*/);
+/* start a new job, waiting for old ones if there are already too many */
+retvalue workers_start(struct workers *, worker_run *, worker_done *, void * /*privdata*/);
+/* wait for all jobs, returns the combined return values of all done calls */
+retvalue workers_finish(/*@only@*/struct workers *);
+
+#endif